@@ -1,5 +1,7 @@
 #include "app_config.h"
 #include "lib/utils/log.h"
+#include "lib/media/buffer/fanout.h"
+#include "thread_sched.h"
 #include <getopt.h>
 #include <stddef.h>
 #include <string.h>
@@ -22,6 +24,26 @@ static int parse_size(const char *s, int *w, int *h)
     return 0;
 }
 
+/* "mp4=block,rtp=drop-new" */
+static int parse_fanout_policy(AppConfig *cfg, const char *s)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        FanoutPolicy p;
+        if (!eq) return -1;
+        *eq = '\0';
+        if (fanout_parse_policy(eq + 1, &p) != 0) return -1;
+        if (strcmp(tok, "mp4") == 0) cfg->fanout_mp4 = (int)p;
+        else if (strcmp(tok, "ts") == 0) cfg->fanout_ts = (int)p;
+        else if (strcmp(tok, "rtp") == 0) cfg->fanout_rtp = (int)p;
+        else return -1;
+    }
+    return 0;
+}
+
 int app_config_load_default(AppConfig *cfg)
 {
     if (!cfg) return -1;
@@ -42,7 +64,53 @@ int app_config_load_default(AppConfig *cfg)
     cfg->sink_type = "file";
     cfg->output_path_h264 = "output.h264";
     cfg->output_path_pcm = "output.pcm";
+    cfg->output_path_mp4 = NULL;
+    cfg->output_ts = NULL;
+    cfg->output_rtp = NULL;
+    cfg->rtp_mtu = 1400;
+    cfg->rtp_pace_kbps = 0;
+    cfg->rtp_sdp = NULL;
+    cfg->fanout_depth = 256;
+    cfg->fanout_mp4 = -1;
+    cfg->fanout_ts = -1;
+    cfg->fanout_rtp = -1;
+    cfg->spill_dir = NULL;
+    cfg->spill_mb = 64;
     cfg->duration_sec = 20;
+    cfg->segment_sec = 0;
+    cfg->segment_mb = 0;
+    cfg->h264_index = 1;
+    cfg->dvr_pre_sec = 0;
+    cfg->dvr_post_sec = 10;
+    cfg->dvr_ctl = NULL;
+    cfg->dvr_avsync_ms = 0;
+    cfg->shm_bus = NULL;
+    cfg->shm_bus_mb = 0;
+    cfg->frame_export = NULL;
+    cfg->frame_export_scale = 0;
+    cfg->frame_export_lease_ms = 500;
+
+    cfg->trace_path = NULL;
+    cfg->trace_records = 1u << 20;
+    cfg->chrome_trace_path = NULL;
+    cfg->sink_io = SINK_IO_STDIO;
+    cfg->aio_depth = 4;
+    cfg->aio_buf_kb = 1024;
+    cfg->aio_direct = 0;
+    cfg->chrome_trace_events = 1u << 16;
+
+    cfg->metrics_listen = NULL;
+
+    cfg->synthetic = 0;
+    cfg->synth_speed = 1.0;
+    cfg->enc_cost_ns_per_px = 2;
+    cfg->report_json = NULL;
+
+    cfg->sched_stats = 0;
+    cfg->thread_sched = NULL;
+    cfg->graph_path = NULL;
+    cfg->graph_workers = 2;
+    cfg->log_level = LOG_LEVEL_INFO;
 
     return 0;
 }
@@ -62,6 +130,76 @@ void app_config_print_summary(const AppConfig *cfg)
         cfg->output_path_h264 ? cfg->output_path_h264 : "(null)",
         cfg->output_path_pcm ? cfg->output_path_pcm : "(null)",
         cfg->duration_sec);
+    if (cfg->output_path_h264 && cfg->h264_index) {
+        LOGI("[CFG] index: %s.idx%s (offset/size/pts/keyframe per packet)", cfg->output_path_h264,
+             (cfg->segment_sec || cfg->segment_mb) ? ", one per segment" :
+             cfg->dvr_pre_sec ? ", one per DVR event" : "");
+    }
+    if (cfg->segment_sec || cfg->segment_mb) {
+        LOGI("[CFG] segment: every %us / %uMiB (keyframe aligned)", cfg->segment_sec, cfg->segment_mb);
+    }
+    if (cfg->dvr_pre_sec) {
+        char avs[32] = "";
+        if (cfg->dvr_avsync_ms > 0) snprintf(avs, sizeof(avs), " avsync>%.1fms", cfg->dvr_avsync_ms);
+        LOGI("[CFG] dvr: pre=%us post=%us triggers: SIGUSR1%s%s%s",
+             cfg->dvr_pre_sec, cfg->dvr_post_sec, cfg->dvr_ctl ? " ctl=" : "",
+             cfg->dvr_ctl ? cfg->dvr_ctl : "", avs);
+    }
+    if (cfg->shm_bus) {
+        char ring[16] = "auto";
+        if (cfg->shm_bus_mb) snprintf(ring, sizeof(ring), "%uMiB", cfg->shm_bus_mb);
+        LOGI("[CFG] shm-bus: socket=%s ring=%s (video + audio, read-only memfd)", cfg->shm_bus, ring);
+    }
+    if (cfg->frame_export) {
+        LOGI("[CFG] frame-export: socket=%s scale=1/%u lease=%ums", cfg->frame_export,
+             cfg->frame_export_scale ? cfg->frame_export_scale : 1, cfg->frame_export_lease_ms);
+    }
+    if (cfg->output_path_mp4) {
+        LOGI("[CFG] mp4: path=%s (fragment per GOP)", cfg->output_path_mp4);
+    }
+    if (cfg->output_ts) {
+        LOGI("[CFG] ts: target=%s (h264 + lpcm, pcr on audio)", cfg->output_ts);
+    }
+    if (cfg->output_rtp) {
+        char pace[24] = "off";
+        if (cfg->rtp_pace_kbps) snprintf(pace, sizeof(pace), "%ukbps", cfg->rtp_pace_kbps);
+        LOGI("[CFG] rtp: target=%s (h264 fu-a + L16 on port+2) mtu=%u pace=%s%s%s", cfg->output_rtp,
+             cfg->rtp_mtu, pace, cfg->rtp_sdp ? " sdp=" : "", cfg->rtp_sdp ? cfg->rtp_sdp : "");
+    }
+    if (cfg->output_path_mp4 || cfg->output_ts || cfg->output_rtp) {
+        LOGI("[CFG] fanout: depth=%u policy mp4=%s ts=%s rtp=%s", cfg->fanout_depth,
+             cfg->fanout_mp4 < 0 ? "auto" : fanout_policy_name((FanoutPolicy)cfg->fanout_mp4),
+             cfg->fanout_ts < 0 ? "auto" : fanout_policy_name((FanoutPolicy)cfg->fanout_ts),
+             cfg->fanout_rtp < 0 ? "auto" : fanout_policy_name((FanoutPolicy)cfg->fanout_rtp));
+    }
+    if (cfg->spill_dir) {
+        LOGI("[CFG] spill: dir=%s %uMiB per queue (h264, audio)", cfg->spill_dir, cfg->spill_mb);
+    }
+    if (cfg->sink_io != SINK_IO_STDIO) {
+        static const char *const io_names[] = { "stdio", "auto", "uring", "threads" };
+        LOGI("[CFG] sink-io: %s depth=%d buf=%uKiB direct=%d",
+             io_names[cfg->sink_io], cfg->aio_depth, cfg->aio_buf_kb, cfg->aio_direct);
+    }
+    if (cfg->trace_path) {
+        LOGI("[CFG] trace: path=%s records=%u", cfg->trace_path, cfg->trace_records);
+    }
+    if (cfg->chrome_trace_path) {
+        LOGI("[CFG] chrome-trace: path=%s events/thread=%u",
+             cfg->chrome_trace_path, cfg->chrome_trace_events);
+    }
+    if (cfg->metrics_listen) {
+        LOGI("[CFG] metrics: listen=%s", cfg->metrics_listen);
+    }
+    if (cfg->thread_sched) {
+        LOGI("[CFG] thread-sched: %s (applied values reported as [RT] after startup)", cfg->thread_sched);
+    }
+    LOGI("[CFG] graph: %s workers=%u (topology reported as [GRAPH])",
+         cfg->graph_path ? cfg->graph_path : "(built-in)", cfg->graph_workers);
+    if (cfg->synthetic) {
+        LOGI("[CFG] synthetic: speed=%.2f enc_cost=%uns/px report=%s",
+             cfg->synth_speed, cfg->enc_cost_ns_per_px,
+             cfg->report_json ? cfg->report_json : "(none)");
+    }
 }
 
 void app_config_print_usage(const char *prog) //当用户传 -h/--help 或者遇到未知参数时会用到
@@ -80,6 +218,50 @@ void app_config_print_usage(const char *prog) //当用户传 -h/--help 或者遇
         "  --sec <n>                Record duration seconds (default: 10)\n"
         "  --out-h264 <file>        Output H.264 file (default: out.h264)\n"
         "  --out-pcm <file>         Output PCM file (default: out.pcm)\n"
+        "  --out-mp4 <file>         Also mux H.264 + PCM into fragmented MP4 (replaces raw outputs unless given)\n"
+        "  --out-ts <target>        Also mux into MPEG-TS: file, FIFO or udp://127.0.0.1:<port> (same rule)\n"
+        "  --out-rtp <udp://ip:port> Also stream RTP: H.264 (RFC 6184) on port, L16 audio on port+2\n"
+        "  --rtp-mtu <bytes>        RTP packet size limit incl. header (default: 1400)\n"
+        "  --rtp-pace-kbps <n>      Pace video packets with a token bucket at n kbps (default: off)\n"
+        "  --rtp-sdp <file>         Write an SDP description for players (ffplay -protocol_whitelist file,udp,rtp)\n"
+        "  --fanout-depth <n>       Per-sink queue length for mp4/ts/rtp, packets + audio chunks (default: 256)\n"
+        "  --fanout-policy <list>   Overflow policy per sink, e.g. mp4=block,ts=drop-old,rtp=drop-new\n"
+        "                           (block | drop-new | drop-old; default: block for files, drop-new for udp)\n"
+        "  --spill-dir <dir>        When the h264/audio queues fill up, spill to a scratch file in dir\n"
+        "                           (tmpfs or a different device than the recording) instead of blocking\n"
+        "  --spill-mb <n>           Scratch file size per queue, reserved at startup (default: 64)\n"
+        "  --segment-sec <n>        Rotate h264/pcm to a new segment every n seconds (at a keyframe)\n"
+        "  --segment-mb <n>         Rotate when a segment pair reaches n MiB\n"
+        "  --no-index               Don't write the <out-h264>.idx packet index (see tools/h264_trim)\n"
+        "  --dvr <sec>              DVR mode: keep the last n seconds in memory, write only on trigger\n"
+        "  --dvr-post <sec>         Seconds to keep recording after a trigger (default: 10)\n"
+        "  --dvr-ctl <path>         Unix datagram socket; send \"trigger\" to save an event (SIGUSR1 also works)\n"
+        "  --dvr-avsync-ms <ms>     Also trigger when |A/V offset| exceeds ms\n"
+        "  --shm-bus <path>         Publish packets/PCM into a memfd ring; readers connect to this unix socket\n"
+        "  --shm-bus-mb <n>         Shared ring data size in MiB (default: 4 s at the bitrate, min 4)\n"
+        "  --frame-export <path>    Hand raw NV12 capture buffers to local readers (unix seqpacket, fd passing)\n"
+        "  --frame-export-scale <n> Also provide a 1/n downscaled variant, n = 2|4|8\n"
+        "  --frame-export-lease-ms <ms> Reclaim frames a reader hasn't released after ms (default: 500)\n"
+        "  --sink-io <mode>         stdio|auto|uring|threads: per-packet fwrite, or coalesced async writes (default: stdio)\n"
+        "  --aio-depth <n>          Async sink buffers in flight (default: 4)\n"
+        "  --aio-buf-kb <n>         Async sink buffer size in KiB (default: 1024)\n"
+        "  --aio-direct             Open sink files with O_DIRECT\n"
+        "  --trace <file>           Record binary event trace (mmap ring file)\n"
+        "  --trace-records <n>      Trace ring size in records, 32 B each (default: 1048576)\n"
+        "  --chrome-trace <file>    Record per-thread spans, write Chrome trace JSON at exit\n"
+        "  --chrome-trace-events <n> Span ring size per thread, 16 B each (default: 65536)\n"
+        "  --metrics-listen <addr>  Serve OpenMetrics on <port>|<ip:port>|unix:<path> at /metrics\n"
+        "  --synthetic              Headless run: synthetic sources + cost-model encoder (no V4L2/ALSA/MPP)\n"
+        "  --speed <x>              Synthetic pacing, 1 = real time, 0 = unthrottled (default: 1)\n"
+        "  --enc-cost <ns>          Cost-model encoder CPU time per pixel in ns (default: 2)\n"
+        "  --report-json <file>     Write end-of-run report as JSON ('-' = stdout; default '-' with --synthetic)\n"
+        "  --sched-stats            Also report per-thread run-queue wait (schedstat)\n"
+        "  --thread-sched <spec>    Per-thread CPU affinity / RT priority / nice: a preset (rt, pin) and/or\n"
+        "                           rules like acap=cpu3:fifo60,h264sink=cpu0-2:nice5 (see README)\n"
+        "  --graph <file>           Build the pipeline from a stage graph description (default: built-in;\n"
+        "                           stages, edges with cap/policy/spill, thread or pool placement; see README)\n"
+        "  --graph-workers <n>      Worker threads shared by the graph's pool stages (default: 2)\n"
+        "  --log-level <lvl>        debug|info|warn|error (default: info)\n"
         "  -h, --help               Show this help\n\n"
         "Examples:\n"
         "  %s --video-dev /dev/video0 --size 1920x1080 --fps 30 --bitrate 4000000 --sec 10\n"
@@ -102,6 +284,46 @@ int app_config_parse_args(AppConfig *cfg,int argc,char **argv)
         OPT_SEC,
         OPT_OUT_H264,
         OPT_OUT_PCM,
+        OPT_OUT_MP4,
+        OPT_OUT_TS,
+        OPT_OUT_RTP,
+        OPT_RTP_MTU,
+        OPT_RTP_PACE_KBPS,
+        OPT_RTP_SDP,
+        OPT_FANOUT_DEPTH,
+        OPT_FANOUT_POLICY,
+        OPT_SPILL_DIR,
+        OPT_SPILL_MB,
+        OPT_SEGMENT_SEC,
+        OPT_SEGMENT_MB,
+        OPT_NO_INDEX,
+        OPT_DVR,
+        OPT_DVR_POST,
+        OPT_DVR_CTL,
+        OPT_DVR_AVSYNC_MS,
+        OPT_SHM_BUS,
+        OPT_SHM_BUS_MB,
+        OPT_FRAME_EXPORT,
+        OPT_FRAME_EXPORT_SCALE,
+        OPT_FRAME_EXPORT_LEASE_MS,
+        OPT_SINK_IO,
+        OPT_AIO_DEPTH,
+        OPT_AIO_BUF_KB,
+        OPT_AIO_DIRECT,
+        OPT_TRACE,
+        OPT_TRACE_RECORDS,
+        OPT_CHROME_TRACE,
+        OPT_CHROME_TRACE_EVENTS,
+        OPT_METRICS_LISTEN,
+        OPT_LOG_LEVEL,
+        OPT_SCHED_STATS,
+        OPT_THREAD_SCHED,
+        OPT_GRAPH,
+        OPT_GRAPH_WORKERS,
+        OPT_SYNTHETIC,
+        OPT_SPEED,
+        OPT_ENC_COST,
+        OPT_REPORT_JSON,
     };
 
     static const struct option long_opts[] = {
@@ -115,11 +337,53 @@ int app_config_parse_args(AppConfig *cfg,int argc,char **argv)
     {"sec",       required_argument, 0, OPT_SEC},
     {"out-h264",  required_argument, 0, OPT_OUT_H264},
     {"out-pcm",   required_argument, 0, OPT_OUT_PCM},
+    {"out-mp4",   required_argument, 0, OPT_OUT_MP4},
+    {"out-ts",    required_argument, 0, OPT_OUT_TS},
+    {"out-rtp",   required_argument, 0, OPT_OUT_RTP},
+    {"rtp-mtu",   required_argument, 0, OPT_RTP_MTU},
+    {"rtp-pace-kbps", required_argument, 0, OPT_RTP_PACE_KBPS},
+    {"rtp-sdp",   required_argument, 0, OPT_RTP_SDP},
+    {"fanout-depth", required_argument, 0, OPT_FANOUT_DEPTH},
+    {"fanout-policy", required_argument, 0, OPT_FANOUT_POLICY},
+    {"spill-dir", required_argument, 0, OPT_SPILL_DIR},
+    {"spill-mb", required_argument, 0, OPT_SPILL_MB},
+    {"segment-sec", required_argument, 0, OPT_SEGMENT_SEC},
+    {"segment-mb", required_argument, 0, OPT_SEGMENT_MB},
+    {"no-index",  no_argument,       0, OPT_NO_INDEX},
+    {"dvr",       required_argument, 0, OPT_DVR},
+    {"dvr-post",  required_argument, 0, OPT_DVR_POST},
+    {"dvr-ctl",   required_argument, 0, OPT_DVR_CTL},
+    {"dvr-avsync-ms", required_argument, 0, OPT_DVR_AVSYNC_MS},
+    {"shm-bus",   required_argument, 0, OPT_SHM_BUS},
+    {"shm-bus-mb", required_argument, 0, OPT_SHM_BUS_MB},
+    {"frame-export", required_argument, 0, OPT_FRAME_EXPORT},
+    {"frame-export-scale", required_argument, 0, OPT_FRAME_EXPORT_SCALE},
+    {"frame-export-lease-ms", required_argument, 0, OPT_FRAME_EXPORT_LEASE_MS},
+    {"sink-io",   required_argument, 0, OPT_SINK_IO},
+    {"aio-depth", required_argument, 0, OPT_AIO_DEPTH},
+    {"aio-buf-kb", required_argument, 0, OPT_AIO_BUF_KB},
+    {"aio-direct", no_argument,      0, OPT_AIO_DIRECT},
+    {"trace",     required_argument, 0, OPT_TRACE},
+    {"trace-records", required_argument, 0, OPT_TRACE_RECORDS},
+    {"chrome-trace", required_argument, 0, OPT_CHROME_TRACE},
+    {"chrome-trace-events", required_argument, 0, OPT_CHROME_TRACE_EVENTS},
+    {"metrics-listen", required_argument, 0, OPT_METRICS_LISTEN},
+    {"log-level", required_argument, 0, OPT_LOG_LEVEL},
+    {"sched-stats", no_argument,     0, OPT_SCHED_STATS},
+    {"thread-sched", required_argument, 0, OPT_THREAD_SCHED},
+    {"graph",     required_argument, 0, OPT_GRAPH},
+    {"graph-workers", required_argument, 0, OPT_GRAPH_WORKERS},
+    {"synthetic", no_argument,       0, OPT_SYNTHETIC},
+    {"speed",     required_argument, 0, OPT_SPEED},
+    {"enc-cost",  required_argument, 0, OPT_ENC_COST},
+    {"report-json", required_argument, 0, OPT_REPORT_JSON},
     {"help",      no_argument,       0, 'h'},
     {0,0,0,0}
     };
 
     int c;
+    int raw_h264_set = 0;
+    int raw_pcm_set = 0;
 
     while((c = getopt_long(argc, argv,"h",long_opts,NULL)) != -1){
         switch (c){
@@ -136,8 +400,68 @@ int app_config_parse_args(AppConfig *cfg,int argc,char **argv)
             case OPT_SR:        cfg->sample_rate = (unsigned)atoi(optarg); break;
             case OPT_CH:        cfg->channels = (unsigned)atoi(optarg); break;
             case OPT_SEC:       cfg->duration_sec = (unsigned int)atoi(optarg); break;
-            case OPT_OUT_H264:  cfg->output_path_h264 = optarg; break;
-            case OPT_OUT_PCM:   cfg->output_path_pcm = optarg; break;
+            case OPT_OUT_H264:  cfg->output_path_h264 = optarg; raw_h264_set = 1; break;
+            case OPT_OUT_PCM:   cfg->output_path_pcm = optarg; raw_pcm_set = 1; break;
+            case OPT_OUT_MP4:   cfg->output_path_mp4 = optarg; break;
+            case OPT_OUT_TS:    cfg->output_ts = optarg; break;
+            case OPT_OUT_RTP:   cfg->output_rtp = optarg; break;
+            case OPT_RTP_MTU:   cfg->rtp_mtu = (unsigned)atoi(optarg); break;
+            case OPT_RTP_PACE_KBPS: cfg->rtp_pace_kbps = (unsigned)atoi(optarg); break;
+            case OPT_RTP_SDP:   cfg->rtp_sdp = optarg; break;
+            case OPT_FANOUT_DEPTH: cfg->fanout_depth = (unsigned)atoi(optarg); break;
+            case OPT_FANOUT_POLICY:
+                if (parse_fanout_policy(cfg, optarg) != 0) {
+                    LOGE("[CFG] invalid fanout policy: %s (want <mp4|ts|rtp>=<block|drop-new|drop-old>,...)", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_SPILL_DIR: cfg->spill_dir = optarg; break;
+            case OPT_SPILL_MB:  cfg->spill_mb = (unsigned)atoi(optarg); break;
+            case OPT_SEGMENT_SEC: cfg->segment_sec = (unsigned)atoi(optarg); break;
+            case OPT_SEGMENT_MB: cfg->segment_mb = (unsigned)atoi(optarg); break;
+            case OPT_NO_INDEX:  cfg->h264_index = 0; break;
+            case OPT_DVR:       cfg->dvr_pre_sec = (unsigned)atoi(optarg); break;
+            case OPT_DVR_POST:  cfg->dvr_post_sec = (unsigned)atoi(optarg); break;
+            case OPT_DVR_CTL:   cfg->dvr_ctl = optarg; break;
+            case OPT_DVR_AVSYNC_MS: cfg->dvr_avsync_ms = atof(optarg); break;
+            case OPT_SHM_BUS:   cfg->shm_bus = optarg; break;
+            case OPT_SHM_BUS_MB: cfg->shm_bus_mb = (unsigned)atoi(optarg); break;
+            case OPT_FRAME_EXPORT: cfg->frame_export = optarg; break;
+            case OPT_FRAME_EXPORT_SCALE: cfg->frame_export_scale = (unsigned)atoi(optarg); break;
+            case OPT_FRAME_EXPORT_LEASE_MS: cfg->frame_export_lease_ms = (unsigned)atoi(optarg); break;
+            case OPT_SINK_IO:
+                if (strcmp(optarg, "stdio") == 0) cfg->sink_io = SINK_IO_STDIO;
+                else if (strcmp(optarg, "auto") == 0) cfg->sink_io = SINK_IO_AUTO;
+                else if (strcmp(optarg, "uring") == 0) cfg->sink_io = SINK_IO_URING;
+                else if (strcmp(optarg, "threads") == 0) cfg->sink_io = SINK_IO_THREADS;
+                else {
+                    LOGE("[CFG] invalid sink io: %s", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_AIO_DEPTH: cfg->aio_depth = atoi(optarg); break;
+            case OPT_AIO_BUF_KB: cfg->aio_buf_kb = (unsigned)atoi(optarg); break;
+            case OPT_AIO_DIRECT: cfg->aio_direct = 1; break;
+            case OPT_TRACE:     cfg->trace_path = optarg; break;
+            case OPT_TRACE_RECORDS: cfg->trace_records = (unsigned)atoi(optarg); break;
+            case OPT_CHROME_TRACE: cfg->chrome_trace_path = optarg; break;
+            case OPT_CHROME_TRACE_EVENTS: cfg->chrome_trace_events = (unsigned)atoi(optarg); break;
+            case OPT_METRICS_LISTEN: cfg->metrics_listen = optarg; break;
+            case OPT_SCHED_STATS: cfg->sched_stats = 1; break;
+            case OPT_THREAD_SCHED: cfg->thread_sched = optarg; break;
+            case OPT_GRAPH:     cfg->graph_path = optarg; break;
+            case OPT_GRAPH_WORKERS: cfg->graph_workers = (unsigned)atoi(optarg); break;
+            case OPT_SYNTHETIC: cfg->synthetic = 1; break;
+            case OPT_SPEED:     cfg->synth_speed = atof(optarg); break;
+            case OPT_ENC_COST:  cfg->enc_cost_ns_per_px = (unsigned)atoi(optarg); break;
+            case OPT_REPORT_JSON: cfg->report_json = optarg; break;
+            case OPT_LOG_LEVEL:
+                cfg->log_level = log_parse_level(optarg);
+                if (cfg->log_level < 0) {
+                    LOGE("[CFG] invalid log level: %s", optarg);
+                    return -1;
+                }
+                break;
             case 'h':
             default:
             app_config_print_usage(argv[0]);
@@ -153,6 +477,84 @@ int app_config_parse_args(AppConfig *cfg,int argc,char **argv)
     if (cfg->bitrate <= 0) cfg->bitrate = 2000000;
     if (cfg->sample_rate == 0) cfg->sample_rate = 48000;
     if (cfg->channels == 0) cfg->channels = 2;
+    if (cfg->output_path_mp4 || cfg->output_ts) {
+        // 只要封装输出时不再顺带写默认的裸流文件
+        if (!raw_h264_set) cfg->output_path_h264 = NULL;
+        if (!raw_pcm_set) cfg->output_path_pcm = NULL;
+    }
+    if (cfg->segment_sec || cfg->segment_mb) {
+        if (!cfg->output_path_h264 || !cfg->output_path_pcm) {
+            LOGE("[CFG] segmenting needs both --out-h264 and --out-pcm");
+            return -1;
+        }
+        if (cfg->sink_io != SINK_IO_STDIO) {
+            LOGE("[CFG] segmenting only supports --sink-io stdio");
+            return -1;
+        }
+    }
+    if (cfg->dvr_pre_sec) {
+        if (!cfg->output_path_h264 || !cfg->output_path_pcm) {
+            LOGE("[CFG] --dvr needs both --out-h264 and --out-pcm (event files are named after them)");
+            return -1;
+        }
+        if (cfg->segment_sec || cfg->segment_mb || cfg->sink_io != SINK_IO_STDIO) {
+            LOGE("[CFG] --dvr replaces the raw file sinks; --segment-* / --sink-io don't apply");
+            return -1;
+        }
+    } else if (cfg->dvr_ctl || cfg->dvr_avsync_ms > 0) {
+        LOGE("[CFG] --dvr-ctl / --dvr-avsync-ms need --dvr");
+        return -1;
+    }
+    if (cfg->output_rtp) {
+        if (strncmp(cfg->output_rtp, "udp://", 6) != 0) {
+            LOGE("[CFG] --out-rtp must be udp://ip:port");
+            return -1;
+        }
+        if (cfg->rtp_mtu < 256 || cfg->rtp_mtu > 9000) {
+            LOGE("[CFG] --rtp-mtu must be 256..9000");
+            return -1;
+        }
+        if (cfg->rtp_pace_kbps && (uint64_t)cfg->rtp_pace_kbps * 1000 < (uint64_t)cfg->bitrate * 3 / 2) {
+            LOGW("[CFG] --rtp-pace-kbps %u is close to the %d bps bitrate; the rtp fanout queue will back up on pacing",
+                 cfg->rtp_pace_kbps, cfg->bitrate);
+        }
+    } else if (cfg->rtp_pace_kbps || cfg->rtp_sdp) {
+        LOGE("[CFG] --rtp-pace-kbps / --rtp-sdp need --out-rtp");
+        return -1;
+    }
+    if (cfg->fanout_depth < 8) cfg->fanout_depth = 8;
+    if (cfg->spill_dir && (cfg->spill_mb < 1 || cfg->spill_mb > 4096)) {
+        LOGE("[CFG] --spill-mb must be 1..4096");
+        return -1;
+    }
+    if (cfg->shm_bus_mb && !cfg->shm_bus) {
+        LOGE("[CFG] --shm-bus-mb needs --shm-bus");
+        return -1;
+    }
+    if (cfg->frame_export_scale != 0 && cfg->frame_export_scale != 2 &&
+        cfg->frame_export_scale != 4 && cfg->frame_export_scale != 8) {
+        LOGE("[CFG] --frame-export-scale must be 2, 4 or 8");
+        return -1;
+    }
+    if (cfg->frame_export_lease_ms == 0) cfg->frame_export_lease_ms = 500;
+    if (cfg->aio_depth < 2) cfg->aio_depth = 2;
+    if (cfg->aio_buf_kb < 4) cfg->aio_buf_kb = 4;
+    if (cfg->chrome_trace_events == 0) cfg->chrome_trace_events = 1u << 16;
+    if (cfg->synth_speed < 0) cfg->synth_speed = 0;
+    if (cfg->synthetic && !cfg->report_json) cfg->report_json = "-";
+    if (cfg->synthetic && cfg->synth_speed == 0 && cfg->duration_sec == 0) {
+        LOGE("[CFG] --speed 0 needs a finite --sec");
+        return -1;
+    }
+    if (cfg->graph_workers < 1 || cfg->graph_workers > 8) {
+        LOGE("[CFG] --graph-workers must be 1..8");
+        return -1;
+    }
+    if (cfg->thread_sched && thread_sched_configure(cfg->thread_sched) != 0) {
+        LOGE("[CFG] invalid --thread-sched: %s (want rt|pin and/or <thread>=cpu<list>:fifo<N>|rr<N>|other:nice<N>,...)",
+             cfg->thread_sched);
+        return -1;
+    }
 
     return 0;
 }
\ No newline at end of file
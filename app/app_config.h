@@ -25,10 +25,69 @@ typedef struct{
     const char *sink_type;
     const char *output_path_h264;
     const char *output_path_pcm;
+    const char *output_path_mp4;   // NULL = 不封装；设置且没显式给 --out-h264/--out-pcm 时只写 mp4
+    const char *output_ts;         // NULL = 不出 TS；文件 / FIFO 路径或 udp://ip:port，规则同 mp4
+    const char *output_rtp;        // NULL = 不出 RTP；udp://ip:port（视频 port，音频 port + 2）
+    unsigned int rtp_mtu;          // RTP 包（含 12 字节头）上限
+    unsigned int rtp_pace_kbps;    // 0 = 不限速；视频按这个速率令牌桶发
+    const char *rtp_sdp;           // NULL = 不写；给 ffplay / VLC 用的 SDP 文件
+    unsigned int fanout_depth;     // mp4 / ts / rtp 各自扇出队列的条数（视频包 + 音频块）
+    int fanout_mp4;                // FanoutPolicy；-1 = 默认（mp4 block，ts 文件 block / udp drop-new，rtp drop-new）
+    int fanout_ts;
+    int fanout_rtp;
+    const char *spill_dir;         // NULL = 不溢写；h264 / audio 队列满了溢写到这个目录下的匿名暂存文件
+    unsigned int spill_mb;         // 每个队列的暂存文件大小（启动时一次占满）
     unsigned int duration_sec;
+    unsigned int segment_sec;      // 0 = 不按时长分段
+    unsigned int segment_mb;       // 0 = 不按大小分段（h264 + pcm 合计）
+    int h264_index;                // 1 = 裸 h264 旁边写 <file>.idx 包索引（默认开）
+    unsigned int dvr_pre_sec;      // > 0 = DVR 模式：只在内存里留最近 n 秒，触发才落盘
+    unsigned int dvr_post_sec;     // 触发后再录的秒数
+    const char *dvr_ctl;           // NULL = 无控制 socket；unix 数据报路径，收 "trigger"
+    double dvr_avsync_ms;          // > 0 = |av_offset p50| 超过它就触发
+    const char *shm_bus;           // NULL = 不开；unix 流 socket 路径，读者连上拿 memfd
+    unsigned int shm_bus_mb;       // 共享内存数据环大小（MiB），0 = 按码率留 4 秒
+    const char *frame_export;      // NULL = 不导出原始帧；unix seqpacket 路径，读者连上拿帧池 fd
+    unsigned int frame_export_scale;    // 0 = 只有原图；2/4/8 = 另出一份缩小变体
+    unsigned int frame_export_lease_ms; // 借出的帧超过它不还就强制收回
+    int sink_io;                   // SINK_IO_*：stdio = 每包 fwrite；其余走 aio_writer
+    int aio_depth;                 // 缓冲个数（在飞上限）
+    unsigned int aio_buf_kb;       // 每块大小（KiB）
+    int aio_direct;                // 1 = O_DIRECT
+
+    /*Trace*/
+    const char *trace_path;        // NULL = 不记录二进制事件
+    unsigned int trace_records;    // ring 条数（32 B/条）
+    const char *chrome_trace_path; // NULL = 不记录线程时间线 span
+    unsigned int chrome_trace_events; // 每线程 span ring 条数（16 B/条）
+
+    /*Metrics*/
+    const char *metrics_listen;    // NULL = 不开 /metrics；"9100" / "ip:port" / "unix:/path"
+
+    /*Synthetic（无头压测：合成源 + 代价模型编码器，主机可跑）*/
+    int synthetic;
+    double synth_speed;            // 1.0 = 实时；0 = 不限速
+    unsigned int enc_cost_ns_per_px;
+    const char *report_json;       // 结束时写运行报告 JSON（"-" = stdout）；synthetic 默认 "-"
+
+    /*Profiling*/
+    int sched_stats;               // 1 = 每秒额外读取 schedstat（run-queue 等待）
+    const char *thread_sched;      // NULL = 默认属性；预设（rt / pin）和 / 或 名字=cpu..:fifo..:nice.. 规则，见 thread_sched.h
+    const char *graph_path;        // NULL = 内置默认图；阶段图描述文件，语法见 stage_graph.h
+    unsigned int graph_workers;    // 标 pool 的阶段共用的 worker 线程数
+
+    /*Log*/
+    int log_level;                 // LOG_LEVEL_*（运行期过滤）
 
 } AppConfig;
 
+enum {
+    SINK_IO_STDIO = 0,
+    SINK_IO_AUTO,                  // io_uring，不可用时退到 pwrite 线程池
+    SINK_IO_URING,
+    SINK_IO_THREADS,
+};
+
 int app_config_load_default(AppConfig *cfg);
 
 void app_config_print_usage(const char *prog);
@@ -1,44 +1,119 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <signal.h>
 #include <pthread.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "lib/utils/log.h"
 #include "app_config.h"
 #include "av_stats.h"
+#include "evtrace.h"
+#include "span_trace.h"
+#include "lat_hist.h"
+#include "thread_stats.h"
+#include "thread_sched.h"
+#include "ctl_loop.h"
+#include "run_report.h"
 #include "lib/media/video/v4l2_capture.h"
+#include "frame_pool.h"
 #include "encoder_mpp.h"
 #include "sink.h"
+#include "aio_writer.h"
+#include "segment_writer.h"
+#include "pkt_index.h"
+#include "dvr_ring.h"
+#include "plugins/metrics_http/metrics_http.h"
+#include "plugins/shm_bus/shm_bus.h"
+#include "plugins/frame_export/frame_export.h"
 #include "audio_capture.h"
+#include "lib/media/synth/synth.h"
+#include "lib/media/mux/fmp4_mux.h"
+#include "lib/media/mux/ts_mux.h"
+#include "plugins/rtp_sink/rtp_sink.h"
+#include "lib/media/buffer/fanout.h"
+#include "lib/media/buffer/spill_queue.h"
+#include "lib/media/graph/stage_graph.h"
 
-#include "rkav/bqueue.h"
 #include "rkav/types.h"
 #include "rkav/time.h"
 #include <lib/media/sync/avsync.h>
 
+// thread_stats_spawn 起的线程：ctl + 图阶段 + pool worker + 扇出 sink，都要进统计表
+_Static_assert(THREAD_STATS_MAX >= 1 + SG_MAX_STAGES + SG_MAX_WORKERS + FANOUT_MAX_SINKS,
+               "THREAD_STATS_MAX too small for the graph + fanout thread budget");
+
 
 // ============ Global ============
 static atomic_int g_stop = 0;
 static AvStats g_stats;
 static AvSync g_avsync;
+static EvTrace g_trace;   // 未开启 --trace 时 recs=NULL，emit 为空操作
 
-static BQueue g_raw_vq;  // VideoFrame*
-static BQueue g_h264_q;  // EncodedPacket*
-static BQueue g_aud_q;   // AudioChunk*
+static SgGraph g_graph;   // 采集 -> 编码 -> sink 的阶段和队列（--graph，默认见 g_default_graph）
 
 static atomic_uint_fast64_t g_video_pts_delta_us;
 static atomic_uint_fast64_t g_audio_pts_delta_us;
 
+// 逐帧阶段延迟：全部在 sink 写完后按帧上携带的时间戳统一记录
+enum {
+    LAT_V_COPY,   // DQBUF -> 进 raw 队列（alloc + memcpy）
+    LAT_V_RAWQ,   // raw 队列等待 -> 编码开始
+    LAT_V_ENC,    // 编码耗时
+    LAT_V_PUSH,   // 编码结束 -> 进 h264 队列
+    LAT_V_H264Q,  // h264 队列等待 -> sink pop
+    LAT_V_WRITE,  // sink pop -> fwrite 完成
+    LAT_V_E2E,    // DQBUF -> fwrite 完成
+    LAT_A_PUSH,   // snd_pcm_readi 返回 -> 进 audio 队列
+    LAT_A_Q,      // audio 队列等待 -> sink pop
+    LAT_A_WRITE,  // sink pop -> fwrite 完成
+    LAT_A_E2E,    // snd_pcm_readi 返回 -> fwrite 完成
+    LAT_COUNT
+};
+static LatHist g_lat[LAT_COUNT];
+static const char *const g_lat_names[LAT_COUNT] = {
+    "copy", "rawq", "enc", "push", "h264q", "write", "e2e",
+    "push", "aq", "write", "e2e",
+};
+static LatHistSnap g_lat_total[LAT_COUNT];  // 累计（仅统计线程读写，供 /metrics）
+
+static MetricsHttp g_metrics;
+static MetricsSnap g_metrics_snap;          // 统计线程的本地快照，publish 时整体拷贝
+
+static CtlLoop g_ctl;                       // 信号 / 定时 / 每秒统计 都在这一个 epoll 里
+
+static AioWriter g_aio_h264;                // --sink-io 非 stdio 时由 main 打开和关闭，sink 线程只写
+static AioWriter g_aio_pcm;
+static int       g_aio_h264_on, g_aio_pcm_on;
+static SegWriter g_seg;                     // --segment-*：替代两个 sink 的 fopen/fwrite
+static int       g_seg_on;
+static Fmp4Mux   g_mp4;                     // --out-mp4：只有 fan-mp4 线程写，main 打开/关闭
+static int       g_mp4_on;
+static TsMux     g_ts;                      // --out-ts：同上
+static int       g_ts_on;
+static RtpSink   g_rtp;                     // --out-rtp：只有 fan-rtp 线程发
+static int       g_rtp_on;
+static Fanout    g_fan;                     // mp4 / ts / rtp 各一个队列 + 线程，包按引用共享
+static int       g_fan_on;
+static DvrRing   g_dvr;                     // --dvr：替代两个 sink 的裸文件，触发时才落盘
+static int       g_dvr_on;
+static ShmBus    g_bus;                     // --shm-bus：两个 sink 都发布，本机其它进程只读跟读
+static int       g_bus_on;
+static FramePool   g_fpool;                 // --frame-export：采集直接合帧进池，编码器和本机读者共享
+static FrameExport g_fx;
+static int         g_fx_on;
+
+static uint64_t g_synth_video_frames;       // 合成视频源产出帧数（线程退出前写，join 后读）
+
 static void request_stop(void)
 {
     int prev = atomic_exchange(&g_stop, 1);
     if (prev == 0) {
-        bq_close(&g_raw_vq);
-        bq_close(&g_h264_q);
-        bq_close(&g_aud_q);
+        sg_stop(&g_graph);
+        ctl_loop_stop(&g_ctl);
     }
 }
 
@@ -51,13 +126,16 @@ static int should_stop(void)
 static void free_video_frame(VideoFrame *vf)
 {
     if (!vf) return;
-    if (vf->data) free(vf->data);
+    if (vf->pool) frame_pool_unref((FramePool *)vf->pool, vf->pool_slot);
+    else if (vf->data) free(vf->data);
     free(vf);
 }
 
+// 包 / 音频块带引用计数（扇出给 mp4 / ts / rtp 时各持一个）：放掉一个引用，最后一个才真正释放
 static void free_audio_chunk(AudioChunk *ac)
 {
     if (!ac) return;
+    if (atomic_fetch_sub(&ac->refs, 1) > 1) return;
     if (ac->data) free(ac->data);
     free(ac);
 }
@@ -65,102 +143,406 @@ static void free_audio_chunk(AudioChunk *ac)
 static void free_encoded_packet(EncodedPacket *p)
 {
     if (!p) return;
+    if (atomic_fetch_sub(&p->refs, 1) > 1) return;
     if (p->data) free(p->data);
     free(p);
 }
 
-typedef struct {
-    const AppConfig *cfg;
-} ThreadArgs;
+/* 溢写序列化：结构体原样 + 数据字节；读回来是一个新分配的、只有一个引用的包 */
+static size_t spill_video_bytes(const void *item)
+{
+    return sizeof(EncodedPacket) + ((const EncodedPacket *)item)->size;
+}
 
-static void *signal_thread(void *arg)
+static void spill_video_store(const void *item, uint8_t *dst)
 {
-    (void)arg;
-    sigset_t set;
-    sigemptyset(&set);
-    sigaddset(&set, SIGINT);
-    sigaddset(&set, SIGTERM);
+    const EncodedPacket *ep = (const EncodedPacket *)item;
+    memcpy(dst, ep, sizeof(*ep));
+    memcpy(dst + sizeof(*ep), ep->data, ep->size);
+}
 
-    int sig = 0;
-    // 等待 Ctrl+C / kill
-    if (sigwait(&set, &sig) == 0) {
-        LOGW("[signal] caught signal=%d, stopping...", sig);
-        request_stop();
+static void *spill_video_load(const uint8_t *src, size_t len)
+{
+    if (len < sizeof(EncodedPacket)) return NULL;
+    EncodedPacket *ep = (EncodedPacket *)malloc(sizeof(*ep));
+    if (!ep) return NULL;
+    memcpy(ep, src, sizeof(*ep));
+    if (ep->size != len - sizeof(*ep) || !(ep->data = (uint8_t *)malloc(ep->size ? ep->size : 1))) {
+        free(ep);
+        return NULL;
     }
-    return NULL;
+    memcpy(ep->data, src + sizeof(*ep), ep->size);
+    atomic_init(&ep->refs, 1);
+    return ep;
 }
 
-typedef struct {
-    unsigned int sec;
-} TimerArgs;
+static void spill_video_release(void *item)
+{
+    free_encoded_packet((EncodedPacket *)item);
+}
 
-static void *timer_thread(void *arg)
+static size_t spill_audio_bytes(const void *item)
 {
-    TimerArgs *t = (TimerArgs *)arg;
-    if (!t || t->sec == 0) return NULL;
+    return sizeof(AudioChunk) + ((const AudioChunk *)item)->bytes;
+}
 
-    unsigned int left = t->sec;
-    while (!should_stop() && left > 0) {
-        sleep(1);
-        left--;
+static void spill_audio_store(const void *item, uint8_t *dst)
+{
+    const AudioChunk *ac = (const AudioChunk *)item;
+    memcpy(dst, ac, sizeof(*ac));
+    memcpy(dst + sizeof(*ac), ac->data, ac->bytes);
+}
+
+static void *spill_audio_load(const uint8_t *src, size_t len)
+{
+    if (len < sizeof(AudioChunk)) return NULL;
+    AudioChunk *ac = (AudioChunk *)malloc(sizeof(*ac));
+    if (!ac) return NULL;
+    memcpy(ac, src, sizeof(*ac));
+    if (ac->bytes != len - sizeof(*ac) || !(ac->data = (uint8_t *)malloc(ac->bytes ? ac->bytes : 1))) {
+        free(ac);
+        return NULL;
     }
+    memcpy(ac->data, src + sizeof(*ac), ac->bytes);
+    atomic_init(&ac->refs, 1);
+    return ac;
+}
+
+static void spill_audio_release(void *item)
+{
+    free_audio_chunk((AudioChunk *)item);
+}
 
-    if (!should_stop()) {
-        LOGI("[timer] reached %u sec, stopping...", t->sec);
+static const SpillOps g_spill_video_ops = {
+    spill_video_bytes, spill_video_store, spill_video_load, spill_video_release,
+};
+static const SpillOps g_spill_audio_ops = {
+    spill_audio_bytes, spill_audio_store, spill_audio_load, spill_audio_release,
+};
+
+static void fan_ref(int kind, void *obj)
+{
+    if (kind == FANOUT_VIDEO) atomic_fetch_add(&((EncodedPacket *)obj)->refs, 1);
+    else atomic_fetch_add(&((AudioChunk *)obj)->refs, 1);
+}
+
+static void fan_unref(int kind, void *obj)
+{
+    if (kind == FANOUT_VIDEO) free_encoded_packet((EncodedPacket *)obj);
+    else free_audio_chunk((AudioChunk *)obj);
+}
+
+/* 扇出 sink：各在自己的线程里写（"fan-mp4" / "fan-ts" / "fan-rtp"） */
+static int fan_write_mp4(void *user, int kind, void *obj)
+{
+    (void)user;
+    int rc;
+    if (kind == FANOUT_VIDEO) {
+        EncodedPacket *ep = (EncodedPacket *)obj;
+        rc = fmp4_mux_write_video(&g_mp4, ep->data, ep->size, ep->pts_us, ep->is_keyframe);
+    } else {
+        AudioChunk *ac = (AudioChunk *)obj;
+        rc = fmp4_mux_write_audio(&g_mp4, ac->data, ac->bytes, (uint32_t)ac->frames, ac->pts_us);
+    }
+    if (rc != 0) {
+        LOGW("[fan-mp4] mp4 write failed");
         request_stop();
     }
-    return NULL;
+    return rc;
 }
 
-static void *stats_thread(void *arg)
+static int fan_write_ts(void *user, int kind, void *obj)
 {
-    (void)arg;
-    while (!should_stop()) {
-        sleep(1);
-        av_stats_tick_print(&g_stats);
-
-        size_t vq = bq_size(&g_raw_vq);
-        size_t hq = bq_size(&g_h264_q);
-        size_t aq = bq_size(&g_aud_q);
-        LOGI("[Q] raw=%zu/%zu h264=%zu/%zu audio=%zu/%zu",
-             vq, bq_capacity(&g_raw_vq),
-             hq, bq_capacity(&g_h264_q),
-             aq, bq_capacity(&g_aud_q));
-
-        uint64_t vdu = atomic_load(&g_video_pts_delta_us);
-        uint64_t adu = atomic_load(&g_audio_pts_delta_us);
-        if (vdu) {
-            LOGI("[PTS] video_delta=%.3fms", (double)vdu / 1000.0);
-        } else {
-            LOGI("[PTS] video_delta=n/a");
+    (void)user;
+    int rc;
+    if (kind == FANOUT_VIDEO) {
+        EncodedPacket *ep = (EncodedPacket *)obj;
+        rc = ts_mux_write_video(&g_ts, ep->data, ep->size, ep->pts_us, ep->is_keyframe);
+    } else {
+        AudioChunk *ac = (AudioChunk *)obj;
+        rc = ts_mux_write_audio(&g_ts, ac->data, ac->bytes, (uint32_t)ac->frames, ac->pts_us);
+    }
+    if (rc != 0) {
+        LOGW("[fan-ts] ts write failed");
+        request_stop();
+    }
+    return rc;
+}
+
+// 预览流出错不停录制：发送失败在 rtp 里限频告警、计 send_err
+static int fan_write_rtp(void *user, int kind, void *obj)
+{
+    (void)user;
+    if (kind == FANOUT_VIDEO) {
+        EncodedPacket *ep = (EncodedPacket *)obj;
+        return rtp_sink_write_video(&g_rtp, ep->data, ep->size, ep->pts_us, ep->is_keyframe);
+    }
+    AudioChunk *ac = (AudioChunk *)obj;
+    return rtp_sink_write_audio(&g_rtp, ac->data, ac->bytes, (uint32_t)ac->frames, ac->pts_us);
+}
+
+typedef struct {
+    const AppConfig *cfg;
+} ThreadArgs;
+
+// 一行一条链路：各阶段 p50/p95/max（ms）
+static void lat_report_range(const char *name, int first, int last)
+{
+    char line[512];
+    int off = snprintf(line, sizeof(line), "[LAT] %s ms p50/p95/max", name);
+    for (int i = first; i <= last && off < (int)sizeof(line); i++) {
+        LatHistSnap snap;
+        lat_hist_take(&g_lat[i], &snap);
+        lat_hist_snap_merge(&g_lat_total[i], &snap);
+        if (snap.count == 0) {
+            off += snprintf(line + off, sizeof(line) - (size_t)off, " %s=n/a", g_lat_names[i]);
+            continue;
         }
-        if (adu) {
-            LOGI("[PTS] audio_delta=%.3fms", (double)adu / 1000.0);
-        } else {
-            LOGI("[PTS] audio_delta=n/a");
+        off += snprintf(line + off, sizeof(line) - (size_t)off, " %s=%.2f/%.2f/%.2f",
+                        g_lat_names[i],
+                        lat_hist_percentile_us(&snap, 0.50) / 1000.0,
+                        lat_hist_percentile_us(&snap, 0.95) / 1000.0,
+                        (double)snap.max_us / 1000.0);
+    }
+    LOGI("%s", line);
+}
+
+// 在统计线程里组一份快照交给 /metrics 线程；媒体线程不参与
+static void metrics_publish(const AvSyncReport *r)
+{
+    if (!g_metrics.running) return;
+
+    MetricsSnap *m = &g_metrics_snap;
+    metrics_snap_reset(m);
+
+    metrics_snap_counter(m, "rkav_video_frames", "Encoded video frames", NULL,
+                         (double)g_stats.total_video_frames);
+    metrics_snap_counter(m, "rkav_encoded_bytes", "Encoded H.264 bytes", NULL,
+                         (double)g_stats.total_enc_bytes);
+    metrics_snap_counter(m, "rkav_audio_chunks", "PCM chunks written", NULL,
+                         (double)g_stats.total_audio_chunks);
+
+    char labels[64];
+    const char *drop_help = "Dropped frames/chunks by cause";
+    for (int st = 0; st < AV_STREAM_COUNT; st++) {
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            snprintf(labels, sizeof(labels), "stream=\"%s\",cause=\"%s\"",
+                     av_stream_name((AvStream)st), av_drop_cause_name((AvDropCause)c));
+            metrics_snap_counter(m, "rkav_drops", drop_help, labels,
+                                 (double)g_stats.total_drops[st][c]);
+            drop_help = NULL;
         }
+    }
+
+    // 每条图边一个 queue 标签（默认图：raw / h264 / audio）
+    const char *help = "Items currently queued";
+    for (int i = 0; i < g_graph.n_edges; i++) {
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", g_graph.edges[i].name);
+        metrics_snap_gauge(m, "rkav_queue_depth", help, labels, (double)spq_size(&g_graph.edges[i].q));
+        help = NULL;
+    }
+    help = "Queue capacity";
+    for (int i = 0; i < g_graph.n_edges; i++) {
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", g_graph.edges[i].name);
+        metrics_snap_gauge(m, "rkav_queue_capacity", help, labels, (double)spq_capacity(&g_graph.edges[i].q));
+        help = NULL;
+    }
+    help = "Items currently in the spill file";
+    for (int i = 0; i < g_graph.n_edges; i++) {
+        if (!g_graph.edges[i].q.map) continue;
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", g_graph.edges[i].name);
+        metrics_snap_gauge(m, "rkav_queue_spilled", help, labels, (double)spq_spilled(&g_graph.edges[i].q));
+        help = NULL;
+    }
+
+    metrics_snap_gauge(m, "rkav_avsync_locked", "1 once the A/V offset is locked", NULL, r->locked);
+    metrics_snap_gauge(m, "rkav_avsync_offset_ms", "Paired video-audio offset p50 (ms)", NULL, r->av_offset_ms);
+    metrics_snap_gauge(m, "rkav_avsync_residual_ms", "Aligned residual p50 (ms)", NULL, r->residual_ms);
+    metrics_snap_gauge(m, "rkav_avsync_drift_msps", "Residual drift (ms per second)", NULL, r->drift_msps);
+    metrics_snap_gauge(m, "rkav_avsync_jitter_ms", "Interval jitter (ms)",
+                       "stream=\"video\",stat=\"p50\"", r->v_jitter_p50_ms);
+    metrics_snap_gauge(m, "rkav_avsync_jitter_ms", NULL,
+                       "stream=\"video\",stat=\"p95\"", r->v_jitter_p95_ms);
+    metrics_snap_gauge(m, "rkav_avsync_jitter_ms", NULL,
+                       "stream=\"audio\",stat=\"p50\"", r->a_jitter_p50_ms);
+    metrics_snap_gauge(m, "rkav_avsync_jitter_ms", NULL,
+                       "stream=\"audio\",stat=\"p95\"", r->a_jitter_p95_ms);
+
+    ThreadStatSample ts[THREAD_STATS_MAX];
+    size_t nts = thread_stats_snapshot(ts, THREAD_STATS_MAX);
+    for (size_t i = 0; i < nts; i++) {
+        snprintf(labels, sizeof(labels), "thread=\"%s\"", ts[i].name);
+        metrics_snap_counter(m, "rkav_thread_cpu_seconds", "CPU time per pipeline thread", labels,
+                             ts[i].cpu_sec);
+    }
+    for (size_t i = 0; i < nts; i++) {
+        snprintf(labels, sizeof(labels), "thread=\"%s\",kind=\"voluntary\"", ts[i].name);
+        metrics_snap_counter(m, "rkav_thread_context_switches", "Context switches per pipeline thread",
+                             labels, (double)ts[i].vol_cs);
+        snprintf(labels, sizeof(labels), "thread=\"%s\",kind=\"involuntary\"", ts[i].name);
+        metrics_snap_counter(m, "rkav_thread_context_switches", NULL, labels, (double)ts[i].invol_cs);
+    }
+
+    for (int i = 0; i < LAT_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "stream=\"%s\",stage=\"%s\"",
+                 i < LAT_A_PUSH ? "video" : "audio", g_lat_names[i]);
+        metrics_snap_histogram_us(m, "rkav_stage_latency_seconds", "Per-frame stage latency",
+                                  labels, &g_lat_total[i]);
+    }
+
+    metrics_http_publish(&g_metrics, m);
+}
 
-        avsync_report_1s(&g_avsync, rkav_now_monotonic_us());
+// 控制循环每个整秒边界回调一次（替代原 stats 线程的 sleep(1)）
+static void stats_tick(void *user)
+{
+    av_stats_tick_print(&g_stats);
+    thread_stats_tick_print();
+
+    // 各线程启动时自己套用规则，第一个 tick 时都已经起来了
+    static int sched_reported;
+    if (!sched_reported) {
+        sched_reported = 1;
+        thread_sched_report();
+    }
+
+    sg_tick_print(&g_graph);
+
+    uint64_t vdu = atomic_load(&g_video_pts_delta_us);
+    uint64_t adu = atomic_load(&g_audio_pts_delta_us);
+    if (vdu) {
+        LOGI("[PTS] video_delta=%.3fms", (double)vdu / 1000.0);
+    } else {
+        LOGI("[PTS] video_delta=n/a");
+    }
+    if (adu) {
+        LOGI("[PTS] audio_delta=%.3fms", (double)adu / 1000.0);
+    } else {
+        LOGI("[PTS] audio_delta=n/a");
     }
+
+    lat_report_range("video", LAT_V_COPY, LAT_V_E2E);
+    lat_report_range("audio", LAT_A_PUSH, LAT_A_E2E);
+
+    const AppConfig *cfg = (const AppConfig *)user;
+    if (g_aio_h264_on) aio_writer_tick_print(&g_aio_h264);
+    if (g_aio_pcm_on) aio_writer_tick_print(&g_aio_pcm);
+
+    uint64_t now_us = rkav_now_monotonic_us();
+    evtrace_emit(&g_trace, EV_AVSYNC_REPORT, now_us, now_us, 0, 0, 0);
+
+    AvSyncReport rep;
+    uint64_t sp = span_begin();
+    avsync_report(&g_avsync, now_us, &rep);
+    avsync_log_report(&rep);
+    span_end(SPAN_AVSYNC_REPORT, sp);
+
+    if (g_dvr_on) {
+        dvr_ring_tick_print(&g_dvr);
+        // 越界期间每秒触发一次（保存中即延长），日志只在进入 / 离开时打
+        static int breach;
+        double off = rep.av_offset_ms < 0 ? -rep.av_offset_ms : rep.av_offset_ms;
+        int over = cfg && cfg->dvr_avsync_ms > 0 && rep.n_pairs > 0 && off > cfg->dvr_avsync_ms;
+        if (over != breach) {
+            if (over) LOGW("[dvr] av_offset=%.1fms beyond %.1fms, triggering", rep.av_offset_ms, cfg->dvr_avsync_ms);
+            else LOGI("[dvr] av_offset back within %.1fms", cfg->dvr_avsync_ms);
+            breach = over;
+        }
+        if (over) dvr_ring_trigger(&g_dvr, "avsync");
+    }
+    if (g_bus_on) shm_bus_tick_print(&g_bus);
+    if (g_fx_on) frame_export_tick_print(&g_fx);
+    if (g_rtp_on) rtp_sink_tick_print(&g_rtp);
+    if (g_fan_on) fanout_tick_print(&g_fan);
+
+    metrics_publish(&rep);
+}
+
+static void ctl_on_signal(void *user, int signo)
+{
+    (void)user;
+    if (signo == SIGUSR1 && g_dvr_on) {
+        dvr_ring_trigger(&g_dvr, "signal");
+        return;
+    }
+    LOGW("[signal] caught signal=%d, stopping...", signo);
+    request_stop();
+}
+
+static void ctl_on_deadline(void *user)
+{
+    const AppConfig *cfg = (const AppConfig *)user;
+    LOGI("[timer] reached %u sec, stopping...", cfg->duration_sec);
+    request_stop();
+}
+
+static void *ctl_thread(void *arg)
+{
+    (void)arg;
+    ctl_loop_run(&g_ctl);
     return NULL;
 }
 
-static void *video_capture_thread(void *arg)
+// 采集侧公共逻辑：拷贝进 VideoFrame 发到 raw 输出（边满则按边的策略丢）。返回 -1 表示下游都关了
+// slot >= 0：帧已经合在帧池里（--frame-export），不再拷贝；先借给本机读者，再进 raw 队列
+static int submit_video_frame(SgStage *st, const AppConfig *cfg, const void *data, size_t len, int slot,
+                              uint64_t pts_us, uint64_t t_dq_us, uint64_t *frame_id)
 {
-    ThreadArgs *ta = (ThreadArgs *)arg;
-    const AppConfig *cfg = ta->cfg;
+    uint64_t sp = span_begin();
+    VideoFrame *vf = (VideoFrame *)calloc(1, sizeof(VideoFrame));
+    if (!vf) {
+        if (slot >= 0) frame_pool_unref(&g_fpool, slot);
+        av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_ALLOC, 1);
+        return 0;
+    }
+
+    if (slot >= 0) {
+        vf->data = frame_pool_data(&g_fpool, slot);
+        vf->pool = &g_fpool;
+        vf->pool_slot = slot;
+    } else {
+        vf->data = (uint8_t *)malloc(len);
+        if (!vf->data) {
+            free(vf);
+            av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_ALLOC, 1);
+            return 0;
+        }
+        memcpy(vf->data, data, len);
+    }
+    vf->size = len;
+    vf->w = cfg->width;
+    vf->h = cfg->height;
+    vf->stride = cfg->width; // 先按 width，当需要更准再从 VIDIOC_G_FMT 取 stride
+    vf->pts_us = pts_us;
+    vf->frame_id = (*frame_id)++;
+    vf->t_dq_us = t_dq_us;
+    if (slot >= 0) frame_export_publish(&g_fx, slot, vf->frame_id, pts_us);
+    vf->t_rawq_us = rkav_now_monotonic_us();
+
+    // raw 边满就丢（默认图里是 drop-new，稳定优先）；帧已经被图释放
+    int pr = sg_emit(st, 0, vf);
+    span_end_arg(SPAN_V_COPY, sp, (uint32_t)len);
+    if (pr == 1) {
+        av_stats_add_queue_drop(&g_stats, AV_STREAM_VIDEO, st->drop_edge ? st->drop_edge->name : NULL, 1);
+    } else if (pr < 0) {
+        return -1;
+    }
+    return 0;
+}
 
+static void video_capture_run(SgStage *st, const AppConfig *cfg)
+{
     V4L2Capture cap;
     if(v4l2_capture_open(&cap,cfg->video_device,cfg->width,cfg->height) != 0){
         LOGE("[video_cap] open failed");
         request_stop();
-        return NULL;
+        return;
     }
     if(v4l2_capture_start(&cap) != 0){
         LOGE("[video_cap] start failed");
         v4l2_capture_close(&cap);
         request_stop();
-        return NULL;
+        return;
     }
 
     uint64_t frame_id = 0;
@@ -173,15 +555,22 @@ static void *video_capture_thread(void *arg)
         void *data = NULL;
         size_t len = 0;
 
-        int ret = v4l2_capture_dqbuf(&cap,&index,&data,&len);
+        // 帧导出时直接合进帧池；池里没空 buffer 也要出队再入队，只是不合帧
+        int slot = g_fx_on ? frame_pool_acquire(&g_fpool) : -1;
+        uint64_t sp = span_begin();
+        int ret = g_fx_on
+            ? v4l2_capture_dqbuf_to(&cap, &index, slot >= 0 ? frame_pool_data(&g_fpool, slot) : NULL, &len)
+            : v4l2_capture_dqbuf(&cap,&index,&data,&len);
+        if (ret == 0) span_end(SPAN_V_DQBUF, sp);
+        if (ret != 0 && slot >= 0) frame_pool_unref(&g_fpool, slot);
         if(ret == 1){
             usleep(1000);
             continue;
         }
 
         if (ret != 0) {
-            LOGE("[video_cap] dqbuf failed");
-            av_stats_add_drop(&g_stats, 1);
+            LOGE_RL("[video_cap] dqbuf failed");
+            av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_CAPTURE_ERR, 1);
             usleep(1000);
             continue;
         }
@@ -192,131 +581,209 @@ static void *video_capture_thread(void *arg)
         } else {
             uint32_t cur = cap.last_sequence;
             if (cur > last_seq + 1) {
-                av_stats_add_drop(&g_stats, (uint64_t)(cur - last_seq - 1));
+                av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_SEQ_GAP,
+                                  (uint64_t)(cur - last_seq - 1));
             }
             last_seq = cur;
         }
         // 产出点打 monotonic timestamp
         uint64_t pts_us = rkav_now_monotonic_us();
+        evtrace_emit(&g_trace, EV_VIDEO_CAPTURE, pts_us, pts_us,
+                     (uint32_t)len, (uint16_t)cap.last_sequence, 0);
 
-        VideoFrame *vf = (VideoFrame *)calloc(1, sizeof(VideoFrame));
-        if (!vf) {
-            av_stats_add_drop(&g_stats, 1);
-            v4l2_capture_qbuf(&cap, index);
-            continue;
-        }
-
-        vf->data = (uint8_t *)malloc(len);
-        if (!vf->data) {
-            free(vf);
-            av_stats_add_drop(&g_stats, 1);
+        if (g_fx_on && slot < 0) {
+            av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_POOL_EMPTY, 1);
             v4l2_capture_qbuf(&cap, index);
             continue;
         }
-        memcpy(vf->data, data, len);
-        vf->size = len;
-        vf->w = cfg->width;
-        vf->h = cfg->height;
-        vf->stride = cfg->width; // 先按 width，当需要更准再从 VIDIOC_G_FMT 取 stride
-        vf->pts_us = pts_us;
-        vf->frame_id = frame_id++;
-
-        // raw 队列满就丢（稳定优先）
-        int pr = bq_try_push(&g_raw_vq, vf);
-        if (pr == 1) {
-            // full
-            av_stats_add_drop(&g_stats, 1);
-            free_video_frame(vf);
-        } else if (pr < 0) {
-            free_video_frame(vf);
-            v4l2_capture_qbuf(&cap, index);
-            break;
-        }
-
+        int sr = submit_video_frame(st, cfg, data, len, slot, pts_us, pts_us, &frame_id);
         v4l2_capture_qbuf(&cap, index);
-
+        if (sr < 0) break;
     }
     v4l2_capture_close(&cap);
-    return NULL;
 }
 
-
-static void *video_encode_thread(void *arg)
+// --synthetic：合成 NV12 源，按 --speed 节奏产出；到时长后返回（图关掉 raw 边），下游排空后依次退出
+static void synth_video_run(SgStage *st, const AppConfig *cfg)
 {
-    ThreadArgs *ta = (ThreadArgs *)arg;
-    const AppConfig *cfg = ta->cfg;
-
-    EncoderMPP enc;
-    if (encoder_mpp_init(&enc, cfg->width, cfg->height, cfg->fps,
-                         cfg->bitrate, MPP_VIDEO_CodingAVC) != 0) {
-        LOGE("[video_enc] encoder init failed");
+    SynthVideo sv;
+    if (synth_video_init(&sv, cfg->width, cfg->height, cfg->fps,
+                         cfg->synth_speed, cfg->duration_sec) != 0) {
+        LOGE("[video_cap] synthetic source init failed");
         request_stop();
-        return NULL;
+        return;
     }
 
+    uint64_t frame_id = 0;
     while (!should_stop()) {
-        void *item = NULL;
-        int r = bq_pop(&g_raw_vq, &item);
-        if (r == 0) break; // closed & empty
-        if (r < 0) {
-            av_stats_add_drop(&g_stats, 1);
-            continue;
+        const uint8_t *data = NULL;
+        size_t len = 0;
+        uint64_t pts_us = 0;
+        uint32_t seq = 0;
+
+        uint64_t sp = span_begin();
+        if (synth_video_next(&sv, &data, &len, &pts_us, &seq) != 0) break;
+        span_end(SPAN_V_DQBUF, sp);
+
+        uint64_t t_dq = rkav_now_monotonic_us();
+        evtrace_emit(&g_trace, EV_VIDEO_CAPTURE, pts_us, t_dq, (uint32_t)len, (uint16_t)seq, 0);
+        int slot = -1;
+        if (g_fx_on) {
+            // 合成源的帧在它自己的缓冲里，拷一次进帧池（与不导出时拷进 VideoFrame 相同）
+            slot = frame_pool_acquire(&g_fpool);
+            if (slot < 0) {
+                av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_POOL_EMPTY, 1);
+                continue;
+            }
+            memcpy(frame_pool_data(&g_fpool, slot), data, len);
         }
+        if (submit_video_frame(st, cfg, data, len, slot, pts_us, t_dq, &frame_id) < 0) break;
+    }
 
-        VideoFrame *vf = (VideoFrame *)item;
+    g_synth_video_frames = sv.frame_idx;
+    synth_video_deinit(&sv);
+}
 
-        uint8_t *pkt_data = NULL;
-        size_t pkt_size = 0;
-        bool key = false;
+/* 阶段 vcap：源，out raw */
+static void vcap_run(SgStage *st)
+{
+    const AppConfig *cfg = ((ThreadArgs *)st->g->user)->cfg;
+    if (cfg->synthetic) synth_video_run(st, cfg);
+    else video_capture_run(st, cfg);
+}
 
-        int er = encoder_mpp_encode_packet(&enc, vf->data, vf->size,
-                                           &pkt_data, &pkt_size, &key);
-        if (er != 0) {
-            av_stats_add_drop(&g_stats, 1);
-            free_video_frame(vf);
-            continue;
-        }
+/* 阶段 venc：in raw，out h264；编码器在 open 里（sg_start 后本阶段线程上）建好，close 里释放 */
+typedef struct {
+    int         synthetic;
+    EncoderMPP  enc;
+    CostEncoder cost;
+} VencState;
 
-        if (pkt_data && pkt_size > 0) {
-            EncodedPacket *ep = (EncodedPacket *)calloc(1, sizeof(EncodedPacket));
-            if (!ep) {
-                free(pkt_data);
-                av_stats_add_drop(&g_stats, 1);
-            } else {
-                ep->data = pkt_data;
-                ep->size = pkt_size;
-                ep->pts_us = vf->pts_us;
-                ep->is_keyframe = key;
+static int venc_open(SgStage *st)
+{
+    const AppConfig *cfg = ((ThreadArgs *)st->g->user)->cfg;
+    VencState *vs = (VencState *)calloc(1, sizeof(VencState));
+    if (!vs) return -1;
+    vs->synthetic = cfg->synthetic;
+    int init_ret = cfg->synthetic
+        ? cost_encoder_init(&vs->cost, cfg->width, cfg->height, cfg->fps,
+                            cfg->bitrate, cfg->enc_cost_ns_per_px)
+        : encoder_mpp_init(&vs->enc, cfg->width, cfg->height, cfg->fps,
+                           cfg->bitrate, MPP_VIDEO_CodingAVC);
+    if (init_ret != 0) {
+        LOGE("[video_enc] encoder init failed");
+        free(vs);
+        return -1;
+    }
+    st->state = vs;
+    return 0;
+}
 
-                int pr = bq_push(&g_h264_q, ep);
-                if (pr != 0) {
-                    free_encoded_packet(ep);
-                    break;
-                }
+static void venc_close(SgStage *st)
+{
+    VencState *vs = (VencState *)st->state;
+    if (vs->synthetic) cost_encoder_deinit(&vs->cost);
+    else encoder_mpp_deinit(&vs->enc);
+    free(vs);
+    st->state = NULL;
+}
 
+static void venc_process(SgStage *st, int port, void *item)
+{
+    (void)port;
+    VencState *vs = (VencState *)st->state;
+    VideoFrame *vf = (VideoFrame *)item;
+
+    uint8_t *pkt_data = NULL;
+    size_t pkt_size = 0;
+    bool key = false;
+
+    uint64_t sp = span_begin();
+    uint64_t t_enc_start = rkav_now_monotonic_us();
+    int er = vs->synthetic
+        ? cost_encoder_encode(&vs->cost, vf->data, vf->size, &pkt_data, &pkt_size, &key)
+        : encoder_mpp_encode_packet(&vs->enc, vf->data, vf->size, &pkt_data, &pkt_size, &key);
+    uint64_t t_enc_end = rkav_now_monotonic_us();
+    span_end_arg(SPAN_V_ENCODE, sp, (uint32_t)pkt_size);
+    if (er != 0) {
+        av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_ENCODE_ERR, 1);
+        free_video_frame(vf);
+        return;
+    }
+
+    if (pkt_data && pkt_size > 0) {
+        EncodedPacket *ep = (EncodedPacket *)calloc(1, sizeof(EncodedPacket));
+        if (!ep) {
+            free(pkt_data);
+            av_stats_add_drop(&g_stats, AV_STREAM_VIDEO, AV_DROP_ALLOC, 1);
+        } else {
+            atomic_init(&ep->refs, 1);
+            ep->data = pkt_data;
+            ep->size = pkt_size;
+            ep->pts_us = vf->pts_us;
+            ep->is_keyframe = key;
+            ep->t_dq_us = vf->t_dq_us;
+            ep->t_rawq_us = vf->t_rawq_us;
+            ep->t_enc_start_us = t_enc_start;
+            ep->t_enc_end_us = t_enc_end;
+            evtrace_emit(&g_trace, EV_VIDEO_ENCODE, ep->pts_us, t_enc_end,
+                         (uint32_t)pkt_size, 0, key ? EV_FLAG_KEYFRAME : 0);
+
+            ep->t_h264q_us = rkav_now_monotonic_us();
+
+            // 下游都关了（停止中）时包已经被图放掉，不计数；drop 策略的 h264 边丢了也算 queue_full
+            int pr = sg_emit(st, 0, ep);
+            if (pr >= 0) {
                 av_stats_inc_video_frame(&g_stats);
                 av_stats_add_enc_bytes(&g_stats, (uint64_t)pkt_size);
             }
+            if (pr == 1) {
+                av_stats_add_queue_drop(&g_stats, AV_STREAM_VIDEO, st->drop_edge ? st->drop_edge->name : NULL, 1);
+            }
         }
+    }
 
-        free_video_frame(vf);
+    free_video_frame(vf);
+}
 
+// 采集侧公共逻辑：buf 的所有权交给 AudioChunk 发到 pcm 输出。返回 -1 表示下游都关了
+static int submit_audio_chunk(SgStage *st, uint8_t *buf, size_t bytes, uint32_t frames,
+                              unsigned int sample_rate, int channels,
+                              uint64_t pts_us, uint64_t t_read)
+{
+    evtrace_emit(&g_trace, EV_AUDIO_CAPTURE, pts_us, t_read,
+                 (uint32_t)bytes, (uint16_t)frames, 0);
+
+    AudioChunk *chunk = (AudioChunk *)calloc(1, sizeof(AudioChunk));
+    if (!chunk) {
+        free(buf);
+        av_stats_add_drop(&g_stats, AV_STREAM_AUDIO, AV_DROP_ALLOC, 1);
+        return 0;
     }
-    encoder_mpp_deinit(&enc);
-    return NULL;
 
+    atomic_init(&chunk->refs, 1);
+    chunk->data = buf;
+    chunk->bytes = bytes;
+    chunk->sample_rate = (int)sample_rate;
+    chunk->channels = channels;
+    chunk->bytes_per_sample = 2; // S16LE
+    chunk->frames = frames;
+    chunk->pts_us = pts_us;
+    chunk->t_read_us = t_read;
+
+    chunk->t_q_us = rkav_now_monotonic_us();
+    int pr = sg_emit(st, 0, chunk);
+    if (pr == 1) av_stats_add_queue_drop(&g_stats, AV_STREAM_AUDIO, st->drop_edge ? st->drop_edge->name : NULL, 1);
+    return pr < 0 ? -1 : 0;
 }
 
-static void *audio_capture_thread(void *arg)
+static void audio_capture_run(SgStage *st, const AppConfig *cfg)
 {
-    ThreadArgs *ta = (ThreadArgs *)arg;
-    const AppConfig *cfg = ta->cfg;
-
     AudioCapture ac;
     if (audio_capture_open(&ac, cfg->audio_device, cfg->sample_rate, (int)cfg->channels) != 0) {
         LOGE("[audio_cap] open failed");
         request_stop();
-        return NULL;
+        return;
     }
 
     // 起始 pts 用 monotonic，后续靠采样计数推进
@@ -327,150 +794,413 @@ static void *audio_capture_thread(void *arg)
     while (!should_stop()) {
         uint8_t *buf = (uint8_t *)malloc(chunk_bytes);
         if (!buf) {
-            av_stats_add_drop(&g_stats, 1);
+            av_stats_add_drop(&g_stats, AV_STREAM_AUDIO, AV_DROP_ALLOC, 1);
             usleep(1000);
             continue;
         }
 
+        uint64_t sp = span_begin();
         ssize_t n = audio_capture_read(&ac, buf, chunk_bytes);
+        if (n > 0) span_end_arg(SPAN_A_READ, sp, (uint32_t)n);
         if (n <= 0) {
             free(buf);
             if (!should_stop()) usleep(1000);
             continue;
         }
 
+        uint64_t t_read = rkav_now_monotonic_us();
         uint32_t frames = (uint32_t)(n / ac.bytes_per_frame);
 
-        AudioChunk *chunk = (AudioChunk *)calloc(1, sizeof(AudioChunk));
-        if (!chunk) {
-            free(buf);
-            av_stats_add_drop(&g_stats, 1);
-            continue;
-        }
-
-        chunk->data = buf;
-        chunk->bytes = (size_t)n;
-        chunk->sample_rate = (int)ac.sample_rate;
-        chunk->channels = ac.channels;
-        chunk->bytes_per_sample = 2; // S16LE
-        chunk->frames = frames;
-        chunk->pts_us = pts_us;
+        int sr = submit_audio_chunk(st, buf, (size_t)n, frames, ac.sample_rate, ac.channels,
+                                    pts_us, t_read);
 
         // 推进 pts：frames 是“每声道帧数”
         pts_us += (uint64_t)frames * 1000000ULL / (uint64_t)ac.sample_rate;
 
-        int pr = bq_push(&g_aud_q, chunk);
-        if (pr != 0) {
-            free_audio_chunk(chunk);
-            break;
-        }
+        if (sr < 0) break;
     }
 
     audio_capture_close(&ac);
-    return NULL;
 }
 
-static void *h264_sink_thread(void *arg)
+static void synth_audio_run(SgStage *st, const AppConfig *cfg)
 {
-    ThreadArgs *ta = (ThreadArgs *)arg;
-    const AppConfig *cfg = ta->cfg;
-
-    FILE *fp = fopen(cfg->output_path_h264, "wb");
-    if (!fp) {
-        LOGE("[h264_sink] open file failed: %s", cfg->output_path_h264);
+    SynthAudio sa;
+    if (synth_audio_init(&sa, cfg->sample_rate, cfg->channels, cfg->audio_chunks_ms,
+                         cfg->synth_speed, cfg->duration_sec) != 0) {
+        LOGE("[audio_cap] synthetic source init failed");
         request_stop();
-        return NULL;
+        return;
     }
-    LOGI("[h264_sink] opened: %s", cfg->output_path_h264);
 
-    uint64_t last_pts = 0;
+    size_t chunk_bytes = (size_t)sa.chunk_frames * sa.channels * 2;
 
     while (!should_stop()) {
-        void *item = NULL;
-        int r = bq_pop(&g_h264_q, &item);
-        if (r == 0) break;
-        if (r < 0) continue;
+        uint8_t *buf = (uint8_t *)malloc(chunk_bytes);
+        if (!buf) {
+            av_stats_add_drop(&g_stats, AV_STREAM_AUDIO, AV_DROP_ALLOC, 1);
+            usleep(1000);
+            continue;
+        }
 
-        EncodedPacket *ep = (EncodedPacket *)item;
-        if (last_pts && ep->pts_us > last_pts) {
-            atomic_store(&g_video_pts_delta_us, ep->pts_us - last_pts);
+        uint32_t frames = 0;
+        uint64_t pts_us = 0;
+        uint64_t sp = span_begin();
+        if (synth_audio_read(&sa, buf, chunk_bytes, &frames, &pts_us) != 0) {
+            free(buf);
+            break;
         }
-        last_pts = ep->pts_us;
+        span_end(SPAN_A_READ, sp);
 
-        avsync_on_video(&g_avsync, ep->pts_us);
+        uint64_t t_read = rkav_now_monotonic_us();
+        if (submit_audio_chunk(st, buf, (size_t)frames * sa.channels * 2, frames,
+                               sa.sample_rate, (int)sa.channels, pts_us, t_read) < 0) break;
+    }
+}
 
+/* 阶段 acap：源，out pcm */
+static void acap_run(SgStage *st)
+{
+    const AppConfig *cfg = ((ThreadArgs *)st->g->user)->cfg;
+    if (cfg->synthetic) synth_audio_run(st, cfg);
+    else audio_capture_run(st, cfg);
+}
 
-        if (ep->data && ep->size) {
-            size_t w = fwrite(ep->data, 1, ep->size, fp);
-            if (w != ep->size) {
-                LOGW("[h264_sink] partial write: %zu/%zu", w, ep->size);
-                request_stop();
-            }
+/* 阶段 h264sink：in h264；裸流 / 分段 / DVR / 索引，再交给扇出和共享内存总线 */
+typedef struct {
+    AioWriter *aio;
+    FILE      *fp;
+    PktIndex   idx;
+    uint64_t   out_off;
+    uint64_t   last_pts;
+} H264SinkState;
+
+static int h264sink_open(SgStage *st)
+{
+    const AppConfig *cfg = ((ThreadArgs *)st->g->user)->cfg;
+    H264SinkState *hs = (H264SinkState *)calloc(1, sizeof(H264SinkState));
+    if (!hs) return -1;
+
+    const char *path = cfg->output_path_h264;
+    hs->aio = path && g_aio_h264_on ? &g_aio_h264 : NULL;
+    int direct = path && !g_seg_on && !g_dvr_on;
+    if (direct && !hs->aio) {
+        hs->fp = fopen(path, "wb");
+        if (!hs->fp) {
+            LOGE("[h264_sink] open file failed: %s", path);
+            free(hs);
+            return -1;
+        }
+    }
+    if (direct) LOGI("[h264_sink] opened: %s", path);
+
+    // 包索引：偏移按逻辑字节流算，stdio / aio 都一样（分段时由 seg_writer 自己写）
+    if (direct && cfg->h264_index) {
+        char idx_path[512];
+        snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+        if (pkt_index_open(&hs->idx, idx_path, (unsigned)cfg->fps) != 0) {
+            LOGW("[h264_sink] index disabled");
         }
+    }
+    st->state = hs;
+    return 0;
+}
 
-        free_encoded_packet(ep);
+static void h264sink_process(SgStage *st, int port, void *item)
+{
+    (void)port;
+    H264SinkState *hs = (H264SinkState *)st->state;
+    AioWriter *aio = hs->aio;
+    FILE *fp = hs->fp;
+    EncodedPacket *ep = (EncodedPacket *)item;
+    uint64_t t_pop = rkav_now_monotonic_us();
+    if (hs->last_pts && ep->pts_us > hs->last_pts) {
+        atomic_store(&g_video_pts_delta_us, ep->pts_us - hs->last_pts);
+    }
+    hs->last_pts = ep->pts_us;
+
+    // trace 与 avsync 用同一个到达时刻，离线回放才能逐位复现
+    uint64_t arrival_us = rkav_now_monotonic_us();
+    evtrace_emit(&g_trace, EV_AVSYNC_VIDEO, ep->pts_us, arrival_us,
+                 (uint32_t)ep->size, 0, ep->is_keyframe ? EV_FLAG_KEYFRAME : 0);
+    avsync_on_video_at(&g_avsync, ep->pts_us, arrival_us);
+
+    uint64_t sp = span_begin();
+    if (ep->data && ep->size && g_dvr_on) {
+        dvr_ring_put_video(&g_dvr, ep->data, ep->size, ep->pts_us, ep->is_keyframe);
+    } else if (ep->data && ep->size && g_seg_on) {
+        if (seg_writer_write_video(&g_seg, ep->data, ep->size, ep->pts_us, ep->is_keyframe) != 0) {
+            LOGW("[h264_sink] segment write failed");
+            request_stop();
+        }
+    } else if (ep->data && ep->size && aio) {
+        if (aio_writer_write(aio, ep->data, ep->size) != 0) {
+            LOGW("[h264_sink] async write failed");
+            request_stop();
+        }
+    } else if (ep->data && ep->size && fp) {
+        size_t w = fwrite(ep->data, 1, ep->size, fp);
+        if (w != ep->size) {
+            LOGW("[h264_sink] partial write: %zu/%zu", w, ep->size);
+            request_stop();
+        }
+    }
+    if (hs->idx.fp && ep->data && ep->size) {
+        pkt_index_add(&hs->idx, hs->out_off, (uint32_t)ep->size, ep->pts_us,
+                      pkt_index_flags(ep->data, ep->size, ep->is_keyframe));
+        hs->out_off += ep->size;
     }
+    // mp4 / ts / rtp 在各自的扇出线程里写，这里只加引用入队；慢的那个按自己的策略丢，不拖这里
+    if (g_fan_on && ep->data && ep->size) {
+        fanout_publish(&g_fan, FANOUT_VIDEO, ep, ep->is_keyframe, ep->pts_us);
+    }
+    // 总线从不阻塞：慢读者自己 overrun，发布失败（包太大）只丢这一条
+    if (g_bus_on && ep->data && ep->size) {
+        shm_bus_publish(&g_bus, SHM_BUS_VIDEO, ep->data, ep->size, ep->pts_us,
+                        ep->is_keyframe ? SHM_BUS_FLAG_KEY : 0, 0);
+    }
+    span_end_arg(SPAN_V_WRITE, sp, (uint32_t)ep->size);
+    uint64_t t_written = rkav_now_monotonic_us();
+    evtrace_emit(&g_trace, EV_VIDEO_SINK, ep->pts_us, t_written,
+                 (uint32_t)ep->size, 0, ep->is_keyframe ? EV_FLAG_KEYFRAME : 0);
+
+    lat_hist_record_span(&g_lat[LAT_V_COPY],  ep->t_dq_us,        ep->t_rawq_us);
+    lat_hist_record_span(&g_lat[LAT_V_RAWQ],  ep->t_rawq_us,      ep->t_enc_start_us);
+    lat_hist_record_span(&g_lat[LAT_V_ENC],   ep->t_enc_start_us, ep->t_enc_end_us);
+    lat_hist_record_span(&g_lat[LAT_V_PUSH],  ep->t_enc_end_us,   ep->t_h264q_us);
+    lat_hist_record_span(&g_lat[LAT_V_H264Q], ep->t_h264q_us,     t_pop);
+    lat_hist_record_span(&g_lat[LAT_V_WRITE], t_pop,              t_written);
+    lat_hist_record_span(&g_lat[LAT_V_E2E],   ep->t_dq_us,        t_written);
+
+    free_encoded_packet(ep);
+}
 
-    fclose(fp);
+static void h264sink_close(SgStage *st)
+{
+    H264SinkState *hs = (H264SinkState *)st->state;
+    if (hs->fp) fclose(hs->fp);
+    if (hs->idx.fp) {
+        uint64_t n = hs->idx.records;
+        if (pkt_index_close(&hs->idx) != 0) LOGW("[h264_sink] index write failed");
+        else LOGI("[h264_sink] index: %llu packets", (unsigned long long)n);
+    }
+    free(hs);
+    st->state = NULL;
     LOGI("[h264_sink] closed");
-    return NULL;
 }
 
-static void *pcm_sink_thread(void *arg)
+/* 阶段 pcmsink：in pcm */
+typedef struct {
+    AioWriter *aio;
+    FILE      *fp;
+    uint64_t   last_pts;
+} PcmSinkState;
+
+static int pcmsink_open(SgStage *st)
 {
-    ThreadArgs *ta = (ThreadArgs *)arg;
-    const AppConfig *cfg = ta->cfg;
+    const AppConfig *cfg = ((ThreadArgs *)st->g->user)->cfg;
+    PcmSinkState *ps = (PcmSinkState *)calloc(1, sizeof(PcmSinkState));
+    if (!ps) return -1;
+
+    const char *path = cfg->output_path_pcm;
+    ps->aio = path && g_aio_pcm_on ? &g_aio_pcm : NULL;
+    int direct = path && !g_seg_on && !g_dvr_on;
+    if (direct && !ps->aio) {
+        ps->fp = fopen(path, "wb");
+        if (!ps->fp) {
+            LOGE("[pcm_sink] open file failed: %s", path);
+            free(ps);
+            return -1;
+        }
+    }
+    if (direct) LOGI("[pcm_sink] opened: %s", path);
+    st->state = ps;
+    return 0;
+}
 
-    FILE *fp = fopen(cfg->output_path_pcm, "wb");
-    if (!fp) {
-        LOGE("[pcm_sink] open file failed: %s", cfg->output_path_pcm);
-        request_stop();
-        return NULL;
+static void pcmsink_process(SgStage *st, int port, void *item)
+{
+    (void)port;
+    PcmSinkState *ps = (PcmSinkState *)st->state;
+    AioWriter *aio = ps->aio;
+    FILE *fp = ps->fp;
+    AudioChunk *ac = (AudioChunk *)item;
+    uint64_t t_pop = rkav_now_monotonic_us();
+    if (ps->last_pts && ac->pts_us > ps->last_pts) {
+        atomic_store(&g_audio_pts_delta_us, ac->pts_us - ps->last_pts);
+    }
+    ps->last_pts = ac->pts_us;
+
+    uint64_t arrival_us = rkav_now_monotonic_us();
+    evtrace_emit(&g_trace, EV_AVSYNC_AUDIO, ac->pts_us, arrival_us,
+                 (uint32_t)ac->sample_rate, (uint16_t)ac->frames, 0);
+    avsync_on_audio_at(&g_avsync, ac->pts_us, ac->frames, (uint32_t)ac->sample_rate, arrival_us);
+
+    uint64_t sp = span_begin();
+    if (ac->data && ac->bytes && g_dvr_on) {
+        dvr_ring_put_audio(&g_dvr, ac->data, ac->bytes, ac->pts_us);
+    } else if (ac->data && ac->bytes && g_seg_on) {
+        if (seg_writer_write_audio(&g_seg, ac->data, ac->bytes, ac->pts_us) != 0) {
+            LOGW("[pcm_sink] segment write failed");
+            request_stop();
+        }
+    } else if (ac->data && ac->bytes && aio) {
+        if (aio_writer_write(aio, ac->data, ac->bytes) != 0) {
+            LOGW("[pcm_sink] async write failed");
+            request_stop();
+        }
+    } else if (ac->data && ac->bytes && fp) {
+        size_t w = fwrite(ac->data, 1, ac->bytes, fp);
+        if (w != ac->bytes) {
+            LOGW("[pcm_sink] partial write: %zu/%zu", w, ac->bytes);
+            request_stop();
+        }
+    }
+    if (g_fan_on && ac->data && ac->bytes) {
+        fanout_publish(&g_fan, FANOUT_AUDIO, ac, false, ac->pts_us);
+    }
+    if (g_bus_on && ac->data && ac->bytes) {
+        shm_bus_publish(&g_bus, SHM_BUS_AUDIO, ac->data, ac->bytes, ac->pts_us, 0, (uint32_t)ac->frames);
     }
-    LOGI("[pcm_sink] opened: %s", cfg->output_path_pcm);
+    span_end_arg(SPAN_A_WRITE, sp, (uint32_t)ac->bytes);
+    uint64_t t_written = rkav_now_monotonic_us();
+    evtrace_emit(&g_trace, EV_AUDIO_SINK, ac->pts_us, t_written,
+                 (uint32_t)ac->bytes, (uint16_t)ac->frames, 0);
+
+    lat_hist_record_span(&g_lat[LAT_A_PUSH],  ac->t_read_us, ac->t_q_us);
+    lat_hist_record_span(&g_lat[LAT_A_Q],     ac->t_q_us,    t_pop);
+    lat_hist_record_span(&g_lat[LAT_A_WRITE], t_pop,         t_written);
+    lat_hist_record_span(&g_lat[LAT_A_E2E],   ac->t_read_us, t_written);
+
+    av_stats_inc_audio_chunk(&g_stats);
+    free_audio_chunk(ac);
+}
 
-    uint64_t last_pts = 0;
+static void pcmsink_close(SgStage *st)
+{
+    PcmSinkState *ps = (PcmSinkState *)st->state;
+    if (ps->fp) fclose(ps->fp);
+    free(ps);
+    st->state = NULL;
+    LOGI("[pcm_sink] closed");
+}
 
-    while (!should_stop()) {
-        void *item = NULL;
-        int r = bq_pop(&g_aud_q, &item);
-        if (r == 0) break;
-        if (r < 0) continue;
+// ============ Stage graph ============
+static void graph_video_unref(void *item) { free_video_frame((VideoFrame *)item); }
+static void graph_packet_ref(void *item) { atomic_fetch_add(&((EncodedPacket *)item)->refs, 1); }
+static void graph_packet_unref(void *item) { free_encoded_packet((EncodedPacket *)item); }
+static int  graph_packet_is_key(const void *item) { return ((const EncodedPacket *)item)->is_keyframe; }
+static void graph_audio_ref(void *item) { atomic_fetch_add(&((AudioChunk *)item)->refs, 1); }
+static void graph_audio_unref(void *item) { free_audio_chunk((AudioChunk *)item); }
+
+static const SgPortType g_graph_types[] = {
+    // raw 帧可能在帧池里借给了本机读者，不能再加引用，也不溢写
+    { "raw",  graph_video_unref, NULL, NULL, NULL },
+    { "h264", graph_packet_unref, graph_packet_ref, graph_packet_is_key, &g_spill_video_ops },
+    { "pcm",  graph_audio_unref, graph_audio_ref, NULL, &g_spill_audio_ops },
+};
+
+// 内置阶段用的是进程里的单例（编码器设备、g_aio_*、g_seg、扇出 ...），每种最多实例化一次
+static const SgStageClass g_graph_classes[] = {
+    { .kind = "vcap", .out = { "raw" }, .wait_span = -1, .run = vcap_run },
+    { .kind = "acap", .out = { "pcm" }, .wait_span = -1, .run = acap_run },
+    { .kind = "venc", .in = { "raw" }, .out = { "h264" }, .wait_span = SPAN_V_RAWQ_WAIT,
+      .open = venc_open, .process = venc_process, .close = venc_close },
+    { .kind = "h264sink", .in = { "h264" }, .wait_span = SPAN_V_H264Q_WAIT,
+      .open = h264sink_open, .process = h264sink_process, .close = h264sink_close },
+    { .kind = "pcmsink", .in = { "pcm" }, .wait_span = SPAN_A_Q_WAIT,
+      .open = pcmsink_open, .process = pcmsink_process, .close = pcmsink_close },
+};
+
+// 默认拓扑（与拆成图之前写死的一样）：raw 小一点、满了丢新帧（稳定优先）；h264 / audio 稍大，
+// 满了阻塞，--spill-dir 时溢写。raw 帧不溢写（原始帧太大，落盘的带宽比编码还贵）
+static const char g_default_graph[] =
+    "stage vcap     vcap\n"
+    "stage venc     venc\n"
+    "stage acap     acap\n"
+    "stage h264sink h264sink\n"
+    "stage pcmsink  pcmsink\n"
+    "edge vcap -> venc     cap=8   policy=drop-new name=raw\n"
+    "edge venc -> h264sink cap=64  policy=block spill name=h264\n"
+    "edge acap -> pcmsink  cap=256 policy=block spill name=audio\n";
+
+static int graph_has_kind(const char *kind)
+{
+    for (int i = 0; i < g_graph.n_stages; i++) {
+        if (strcmp(g_graph.stages[i].cls->kind, kind) == 0) return 1;
+    }
+    return 0;
+}
 
-        AudioChunk *ac = (AudioChunk *)item;
-        if (last_pts && ac->pts_us > last_pts) {
-            atomic_store(&g_audio_pts_delta_us, ac->pts_us - last_pts);
+static char *read_text_file(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (len + 4096 + 1 > cap) {
+            cap = cap ? cap * 2 : 8192;
+            char *nb = (char *)realloc(buf, cap);
+            if (!nb) {
+                free(buf);
+                fclose(fp);
+                return NULL;
+            }
+            buf = nb;
         }
-        last_pts = ac->pts_us;
+        size_t n = fread(buf + len, 1, cap - len - 1, fp);
+        len += n;
+        if (n == 0) break;
+    }
+    fclose(fp);
+    buf[len] = '\0';
+    return buf;
+}
 
-        avsync_on_audio(&g_avsync, ac->pts_us, ac->frames, (uint32_t)ac->sample_rate);
+static int graph_setup(const AppConfig *cfg, ThreadArgs *ta)
+{
+    sg_init(&g_graph, ta, cfg->spill_dir, (size_t)cfg->spill_mb << 20, (int)cfg->graph_workers);
+    for (size_t i = 0; i < sizeof(g_graph_types) / sizeof(g_graph_types[0]); i++) {
+        if (sg_register_type(&g_graph, &g_graph_types[i]) != 0) return -1;
+    }
+    for (size_t i = 0; i < sizeof(g_graph_classes) / sizeof(g_graph_classes[0]); i++) {
+        if (sg_register_class(&g_graph, &g_graph_classes[i]) != 0) return -1;
+    }
 
-        if (ac->data && ac->bytes) {
-            size_t w = fwrite(ac->data, 1, ac->bytes, fp);
-            if (w != ac->bytes) {
-                LOGW("[pcm_sink] partial write: %zu/%zu", w, ac->bytes);
-                request_stop();
+    char *text = NULL;
+    if (cfg->graph_path && !(text = read_text_file(cfg->graph_path))) {
+        LOGE("[graph] can't read %s: %s", cfg->graph_path, strerror(errno));
+        return -1;
+    }
+    int rc = sg_build(&g_graph, text ? text : g_default_graph);
+    free(text);
+    if (rc != 0) return -1;
+
+    for (int i = 0; i < g_graph.n_stages; i++) {
+        for (int j = 0; j < i; j++) {
+            if (g_graph.stages[i].cls == g_graph.stages[j].cls) {
+                LOGE("[graph] stages %s and %s: only one %s stage is supported",
+                     g_graph.stages[j].name, g_graph.stages[i].name, g_graph.stages[i].cls->kind);
+                return -1;
             }
         }
-
-        av_stats_inc_audio_chunk(&g_stats);
-        free_audio_chunk(ac);
     }
-
-    fclose(fp);
-    LOGI("[pcm_sink] closed");
-    return NULL;
+    sg_print(&g_graph);
+    return 0;
 }
 
 
 int main(int argc, char **argv)
 {
-    // 用 sigwait 捕获信号：先把 SIGINT/SIGTERM block 掉，避免异步 signal handler
+    // 信号走 signalfd：先在所有线程把 SIGINT/SIGTERM block 掉，避免异步 signal handler
     sigset_t set;
     sigemptyset(&set);
     sigaddset(&set, SIGINT);
     sigaddset(&set, SIGTERM);
     pthread_sigmask(SIG_BLOCK, &set, NULL);
+    // FIFO 读端退出时 write 返回 EPIPE 由 sink 处理，不要被 SIGPIPE 直接杀掉
+    signal(SIGPIPE, SIG_IGN);
 
     AppConfig cfg;
     app_config_load_default(&cfg);
@@ -478,96 +1208,398 @@ int main(int argc, char **argv)
         app_config_print_usage(argv[0]);
         return -1;
     }
+    if (cfg.dvr_pre_sec) {
+        // DVR 的触发信号同样走 signalfd；必须赶在日志线程之前 block
+        sigaddset(&set, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+    }
+
+    // 主线程的规则要赶在日志线程之前套用：之后普通 pthread_create 的线程（日志、aio、metrics）都继承这一份
+    thread_sched_apply_self("main");
+
+    // 媒体线程起来之前切到异步日志：stderr 阻塞不再卡采集/编码
+    log_set_level(cfg.log_level);
+    if (log_async_start(4096) != 0) {
+        LOGW("[main] async log unavailable, falling back to sync stderr");
+    }
 
     app_config_print_summary(&cfg);
+    thread_stats_enable_schedstat(cfg.sched_stats);
 
     av_stats_init(&g_stats);
     atomic_store(&g_video_pts_delta_us, 0);
     atomic_store(&g_audio_pts_delta_us, 0);
 
     avsync_init(&g_avsync, cfg.fps);
+    for (int i = 0; i < LAT_COUNT; i++) lat_hist_init(&g_lat[i]);
+
+    if (cfg.trace_path) {
+        EvTraceMeta meta = {
+            .video_fps = (uint32_t)cfg.fps,
+            .audio_sample_rate = cfg.sample_rate,
+            .audio_channels = cfg.channels,
+        };
+        if (evtrace_open(&g_trace, cfg.trace_path, cfg.trace_records, &meta) != 0) {
+            LOGW("[main] trace disabled");
+        }
+    }
     
-    // 队列容量：稳定优先（raw 小一点，h264/audio 稍大一点）
-    if (bq_init(&g_raw_vq, 8) != 0 ||
-        bq_init(&g_h264_q, 64) != 0 ||
-        bq_init(&g_aud_q, 256) != 0) {
-        LOGE("[main] queue init failed");
-        return -1;
+    // 必须在任何阶段线程启动前打开：g_span_trace_enabled 之后只读
+    if (cfg.chrome_trace_path && span_trace_start(cfg.chrome_trace_events) != 0) {
+        LOGW("[main] chrome trace disabled");
     }
 
+    // 阶段和队列按图建（--graph 或默认图）；阶段的 open（编码器、sink 文件）在 sg_start 之后各自线程上做
     ThreadArgs ta = { .cfg = &cfg };
-    TimerArgs  targs = { .sec = cfg.duration_sec };
+    // 启动阶段出错一律 goto fail：按各个 *_on 收尾
+    int ctl_on = 0;
+    int dvr_ctl_fd = -1;
+    if (graph_setup(&cfg, &ta) != 0) {
+        LOGE("[main] graph setup failed");
+        goto fail;
+    }
 
-    pthread_t th_sig, th_timer, th_stat;
-    pthread_t th_vcap, th_venc;
-    pthread_t th_acap, th_h264sink, th_pcmsink;
+    if (cfg.sink_io != SINK_IO_STDIO) {
+        static const AioBackend backends[] = {
+            [SINK_IO_AUTO] = AIO_BACKEND_AUTO,
+            [SINK_IO_URING] = AIO_BACKEND_URING,
+            [SINK_IO_THREADS] = AIO_BACKEND_THREADS,
+        };
+        AioWriterOpts ao = {
+            .backend = backends[cfg.sink_io],
+            .depth = cfg.aio_depth,
+            .buf_bytes = (size_t)cfg.aio_buf_kb * 1024,
+            .direct = cfg.aio_direct,
+        };
+        // 图里没有对应的 sink 阶段时不打开：不会有人写，也别把输出文件截成空的
+        if (cfg.output_path_h264 && graph_has_kind("h264sink")) {
+            if (aio_writer_open(&g_aio_h264, cfg.output_path_h264, "h264", &ao) != 0) {
+                LOGE("[main] sink open failed");
+                goto fail;
+            }
+            g_aio_h264_on = 1;
+        }
+        if (cfg.output_path_pcm && graph_has_kind("pcmsink")) {
+            if (aio_writer_open(&g_aio_pcm, cfg.output_path_pcm, "pcm", &ao) != 0) {
+                LOGE("[main] sink open failed");
+                goto fail;
+            }
+            g_aio_pcm_on = 1;
+        }
+    }
 
-    if (pthread_create(&th_sig, NULL, signal_thread, NULL) != 0) {
-        LOGE("[main] pthread_create signal failed");
-        return -1;
+    if (cfg.segment_sec || cfg.segment_mb) {
+        // 预分配按一段的预计大小：视频按码率留 25% 余量，PCM 是定长的
+        uint64_t seg_bytes = (uint64_t)cfg.segment_mb << 20;
+        uint64_t pcm_bps = (uint64_t)cfg.sample_rate * cfg.channels * 2;
+        uint64_t pre_v = seg_bytes, pre_a = seg_bytes;
+        if (cfg.segment_sec) {
+            uint64_t v = (uint64_t)cfg.bitrate / 8 * cfg.segment_sec * 5 / 4;
+            uint64_t a = pcm_bps * cfg.segment_sec;
+            pre_v = seg_bytes && seg_bytes < v ? seg_bytes : v;
+            pre_a = seg_bytes && seg_bytes < a ? seg_bytes : a;
+        }
+        // 音频暂存：等视频关键帧的那一段，按 2 个 GOP 留
+        size_t hold = (size_t)(pcm_bps * 2);
+        if (seg_writer_open(&g_seg, cfg.output_path_h264, cfg.output_path_pcm,
+                            cfg.sample_rate, cfg.channels, cfg.segment_sec, seg_bytes, pre_v, pre_a, hold,
+                            cfg.h264_index ? (unsigned)cfg.fps : 0) != 0) {
+            LOGE("[main] segment writer open failed");
+            goto fail;
+        }
+        g_seg_on = 1;
     }
 
-    if (cfg.duration_sec > 0) {
-        if (pthread_create(&th_timer, NULL, timer_thread, &targs) != 0) {
-            LOGE("[main] pthread_create timer failed");
-            request_stop();
+    if (cfg.dvr_pre_sec) {
+        // 环按 pre + 一个 GOP 余量估：视频按码率留 50%，音频 PCM 定长；记录表按帧数 / 块数留两倍
+        unsigned win = cfg.dvr_pre_sec + 4;
+        uint64_t pcm_bps = (uint64_t)cfg.sample_rate * cfg.channels * 2;
+        size_t v_bytes = (size_t)((uint64_t)cfg.bitrate / 8 * win * 3 / 2);
+        if (v_bytes < (4u << 20)) v_bytes = 4u << 20;
+        size_t a_bytes = (size_t)(pcm_bps * (win + 2));
+        unsigned chunks_ps = cfg.audio_chunks_ms ? 1000u / cfg.audio_chunks_ms : 50u;
+        if (chunks_ps < 50) chunks_ps = 50;
+        if (dvr_ring_open(&g_dvr, cfg.output_path_h264, cfg.output_path_pcm, cfg.sample_rate, cfg.channels,
+                          cfg.dvr_pre_sec, cfg.dvr_post_sec,
+                          v_bytes, (uint32_t)cfg.fps * win * 2, a_bytes, chunks_ps * (win + 2) * 2,
+                          cfg.h264_index ? (unsigned)cfg.fps : 0) != 0) {
+            LOGE("[main] dvr ring open failed");
+            goto fail;
         }
+        g_dvr_on = 1;
     }
 
-    if (pthread_create(&th_stat, NULL, stats_thread, NULL) != 0) {
-        LOGE("[main] pthread_create stats failed");
-        request_stop();
+    if (cfg.output_path_mp4) {
+        if (fmp4_mux_open(&g_mp4, cfg.output_path_mp4, cfg.width, cfg.height, cfg.fps,
+                          cfg.sample_rate, cfg.channels) != 0) {
+            LOGE("[main] mp4 open failed");
+            goto fail;
+        }
+        g_mp4_on = 1;
+    }
+    if (cfg.output_ts) {
+        if (ts_mux_open(&g_ts, cfg.output_ts, cfg.sample_rate, cfg.channels) != 0) {
+            LOGE("[main] ts open failed");
+            goto fail;
+        }
+        g_ts_on = 1;
+    }
+    if (cfg.output_rtp) {
+        if (rtp_sink_open(&g_rtp, cfg.output_rtp, cfg.rtp_mtu, cfg.rtp_pace_kbps, cfg.sample_rate,
+                          cfg.channels, cfg.audio_chunks_ms, cfg.rtp_sdp) != 0) {
+            LOGE("[main] rtp open failed");
+            goto fail;
+        }
+        g_rtp_on = 1;
+    }
+    if (g_mp4_on || g_ts_on || g_rtp_on) {
+        // 默认：文件不丢（block），网络丢新包并跳到下一个关键帧，慢接收端不拖录制
+        int ts_udp = cfg.output_ts && strncmp(cfg.output_ts, "udp://", 6) == 0;
+        fanout_init(&g_fan, fan_ref, fan_unref);
+        int rc = 0;
+        if (g_mp4_on) {
+            FanoutPolicy p = cfg.fanout_mp4 >= 0 ? (FanoutPolicy)cfg.fanout_mp4 : FANOUT_BLOCK;
+            rc |= fanout_add(&g_fan, "mp4", p, cfg.fanout_depth, fan_write_mp4, NULL) < 0;
+        }
+        if (g_ts_on) {
+            FanoutPolicy p = cfg.fanout_ts >= 0 ? (FanoutPolicy)cfg.fanout_ts :
+                             ts_udp ? FANOUT_DROP_NEW : FANOUT_BLOCK;
+            rc |= fanout_add(&g_fan, "ts", p, cfg.fanout_depth, fan_write_ts, NULL) < 0;
+        }
+        if (g_rtp_on) {
+            FanoutPolicy p = cfg.fanout_rtp >= 0 ? (FanoutPolicy)cfg.fanout_rtp : FANOUT_DROP_NEW;
+            rc |= fanout_add(&g_fan, "rtp", p, cfg.fanout_depth, fan_write_rtp, NULL) < 0;
+        }
+        g_fan_on = 1;
+        if (rc || fanout_start(&g_fan) != 0) {
+            LOGE("[main] fanout start failed");
+            goto fail;
+        }
+    }
+    if (cfg.shm_bus) {
+        // 数据环默认按码率 + PCM 留 4 秒；slot 按每秒消息数留 8 秒，数据环先满
+        uint64_t pcm_bps = (uint64_t)cfg.sample_rate * cfg.channels * 2;
+        size_t bytes = (size_t)cfg.shm_bus_mb << 20;
+        if (!bytes) bytes = (size_t)(((uint64_t)cfg.bitrate / 8 + pcm_bps) * 4);
+        if (bytes < (4u << 20)) bytes = 4u << 20;
+        unsigned chunks_ps = cfg.audio_chunks_ms ? 1000u / cfg.audio_chunks_ms : 50u;
+        ShmBusInfo bi = {
+            .width = (unsigned)cfg.width, .height = (unsigned)cfg.height, .fps = (unsigned)cfg.fps,
+            .sample_rate = cfg.sample_rate, .channels = cfg.channels,
+        };
+        if (shm_bus_open(&g_bus, cfg.shm_bus, bytes, ((unsigned)cfg.fps + chunks_ps) * 8, &bi) != 0) {
+            LOGE("[main] shm bus open failed");
+            goto fail;
+        }
+        g_bus_on = 1;
+    }
+    if (cfg.frame_export) {
+        // 帧池：raw 边 + 采集 / 编码在手上的 + 每个读者最多借 2 帧，读者不还也够编码器用
+        unsigned n = 3 + FX_MAX_CLIENTS * 2;
+        for (int i = 0; i < g_graph.n_edges; i++) {
+            if (strcmp(g_graph.types[g_graph.edges[i].type].name, "raw") == 0) {
+                n += (unsigned)spq_capacity(&g_graph.edges[i].q);
+            }
+        }
+        if (frame_pool_init(&g_fpool, n, (unsigned)cfg.width, (unsigned)cfg.height,
+                            cfg.frame_export_scale) != 0 ||
+            frame_export_start(&g_fx, &g_fpool, cfg.frame_export, cfg.frame_export_lease_ms, 2) != 0) {
+            LOGE("[main] frame export start failed");
+            frame_pool_deinit(&g_fpool);
+            goto fail;
+        }
+        g_fx_on = 1;
     }
 
-    if (pthread_create(&th_vcap, NULL, video_capture_thread, &ta) != 0) {
-        LOGE("[main] pthread_create video_cap failed");
-        request_stop();
+    if (cfg.metrics_listen && metrics_http_start(&g_metrics, cfg.metrics_listen) != 0) {
+        LOGW("[main] metrics endpoint disabled");
     }
-    if (pthread_create(&th_venc, NULL, video_encode_thread, &ta) != 0) {
-        LOGE("[main] pthread_create video_enc failed");
-        request_stop();
+
+    CtlLoopOps ops = {
+        .on_tick = stats_tick,
+        .on_signal = ctl_on_signal,
+        .on_deadline = ctl_on_deadline,
+        .user = &cfg,
+    };
+    // synthetic：时长按媒体时间由数据源自己结束（可能快于实时），不设墙钟 deadline
+    if (ctl_loop_init(&g_ctl, 1000, cfg.synthetic ? 0 : cfg.duration_sec, &set, &ops) != 0) {
+        LOGE("[main] control loop init failed");
+        goto fail;
     }
+    ctl_on = 1;
 
-    if (pthread_create(&th_acap, NULL, audio_capture_thread, &ta) != 0) {
-        LOGE("[main] pthread_create audio_cap failed");
-        request_stop();
+    if (cfg.dvr_ctl) {
+        dvr_ctl_fd = dvr_ctl_open(cfg.dvr_ctl);
+        if (dvr_ctl_fd < 0 || ctl_loop_watch_fd(&g_ctl, dvr_ctl_fd, dvr_ctl_on_readable, &g_dvr) != 0) {
+            LOGW("[main] dvr control socket disabled");
+        }
+    }
+    if (g_bus_on && ctl_loop_watch_fd(&g_ctl, g_bus.listen_fd, shm_bus_on_accept, &g_bus) != 0) {
+        LOGW("[main] shm bus readers can't attach");
     }
 
-    if (pthread_create(&th_h264sink, NULL, h264_sink_thread, &ta) != 0) {
-        LOGE("[main] pthread_create h264_sink failed");
-        request_stop();
+    pthread_t th_ctl;
+
+    if (thread_stats_spawn(&th_ctl, "ctl", ctl_thread, NULL) != 0) {
+        LOGE("[main] pthread_create ctl failed");
+        goto fail;
     }
-    if (pthread_create(&th_pcmsink, NULL, pcm_sink_thread, &ta) != 0) {
-        LOGE("[main] pthread_create pcm_sink failed");
+
+    uint64_t t_start = rkav_now_monotonic_us();
+
+    // 阶段线程名（vcap / venc / ...）就是图里的 stage 名，--thread-sched 按它匹配
+    if (sg_start(&g_graph) != 0) {
+        LOGE("[main] pipeline start failed");
         request_stop();
     }
 
-    // join
-    pthread_join(th_vcap, NULL);
-    pthread_join(th_acap, NULL);
-    pthread_join(th_venc, NULL);
-    pthread_join(th_h264sink, NULL);
-    pthread_join(th_pcmsink, NULL);
+    // 源结束后一路关边，sink 读空后退出；停止时所有阶段立即退出
+    sg_join(&g_graph);
+    uint64_t wall_us = rkav_now_monotonic_us() - t_start;
+
+    // aio 写端归 main：图里没有对应的 sink 阶段（--graph）时也要在这里收掉线程和 fd
+    if (g_aio_h264_on) aio_writer_close(&g_aio_h264);
+    if (g_aio_pcm_on) aio_writer_close(&g_aio_pcm);
+
+    if (g_seg_on) {
+        g_seg_on = 0;
+        seg_writer_close(&g_seg);
+    }
+    // 两个发布方都停了：扇出线程写完各自队列里剩下的，封装器再收尾
+    if (g_fan_on) fanout_stop(&g_fan);
+    if (g_mp4_on) {
+        g_mp4_on = 0;
+        if (fmp4_mux_close(&g_mp4) != 0) LOGW("[main] mp4 close failed");
+    }
+    if (g_ts_on) {
+        g_ts_on = 0;
+        if (ts_mux_close(&g_ts) != 0) LOGW("[main] ts close failed");
+        // 写的是普通文件时回读自检一遍（FIFO/UDP 没法回读）
+        struct stat st;
+        if (stat(cfg.output_ts, &st) == 0 && S_ISREG(st.st_mode)) {
+            TsCheckReport tr;
+            if (ts_check_file(cfg.output_ts, &tr) == 0) ts_check_print(cfg.output_ts, &tr);
+        }
+    }
 
-    // 停止后 stats/signal/timer 也收尾
+    // 停止后控制循环也收尾（request_stop 会写 eventfd 唤醒它）
     request_stop();
-    pthread_join(th_stat, NULL);
+    pthread_join(th_ctl, NULL);
+    ctl_loop_deinit(&g_ctl);
+    dvr_ctl_close(dvr_ctl_fd, cfg.dvr_ctl);
+    // 读者连接归控制线程管，它停了再关；读者读完剩下的消息后看到 closed
+    if (g_bus_on) {
+        g_bus_on = 0;
+        shm_bus_close(&g_bus);
+    }
+    // sink 线程已停，tick 打印在控制线程上，也停了再关
+    if (g_fan_on) {
+        g_fan_on = 0;
+        fanout_destroy(&g_fan);
+    }
+    if (g_rtp_on) {
+        g_rtp_on = 0;
+        rtp_sink_close(&g_rtp);
+    }
+    // 采集 / 编码早已停了，控制线程（tick 打印）也停了：收回读者手上的帧再拆池
+    if (g_fx_on) {
+        g_fx_on = 0;
+        frame_export_stop(&g_fx);
+        frame_pool_deinit(&g_fpool);
+    }
+
+    // 触发都来自控制线程，它停了再关：正在保存的事件把环里剩下的写完
+    if (g_dvr_on) {
+        g_dvr_on = 0;
+        dvr_ring_close(&g_dvr);
+    }
 
-    // signal 线程默认会一直阻塞，手动发一个 stop 后它仍在 sigwait：
-    // 这里不强杀：让用户 Ctrl+C 或 kill；但为了让程序能自然退出，我们在 stop 后发送 SIGTERM 给自己
-    pthread_kill(th_sig, SIGTERM);
-    pthread_join(th_sig, NULL);
+    metrics_http_stop(&g_metrics);
 
-    if (cfg.duration_sec > 0) {
-        pthread_join(th_timer, NULL);
+    if (g_span_trace_enabled) {
+        span_trace_write_chrome(cfg.chrome_trace_path);
+        span_trace_stop();
     }
 
-    // 清理队列
-    bq_destroy(&g_raw_vq);
-    bq_destroy(&g_h264_q);
-    bq_destroy(&g_aud_q);
+    if (cfg.report_json) {
+        // 最后一个窗口还没被 stats_tick 取走的延迟样本并进累计
+        for (int i = 0; i < LAT_COUNT; i++) {
+            LatHistSnap snap;
+            lat_hist_take(&g_lat[i], &snap);
+            lat_hist_snap_merge(&g_lat_total[i], &snap);
+        }
+        const char *streams[LAT_COUNT];
+        for (int i = 0; i < LAT_COUNT; i++) streams[i] = i < LAT_A_PUSH ? "video" : "audio";
+
+        RunReport rr = {
+            .cfg = &cfg,
+            .wall_us = wall_us,
+            .video_generated = g_synth_video_frames,
+            .stats = &g_stats,
+            .lat = g_lat_total,
+            .lat_names = g_lat_names,
+            .lat_streams = streams,
+            .n_lat = LAT_COUNT,
+        };
+        run_report_write_file(cfg.report_json, &rr);
+    }
+
+    // 清理队列（停止时边里剩下的条目在这里放掉）
+    sg_destroy(&g_graph);
 
     avsync_deinit(&g_avsync);
-    LOGI("[main] done. video=%s audio=%s", cfg.output_path_h264, cfg.output_path_pcm);
+    evtrace_close(&g_trace);
+    LOGI("[main] done. video=%s audio=%s log_dropped=%llu",
+         cfg.output_path_h264, cfg.output_path_pcm,
+         (unsigned long long)log_dropped_count());
+    log_async_stop();
     return 0;
+
+fail:
+    // 启动失败：阶段线程都还没起，按正常收尾的顺序放掉已经打开的
+    if (ctl_on) ctl_loop_deinit(&g_ctl);
+    dvr_ctl_close(dvr_ctl_fd, cfg.dvr_ctl);
+    metrics_http_stop(&g_metrics);
+    if (g_fx_on) {
+        g_fx_on = 0;
+        frame_export_stop(&g_fx);
+        frame_pool_deinit(&g_fpool);
+    }
+    if (g_bus_on) {
+        g_bus_on = 0;
+        shm_bus_close(&g_bus);
+    }
+    if (g_fan_on) {
+        g_fan_on = 0;
+        fanout_stop(&g_fan);
+        fanout_destroy(&g_fan);
+    }
+    if (g_mp4_on) {
+        g_mp4_on = 0;
+        fmp4_mux_close(&g_mp4);
+    }
+    if (g_ts_on) {
+        g_ts_on = 0;
+        ts_mux_close(&g_ts);
+    }
+    if (g_rtp_on) {
+        g_rtp_on = 0;
+        rtp_sink_close(&g_rtp);
+    }
+    if (g_dvr_on) {
+        g_dvr_on = 0;
+        dvr_ring_close(&g_dvr);
+    }
+    if (g_seg_on) {
+        g_seg_on = 0;
+        seg_writer_close(&g_seg);
+    }
+    if (g_aio_h264_on) aio_writer_close(&g_aio_h264);
+    if (g_aio_pcm_on) aio_writer_close(&g_aio_pcm);
+    if (g_span_trace_enabled) span_trace_stop();
+    sg_destroy(&g_graph);
+    avsync_deinit(&g_avsync);
+    evtrace_close(&g_trace);
+    log_async_stop();
+    return -1;
 }
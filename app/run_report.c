@@ -0,0 +1,135 @@
+#include "run_report.h"
+#include "thread_stats.h"
+#include "lib/utils/log.h"
+
+#include <string.h>
+#include <sys/resource.h>
+
+static void put_lat(FILE *fp, const LatHistSnap *s)
+{
+    if (s->count == 0) {
+        fprintf(fp, "{\"count\":0}");
+        return;
+    }
+    fprintf(fp, "{\"count\":%llu,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+            (unsigned long long)s->count,
+            lat_hist_percentile_us(s, 0.50) / 1000.0,
+            lat_hist_percentile_us(s, 0.95) / 1000.0,
+            lat_hist_percentile_us(s, 0.99) / 1000.0,
+            (double)s->max_us / 1000.0);
+}
+
+static void put_lat_stream(FILE *fp, const RunReport *r, const char *stream)
+{
+    int first = 1;
+    fprintf(fp, "\"%s\":{", stream);
+    for (int i = 0; i < r->n_lat; i++) {
+        if (strcmp(r->lat_streams[i], stream) != 0) continue;
+        fprintf(fp, "%s\"%s\":", first ? "" : ",", r->lat_names[i]);
+        put_lat(fp, &r->lat[i]);
+        first = 0;
+    }
+    fprintf(fp, "}");
+}
+
+int run_report_write_json(FILE *fp, const RunReport *r)
+{
+    if (!fp || !r || !r->cfg || !r->stats) return -1;
+
+    const AppConfig *cfg = r->cfg;
+    AvStats *st = r->stats;
+    double wall_s = (double)r->wall_us / 1e6;
+
+    // 当前累计（含最后一个未 tick 的窗口）
+    uint64_t frames = counter_sum(st->video_frames);
+    uint64_t bytes  = counter_sum(st->enc_bytes);
+    uint64_t achk   = counter_sum(st->audio_chunks);
+    uint64_t drops  = 0;
+    for (int s = 0; s < AV_STREAM_COUNT; s++) {
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            drops += av_stats_drop_total(st, (AvStream)s, (AvDropCause)c);
+        }
+    }
+
+    double fps = wall_s > 0 ? (double)frames / wall_s : 0.0;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"mode\":\"%s\",\n", cfg->synthetic ? "synthetic" : "device");
+    fprintf(fp, "  \"config\":{\"width\":%d,\"height\":%d,\"fps\":%d,\"bitrate\":%d,"
+                "\"sample_rate\":%u,\"channels\":%u,\"duration_sec\":%u,"
+                "\"speed\":%.3f,\"enc_cost_ns_per_px\":%u},\n",
+            cfg->width, cfg->height, cfg->fps, cfg->bitrate,
+            cfg->sample_rate, cfg->channels, cfg->duration_sec,
+            cfg->synthetic ? cfg->synth_speed : 1.0,
+            cfg->synthetic ? cfg->enc_cost_ns_per_px : 0);
+    fprintf(fp, "  \"wall_sec\":%.3f,\n", wall_s);
+    fprintf(fp, "  \"video\":{\"generated\":%llu,\"encoded\":%llu,\"sustained_fps\":%.2f,"
+                "\"realtime_factor\":%.3f,\"encoded_bytes\":%llu,\"bitrate_kbps\":%.1f},\n",
+            (unsigned long long)r->video_generated, (unsigned long long)frames, fps,
+            cfg->fps > 0 ? fps / cfg->fps : 0.0,
+            (unsigned long long)bytes,
+            wall_s > 0 ? (double)bytes * 8.0 / 1000.0 / wall_s : 0.0);
+    fprintf(fp, "  \"audio\":{\"chunks\":%llu},\n", (unsigned long long)achk);
+    fprintf(fp, "  \"drops\":{\"total\":%llu,\"by_cause\":{", (unsigned long long)drops);
+    for (int s = 0, first_s = 1; s < AV_STREAM_COUNT; s++) {
+        int first_c = 1;
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            uint64_t n = av_stats_drop_total(st, (AvStream)s, (AvDropCause)c);
+            if (!n) continue;
+            if (first_c) {
+                fprintf(fp, "%s\"%s\":{", first_s ? "" : ",", av_stream_name((AvStream)s));
+                first_s = 0;
+            }
+            fprintf(fp, "%s\"%s\":%llu", first_c ? "" : ",",
+                    av_drop_cause_name((AvDropCause)c), (unsigned long long)n);
+            first_c = 0;
+        }
+        if (!first_c) fprintf(fp, "}");
+    }
+    fprintf(fp, "}},\n");
+
+    fprintf(fp, "  \"latency_ms\":{");
+    put_lat_stream(fp, r, "video");
+    fprintf(fp, ",");
+    put_lat_stream(fp, r, "audio");
+    fprintf(fp, "},\n");
+
+    ThreadStatSample ts[THREAD_STATS_MAX];
+    size_t nts = thread_stats_snapshot(ts, THREAD_STATS_MAX);
+    fprintf(fp, "  \"threads\":[");
+    for (size_t i = 0; i < nts; i++) {
+        fprintf(fp, "%s\n    {\"name\":\"%s\",\"cpu_sec\":%.3f,\"cpu_pct\":%.1f,"
+                    "\"vol_cs\":%llu,\"invol_cs\":%llu,\"min_flt\":%llu,\"maj_flt\":%llu}",
+                i ? "," : "", ts[i].name, ts[i].cpu_sec,
+                wall_s > 0 ? ts[i].cpu_sec * 100.0 / wall_s : 0.0,
+                (unsigned long long)ts[i].vol_cs, (unsigned long long)ts[i].invol_cs,
+                (unsigned long long)ts[i].min_flt, (unsigned long long)ts[i].maj_flt);
+    }
+    fprintf(fp, "\n  ],\n");
+
+    struct rusage ru;
+    long rss_kb = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : -1;
+    fprintf(fp, "  \"peak_rss_kb\":%ld\n", rss_kb);
+    fprintf(fp, "}\n");
+    return 0;
+}
+
+int run_report_write_file(const char *path, const RunReport *r)
+{
+    if (!path) return -1;
+    if (strcmp(path, "-") == 0) {
+        int ret = run_report_write_json(stdout, r);
+        fflush(stdout);
+        return ret;
+    }
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOGE("[report] open %s failed", path);
+        return -1;
+    }
+    int ret = run_report_write_json(fp, r);
+    fclose(fp);
+    if (ret == 0) LOGI("[report] written: %s", path);
+    return ret;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "app_config.h"
+#include "av_stats.h"
+#include "lat_hist.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*
+ * 一次运行结束时的汇总报告（JSON），主要给 --synthetic 压测做回归对比：
+ * 吞吐、丢帧、各阶段延迟百分位、每线程 CPU、峰值 RSS。
+ */
+typedef struct {
+    const AppConfig   *cfg;
+    uint64_t           wall_us;
+    uint64_t           video_generated;  // 合成源产出帧数（真实采集为 0）
+
+    AvStats           *stats;            // 只读
+
+    const LatHistSnap *lat;              // [n_lat]
+    const char *const *lat_names;
+    const char *const *lat_streams;      // "video" / "audio"
+    int                n_lat;
+} RunReport;
+
+int run_report_write_json(FILE *fp, const RunReport *r);
+
+/* path 为 "-" 时写 stdout */
+int run_report_write_file(const char *path, const RunReport *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1009 @@
+/*
+ * rkav_bench：热点原语的微基准。
+ *
+ * - 每个 case 分批执行（batch 内连续调用），按批记录 ns/op，报告 mean/p50/p95/p99
+ * - 多次重复取全部批次的分布，首轮 warmup 不计
+ * - --json 输出机器可读结果；--baseline 读取旧结果逐项对比 p50，超过阈值记为回归（退出码 2）
+ * - 不依赖 MPP/ALSA，主机上：make bench CC=gcc SYSROOT=/
+ */
+#include "rkav/bqueue.h"
+#include "rkav/time.h"
+#include "lib/media/sync/avsync.h"
+#include "lib/utils/log.h"
+#include "lib/core/span_trace.h"
+#include "lib/core/counters.h"
+#include "lib/media/buffer/spill_queue.h"
+#include "lib/media/graph/stage_graph.h"
+#include "plugins/shm_bus/shm_bus.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SAMPLES 4096
+#define MAX_CASES   32
+
+typedef struct {
+    const char *filter;
+    const char *json_path;
+    const char *baseline_path;
+    double      threshold_pct;
+    int         quick;
+    int         list;
+} BenchOpts;
+
+typedef struct {
+    char     name[48];
+    uint64_t ops;
+    double   mean_ns;
+    double   p50_ns;
+    double   p95_ns;
+    double   p99_ns;
+    double   extra;        // case 自定义（如 GB/s、丢弃率），NaN 表示无
+    const char *extra_name;
+} BenchResult;
+
+/*
+ * 一个 case：run(ctx, n) 执行 n 次操作，返回实际计入的操作数；
+ * self_timed 的 case 需要在批内做不计时的准备/收尾，run 自己计时并返回耗时（ns）。
+ */
+typedef struct {
+    const char *name;
+    uint64_t  (*run)(void *ctx, uint64_t n);
+    int       (*setup)(void **ctx);
+    void      (*teardown)(void *ctx, BenchResult *r);
+    uint64_t    batch;     // 每批操作数
+    uint64_t    batches;   // 每轮批数
+    int         self_timed;
+} BenchCase;
+
+static BenchResult g_results[MAX_CASES];
+static int         g_n_results;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct_sorted(const double *v, size_t n, double q)
+{
+    if (n == 0) return 0.0;
+    size_t rank = (size_t)ceil(q * (double)n);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return v[rank - 1];
+}
+
+/* stderr 临时指到 /dev/null（日志类 case 不刷屏），返回旧 fd */
+static int mute_stderr(void)
+{
+    int saved = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+    return saved;
+}
+
+static void restore_stderr(int saved)
+{
+    if (saved < 0) return;
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+}
+
+/* ---------------- time ---------------- */
+
+static uint64_t run_now_us(void *ctx, uint64_t n)
+{
+    (void)ctx;
+    volatile uint64_t sink = 0;
+    for (uint64_t i = 0; i < n; i++) sink += rkav_now_monotonic_us();
+    (void)sink;
+    return n;
+}
+
+/* ---------------- bqueue ---------------- */
+
+/*
+ * 流水线里的边已经都换成 SpillQueue / 阶段图了，BQueue 只剩这里在用。留着它当基线：
+ * spq 不开溢写时就是同一个互斥锁 + 条件变量的环，spq/ram_push_pop_256 每条的开销应该和
+ * bq/push_pop_same_thread 在同一量级，拉开了说明溢写判断 / 统计在 RAM 路径上变贵了。
+ */
+
+typedef struct {
+    BQueue   q;
+    int      producers;
+    uint64_t per_producer;
+    pthread_t th[8];
+    pthread_t consumer;
+    atomic_uint_fast64_t consumed;
+} BqCtx;
+
+static uint64_t run_bq_same_thread(void *ctx, uint64_t n)
+{
+    BqCtx *c = (BqCtx *)ctx;
+    void *item;
+    for (uint64_t i = 0; i < n; i++) {
+        bq_push(&c->q, (void *)(uintptr_t)(i + 1));
+        bq_pop(&c->q, &item);
+    }
+    return n;
+}
+
+static void *bq_producer(void *arg)
+{
+    BqCtx *c = (BqCtx *)arg;
+    for (uint64_t i = 0; i < c->per_producer; i++) {
+        if (bq_push(&c->q, (void *)(uintptr_t)(i + 1)) != 0) break;
+    }
+    return NULL;
+}
+
+static void *bq_consumer(void *arg)
+{
+    BqCtx *c = (BqCtx *)arg;
+    uint64_t want = c->per_producer * (uint64_t)c->producers;
+    void *item;
+    for (uint64_t i = 0; i < want; i++) {
+        if (bq_pop(&c->q, &item) != 1) break;
+    }
+    atomic_fetch_add(&c->consumed, want);
+    return NULL;
+}
+
+/* 一批 = 启动 producers + 1 consumer 传完 n 个元素；计入线程创建开销，batch 取大 */
+static uint64_t run_bq_threads(void *ctx, uint64_t n)
+{
+    BqCtx *c = (BqCtx *)ctx;
+    c->per_producer = n / (uint64_t)c->producers;
+    pthread_create(&c->consumer, NULL, bq_consumer, c);
+    for (int i = 0; i < c->producers; i++) pthread_create(&c->th[i], NULL, bq_producer, c);
+    for (int i = 0; i < c->producers; i++) pthread_join(c->th[i], NULL);
+    pthread_join(c->consumer, NULL);
+    return c->per_producer * (uint64_t)c->producers;
+}
+
+static int setup_bq_common(void **ctx, int producers, size_t cap)
+{
+    BqCtx *c = calloc(1, sizeof(*c));
+    if (!c || bq_init(&c->q, cap) != 0) {
+        free(c);
+        return -1;
+    }
+    c->producers = producers;
+    *ctx = c;
+    return 0;
+}
+
+static int setup_bq_1p(void **ctx) { return setup_bq_common(ctx, 1, 64); }
+static int setup_bq_4p(void **ctx) { return setup_bq_common(ctx, 4, 64); }
+
+static void teardown_bq(void *ctx, BenchResult *r)
+{
+    (void)r;
+    BqCtx *c = (BqCtx *)ctx;
+    bq_destroy(&c->q);
+    free(c);
+}
+
+/* ---------------- spill queue ---------------- */
+
+/*
+ * 同一线程先连推 n 条再连取 n 条（和边上的突发一致）：
+ *   ram   = 不开溢写，内存窗口 >= n，只有锁 + 环
+ *   spill = 内存窗口 16 条，其余都序列化进 /tmp 的暂存文件再读回（每条 1 KiB，含两次拷贝）
+ * 条目是一块固定的 1 KiB 负载，load 读回到一块固定缓冲，不计 malloc/free。
+ */
+#define SPQ_ITEM_BYTES 1024
+#define SPQ_BATCH      256
+
+static uint8_t g_spq_item[SPQ_ITEM_BYTES];
+static uint8_t g_spq_loaded[SPQ_ITEM_BYTES];
+
+static size_t spq_item_bytes(const void *item) { (void)item; return SPQ_ITEM_BYTES; }
+static void spq_item_store(const void *item, uint8_t *dst) { memcpy(dst, item, SPQ_ITEM_BYTES); }
+static void spq_item_release(void *item) { (void)item; }
+
+static void *spq_item_load(const uint8_t *src, size_t len)
+{
+    memcpy(g_spq_loaded, src, len);
+    return g_spq_loaded;
+}
+
+static const SpillOps g_spq_ops = {
+    spq_item_bytes, spq_item_store, spq_item_load, spq_item_release,
+};
+
+typedef struct {
+    SpillQueue q;
+    uint64_t   pushed;     // 含 warmup，spill_pct 的分母
+    int        muted;
+} SpqCtx;
+
+static int setup_spq(void **ctx, size_t cap, const char *spill_dir)
+{
+    SpqCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->muted = mute_stderr();  // 建暂存文件 / destroy 时的汇总日志
+    if (spq_init(&c->q, "bench", cap, spill_dir, spill_dir ? 4u << 20 : 0, &g_spq_ops) != 0) {
+        restore_stderr(c->muted);
+        free(c);
+        return -1;
+    }
+    memset(g_spq_item, 0x5a, sizeof(g_spq_item));
+    *ctx = c;
+    return 0;
+}
+
+static int setup_spq_ram(void **ctx)   { return setup_spq(ctx, SPQ_BATCH, NULL); }
+static int setup_spq_spill(void **ctx) { return setup_spq(ctx, 16, "/tmp"); }
+
+static uint64_t run_spq(void *ctx, uint64_t n)
+{
+    SpqCtx *c = (SpqCtx *)ctx;
+    void *item;
+    for (uint64_t i = 0; i < n; i++) spq_push(&c->q, g_spq_item);
+    for (uint64_t i = 0; i < n; i++) spq_pop(&c->q, &item);
+    c->pushed += n;
+    return n;
+}
+
+static void teardown_spq(void *ctx, BenchResult *r)
+{
+    SpqCtx *c = (SpqCtx *)ctx;
+    if (c->q.map) {
+        r->extra = c->pushed ? (double)c->q.spilled_items * 100.0 / (double)c->pushed : 0.0;
+        r->extra_name = "spill_pct";
+    }
+    spq_destroy(&c->q);
+    restore_stderr(c->muted);
+    free(c);
+}
+
+/* ---------------- stage graph ---------------- */
+
+/*
+ * sg_emit 一出三（同一个输出端口接三条边，像 venc 的 h264 接 sink / mp4 / rtp）：
+ * 每次 = 两次 ref + 三次入队 + 三次唤醒下游。图不 start，下游不跑，
+ * 批后不计时地把三条边读空；条目预先分配好，也不计。
+ */
+#define SG_FAN_BATCH 256
+
+typedef struct {
+    atomic_int refs;
+} SgItem;
+
+static void sg_item_ref(void *item) { atomic_fetch_add(&((SgItem *)item)->refs, 1); }
+
+static void sg_item_unref(void *item)
+{
+    SgItem *it = (SgItem *)item;
+    if (atomic_fetch_sub(&it->refs, 1) == 1) free(it);
+}
+
+static void sg_bench_run(SgStage *st) { (void)st; }
+static void sg_bench_process(SgStage *st, int port, void *item) { (void)st; (void)port; sg_item_unref(item); }
+
+typedef struct {
+    SgGraph  g;
+    SgItem  *items[SG_FAN_BATCH];
+    int      muted;
+} SgCtx;
+
+static int setup_sg_fanout(void **ctx)
+{
+    static const SgPortType type = { "item", sg_item_unref, sg_item_ref, NULL, NULL };
+    static const SgStageClass src = { "src", { NULL }, { "item", NULL }, -1, NULL, sg_bench_run, NULL, NULL };
+    static const SgStageClass dst = { "dst", { "item", NULL }, { NULL }, -1, NULL, NULL, sg_bench_process, NULL };
+
+    SgCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->muted = mute_stderr();
+    sg_init(&c->g, NULL, NULL, 0, 1);
+    if (sg_register_type(&c->g, &type) != 0 || sg_register_class(&c->g, &src) != 0 ||
+        sg_register_class(&c->g, &dst) != 0 ||
+        sg_build(&c->g, "stage src src thread; stage a dst thread; stage b dst thread; stage c dst thread;"
+                        "edge src -> a cap=256; edge src -> b cap=256; edge src -> c cap=256") != 0) {
+        sg_destroy(&c->g);
+        restore_stderr(c->muted);
+        free(c);
+        return -1;
+    }
+    *ctx = c;
+    return 0;
+}
+
+static uint64_t run_sg_fanout(void *ctx, uint64_t n)
+{
+    SgCtx *c = (SgCtx *)ctx;
+    SgStage *st = &c->g.stages[0];
+    if (n > SG_FAN_BATCH) n = SG_FAN_BATCH;
+    for (uint64_t i = 0; i < n; i++) {
+        c->items[i] = malloc(sizeof(SgItem));
+        atomic_init(&c->items[i]->refs, 1);
+    }
+
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < n; i++) sg_emit(st, 0, c->items[i]);
+    uint64_t spent = now_ns() - t0;
+
+    for (int k = 0; k < st->n_out; k++) {
+        void *item;
+        while (spq_try_pop(&st->out[k]->q, &item) == 1) sg_item_unref(item);
+    }
+    return spent;
+}
+
+static void teardown_sg(void *ctx, BenchResult *r)
+{
+    (void)r;
+    SgCtx *c = (SgCtx *)ctx;
+    sg_stop(&c->g);
+    sg_destroy(&c->g);
+    restore_stderr(c->muted);
+    free(c);
+}
+
+/* ---------------- avsync ---------------- */
+
+typedef struct {
+    AvSync   s;
+    uint64_t vpts;
+    uint64_t apts;
+    uint64_t t_us;
+    uint64_t v_step;
+    uint64_t a_step;
+    int      v_per_win;   // 每个窗口视频/音频事件数（report case 用）
+    int      a_per_win;
+    int      muted;
+} AvCtx;
+
+static int setup_av(void **ctx, uint64_t v_step, uint64_t a_step, int v_per_win, int a_per_win)
+{
+    AvCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    if (avsync_init(&c->s, 30) != 0) {
+        free(c);
+        return -1;
+    }
+    c->vpts = c->t_us = 1000000;
+    c->apts = 1000000 + 40000;
+    c->v_step = v_step;
+    c->a_step = a_step;
+    c->v_per_win = v_per_win;
+    c->a_per_win = a_per_win;
+    c->muted = mute_stderr();  // offset 锁定等日志
+    *ctx = c;
+    return 0;
+}
+
+static int setup_av_rt(void **ctx)      { return setup_av(ctx, 33333, 20000, 30, 50); }
+static int setup_av_extreme(void **ctx) { return setup_av(ctx, 1000, 1000, 1000, 1000); }
+
+static void teardown_av(void *ctx, BenchResult *r)
+{
+    (void)r;
+    AvCtx *c = (AvCtx *)ctx;
+    restore_stderr(c->muted);
+    avsync_deinit(&c->s);
+    free(c);
+}
+
+static uint64_t run_av_video(void *ctx, uint64_t n)
+{
+    AvCtx *c = (AvCtx *)ctx;
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < n; i++) {
+        c->vpts += c->v_step;
+        c->t_us += c->v_step;
+        avsync_on_video_at(&c->s, c->vpts, c->t_us + (i & 7));
+    }
+    uint64_t spent = now_ns() - t0;
+
+    // 一批 = 一个窗口，不计时地清一次样本，和线上每秒 report 的节奏一致
+    AvSyncReport rep;
+    avsync_report(&c->s, c->t_us, &rep);
+    return spent;
+}
+
+static uint64_t run_av_audio(void *ctx, uint64_t n)
+{
+    AvCtx *c = (AvCtx *)ctx;
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < n; i++) {
+        c->apts += c->a_step;
+        c->t_us += c->a_step;
+        avsync_on_audio_at(&c->s, c->apts, (uint32_t)(c->a_step * 48 / 1000), 48000,
+                           c->t_us + (i & 3));
+    }
+    uint64_t spent = now_ns() - t0;
+
+    AvSyncReport rep;
+    avsync_report(&c->s, c->t_us, &rep);
+    return spent;
+}
+
+/* 只计 report_1s 本身（含格式化日志，输出到 /dev/null）；每次前先灌满一个窗口 */
+static uint64_t run_av_report(void *ctx, uint64_t n)
+{
+    AvCtx *c = (AvCtx *)ctx;
+    uint64_t spent = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        for (int k = 0; k < c->v_per_win; k++) {
+            c->vpts += c->v_step;
+            avsync_on_video_at(&c->s, c->vpts, c->vpts + (uint64_t)(k & 7));
+        }
+        for (int k = 0; k < c->a_per_win; k++) {
+            c->apts += c->a_step;
+            avsync_on_audio_at(&c->s, c->apts, (uint32_t)(c->a_step * 48 / 1000), 48000,
+                               c->apts + (uint64_t)(k & 3));
+        }
+        uint64_t t0 = now_ns();
+        avsync_report_1s(&c->s, c->vpts);
+        spent += now_ns() - t0;
+    }
+    return spent;
+}
+
+/* ---------------- NV12 合帧（同 v4l2_capture_dqbuf：Y/UV 两个 plane 拷成连续帧） ---------------- */
+
+typedef struct {
+    int      w, h;
+    uint8_t *y;
+    uint8_t *uv;
+    uint8_t *dst;
+} Nv12Ctx;
+
+static int setup_nv12(void **ctx, int w, int h)
+{
+    Nv12Ctx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->w = w;
+    c->h = h;
+    c->y = malloc((size_t)w * h);
+    c->uv = malloc((size_t)w * h / 2);
+    c->dst = malloc((size_t)w * h * 3 / 2);
+    if (!c->y || !c->uv || !c->dst) {
+        free(c->y); free(c->uv); free(c->dst); free(c);
+        return -1;
+    }
+    memset(c->y, 0x10, (size_t)w * h);
+    memset(c->uv, 0x80, (size_t)w * h / 2);
+    memset(c->dst, 0, (size_t)w * h * 3 / 2);
+    *ctx = c;
+    return 0;
+}
+
+static int setup_nv12_720p(void **ctx)  { return setup_nv12(ctx, 1280, 720); }
+static int setup_nv12_1080p(void **ctx) { return setup_nv12(ctx, 1920, 1080); }
+
+static uint64_t run_nv12(void *ctx, uint64_t n)
+{
+    Nv12Ctx *c = (Nv12Ctx *)ctx;
+    size_t y_size = (size_t)c->w * c->h;
+    for (uint64_t i = 0; i < n; i++) {
+        memcpy(c->dst, c->y, y_size);
+        memcpy(c->dst + y_size, c->uv, y_size / 2);
+        __asm__ __volatile__("" ::: "memory");
+    }
+    return n;
+}
+
+static void teardown_nv12(void *ctx, BenchResult *r)
+{
+    Nv12Ctx *c = (Nv12Ctx *)ctx;
+    double bytes = (double)c->w * c->h * 3 / 2;
+    r->extra = r->p50_ns > 0 ? bytes / r->p50_ns : NAN;  // bytes/ns == GB/s
+    r->extra_name = "gbps";
+    free(c->y); free(c->uv); free(c->dst); free(c);
+}
+
+/* ---------------- log ---------------- */
+
+typedef struct {
+    int saved;
+    int async;
+    uint64_t dropped0;
+} LogCtx;
+
+static int setup_log(void **ctx, int async, int level)
+{
+    LogCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->saved = mute_stderr();
+    c->async = async;
+    log_set_level(level);
+    if (async && log_async_start(4096) != 0) {
+        restore_stderr(c->saved);
+        free(c);
+        return -1;
+    }
+    c->dropped0 = log_dropped_count();
+    *ctx = c;
+    return 0;
+}
+
+static int setup_log_sync(void **ctx)     { return setup_log(ctx, 0, LOG_LEVEL_INFO); }
+static int setup_log_async(void **ctx)    { return setup_log(ctx, 1, LOG_LEVEL_INFO); }
+static int setup_log_filtered(void **ctx) { return setup_log(ctx, 0, LOG_LEVEL_ERROR); }
+
+static uint64_t run_log(void *ctx, uint64_t n)
+{
+    (void)ctx;
+    for (uint64_t i = 0; i < n; i++) {
+        LOGI("[bench] frame=%llu pts=%llu size=%d", (unsigned long long)i,
+             (unsigned long long)(i * 33333), 12345);
+    }
+    return n;
+}
+
+static void teardown_log(void *ctx, BenchResult *r)
+{
+    LogCtx *c = (LogCtx *)ctx;
+    if (c->async) {
+        uint64_t dropped = log_dropped_count() - c->dropped0;
+        log_async_stop();
+        r->extra = r->ops ? (double)dropped * 100.0 / (double)r->ops : 0.0;
+        r->extra_name = "drop_pct";
+    }
+    log_set_level(LOG_LEVEL_INFO);
+    restore_stderr(c->saved);
+    free(c);
+}
+
+/* ---------------- span ---------------- */
+
+/* 关闭时应只剩一次读全局 + 预测命中的分支；开启时是两次 clock_gettime + 一次 ring 写 */
+static int setup_span(void **ctx, int on)
+{
+    int *saved = malloc(sizeof(int));
+    if (!saved) return -1;
+    *saved = mute_stderr();
+    if (on && span_trace_start(4096) != 0) {
+        restore_stderr(*saved);
+        free(saved);
+        return -1;
+    }
+    *ctx = saved;
+    return 0;
+}
+
+static int setup_span_off(void **ctx) { return setup_span(ctx, 0); }
+static int setup_span_on(void **ctx)  { return setup_span(ctx, 1); }
+
+static uint64_t run_span(void *ctx, uint64_t n)
+{
+    (void)ctx;
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t sp = span_begin();
+        __asm__ __volatile__("" ::: "memory");
+        span_end_arg(SPAN_V_WRITE, sp, (uint32_t)i);
+    }
+    return n;
+}
+
+static void teardown_span(void *ctx, BenchResult *r)
+{
+    (void)r;
+    int *saved = (int *)ctx;
+    span_trace_stop();
+    restore_stderr(*saved);
+    free(saved);
+}
+
+/* ---------------- counters ---------------- */
+
+/*
+ * 4 个线程各加各的计数器（对应采集/编码/sink 各自计数）：
+ *   shared  = 旧 AvStats 布局，四个 atomic 挤在一条 cache line，atomic_fetch_add
+ *   sharded = counters 注册表，每线程私有分片
+ */
+#define CNT_THREADS 4
+
+typedef struct {
+    atomic_uint_fast64_t shared[CNT_THREADS];
+    CounterId            ids[CNT_THREADS];
+    int                  sharded;
+    uint64_t             per_thread;
+    pthread_t            th[CNT_THREADS];
+} CntCtx;
+
+typedef struct {
+    CntCtx *c;
+    int     idx;
+} CntArg;
+
+static void *cnt_worker(void *arg)
+{
+    CntArg *a = (CntArg *)arg;
+    CntCtx *c = a->c;
+    if (c->sharded) {
+        CounterId id = c->ids[a->idx];
+        for (uint64_t i = 0; i < c->per_thread; i++) counter_inc(id);
+    } else {
+        atomic_uint_fast64_t *p = &c->shared[a->idx];
+        for (uint64_t i = 0; i < c->per_thread; i++) {
+            atomic_fetch_add_explicit(p, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+static uint64_t run_cnt(void *ctx, uint64_t n)
+{
+    CntCtx *c = (CntCtx *)ctx;
+    CntArg args[CNT_THREADS];
+    c->per_thread = n / CNT_THREADS;
+    for (int i = 0; i < CNT_THREADS; i++) {
+        args[i].c = c;
+        args[i].idx = i;
+        pthread_create(&c->th[i], NULL, cnt_worker, &args[i]);
+    }
+    for (int i = 0; i < CNT_THREADS; i++) pthread_join(c->th[i], NULL);
+    return c->per_thread * CNT_THREADS;
+}
+
+static int setup_cnt(void **ctx, int sharded)
+{
+    CntCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->sharded = sharded;
+    for (int i = 0; i < CNT_THREADS; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "bench.cnt%d", i);
+        c->ids[i] = counter_register(name);
+        if (c->ids[i] < 0) {
+            free(c);
+            return -1;
+        }
+    }
+    *ctx = c;
+    return 0;
+}
+
+static int setup_cnt_shared(void **ctx)  { return setup_cnt(ctx, 0); }
+static int setup_cnt_sharded(void **ctx) { return setup_cnt(ctx, 1); }
+
+static void teardown_cnt(void *ctx, BenchResult *r)
+{
+    (void)r;
+    free(ctx);
+}
+
+/* ---------------- shm bus ---------------- */
+
+/*
+ * 共享内存总线发布：4 KiB 消息连续发，0/1/2/4/8 个读者线程各自只读映射跟读（futex 等待）。
+ * ns/op = 单次发布耗时（含 FUTEX_WAKE），随读者数的变化就是扇出代价；
+ * 读者跟不上就 overrun，lost_pct = 读者没拿到的消息占比，生产者不受影响。
+ */
+#define BUS_MAX_READERS 8
+#define BUS_MSG_BYTES   4096
+
+typedef struct {
+    ShmBus               bus;
+    int                  readers;
+    pthread_t            th[BUS_MAX_READERS];
+    atomic_int           stop;
+    atomic_uint_fast64_t got;
+    atomic_uint_fast64_t lost;
+    uint64_t             published;
+    uint8_t              payload[BUS_MSG_BYTES];
+    int                  muted;
+} BusCtx;
+
+static void *bus_reader(void *arg)
+{
+    BusCtx *c = (BusCtx *)arg;
+    ShmBusReader r;
+    if (shm_bus_reader_attach(&r, dup(c->bus.ro_fd)) != 0) return NULL;
+    uint64_t got = 0;
+    while (!atomic_load(&c->stop)) {
+        ShmBusMsg m;
+        int rc = shm_bus_next(&r, &m, 10);
+        if (rc < 0) break;
+        if (rc == 0) continue;
+        volatile uint8_t touch = m.data[0] ^ m.data[m.len - 1];
+        (void)touch;
+        if (shm_bus_msg_valid(&r, &m)) got++;
+    }
+    atomic_fetch_add(&c->got, got);
+    atomic_fetch_add(&c->lost, r.lost);
+    shm_bus_reader_close(&r);
+    return NULL;
+}
+
+static uint64_t run_bus(void *ctx, uint64_t n)
+{
+    BusCtx *c = (BusCtx *)ctx;
+    for (uint64_t i = 0; i < n; i++) {
+        shm_bus_publish(&c->bus, SHM_BUS_VIDEO, c->payload, sizeof(c->payload), c->published + i, 0, 0);
+    }
+    c->published += n;
+    return n;
+}
+
+static int setup_bus(void **ctx, int readers)
+{
+    BusCtx *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+    c->muted = mute_stderr();
+    if (shm_bus_open(&c->bus, NULL, 4u << 20, 1024, NULL) != 0) {
+        restore_stderr(c->muted);
+        free(c);
+        return -1;
+    }
+    memset(c->payload, 0x5a, sizeof(c->payload));
+    c->readers = readers;
+    for (int i = 0; i < readers; i++) pthread_create(&c->th[i], NULL, bus_reader, c);
+    *ctx = c;
+    return 0;
+}
+
+static int setup_bus_0r(void **ctx) { return setup_bus(ctx, 0); }
+static int setup_bus_1r(void **ctx) { return setup_bus(ctx, 1); }
+static int setup_bus_2r(void **ctx) { return setup_bus(ctx, 2); }
+static int setup_bus_4r(void **ctx) { return setup_bus(ctx, 4); }
+static int setup_bus_8r(void **ctx) { return setup_bus(ctx, 8); }
+
+static void teardown_bus(void *ctx, BenchResult *r)
+{
+    BusCtx *c = (BusCtx *)ctx;
+    atomic_store(&c->stop, 1);
+    shm_bus_close(&c->bus);   // closed + 唤醒，睡着的读者立刻返回
+    for (int i = 0; i < c->readers; i++) pthread_join(c->th[i], NULL);
+    restore_stderr(c->muted);
+    if (c->readers) {
+        uint64_t want = c->published * (uint64_t)c->readers;
+        uint64_t got = atomic_load(&c->got);
+        r->extra = want ? (double)(want > got ? want - got : 0) * 100.0 / (double)want : 0.0;
+        r->extra_name = "lost_pct";
+    }
+    free(c);
+}
+
+/* ---------------- 注册表 ---------------- */
+
+static const BenchCase g_cases[] = {
+    { "time/now_monotonic_us",   run_now_us,        NULL,               NULL,          1024,  256, 0 },
+    { "bq/push_pop_same_thread", run_bq_same_thread, setup_bq_1p,       teardown_bq,   1024,  256, 0 },
+    { "bq/1p1c",                 run_bq_threads,    setup_bq_1p,        teardown_bq,   65536, 24, 0 },
+    { "bq/4p1c",                 run_bq_threads,    setup_bq_4p,        teardown_bq,   65536, 24, 0 },
+    { "spq/ram_push_pop_256",    run_spq,           setup_spq_ram,      teardown_spq,  SPQ_BATCH, 256, 0 },
+    { "spq/spill_push_pop_256",  run_spq,           setup_spq_spill,    teardown_spq,  SPQ_BATCH, 128, 0 },
+    { "graph/emit_fanout_3",     run_sg_fanout,     setup_sg_fanout,    teardown_sg,   SG_FAN_BATCH, 256, 1 },
+    { "avsync/on_video_30fps",   run_av_video,      setup_av_rt,        teardown_av,   30,    512, 1 },
+    { "avsync/on_audio_50cps",   run_av_audio,      setup_av_rt,        teardown_av,   50,    512, 1 },
+    { "avsync/on_video_1khz",    run_av_video,      setup_av_extreme,   teardown_av,   1000,  64,  1 },
+    { "avsync/report_1s_rt",     run_av_report,     setup_av_rt,        teardown_av,   1,     512, 1 },
+    { "avsync/report_1s_1khz",   run_av_report,     setup_av_extreme,   teardown_av,   1,     256, 1 },
+    { "nv12/compose_720p",       run_nv12,          setup_nv12_720p,    teardown_nv12, 4,     128, 0 },
+    { "nv12/compose_1080p",      run_nv12,          setup_nv12_1080p,   teardown_nv12, 2,     128, 0 },
+    { "log/print_sync_devnull",  run_log,           setup_log_sync,     teardown_log,  256,   128, 0 },
+    { "log/print_async",         run_log,           setup_log_async,    teardown_log,  256,   128, 0 },
+    { "log/print_filtered",      run_log,           setup_log_filtered, teardown_log,  1024,  256, 0 },
+    { "counters/shared_atomic_4t", run_cnt,       setup_cnt_shared,   teardown_cnt,  1 << 20, 32, 0 },
+    { "counters/sharded_4t",     run_cnt,           setup_cnt_sharded,  teardown_cnt,  1 << 20, 32, 0 },
+    { "span/disabled",           run_span,          setup_span_off,     teardown_span, 4096,  256, 0 },
+    { "span/enabled",            run_span,          setup_span_on,      teardown_span, 1024,  256, 0 },
+    { "shmbus/publish_4k_0r",    run_bus,           setup_bus_0r,       teardown_bus,  1024,  128, 0 },
+    { "shmbus/publish_4k_1r",    run_bus,           setup_bus_1r,       teardown_bus,  1024,  128, 0 },
+    { "shmbus/publish_4k_2r",    run_bus,           setup_bus_2r,       teardown_bus,  1024,  128, 0 },
+    { "shmbus/publish_4k_4r",    run_bus,           setup_bus_4r,       teardown_bus,  1024,  128, 0 },
+    { "shmbus/publish_4k_8r",    run_bus,           setup_bus_8r,       teardown_bus,  1024,  128, 0 },
+};
+
+#define N_CASES (sizeof(g_cases) / sizeof(g_cases[0]))
+
+static int run_case(const BenchCase *bc, const BenchOpts *o, BenchResult *r)
+{
+    void *ctx = NULL;
+    if (bc->setup && bc->setup(&ctx) != 0) {
+        fprintf(stderr, "[bench] %s: setup failed\n", bc->name);
+        return -1;
+    }
+
+    uint64_t batches = o->quick ? (bc->batches + 7) / 8 : bc->batches;
+    if (batches > MAX_SAMPLES) batches = MAX_SAMPLES;
+
+    static double samples[MAX_SAMPLES];
+    size_t ns = 0;
+    uint64_t ops = 0;
+    double total_ns = 0.0;
+
+    // warmup：一轮不计
+    bc->run(ctx, bc->batch);
+
+    for (uint64_t b = 0; b < batches; b++) {
+        uint64_t t0 = now_ns();
+        uint64_t done = bc->run(ctx, bc->batch);
+        uint64_t dt = now_ns() - t0;
+        if (bc->self_timed) {
+            dt = done;
+            done = bc->batch;
+        }
+        if (done == 0) continue;
+        double per = (double)dt / (double)done;
+        samples[ns++] = per;
+        ops += done;
+        total_ns += (double)dt;
+    }
+
+    qsort(samples, ns, sizeof(double), cmp_double);
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", bc->name);
+    r->ops = ops;
+    r->mean_ns = ops ? total_ns / (double)ops : 0.0;
+    r->p50_ns = pct_sorted(samples, ns, 0.50);
+    r->p95_ns = pct_sorted(samples, ns, 0.95);
+    r->p99_ns = pct_sorted(samples, ns, 0.99);
+    r->extra = NAN;
+
+    if (bc->teardown) bc->teardown(ctx, r);
+    return 0;
+}
+
+/* ---------------- 输出 / 对比 ---------------- */
+
+static int write_json(const char *path)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "[bench] open %s failed\n", path);
+        return -1;
+    }
+
+    // 每个结果独占一行，--baseline 按行解析
+    fprintf(fp, "{\"schema\":\"rkav-bench-1\",\"created\":%ld,\"results\":[\n", (long)time(NULL));
+    for (int i = 0; i < g_n_results; i++) {
+        const BenchResult *r = &g_results[i];
+        fprintf(fp, "{\"name\":\"%s\",\"ops\":%llu,\"mean_ns\":%.3f,\"p50_ns\":%.3f,"
+                    "\"p95_ns\":%.3f,\"p99_ns\":%.3f",
+                r->name, (unsigned long long)r->ops, r->mean_ns, r->p50_ns, r->p95_ns, r->p99_ns);
+        if (r->extra_name && !isnan(r->extra)) fprintf(fp, ",\"%s\":%.3f", r->extra_name, r->extra);
+        fprintf(fp, "}%s\n", i + 1 < g_n_results ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
+
+static int compare_baseline(const char *path, double threshold_pct)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "[bench] open baseline %s failed\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[512];
+    printf("\n%-28s %12s %12s %9s\n", "baseline", "old p50", "new p50", "delta");
+    while (fgets(line, sizeof(line), fp)) {
+        char name[48];
+        double p50;
+        const char *pn = strstr(line, "\"name\":\"");
+        const char *pp = strstr(line, "\"p50_ns\":");
+        if (!pn || !pp) continue;
+        if (sscanf(pn + 8, "%47[^\"]", name) != 1 || sscanf(pp + 9, "%lf", &p50) != 1) continue;
+
+        for (int i = 0; i < g_n_results; i++) {
+            if (strcmp(g_results[i].name, name) != 0) continue;
+            double delta = p50 > 0 ? (g_results[i].p50_ns - p50) * 100.0 / p50 : 0.0;
+            int bad = delta > threshold_pct;
+            regressions += bad;
+            printf("%-28s %12.1f %12.1f %+8.1f%%%s\n", name, p50, g_results[i].p50_ns, delta,
+                   bad ? "  REGRESSION" : "");
+        }
+    }
+    fclose(fp);
+
+    printf("%d regression(s) over %.1f%%\n", regressions, threshold_pct);
+    return regressions;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s [options]\n\n"
+        "Options:\n"
+        "  --filter <substr>        Only run cases whose name contains <substr>\n"
+        "  --json <file>            Write machine-readable results ('-' = stdout)\n"
+        "  --baseline <file>        Compare p50 against a previous --json result\n"
+        "  --threshold <pct>        Regression threshold for --baseline (default: 10)\n"
+        "  --quick                  1/8 of the batches (smoke run)\n"
+        "  --list                   List cases and exit\n"
+        "  -h, --help               Show this help\n",
+        prog);
+}
+
+static int parse_opts(BenchOpts *o, int argc, char **argv)
+{
+    enum { OPT_FILTER = 1000, OPT_JSON, OPT_BASELINE, OPT_THRESHOLD, OPT_QUICK, OPT_LIST };
+    static const struct option long_opts[] = {
+        {"filter",    required_argument, 0, OPT_FILTER},
+        {"json",      required_argument, 0, OPT_JSON},
+        {"baseline",  required_argument, 0, OPT_BASELINE},
+        {"threshold", required_argument, 0, OPT_THRESHOLD},
+        {"quick",     no_argument,       0, OPT_QUICK},
+        {"list",      no_argument,       0, OPT_LIST},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    memset(o, 0, sizeof(*o));
+    o->threshold_pct = 10.0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (c) {
+        case OPT_FILTER:    o->filter = optarg; break;
+        case OPT_JSON:      o->json_path = optarg; break;
+        case OPT_BASELINE:  o->baseline_path = optarg; break;
+        case OPT_THRESHOLD: o->threshold_pct = atof(optarg); break;
+        case OPT_QUICK:     o->quick = 1; break;
+        case OPT_LIST:      o->list = 1; break;
+        case 'h':
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOpts o;
+    if (parse_opts(&o, argc, argv) != 0) return 1;
+
+    if (o.list) {
+        for (size_t i = 0; i < N_CASES; i++) printf("%s\n", g_cases[i].name);
+        return 0;
+    }
+
+    printf("%-28s %12s %10s %10s %10s %10s\n", "case", "ops", "mean ns", "p50 ns", "p95 ns", "p99 ns");
+    for (size_t i = 0; i < N_CASES && g_n_results < MAX_CASES; i++) {
+        if (o.filter && !strstr(g_cases[i].name, o.filter)) continue;
+
+        BenchResult *r = &g_results[g_n_results];
+        if (run_case(&g_cases[i], &o, r) != 0) continue;
+        g_n_results++;
+
+        printf("%-28s %12llu %10.1f %10.1f %10.1f %10.1f",
+               r->name, (unsigned long long)r->ops, r->mean_ns, r->p50_ns, r->p95_ns, r->p99_ns);
+        if (r->extra_name && !isnan(r->extra)) printf("  %s=%.2f", r->extra_name, r->extra);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (o.json_path && write_json(o.json_path) != 0) return 1;
+
+    if (o.baseline_path) {
+        int reg = compare_baseline(o.baseline_path, o.threshold_pct);
+        if (reg < 0) return 1;
+        if (reg > 0) return 2;
+    }
+    return 0;
+}
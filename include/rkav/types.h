@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -16,6 +17,14 @@ typedef struct {
     int stride;
     uint64_t pts_us;
     uint64_t frame_id;
+
+    /* 逐级时间戳（CLOCK_MONOTONIC us，0 = 未记录） */
+    uint64_t t_dq_us;           // DQBUF 返回
+    uint64_t t_rawq_us;         // 进入 raw 队列
+
+    /* 非 NULL：data 是帧池（FramePool*）的 buffer，释放时按 pool_slot 还回去而不是 free */
+    void    *pool;
+    int      pool_slot;
 } VideoFrame;
 
 typedef struct{
@@ -26,6 +35,11 @@ typedef struct{
     int       bytes_per_sample; // e.g. 2 for S16LE
     uint32_t  frames;           // per-channel frames
     uint64_t  pts_us;           // base + accumulated by sample count
+
+    uint64_t  t_read_us;        // snd_pcm_readi 返回
+    uint64_t  t_q_us;           // 进入 audio 队列
+
+    atomic_int refs;            // 扇出给多个 sink 时各持一个引用，最后一个放手的释放
 } AudioChunk;
 
 typedef struct {
@@ -33,6 +47,15 @@ typedef struct {
     size_t   size;
     uint64_t pts_us;
     bool is_keyframe;
+
+    /* 从 VideoFrame 继承 + 编码阶段补充（sink 侧 pop/write 时刻在 sink 内部测） */
+    uint64_t t_dq_us;
+    uint64_t t_rawq_us;
+    uint64_t t_enc_start_us;
+    uint64_t t_enc_end_us;
+    uint64_t t_h264q_us;        // 进入 h264 队列
+
+    atomic_int refs;            // 同 AudioChunk.refs
 } EncodedPacket;
 
 
@@ -1,30 +1,116 @@
 #include "av_stats.h"
 #include "lib/utils/log.h"
 
+#include <stdio.h>
+#include <string.h>
+
+static const char *const k_stream_names[AV_STREAM_COUNT] = {
+    [AV_STREAM_VIDEO] = "video",
+    [AV_STREAM_AUDIO] = "audio",
+};
+
+static const char *const k_cause_names[AV_DROP_CAUSE_COUNT] = {
+    [AV_DROP_SEQ_GAP]     = "seq_gap",
+    [AV_DROP_QUEUE_FULL]  = "queue_full",
+    [AV_DROP_ALLOC]       = "alloc",
+    [AV_DROP_CAPTURE_ERR] = "capture_err",
+    [AV_DROP_ENCODE_ERR]  = "encode_err",
+    [AV_DROP_POOL_EMPTY]  = "pool_empty",
+};
+
+const char *av_stream_name(AvStream stream)
+{
+    return (unsigned)stream < AV_STREAM_COUNT ? k_stream_names[stream] : "?";
+}
+
+const char *av_drop_cause_name(AvDropCause cause)
+{
+    return (unsigned)cause < AV_DROP_CAUSE_COUNT ? k_cause_names[cause] : "?";
+}
 
 void av_stats_init(AvStats *s)
 {
     if (!s) return;
-    atomic_store(&s->video_frames, 0);
-    atomic_store(&s->enc_bytes, 0);
-    atomic_store(&s->audio_chunks, 0);
-    atomic_store(&s->drop_count, 0);
+    memset(s, 0, sizeof(*s));
+
+    char name[48];
+    s->video_frames = counter_register("av.video_frames");
+    s->enc_bytes = counter_register("av.enc_bytes");
+    s->audio_chunks = counter_register("av.audio_chunks");
+    for (int st = 0; st < AV_STREAM_COUNT; st++) {
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            snprintf(name, sizeof(name), "av.drops.%s.%s", k_stream_names[st], k_cause_names[c]);
+            s->drops[st][c] = counter_register(name);
+        }
+    }
+
+    // 计数器是进程级单调的：重复 init 时从当前值起算
+    s->total_video_frames = counter_sum(s->video_frames);
+    s->total_enc_bytes = counter_sum(s->enc_bytes);
+    s->total_audio_chunks = counter_sum(s->audio_chunks);
+    for (int st = 0; st < AV_STREAM_COUNT; st++) {
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            s->total_drops[st][c] = counter_sum(s->drops[st][c]);
+        }
+    }
+}
+
+uint64_t av_stats_drop_total(AvStats *s, AvStream stream, AvDropCause cause)
+{
+    if (!s || (unsigned)stream >= AV_STREAM_COUNT || (unsigned)cause >= AV_DROP_CAUSE_COUNT) return 0;
+    return counter_sum(s->drops[stream][cause]);
+}
+
+/* 返回自上次以来的增量，并把 *last 推进到当前值 */
+static uint64_t take_delta(CounterId id, uint64_t *last)
+{
+    uint64_t cur = counter_sum(id);
+    uint64_t d = cur - *last;
+    *last = cur;
+    return d;
 }
 
 void av_stats_tick_print(AvStats *s)
 {
     if(!s) return;
 
-    uint64_t frames = atomic_exchange(&s->video_frames, 0);
-    uint64_t bytes = atomic_exchange(&s->enc_bytes, 0);
-    uint64_t achk = atomic_exchange(&s->audio_chunks, 0);
-    uint64_t drops = atomic_exchange(&s->drop_count, 0);
+    uint64_t frames = take_delta(s->video_frames, &s->total_video_frames);
+    uint64_t bytes = take_delta(s->enc_bytes, &s->total_enc_bytes);
+    uint64_t achk = take_delta(s->audio_chunks, &s->total_audio_chunks);
+
+    // 只列出本窗口非零的原因，例如 " (video:queue_full=3@raw video:seq_gap=1)"；@ 后是最近一次丢的边"
+    char causes[256];
+    size_t off = 0;
+    uint64_t drops = 0;
+    causes[0] = '\0';
+    for (int st = 0; st < AV_STREAM_COUNT; st++) {
+        for (int c = 0; c < AV_DROP_CAUSE_COUNT; c++) {
+            uint64_t n = take_delta(s->drops[st][c], &s->total_drops[st][c]);
+            if (!n) continue;
+            drops += n;
+            if (off < sizeof(causes)) {
+                const char *edge = c == AV_DROP_QUEUE_FULL
+                    ? atomic_load_explicit(&s->queue_edge[st], memory_order_relaxed) : NULL;
+                int w = snprintf(causes + off, sizeof(causes) - off, "%s%s:%s=%llu%s%s",
+                                 off ? " " : " (", k_stream_names[st], k_cause_names[c],
+                                 (unsigned long long)n, edge ? "@" : "", edge ? edge : "");
+                if (w > 0) off += (size_t)w;
+            }
+        }
+    }
+    if (off && off < sizeof(causes) - 1) {
+        causes[off++] = ')';
+        causes[off] = '\0';
+    }
+
+    s->total_drop_count += drops;
 
     uint64_t kbps = (bytes * 8) / 1000; // convert to kbps
 
-    LOGI("[STAT] video_fps=%llu enc_bitrate=%llukbps audio_chunks_per_sec=%llu drop_count=%llu",
+    LOGI("[STAT] video_fps=%llu enc_bitrate=%llukbps audio_chunks_per_sec=%llu drop_count=%llu%s",
          (unsigned long long)frames,
          (unsigned long long)kbps,
          (unsigned long long)achk,
-         (unsigned long long)drops);
-}
\ No newline at end of file
+         (unsigned long long)drops,
+         causes);
+}
@@ -2,34 +2,76 @@
 #include <stdatomic.h>
 #include <stdint.h>
 
+#include "counters.h"
+
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+typedef enum {
+    AV_STREAM_VIDEO = 0,
+    AV_STREAM_AUDIO,
+    AV_STREAM_COUNT
+} AvStream;
+
+/* 丢弃原因：区分“下游慢”（队列满）和“相机饿”（sequence 跳号）等 */
+typedef enum {
+    AV_DROP_SEQ_GAP = 0,   // 驱动 sequence 跳号：缓冲没及时 QBUF 或传感器侧丢帧
+    AV_DROP_QUEUE_FULL,    // 下游队列满（视频多是 raw 边上编码跟不上；音频 / 其它 drop 策略的边同样算这里）
+    AV_DROP_ALLOC,         // calloc / malloc 失败
+    AV_DROP_CAPTURE_ERR,   // DQBUF 等采集调用失败
+    AV_DROP_ENCODE_ERR,    // 编码器返回错误
+    AV_DROP_POOL_EMPTY,    // 帧池没有空 buffer（--frame-export 的读者占着不还）
+    AV_DROP_CAUSE_COUNT
+} AvDropCause;
+
+/*
+ * 计数走 counters 注册表（每线程一个分片，写端无 lock 前缀）；
+ * 这里只存 id 和上一次 tick 时的累计值，tick 用差值得到每秒数。
+ */
 typedef struct {
-    atomic_uint_fast64_t video_frames;   // per 1s
-    atomic_uint_fast64_t enc_bytes;      // per 1s
-    atomic_uint_fast64_t audio_chunks;   // per 1s
-    atomic_uint_fast64_t drop_count;     // per 1s
+    CounterId video_frames;
+    CounterId enc_bytes;
+    CounterId audio_chunks;
+    CounterId drops[AV_STREAM_COUNT][AV_DROP_CAUSE_COUNT];
+    _Atomic(const char *) queue_edge[AV_STREAM_COUNT];   // 最近一次 queue_full 丢在哪条边（[STAT] 里标出）
+
+    /* 上一次 tick 时的累计值：只由调用 tick 的统计线程读写 */
+    uint64_t total_video_frames;
+    uint64_t total_enc_bytes;
+    uint64_t total_audio_chunks;
+    uint64_t total_drop_count;
+    uint64_t total_drops[AV_STREAM_COUNT][AV_DROP_CAUSE_COUNT];
 } AvStats;
 
 void av_stats_init(AvStats *stats);
 void av_stats_tick_print(AvStats *s);
 
+const char *av_stream_name(AvStream stream);
+const char *av_drop_cause_name(AvDropCause cause);
+
+/* 当前累计（含还没 tick 的窗口，运行结束时汇总用） */
+uint64_t av_stats_drop_total(AvStats *s, AvStream stream, AvDropCause cause);
+
 static inline void av_stats_inc_video_frame(AvStats *s) {
-    atomic_fetch_add_explicit(&s->video_frames, 1, memory_order_relaxed);
+    counter_inc(s->video_frames);
 }
 static inline void av_stats_add_enc_bytes(AvStats *s, uint64_t bytes) {
-    atomic_fetch_add_explicit(&s->enc_bytes, bytes, memory_order_relaxed);
+    counter_add(s->enc_bytes, bytes);
 }
 static inline void av_stats_inc_audio_chunk(AvStats *s) {
-    atomic_fetch_add_explicit(&s->audio_chunks, 1, memory_order_relaxed);
+    counter_inc(s->audio_chunks);
 }
-static inline void av_stats_add_drop(AvStats *s, uint64_t n) {
-    atomic_fetch_add_explicit(&s->drop_count, n, memory_order_relaxed);
+static inline void av_stats_add_drop(AvStats *s, AvStream stream, AvDropCause cause, uint64_t n) {
+    counter_add(s->drops[stream][cause], n);
+}
+/* queue_full 带上边名（图里的边名，活得比统计线程久；NULL = 不标） */
+static inline void av_stats_add_queue_drop(AvStats *s, AvStream stream, const char *edge, uint64_t n) {
+    if (edge) atomic_store_explicit(&s->queue_edge[stream], edge, memory_order_relaxed);
+    counter_add(s->drops[stream][AV_DROP_QUEUE_FULL], n);
 }
 
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
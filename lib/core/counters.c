@@ -0,0 +1,97 @@
+#include "counters.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define COUNTER_NAME_MAX 48
+
+__thread CounterShard *g_counter_shard;
+CounterShard           g_counter_overflow;
+
+static CounterShard   g_shards[COUNTER_SHARDS_MAX];
+static atomic_int     g_shard_owned[COUNTER_SHARDS_MAX];
+static atomic_int     g_nshards;                    // 曾经领取过的分片数（求和只扫这么多）
+
+static pthread_mutex_t g_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static char            g_names[COUNTERS_MAX][COUNTER_NAME_MAX];
+static atomic_int      g_ncounters;
+
+static pthread_once_t  g_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t   g_key;
+
+/* 线程退出：交还分片（值保留） */
+static void shard_release(void *p)
+{
+    CounterShard *s = (CounterShard *)p;
+    int idx = (int)(s - g_shards);
+    if (idx >= 0 && idx < COUNTER_SHARDS_MAX) {
+        atomic_store_explicit(&g_shard_owned[idx], 0, memory_order_release);
+    }
+}
+
+static void key_init(void)
+{
+    pthread_key_create(&g_key, shard_release);
+}
+
+CounterShard *counter_shard_acquire(void)
+{
+    pthread_once(&g_key_once, key_init);
+
+    for (int i = 0; i < COUNTER_SHARDS_MAX; i++) {
+        int expect = 0;
+        if (atomic_compare_exchange_strong_explicit(&g_shard_owned[i], &expect, 1,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed)) {
+            // g_nshards = max(g_nshards, i + 1)
+            int n = atomic_load(&g_nshards);
+            while (n < i + 1 && !atomic_compare_exchange_weak(&g_nshards, &n, i + 1)) {
+            }
+            g_counter_shard = &g_shards[i];
+            pthread_setspecific(g_key, g_counter_shard);
+            return g_counter_shard;
+        }
+    }
+    return NULL;
+}
+
+CounterId counter_register(const char *name)
+{
+    if (!name || !name[0]) return -1;
+
+    pthread_mutex_lock(&g_reg_lock);
+    int n = atomic_load(&g_ncounters);
+    for (int i = 0; i < n; i++) {
+        if (strncmp(g_names[i], name, COUNTER_NAME_MAX - 1) == 0) {
+            pthread_mutex_unlock(&g_reg_lock);
+            return i;
+        }
+    }
+    if (n >= COUNTERS_MAX) {
+        pthread_mutex_unlock(&g_reg_lock);
+        return -1;
+    }
+    strncpy(g_names[n], name, COUNTER_NAME_MAX - 1);
+    g_names[n][COUNTER_NAME_MAX - 1] = '\0';
+    atomic_store(&g_ncounters, n + 1);
+    pthread_mutex_unlock(&g_reg_lock);
+    return n;
+}
+
+const char *counter_name(CounterId id)
+{
+    if (id < 0 || id >= atomic_load(&g_ncounters)) return "?";
+    return g_names[id];
+}
+
+uint64_t counter_sum(CounterId id)
+{
+    if ((unsigned)id >= COUNTERS_MAX) return 0;
+
+    uint64_t sum = atomic_load_explicit(&g_counter_overflow.v[id], memory_order_relaxed);
+    int n = atomic_load_explicit(&g_nshards, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        sum += atomic_load_explicit(&g_shards[i].v[id], memory_order_relaxed);
+    }
+    return sum;
+}
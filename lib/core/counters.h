@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 按线程分片的计数器注册表。
+ *
+ * - counter_register() 运行期按名字登记，返回 id（同名重复登记返回同一个 id），
+ *   新子系统加计数器不用改 av_stats.h
+ * - 每个线程第一次 counter_add() 时领取一个私有分片（cache line 对齐），之后只有它写：
+ *   relaxed load + store，编译出来就是普通的 load/add/store，没有 lock 前缀，cache line 不在核间来回
+ * - counter_sum() 对所有分片做 relaxed load 求和（读者不阻塞写者，值单调不减）
+ * - 线程退出时分片交还，值保留；下一个线程接着往上加，所以总和不丢
+ * - 分片用完（> COUNTER_SHARDS_MAX 个线程同时在加）时退化到一个共享的 atomic 分片
+ */
+
+#define COUNTERS_MAX       64
+#define COUNTER_SHARDS_MAX 32
+
+typedef int CounterId;         // < 0 = 无效
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t v[COUNTERS_MAX];
+} CounterShard;
+
+extern __thread CounterShard *g_counter_shard;
+extern CounterShard           g_counter_overflow;
+
+/* 为当前线程领取分片；用完返回 NULL */
+CounterShard *counter_shard_acquire(void);
+
+/* 名字最长 47 字节；注册表满返回 -1 */
+CounterId counter_register(const char *name);
+
+const char *counter_name(CounterId id);
+
+uint64_t counter_sum(CounterId id);
+
+static inline void counter_add(CounterId id, uint64_t n)
+{
+    if (__builtin_expect((unsigned)id >= COUNTERS_MAX, 0)) return;
+
+    CounterShard *s = g_counter_shard;
+    if (__builtin_expect(!s, 0)) {
+        s = counter_shard_acquire();
+        if (!s) {
+            atomic_fetch_add_explicit(&g_counter_overflow.v[id], n, memory_order_relaxed);
+            return;
+        }
+    }
+    _Atomic uint64_t *p = &s->v[id];
+    atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static inline void counter_inc(CounterId id)
+{
+    counter_add(id, 1);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,196 @@
+#include "ctl_loop.h"
+#include "lib/utils/log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static void close_fd(int *fd)
+{
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+}
+
+static int add_fd(int epfd, int fd)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * 周期 tick：整秒周期用 CLOCK_REALTIME 对齐到墙钟边界（日志时间戳落在 .000 附近），
+ * 并带 CANCEL_ON_SET，系统时间被改时重新对齐；其余周期按 CLOCK_MONOTONIC 从现在起算。
+ */
+static int arm_tick(CtlLoop *c)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_sec  = c->interval_ms / 1000;
+    its.it_interval.tv_nsec = (long)(c->interval_ms % 1000) * 1000000L;
+
+    if (c->interval_ms % 1000 == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        time_t step = (time_t)(c->interval_ms / 1000);
+        its.it_value.tv_sec  = (now.tv_sec / step + 1) * step;
+        its.it_value.tv_nsec = 0;
+        return timerfd_settime(c->tick_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    its.it_value = now;
+    its.it_value.tv_sec  += its.it_interval.tv_sec;
+    its.it_value.tv_nsec += its.it_interval.tv_nsec;
+    if (its.it_value.tv_nsec >= 1000000000L) {
+        its.it_value.tv_sec++;
+        its.it_value.tv_nsec -= 1000000000L;
+    }
+    return timerfd_settime(c->tick_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int ctl_loop_init(CtlLoop *c, unsigned int interval_ms, unsigned int duration_sec,
+                  const sigset_t *sigs, const CtlLoopOps *ops)
+{
+    if (!c) return -1;
+    memset(c, 0, sizeof(*c));
+    c->epfd = c->tick_fd = c->deadline_fd = c->sig_fd = c->wake_fd = -1;
+    c->interval_ms = interval_ms;
+    if (ops) c->ops = *ops;
+
+    c->epfd = epoll_create1(EPOLL_CLOEXEC);
+    c->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (c->epfd < 0 || c->wake_fd < 0 || add_fd(c->epfd, c->wake_fd) != 0) goto fail;
+
+    if (interval_ms) {
+        clockid_t clk = (interval_ms % 1000 == 0) ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+        c->tick_fd = timerfd_create(clk, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (c->tick_fd < 0 || arm_tick(c) != 0 || add_fd(c->epfd, c->tick_fd) != 0) goto fail;
+    }
+
+    if (duration_sec) {
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = duration_sec;
+        c->deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (c->deadline_fd < 0 || timerfd_settime(c->deadline_fd, 0, &its, NULL) != 0 ||
+            add_fd(c->epfd, c->deadline_fd) != 0) goto fail;
+    }
+
+    if (sigs) {
+        c->sig_fd = signalfd(-1, sigs, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (c->sig_fd < 0 || add_fd(c->epfd, c->sig_fd) != 0) goto fail;
+    }
+
+    atomic_store(&c->ready, 1);
+    return 0;
+
+fail:
+    LOGE("[ctl] init failed: %s", strerror(errno));
+    ctl_loop_deinit(c);
+    return -1;
+}
+
+int ctl_loop_watch_fd(CtlLoop *c, int fd, void (*on_readable)(void *user, int fd), void *user)
+{
+    if (!c || fd < 0 || !on_readable || c->n_watch == CTL_LOOP_MAX_WATCH) return -1;
+    if (add_fd(c->epfd, fd) != 0) {
+        LOGE("[ctl] watch fd=%d failed: %s", fd, strerror(errno));
+        return -1;
+    }
+    c->watch[c->n_watch++] = (CtlLoopWatch){ .fd = fd, .on_readable = on_readable, .user = user };
+    return 0;
+}
+
+static void handle_tick(CtlLoop *c)
+{
+    uint64_t exp = 0;
+    ssize_t r = read(c->tick_fd, &exp, sizeof(exp));
+    if (r < 0) {
+        if (errno == ECANCELED) {
+            LOGW("[ctl] wall clock changed, realigning tick");
+            arm_tick(c);
+        }
+        return;
+    }
+    if (r != (ssize_t)sizeof(exp) || exp == 0) return;
+
+    if (exp > 1) {
+        c->missed += exp - 1;
+        LOGW_RL("[ctl] tick overrun: missed=%llu total_missed=%llu",
+                (unsigned long long)(exp - 1), (unsigned long long)c->missed);
+    }
+    c->ticks++;
+    if (c->ops.on_tick) c->ops.on_tick(c->ops.user);
+}
+
+int ctl_loop_run(CtlLoop *c)
+{
+    if (!c || !atomic_load(&c->ready)) return -1;
+
+    struct epoll_event evs[4];
+    while (!atomic_load(&c->stop)) {
+        int n = epoll_wait(c->epfd, evs, 4, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGE("[ctl] epoll_wait failed: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            if (fd == c->wake_fd) {
+                uint64_t v;
+                ssize_t r = read(c->wake_fd, &v, sizeof(v));
+                (void)r;
+            } else if (fd == c->sig_fd) {
+                struct signalfd_siginfo si;
+                while (read(c->sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+                    if (c->ops.on_signal) c->ops.on_signal(c->ops.user, (int)si.ssi_signo);
+                }
+            } else if (fd == c->deadline_fd) {
+                uint64_t v;
+                ssize_t r = read(c->deadline_fd, &v, sizeof(v));
+                (void)r;
+                if (c->ops.on_deadline) c->ops.on_deadline(c->ops.user);
+            } else if (fd == c->tick_fd) {
+                // 已经要停了就不再出 report（与原 stats 线程一致）
+                if (!atomic_load(&c->stop)) handle_tick(c);
+            } else {
+                for (int w = 0; w < c->n_watch; w++) {
+                    if (c->watch[w].fd == fd) c->watch[w].on_readable(c->watch[w].user, fd);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+void ctl_loop_stop(CtlLoop *c)
+{
+    if (!c || !atomic_load(&c->ready)) return;
+    if (atomic_exchange(&c->stop, 1)) return;
+
+    uint64_t one = 1;
+    ssize_t r = write(c->wake_fd, &one, sizeof(one));
+    (void)r;
+}
+
+void ctl_loop_deinit(CtlLoop *c)
+{
+    if (!c) return;
+    atomic_store(&c->ready, 0);
+    close_fd(&c->tick_fd);
+    close_fd(&c->deadline_fd);
+    close_fd(&c->sig_fd);
+    close_fd(&c->wake_fd);
+    close_fd(&c->epfd);
+}
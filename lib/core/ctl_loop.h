@@ -0,0 +1,77 @@
+#pragma once
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*
+ * 控制循环：一个 epoll 等四类事件，替代原来的 signal / timer / stats 三个线程。
+ *
+ *   tick_fd      timerfd，绝对时间 + 固定周期：每个 interval 边界触发一次 on_tick，
+ *                打印耗时不会累积成漂移；interval 为整秒时对齐到墙钟整秒
+ *   deadline_fd  timerfd，一次性：录制时长到了触发 on_deadline
+ *   sig_fd       signalfd：SIGINT/SIGTERM 等（调用方需事先在所有线程 block 这些信号）
+ *   wake_fd      eventfd：ctl_loop_stop() 从任意线程唤醒并退出
+ *
+ * 另外可以挂最多 CTL_LOOP_MAX_WATCH 个调用方自己的 fd（如控制 socket），可读时回调。
+ */
+
+#define CTL_LOOP_MAX_WATCH 4
+
+typedef struct {
+    int    fd;
+    void (*on_readable)(void *user, int fd);
+    void  *user;
+} CtlLoopWatch;
+
+typedef struct {
+    void (*on_tick)(void *user);
+    void (*on_signal)(void *user, int signo);
+    void (*on_deadline)(void *user);
+    void *user;
+} CtlLoopOps;
+
+typedef struct {
+    int          epfd;
+    int          tick_fd;
+    int          deadline_fd;
+    int          sig_fd;
+    int          wake_fd;
+    unsigned int interval_ms;
+
+    CtlLoopOps   ops;
+    CtlLoopWatch watch[CTL_LOOP_MAX_WATCH];
+    int          n_watch;
+    atomic_int   ready;
+    atomic_int   stop;
+
+    uint64_t     ticks;
+    uint64_t     missed;     // timerfd 溢出（on_tick 比一个周期还慢）
+} CtlLoop;
+
+/*
+ * @param interval_ms  tick 周期（0 = 不要 tick）
+ * @param duration_sec 录制时长（0 = 不限）
+ * @param sigs         交给 signalfd 的信号集（NULL = 不处理信号）
+ */
+int  ctl_loop_init(CtlLoop *c, unsigned int interval_ms, unsigned int duration_sec,
+                   const sigset_t *sigs, const CtlLoopOps *ops);
+
+/* init 之后、run 之前调用；fd 归调用方（deinit 不关） */
+int  ctl_loop_watch_fd(CtlLoop *c, int fd, void (*on_readable)(void *user, int fd), void *user);
+
+/* 阻塞运行直到 ctl_loop_stop() */
+int  ctl_loop_run(CtlLoop *c);
+
+/* 任意线程可调；重复调用无害 */
+void ctl_loop_stop(CtlLoop *c);
+
+void ctl_loop_deinit(CtlLoop *c);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,221 @@
+#include "evtrace.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAG "trace"
+
+/* 打开时做一次开销标定的条数（之后清空，不留在文件里） */
+#define CALIBRATE_N 4096u
+
+_Static_assert(sizeof(EvRecord) == 32, "EvRecord must stay 32 bytes");
+_Static_assert(sizeof(EvTraceHeader) <= EVTRACE_HEADER_BYTES, "header must fit in one page");
+
+static uint64_t round_up_pow2(uint64_t v)
+{
+    uint64_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static void calibrate(EvTrace *t)
+{
+    uint64_t n = CALIBRATE_N;
+    if (n > t->mask + 1) n = t->mask + 1;
+
+    uint64_t t0 = rkav_now_monotonic_us();
+    for (uint64_t i = 0; i < n; i++) {
+        evtrace_emit(t, EV_AVSYNC_REPORT, i, t0, 0, 0, 0);
+    }
+    uint64_t t1 = rkav_now_monotonic_us();
+    t->emit_ns = (double)(t1 - t0) * 1000.0 / (double)n;
+
+    /* 标定数据不是真实事件：清掉并把序号归零 */
+    memset(t->recs, 0, (size_t)n * sizeof(EvRecord));
+    atomic_store(&t->hdr->head, 0);
+}
+
+int evtrace_open(EvTrace *t, const char *path, uint64_t capacity, const EvTraceMeta *meta)
+{
+    if (!t || !path) return -1;
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+
+    if (capacity < 1024) capacity = 1024;
+    capacity = round_up_pow2(capacity);
+
+    size_t bytes = EVTRACE_HEADER_BYTES + (size_t)capacity * sizeof(EvRecord);
+
+    t->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (t->fd < 0) {
+        LOGE("[%s] open %s failed: %s", TAG, path, strerror(errno));
+        return -1;
+    }
+    /* 一次性定长：之后只在映射内覆盖写，磁盘占用有上界 */
+    if (ftruncate(t->fd, (off_t)bytes) != 0) {
+        LOGE("[%s] ftruncate %zu failed: %s", TAG, bytes, strerror(errno));
+        close(t->fd);
+        t->fd = -1;
+        return -1;
+    }
+
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+    if (p == MAP_FAILED) {
+        LOGE("[%s] mmap failed: %s", TAG, strerror(errno));
+        close(t->fd);
+        t->fd = -1;
+        return -1;
+    }
+
+    t->map_bytes = bytes;
+    t->hdr  = (EvTraceHeader *)p;
+    t->recs = (EvRecord *)((uint8_t *)p + EVTRACE_HEADER_BYTES);
+    t->mask = capacity - 1;
+
+    EvTraceHeader *h = t->hdr;
+    memcpy(h->magic, EVTRACE_MAGIC, sizeof(h->magic));
+    h->version     = EVTRACE_VERSION;
+    h->record_size = (uint32_t)sizeof(EvRecord);
+    h->capacity    = capacity;
+    h->created_us  = rkav_now_monotonic_us();
+    if (meta) {
+        h->video_fps         = meta->video_fps;
+        h->audio_sample_rate = meta->audio_sample_rate;
+        h->audio_channels    = meta->audio_channels;
+    }
+    h->clean_close = 0;
+    atomic_store(&h->head, 0);
+
+    calibrate(t);
+
+    /* 头部落盘后崩溃也能被识别 */
+    msync(h, EVTRACE_HEADER_BYTES, MS_ASYNC);
+
+    LOGI("[%s] opened %s records=%llu (%zu KiB) emit_cost=%.1fns/event",
+         TAG, path, (unsigned long long)capacity, bytes / 1024, t->emit_ns);
+    return 0;
+}
+
+void evtrace_close(EvTrace *t)
+{
+    if (!t || !t->hdr) return;
+
+    uint64_t n = atomic_load(&t->hdr->head);
+    t->hdr->clean_close = 1;
+    msync(t->hdr, t->map_bytes, MS_SYNC);
+    munmap(t->hdr, t->map_bytes);
+    if (t->fd >= 0) close(t->fd);
+
+    LOGI("[%s] closed events=%llu (kept last %llu)", TAG,
+         (unsigned long long)n,
+         (unsigned long long)(n < t->mask + 1 ? n : t->mask + 1));
+
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+}
+
+static int cmp_event_seq(const void *a, const void *b)
+{
+    uint64_t sa = ((const EvEvent *)a)->seq;
+    uint64_t sb = ((const EvEvent *)b)->seq;
+    return (sa > sb) - (sa < sb);
+}
+
+int evtrace_load(const char *path, EvTraceDump *out)
+{
+    if (!path || !out) return -1;
+    memset(out, 0, sizeof(*out));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("[%s] open %s failed: %s", TAG, path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < EVTRACE_HEADER_BYTES) {
+        LOGE("[%s] %s: too small for a trace file", TAG, path);
+        close(fd);
+        return -1;
+    }
+
+    size_t bytes = (size_t)st.st_size;
+    void *p = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LOGE("[%s] mmap %s failed: %s", TAG, path, strerror(errno));
+        return -1;
+    }
+
+    const EvTraceHeader *h = (const EvTraceHeader *)p;
+    uint64_t cap = h->capacity;
+    if (memcmp(h->magic, EVTRACE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != EVTRACE_VERSION ||
+        h->record_size != sizeof(EvRecord) ||
+        cap == 0 || (cap & (cap - 1)) != 0 ||
+        bytes < EVTRACE_HEADER_BYTES + (size_t)cap * sizeof(EvRecord)) {
+        LOGE("[%s] %s: bad header", TAG, path);
+        munmap(p, bytes);
+        return -1;
+    }
+
+    memcpy(&out->hdr, h, sizeof(out->hdr));
+
+    out->events = (EvEvent *)malloc((size_t)cap * sizeof(EvEvent));
+    if (!out->events) {
+        munmap(p, bytes);
+        return -1;
+    }
+
+    const EvRecord *recs = (const EvRecord *)((const uint8_t *)p + EVTRACE_HEADER_BYTES);
+    uint64_t head = atomic_load(&h->head);
+    for (uint64_t i = 0; i < cap; i++) {
+        uint64_t seq = atomic_load_explicit((_Atomic uint64_t *)&recs[i].seq, memory_order_acquire);
+        if (seq == 0 || ((seq - 1) & (cap - 1)) != i) {
+            // head 之前应当写过的槽却无效：写到一半（崩溃/竞争）
+            if (i < head) out->torn++;
+            continue;
+        }
+        EvEvent *e = &out->events[out->n++];
+        e->seq        = seq - 1;
+        e->pts_us     = recs[i].pts_us;
+        e->arrival_us = recs[i].arrival_us;
+        e->size       = recs[i].size;
+        e->aux        = recs[i].aux;
+        e->stage      = recs[i].stage;
+        e->flags      = recs[i].flags;
+    }
+    munmap(p, bytes);
+
+    qsort(out->events, out->n, sizeof(EvEvent), cmp_event_seq);
+    return 0;
+}
+
+void evtrace_dump_free(EvTraceDump *d)
+{
+    if (!d) return;
+    free(d->events);
+    memset(d, 0, sizeof(*d));
+}
+
+const char *evtrace_stage_name(uint8_t stage)
+{
+    switch (stage) {
+    case EV_VIDEO_CAPTURE: return "video_capture";
+    case EV_VIDEO_ENCODE:  return "video_encode";
+    case EV_VIDEO_SINK:    return "video_sink";
+    case EV_AUDIO_CAPTURE: return "audio_capture";
+    case EV_AUDIO_SINK:    return "audio_sink";
+    case EV_AVSYNC_VIDEO:  return "avsync_video";
+    case EV_AVSYNC_AUDIO:  return "avsync_audio";
+    case EV_AVSYNC_REPORT: return "avsync_report";
+    default:               return "unknown";
+    }
+}
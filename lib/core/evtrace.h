@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 二进制事件追踪（post-mortem 分析用）。
+ *
+ * 文件布局：
+ *   [0, 4096)            EvTraceHeader（一页，记录区从页边界开始）
+ *   [4096, ...)          capacity 条定长 EvRecord（环形覆盖，磁盘占用固定）
+ *
+ * 写入：多线程无锁追加。atomic_fetch_add 领取全局序号 -> 写字段 -> 最后 release 发布 seq。
+ * 崩溃容忍：读取方不信任 head，而是逐条校验 record.seq（0 = 空槽/写了一半），
+ *           并用 (seq - 1) % capacity == 槽位下标 过滤被覆盖的旧记录。
+ */
+
+#define EVTRACE_MAGIC        "RKAVTRC1"
+#define EVTRACE_VERSION      1u
+#define EVTRACE_HEADER_BYTES 4096u
+
+typedef enum {
+    EV_VIDEO_CAPTURE = 1,  // DQBUF 之后：pts=采集 pts, size=帧字节数, aux=driver sequence 低 16 位
+    EV_VIDEO_ENCODE  = 2,  // 编码输出：size=packet 字节数, flags=EV_FLAG_KEYFRAME
+    EV_VIDEO_SINK    = 3,  // h264 写盘完成
+    EV_AUDIO_CAPTURE = 4,  // snd_pcm_readi 返回：aux=frames
+    EV_AUDIO_SINK    = 5,  // pcm 写盘完成
+    EV_AVSYNC_VIDEO  = 6,  // avsync_on_video 的输入
+    EV_AVSYNC_AUDIO  = 7,  // avsync_on_audio 的输入：aux=frames, size=sample_rate
+    EV_AVSYNC_REPORT = 8,  // avsync_report_1s：pts=报告时刻
+} EvStage;
+
+#define EV_FLAG_KEYFRAME 0x01u
+
+typedef struct {
+    _Atomic uint64_t seq;      // 全局序号 + 1；0 = 无效
+    uint64_t pts_us;
+    uint64_t arrival_us;       // CLOCK_MONOTONIC，事件发生时刻
+    uint32_t size;
+    uint16_t aux;
+    uint8_t  stage;            // EvStage
+    uint8_t  flags;
+} EvRecord;                    // 32 B，两条一个 cache line
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;         // 记录条数（2 的幂）
+    uint64_t created_us;       // 打开时刻（monotonic）
+    uint32_t video_fps;
+    uint32_t audio_sample_rate;
+    uint32_t audio_channels;
+    uint32_t clean_close;      // 正常关闭时置 1；崩溃后为 0
+    _Atomic uint64_t head;     // 下一个待领取的序号（仅作提示）
+} EvTraceHeader;
+
+typedef struct {
+    int            fd;
+    size_t         map_bytes;
+    EvTraceHeader *hdr;
+    EvRecord      *recs;       // NULL = 未启用，emit 直接返回
+    uint64_t       mask;
+    double         emit_ns;    // 打开时实测的单条 emit 开销
+} EvTrace;
+
+typedef struct {
+    uint32_t video_fps;
+    uint32_t audio_sample_rate;
+    uint32_t audio_channels;
+} EvTraceMeta;
+
+/*
+ * 打开（创建/截断）追踪文件并 mmap。
+ * capacity 会向上取整到 2 的幂；文件大小 = 4096 + capacity * 32。
+ */
+int  evtrace_open(EvTrace *t, const char *path, uint64_t capacity, const EvTraceMeta *meta);
+
+/* msync + munmap，并标记 clean_close */
+void evtrace_close(EvTrace *t);
+
+static inline int evtrace_enabled(const EvTrace *t)
+{
+    return t && t->recs;
+}
+
+static inline void evtrace_emit(EvTrace *t, EvStage stage,
+                                uint64_t pts_us, uint64_t arrival_us,
+                                uint32_t size, uint16_t aux, uint8_t flags)
+{
+    if (!evtrace_enabled(t)) return;
+
+    uint64_t seq = atomic_fetch_add_explicit(&t->hdr->head, 1, memory_order_relaxed);
+    EvRecord *r = &t->recs[seq & t->mask];
+
+    /* 先作废旧内容，再写字段，最后发布 seq（seqlock 写者顺序） */
+    atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    r->pts_us     = pts_us;
+    r->arrival_us = arrival_us;
+    r->size       = size;
+    r->aux        = aux;
+    r->stage      = (uint8_t)stage;
+    r->flags      = flags;
+    atomic_store_explicit(&r->seq, seq + 1, memory_order_release);
+}
+
+/* ---- 读取端（离线工具用） ---- */
+
+typedef struct {
+    uint64_t seq;              // 全局序号（从 0 开始）
+    uint64_t pts_us;
+    uint64_t arrival_us;
+    uint32_t size;
+    uint16_t aux;
+    uint8_t  stage;
+    uint8_t  flags;
+} EvEvent;
+
+typedef struct {
+    EvTraceHeader hdr;         // 文件头拷贝（head 仅作参考）
+    EvEvent      *events;      // 按 seq 升序
+    size_t        n;
+    size_t        torn;        // seq=0 或与槽位不符而被丢弃的槽数（不含从未写过的槽）
+} EvTraceDump;
+
+/*
+ * 读取整个 trace 文件（只读 mmap），校验头部并按 seq 排序有效记录。
+ * 崩溃后留下的文件（clean_close=0）同样可读。
+ */
+int  evtrace_load(const char *path, EvTraceDump *out);
+void evtrace_dump_free(EvTraceDump *d);
+
+const char *evtrace_stage_name(uint8_t stage);
+
+#ifdef __cplusplus
+}
+#endif
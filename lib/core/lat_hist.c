@@ -0,0 +1,68 @@
+#include "lat_hist.h"
+
+void lat_hist_init(LatHist *h)
+{
+    if (!h) return;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) atomic_store(&h->bucket[i], 0);
+    atomic_store(&h->count, 0);
+    atomic_store(&h->sum_us, 0);
+    atomic_store(&h->max_us, 0);
+}
+
+void lat_hist_take(LatHist *h, LatHistSnap *out)
+{
+    if (!h || !out) return;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) {
+        out->bucket[i] = atomic_exchange_explicit(&h->bucket[i], 0, memory_order_relaxed);
+    }
+    out->count  = atomic_exchange_explicit(&h->count, 0, memory_order_relaxed);
+    out->sum_us = atomic_exchange_explicit(&h->sum_us, 0, memory_order_relaxed);
+    out->max_us = atomic_exchange_explicit(&h->max_us, 0, memory_order_relaxed);
+}
+
+static uint64_t bucket_lower_us(unsigned idx)
+{
+    if (idx < LAT_HIST_SUB) return idx;
+    unsigned shift = (idx - LAT_HIST_SUB) / LAT_HIST_SUB;
+    unsigned sub   = (idx - LAT_HIST_SUB) % LAT_HIST_SUB;
+    return (uint64_t)(LAT_HIST_SUB + sub) << shift;
+}
+
+uint64_t lat_hist_bucket_upper_us(unsigned idx)
+{
+    if (idx + 1 >= LAT_HIST_BUCKETS) return UINT64_MAX;
+    return bucket_lower_us(idx + 1);
+}
+
+double lat_hist_percentile_us(const LatHistSnap *s, double q)
+{
+    if (!s || s->count == 0) return 0.0;
+
+    // 与 avsync 一致：nearest-rank
+    uint64_t rank = (uint64_t)(q * (double)s->count);
+    if ((double)rank < q * (double)s->count) rank++;
+    if (rank < 1) rank = 1;
+    if (rank > s->count) rank = s->count;
+
+    // 桶内计数与 count 可能因并发 take 略有出入，按桶累计为准
+    uint64_t acc = 0;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) {
+        acc += s->bucket[i];
+        if (acc >= rank) {
+            double lo = (double)bucket_lower_us(i);
+            double hi = (i + 1 < LAT_HIST_BUCKETS) ? (double)bucket_lower_us(i + 1) : lo;
+            double mid = (lo + hi) / 2.0;
+            return mid > (double)s->max_us && s->max_us ? (double)s->max_us : mid;
+        }
+    }
+    return (double)s->max_us;
+}
+
+void lat_hist_snap_merge(LatHistSnap *dst, const LatHistSnap *src)
+{
+    if (!dst || !src) return;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) dst->bucket[i] += src->bucket[i];
+    dst->count  += src->count;
+    dst->sum_us += src->sum_us;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+}
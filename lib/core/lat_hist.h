@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 延迟直方图（微秒）：对数分桶，每个 2 的幂区间再线性切 8 份，相对误差 <= 12.5%。
+ *   [0, 8)us 每 1us 一桶；之后 [8,16) [16,32) ... 每段 8 桶；上限约 134s（超出计入最后一桶）。
+ *
+ * 记录端只做 relaxed fetch_add，无锁；统计线程用 lat_hist_take() 取走并清零本周期数据。
+ */
+
+#define LAT_HIST_SUB_BITS 3
+#define LAT_HIST_SUB      (1u << LAT_HIST_SUB_BITS)
+#define LAT_HIST_MAX_BIT  27
+#define LAT_HIST_BUCKETS  (LAT_HIST_SUB + (LAT_HIST_MAX_BIT - LAT_HIST_SUB_BITS) * LAT_HIST_SUB)
+
+typedef struct {
+    atomic_uint_fast64_t bucket[LAT_HIST_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum_us;
+    atomic_uint_fast64_t max_us;
+} LatHist;
+
+/* 非原子快照（一个统计周期的数据） */
+typedef struct {
+    uint64_t bucket[LAT_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} LatHistSnap;
+
+void lat_hist_init(LatHist *h);
+
+static inline unsigned lat_hist_index(uint64_t us)
+{
+    if (us < LAT_HIST_SUB) return (unsigned)us;
+    if (us >= (1ULL << LAT_HIST_MAX_BIT)) return LAT_HIST_BUCKETS - 1;
+
+    unsigned msb = 63u - (unsigned)__builtin_clzll(us);
+    unsigned shift = msb - LAT_HIST_SUB_BITS;
+    return LAT_HIST_SUB + shift * LAT_HIST_SUB + (unsigned)((us >> shift) & (LAT_HIST_SUB - 1));
+}
+
+static inline void lat_hist_record(LatHist *h, uint64_t us)
+{
+    atomic_fetch_add_explicit(&h->bucket[lat_hist_index(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, us, memory_order_relaxed);
+
+    uint64_t cur = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    while (us > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max_us, &cur, us,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/* 记录 t1 - t0；任一时间戳缺失（0）或倒序时忽略 */
+static inline void lat_hist_record_span(LatHist *h, uint64_t t0_us, uint64_t t1_us)
+{
+    if (t0_us && t1_us >= t0_us) lat_hist_record(h, t1_us - t0_us);
+}
+
+/* 取走本周期数据并清零 */
+void lat_hist_take(LatHist *h, LatHistSnap *out);
+
+/* 桶的上界（us），用于导出 cumulative buckets */
+uint64_t lat_hist_bucket_upper_us(unsigned idx);
+
+/* 百分位（us，取所在桶的中点）；count==0 返回 0 */
+double lat_hist_percentile_us(const LatHistSnap *s, double q);
+
+/* 合并：dst += src */
+void lat_hist_snap_merge(LatHistSnap *dst, const LatHistSnap *src);
+
+#ifdef __cplusplus
+}
+#endif
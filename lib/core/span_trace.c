@@ -0,0 +1,209 @@
+#include "span_trace.h"
+#include "lib/utils/log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TAG "span"
+
+#define T0_BITS 56
+#define T0_MASK ((1ULL << T0_BITS) - 1)
+
+typedef struct {
+    uint64_t t0_id;            // 低 56 位：相对 span_trace_start 的 ns；高 8 位：SpanId
+    uint32_t dur_ns;           // 超过 4.29 s 截断
+    uint32_t arg;
+} SpanEvent;                   // 16 B
+
+typedef struct {
+    SpanEvent        *ev;
+    uint64_t          mask;
+    _Atomic uint64_t  head;    // 只有所属线程写
+    pid_t             tid;
+    char              name[16];
+} SpanBuf;
+
+int g_span_trace_enabled = 0;
+
+static SpanBuf          g_bufs[SPAN_TRACE_MAX_THREADS];
+static atomic_int       g_nbufs;
+static atomic_ullong    g_lost;          // 线程数超上限或分配失败而丢掉的 span
+static size_t           g_cap;
+static uint64_t         g_base_ns;
+
+static __thread SpanBuf *t_buf;
+static __thread int      t_no_buf;
+
+static const char *const k_names[SPAN_COUNT] = {
+    [SPAN_V_DQBUF]       = "dqbuf",
+    [SPAN_V_COPY]        = "copy",
+    [SPAN_V_RAWQ_WAIT]   = "rawq_wait",
+    [SPAN_V_ENC_PUT]     = "enc_put",
+    [SPAN_V_ENC_GET]     = "enc_get",
+    [SPAN_V_ENCODE]      = "encode",
+    [SPAN_V_H264Q_WAIT]  = "h264q_wait",
+    [SPAN_V_WRITE]       = "h264_write",
+    [SPAN_A_READ]        = "pcm_read",
+    [SPAN_A_Q_WAIT]      = "aq_wait",
+    [SPAN_A_WRITE]       = "pcm_write",
+    [SPAN_AVSYNC_REPORT] = "avsync_report",
+};
+
+const char *span_name(SpanId id)
+{
+    return (unsigned)id < SPAN_COUNT ? k_names[id] : "?";
+}
+
+static const char *span_cat(unsigned id)
+{
+    if (id == SPAN_AVSYNC_REPORT) return "ctl";
+    return id >= SPAN_A_READ ? "audio" : "video";
+}
+
+static void no_buf(const char *why)
+{
+    // 每个线程只报一次：时间线上少了这一行不是因为它闲着
+    char name[16];
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) name[0] = '\0';
+    LOGW("[%s] %s (tid %d): %s, its spans are dropped", TAG, name[0] ? name : "?",
+         (int)syscall(SYS_gettid), why);
+    t_no_buf = 1;
+}
+
+/* 线程第一次记录时领取 ring（只在这里分配，之后的热路径不碰锁/malloc） */
+static SpanBuf *claim_buf(void)
+{
+    int idx = atomic_fetch_add(&g_nbufs, 1);
+    if (idx >= SPAN_TRACE_MAX_THREADS) {
+        no_buf("all trace buffers taken");
+        return NULL;
+    }
+
+    SpanBuf *b = &g_bufs[idx];
+    b->ev = (SpanEvent *)calloc(g_cap, sizeof(SpanEvent));
+    if (!b->ev) {
+        no_buf("trace buffer allocation failed");
+        return NULL;
+    }
+    b->mask = g_cap - 1;
+    b->tid = (pid_t)syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), b->name, sizeof(b->name)) != 0) {
+        snprintf(b->name, sizeof(b->name), "tid-%d", (int)b->tid);
+    }
+    t_buf = b;
+    return b;
+}
+
+void span_record(SpanId id, uint64_t t0_ns, uint64_t t1_ns, uint32_t arg)
+{
+    SpanBuf *b = t_buf;
+    if (__builtin_expect(!b, 0)) {
+        if (t_no_buf || !(b = claim_buf())) {
+            atomic_fetch_add_explicit(&g_lost, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    uint64_t h = atomic_load_explicit(&b->head, memory_order_relaxed);
+    SpanEvent *e = &b->ev[h & b->mask];
+    uint64_t d = t1_ns > t0_ns ? t1_ns - t0_ns : 0;
+
+    uint64_t rel = t0_ns > g_base_ns ? t0_ns - g_base_ns : 0;
+    e->t0_id  = (rel & T0_MASK) | ((uint64_t)id << T0_BITS);
+    e->dur_ns = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    e->arg    = arg;
+    atomic_store_explicit(&b->head, h + 1, memory_order_release);
+}
+
+int span_trace_start(size_t events_per_thread)
+{
+    if (events_per_thread == 0) return -1;
+
+    size_t cap = 1;
+    while (cap < events_per_thread) cap <<= 1;
+
+    memset(g_bufs, 0, sizeof(g_bufs));
+    atomic_store(&g_nbufs, 0);
+    atomic_store(&g_lost, 0);
+    g_cap = cap;
+    g_base_ns = span_now_ns();
+    g_span_trace_enabled = 1;
+
+    LOGI("[%s] enabled: %zu events/thread (%zu KiB/thread)",
+         TAG, cap, cap * sizeof(SpanEvent) / 1024);
+    return 0;
+}
+
+int span_trace_write_chrome(const char *path)
+{
+    if (!path) return -1;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOGE("[%s] open %s failed", TAG, path);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int nbufs = atomic_load(&g_nbufs);
+    if (nbufs > SPAN_TRACE_MAX_THREADS) nbufs = SPAN_TRACE_MAX_THREADS;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"process_name\","
+                "\"args\":{\"name\":\"s2_rk_avsync\"}}", pid);
+
+    uint64_t written = 0, overwritten = 0;
+    for (int i = 0; i < nbufs; i++) {
+        const SpanBuf *b = &g_bufs[i];
+        if (!b->ev) continue;
+
+        fprintf(fp, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\","
+                    "\"args\":{\"name\":\"%s\"}}", pid, (int)b->tid, b->name);
+
+        uint64_t head = atomic_load_explicit(&b->head, memory_order_acquire);
+        uint64_t n = head < g_cap ? head : g_cap;
+        overwritten += head - n;
+
+        for (uint64_t s = head - n; s < head; s++) {
+            const SpanEvent *e = &b->ev[s & b->mask];
+            unsigned id = (unsigned)(e->t0_id >> T0_BITS);
+
+            fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"cat\":\"%s\","
+                        "\"ts\":%.3f,\"dur\":%.3f",
+                    pid, (int)b->tid, span_name((SpanId)id), span_cat(id),
+                    (double)(e->t0_id & T0_MASK) / 1000.0, (double)e->dur_ns / 1000.0);
+            if (e->arg) fprintf(fp, ",\"args\":{\"n\":%u}", e->arg);
+            fputc('}', fp);
+        }
+        written += n;
+    }
+    fprintf(fp, "\n]}\n");
+
+    int ret = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0) ret = -1;
+
+    unsigned long long lost = atomic_load(&g_lost);
+    if (ret == 0) {
+        LOGI("[%s] written %s: threads=%d events=%llu overwritten=%llu lost=%llu",
+             TAG, path, nbufs, (unsigned long long)written,
+             (unsigned long long)overwritten, lost);
+    } else {
+        LOGE("[%s] write %s failed", TAG, path);
+    }
+    return ret;
+}
+
+void span_trace_stop(void)
+{
+    g_span_trace_enabled = 0;
+    for (int i = 0; i < SPAN_TRACE_MAX_THREADS; i++) {
+        free(g_bufs[i].ev);
+        g_bufs[i].ev = NULL;
+    }
+    atomic_store(&g_nbufs, 0);
+}
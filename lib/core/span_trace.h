@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "thread_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 时间线 span（Chrome trace-event JSON，chrome://tracing / ui.perfetto.dev 可直接打开）。
+ *
+ * 与 evtrace 的区别：evtrace 记“某帧在某时刻到了哪一站”（给 avsync 回放），
+ * 这里记“某线程在 [t0, t1) 里在干什么”，用来看跨线程干扰（编码卡住时 sink 在不在 fwrite 等）。
+ *
+ * - 每个线程第一次记录时领取一个私有 ring（单写者，无锁，满了覆盖最旧的）
+ * - 关闭时：span_begin/span_end 只读一个全局 int + __builtin_expect，不取时钟
+ * - 只在所有阶段线程 join 之后调用 span_trace_write_chrome()
+ */
+
+typedef enum {
+    SPAN_V_DQBUF = 0,      // VIDIOC_DQBUF（合成源：等待下一帧到达）
+    SPAN_V_COPY,           // 拷贝进 VideoFrame + 推 raw 队列
+    SPAN_V_RAWQ_WAIT,      // 编码线程在 raw 队列上等
+    SPAN_V_ENC_PUT,        // MPP encode_put_frame（含拷进 MPP buffer）
+    SPAN_V_ENC_GET,        // MPP encode_get_packet
+    SPAN_V_ENCODE,         // 整次编码调用
+    SPAN_V_H264Q_WAIT,     // h264 sink 在队列上等
+    SPAN_V_WRITE,          // h264 fwrite
+    SPAN_A_READ,           // snd_pcm_readi（合成源：等待下一块）
+    SPAN_A_Q_WAIT,         // pcm sink 在队列上等
+    SPAN_A_WRITE,          // pcm fwrite
+    SPAN_AVSYNC_REPORT,    // 每秒 avsync_report
+    SPAN_COUNT
+} SpanId;
+
+/* 与 thread_stats 同一份线程预算：记 span 的都是 thread_stats_spawn 起的线程 */
+#define SPAN_TRACE_MAX_THREADS THREAD_STATS_MAX
+
+extern int g_span_trace_enabled;   // 线程启动前设好，之后只读
+
+static inline uint64_t span_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* 记录一条 [t0_ns, t1_ns) 的 span；arg 会作为 args.n 导出（字节数等，0 = 不导出） */
+void span_record(SpanId id, uint64_t t0_ns, uint64_t t1_ns, uint32_t arg);
+
+static inline uint64_t span_begin(void)
+{
+    if (__builtin_expect(!g_span_trace_enabled, 1)) return 0;
+    return span_now_ns();
+}
+
+static inline void span_end_arg(SpanId id, uint64_t t0_ns, uint32_t arg)
+{
+    if (__builtin_expect(!g_span_trace_enabled, 1)) return;
+    span_record(id, t0_ns, span_now_ns(), arg);
+}
+
+static inline void span_end(SpanId id, uint64_t t0_ns)
+{
+    span_end_arg(id, t0_ns, 0);
+}
+
+/* 开启记录；events_per_thread 向上取整到 2 的幂（16 B/条） */
+int  span_trace_start(size_t events_per_thread);
+
+/* 写 Chrome trace JSON，返回 0/-1 */
+int  span_trace_write_chrome(const char *path);
+
+/* 关闭记录并释放各线程 ring */
+void span_trace_stop(void);
+
+const char *span_name(SpanId id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,313 @@
+#include "thread_sched.h"
+#include "lib/utils/log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SCHED_MAX_RULES   24
+#define SCHED_MAX_APPLIED 32
+
+typedef struct {
+    char      name[16];
+    char      spec[48];         // 原样保留，报告里显示“请求的”
+    int       has_cpus;
+    cpu_set_t cpus;
+    int       policy;           // -1 = 不动
+    int       prio;
+    int       has_nice;
+    int       nice;
+} SchedRule;
+
+typedef struct {
+    char  name[16];
+    pid_t tid;
+    char  want[48];
+    char  cpus[32];
+    char  sched[16];
+    int   nice;
+    char  err[96];
+} SchedApplied;
+
+static pthread_mutex_t g_sc_mu = PTHREAD_MUTEX_INITIALIZER;
+static SchedRule       g_rules[SCHED_MAX_RULES];
+static int             g_nrules;
+static SchedApplied    g_applied[SCHED_MAX_APPLIED];
+static int             g_napplied;
+static cpu_set_t       g_online;
+static int             g_online_init;
+
+static void online_init(void)
+{
+    if (g_online_init) return;
+    CPU_ZERO(&g_online);
+    if (sched_getaffinity(0, sizeof(g_online), &g_online) != 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n && i < CPU_SETSIZE; i++) CPU_SET((int)i, &g_online);
+    }
+    g_online_init = 1;
+}
+
+/* "3"、"0-2"、"0+2"、"0-1+3"；结果与在线 CPU 取交集 */
+static int parse_cpus(const char *s, cpu_set_t *out)
+{
+    CPU_ZERO(out);
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10);
+        if (end == s || a < 0 || a >= CPU_SETSIZE) return -1;
+        long b = a;
+        if (*end == '-') {
+            s = end + 1;
+            b = strtol(s, &end, 10);
+            if (end == s || b < a || b >= CPU_SETSIZE) return -1;
+        }
+        for (long i = a; i <= b; i++) {
+            if (CPU_ISSET((int)i, &g_online)) CPU_SET((int)i, out);
+        }
+        if (*end == '+') end++;
+        else if (*end) return -1;
+        s = end;
+    }
+    return 0;
+}
+
+static void format_cpus(const cpu_set_t *set, char *out, size_t n)
+{
+    size_t off = 0;
+    out[0] = '\0';
+    for (int i = 0; i < CPU_SETSIZE && off < n; i++) {
+        if (!CPU_ISSET(i, set)) continue;
+        int j = i;
+        while (j + 1 < CPU_SETSIZE && CPU_ISSET(j + 1, set)) j++;
+        int w = j > i ? snprintf(out + off, n - off, "%s%d-%d", off ? "," : "", i, j)
+                      : snprintf(out + off, n - off, "%s%d", off ? "," : "", i);
+        if (w < 0) break;
+        off += (size_t)w;
+        i = j;
+    }
+    if (!out[0]) snprintf(out, n, "-");
+}
+
+static int parse_rule(const char *name, char *items)
+{
+    SchedRule r;
+    memset(&r, 0, sizeof(r));
+    r.policy = -1;
+    if (!*name || strlen(name) >= sizeof(r.name)) return -1;
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    snprintf(r.spec, sizeof(r.spec), "%s", items);
+
+    char *save = NULL;
+    for (char *it = strtok_r(items, ":", &save); it; it = strtok_r(NULL, ":", &save)) {
+        char *end;
+        if (strncmp(it, "cpu", 3) == 0) {
+            if (parse_cpus(it + 3, &r.cpus) != 0) return -1;
+            r.has_cpus = 1;
+        } else if (strncmp(it, "fifo", 4) == 0 || strncmp(it, "rr", 2) == 0) {
+            int fifo = it[0] == 'f';
+            long p = strtol(it + (fifo ? 4 : 2), &end, 10);
+            if (*end || p < 1 || p > 99) return -1;
+            r.policy = fifo ? SCHED_FIFO : SCHED_RR;
+            r.prio = (int)p;
+        } else if (strcmp(it, "other") == 0) {
+            r.policy = SCHED_OTHER;
+            r.prio = 0;
+        } else if (strncmp(it, "nice", 4) == 0) {
+            long v = strtol(it + 4, &end, 10);
+            if (end == it + 4 || *end || v < -20 || v > 19) return -1;
+            r.has_nice = 1;
+            r.nice = (int)v;
+        } else {
+            return -1;
+        }
+    }
+
+    // 同名规则覆盖（预设后面跟的覆盖项）
+    for (int i = 0; i < g_nrules; i++) {
+        if (strcmp(g_rules[i].name, r.name) == 0) {
+            g_rules[i] = r;
+            return 0;
+        }
+    }
+    if (g_nrules >= SCHED_MAX_RULES) return -1;
+    g_rules[g_nrules++] = r;
+    return 0;
+}
+
+/* 预设展开成规则串：最后一个在线核给采集，其余核给别的线程（单核机器上就都是同一个核） */
+static int expand_preset(const char *name, char *out, size_t n)
+{
+    int rt = strcmp(name, "rt") == 0;
+    if (!rt && strcmp(name, "pin") != 0) return -1;
+
+    int last = -1;
+    char rest[128] = "";
+    size_t off = 0;
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &g_online)) continue;
+        if (last >= 0) off += (size_t)snprintf(rest + off, sizeof(rest) - off, "%s%d", off ? "+" : "", last);
+        last = i;
+        if (off >= sizeof(rest)) return -1;
+    }
+    if (last < 0) return -1;
+    if (!rest[0]) snprintf(rest, sizeof(rest), "%d", last);
+
+    snprintf(out, n,
+             "acap=cpu%d%s,vcap=cpu%d%s,venc=cpu%s,ctl=cpu%s,main=cpu%s,"
+             "h264sink=cpu%s:nice5,pcmsink=cpu%s:nice5,fan-*=cpu%s:nice5",
+             last, rt ? ":fifo60" : "", last, rt ? ":fifo50" : "", rest, rest, rest, rest, rest, rest);
+    return 0;
+}
+
+int thread_sched_configure(const char *spec)
+{
+    if (!spec) return -1;
+    online_init();
+
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    int rc = 0;
+    char *save = NULL;
+    pthread_mutex_lock(&g_sc_mu);
+    for (char *tok = strtok_r(buf, ",", &save); tok && rc == 0; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            char preset[512];
+            if (expand_preset(tok, preset, sizeof(preset)) != 0) {
+                rc = -1;
+                break;
+            }
+            char *psave = NULL;
+            for (char *p = strtok_r(preset, ",", &psave); p && rc == 0; p = strtok_r(NULL, ",", &psave)) {
+                char *peq = strchr(p, '=');
+                *peq = '\0';
+                rc = parse_rule(p, peq + 1);
+            }
+            continue;
+        }
+        *eq = '\0';
+        rc = parse_rule(tok, eq + 1);
+    }
+    pthread_mutex_unlock(&g_sc_mu);
+    return rc;
+}
+
+int thread_sched_enabled(void)
+{
+    return g_nrules > 0;
+}
+
+static const SchedRule *find_rule(const char *name)
+{
+    const SchedRule *prefix = NULL;
+    for (int i = 0; i < g_nrules; i++) {
+        const SchedRule *r = &g_rules[i];
+        size_t n = strlen(r->name);
+        if (strcmp(r->name, name) == 0) return r;
+        if (n && r->name[n - 1] == '*' && strncmp(r->name, name, n - 1) == 0) prefix = r;
+    }
+    return prefix;
+}
+
+static const char *policy_name(int p)
+{
+    switch (p) {
+        case SCHED_FIFO:  return "fifo";
+        case SCHED_RR:    return "rr";
+        case SCHED_OTHER: return "other";
+#ifdef SCHED_BATCH
+        case SCHED_BATCH: return "batch";
+#endif
+#ifdef SCHED_IDLE
+        case SCHED_IDLE:  return "idle";
+#endif
+    }
+    return "?";
+}
+
+void thread_sched_apply_self(const char *name)
+{
+    pthread_mutex_lock(&g_sc_mu);
+    const SchedRule *found = name ? find_rule(name) : NULL;
+    SchedRule r;
+    if (found) r = *found;
+    pthread_mutex_unlock(&g_sc_mu);
+    if (!found) return;
+
+    SchedApplied a;
+    memset(&a, 0, sizeof(a));
+    snprintf(a.name, sizeof(a.name), "%s", name);
+    snprintf(a.want, sizeof(a.want), "%s", r.spec);
+    a.tid = (pid_t)syscall(SYS_gettid);
+    size_t eoff = 0;
+
+    // 顺序：先绑核再提优先级，免得 RT 线程在错误的核上先跑一段
+    if (r.has_cpus) {
+        if (CPU_COUNT(&r.cpus) == 0) {
+            eoff += (size_t)snprintf(a.err + eoff, sizeof(a.err) - eoff, "%scpu: none online", eoff ? "; " : "");
+        } else if (sched_setaffinity(0, sizeof(r.cpus), &r.cpus) != 0) {
+            eoff += (size_t)snprintf(a.err + eoff, sizeof(a.err) - eoff, "%scpu: %s", eoff ? "; " : "", strerror(errno));
+        }
+    }
+    if (r.policy >= 0 && eoff < sizeof(a.err)) {
+        struct sched_param sp = { .sched_priority = r.prio };
+        int err = pthread_setschedparam(pthread_self(), r.policy, &sp);
+        if (err != 0) {
+            eoff += (size_t)snprintf(a.err + eoff, sizeof(a.err) - eoff, "%s%s: %s", eoff ? "; " : "",
+                                     policy_name(r.policy), strerror(err));
+        }
+    }
+    if (r.has_nice && eoff < sizeof(a.err)) {
+        if (setpriority(PRIO_PROCESS, (id_t)a.tid, r.nice) != 0) {
+            eoff += (size_t)snprintf(a.err + eoff, sizeof(a.err) - eoff, "%snice: %s", eoff ? "; " : "", strerror(errno));
+        }
+    }
+
+    // 读回实际生效的
+    cpu_set_t cur;
+    CPU_ZERO(&cur);
+    if (sched_getaffinity(0, sizeof(cur), &cur) == 0) format_cpus(&cur, a.cpus, sizeof(a.cpus));
+    else snprintf(a.cpus, sizeof(a.cpus), "?");
+    int pol = 0;
+    struct sched_param sp;
+    if (pthread_getschedparam(pthread_self(), &pol, &sp) == 0) {
+        if (pol == SCHED_FIFO || pol == SCHED_RR) snprintf(a.sched, sizeof(a.sched), "%s/%d", policy_name(pol), sp.sched_priority);
+        else snprintf(a.sched, sizeof(a.sched), "%s", policy_name(pol));
+    }
+    errno = 0;
+    a.nice = getpriority(PRIO_PROCESS, (id_t)a.tid);
+
+    pthread_mutex_lock(&g_sc_mu);
+    if (g_napplied < SCHED_MAX_APPLIED) g_applied[g_napplied++] = a;
+    pthread_mutex_unlock(&g_sc_mu);
+}
+
+void thread_sched_report(void)
+{
+    pthread_mutex_lock(&g_sc_mu);
+    int n = g_napplied;
+    SchedApplied rows[SCHED_MAX_APPLIED];
+    memcpy(rows, g_applied, sizeof(SchedApplied) * (size_t)n);
+    pthread_mutex_unlock(&g_sc_mu);
+    if (!n) return;
+
+    char online[32];
+    format_cpus(&g_online, online, sizeof(online));
+    LOGI("[RT] %-10s %-7s %-24s %-8s %-9s %s   (online cpus %s)", "thread", "tid", "requested", "cpus", "sched", "nice", online);
+    for (int i = 0; i < n; i++) {
+        SchedApplied *a = &rows[i];
+        if (a->err[0]) {
+            LOGW("[RT] %-10s %-7d %-24s %-8s %-9s %-4d  FAILED: %s", a->name, (int)a->tid, a->want, a->cpus,
+                 a->sched, a->nice, a->err);
+        } else {
+            LOGI("[RT] %-10s %-7d %-24s %-8s %-9s %d", a->name, (int)a->tid, a->want, a->cpus, a->sched, a->nice);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*
+ * 每个阶段线程的 CPU 亲和性 / 调度策略 / nice。
+ *
+ * 规则按线程名（thread_stats_spawn 的 name，不含 "rkav-"）匹配，末尾 '*' 做前缀匹配（"fan-*"）；
+ * "main" 是主线程，也就是之后用普通 pthread_create 起的线程（日志、aio、metrics ...）继承的那一份。
+ * thread_stats_spawn 起的线程在跑业务函数之前自己套用规则，结果（实际读回来的亲和性 / 策略 / nice，
+ * 以及 EPERM 之类的失败）记进表里，thread_sched_report() 一次性打印。
+ *
+ * 描述串：[预设,]名字=项:项...,名字=项...
+ *   cpu<列表>   亲和性，如 cpu3、cpu0-2、cpu0+2（与在线 CPU 取交集，交集为空则不动）
+ *   fifo<N> / rr<N> / other   调度策略和 RT 优先级（1..99，需要 CAP_SYS_NICE 或 RLIMIT_RTPRIO）
+ *   nice<N>     nice 值（-20..19，调低需要权限）
+ * 预设（按在线 CPU 数生成，最后一个核留给采集）：
+ *   rt   acap / vcap 绑最后一个核跑 SCHED_FIFO（音频 60 > 视频 50），其余线程限制在别的核，sink 类 nice 5
+ *   pin  同样的绑核，但不要 RT 权限：采集不改策略，其余 nice 5
+ */
+
+/* 解析并登记规则；同名规则后面的覆盖前面的。返回 -1 = 描述串不合法 */
+int  thread_sched_configure(const char *spec);
+
+/* 是否登记了任何规则 */
+int  thread_sched_enabled(void);
+
+/* 在调用线程上套用名字匹配的规则并记录结果；没有匹配的规则时什么都不做 */
+void thread_sched_apply_self(const char *name);
+
+/* 打印 [RT] 表：每个套用过规则的线程，请求的 vs 实际的 */
+void thread_sched_report(void);
+
+#ifdef __cplusplus
+}
+#endif
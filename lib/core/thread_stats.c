@@ -0,0 +1,324 @@
+#include "thread_stats.h"
+#include "thread_sched.h"
+#include "lib/utils/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    char      name[16];
+    pthread_t th;
+    pid_t     tid;
+    int       used;
+    int       active;
+    int       exited;       // 线程已退出，只留最终值；表满时可以腾给新线程
+
+    void   *(*fn)(void *);
+    void     *arg;
+
+    /* 上一次采样的累计值 */
+    uint64_t  cpu_ns;
+    uint64_t  vol_cs;
+    uint64_t  invol_cs;
+    uint64_t  min_flt;
+    uint64_t  maj_flt;
+    uint64_t  rq_wait_ns;
+    uint64_t  rq_slices;
+
+    /* 最近一个窗口的增量 */
+    double    cpu_pct;
+    uint64_t  d_vol_cs;
+    uint64_t  d_invol_cs;
+    uint64_t  d_min_flt;
+    uint64_t  d_maj_flt;
+    uint64_t  d_rq_wait_ns;
+    uint64_t  d_rq_slices;
+} ThreadSlot;
+
+static pthread_mutex_t g_ts_mu = PTHREAD_MUTEX_INITIALIZER;
+static ThreadSlot      g_ts[THREAD_STATS_MAX];
+static int             g_ts_schedstat;
+static uint64_t        g_ts_last_wall_ns;
+static uint64_t        g_ts_last_proc_ns;
+
+static uint64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    if (clock_gettime(id, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* 线程名 + --thread-sched 规则：登记进表与否都要做 */
+static void name_self(const char *name)
+{
+    char comm[16];
+    snprintf(comm, sizeof(comm), "rkav-%.10s", name);
+    pthread_setname_np(pthread_self(), comm);
+    thread_sched_apply_self(name);
+}
+
+static void *thread_trampoline(void *p)
+{
+    ThreadSlot *s = (ThreadSlot *)p;
+
+    name_self(s->name);
+
+    pthread_mutex_lock(&g_ts_mu);
+    s->th = pthread_self();
+    s->tid = (pid_t)syscall(SYS_gettid);
+    s->active = 1;
+    pthread_mutex_unlock(&g_ts_mu);
+
+    void *ret = s->fn(s->arg);
+
+    // 退出前自己补一次最终值（RUSAGE_THREAD 只能取调用线程），之后统计线程不再碰这个 pthread_t
+    struct rusage ru;
+    int have_ru = getrusage(RUSAGE_THREAD, &ru) == 0;
+    uint64_t cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    pthread_mutex_lock(&g_ts_mu);
+    if (cpu) s->cpu_ns = cpu;
+    if (have_ru) {
+        s->vol_cs   = (uint64_t)ru.ru_nvcsw;
+        s->invol_cs = (uint64_t)ru.ru_nivcsw;
+        s->min_flt  = (uint64_t)ru.ru_minflt;
+        s->maj_flt  = (uint64_t)ru.ru_majflt;
+    }
+    s->active = 0;
+    s->exited = 1;
+    s->cpu_pct = 0.0;
+    pthread_mutex_unlock(&g_ts_mu);
+    return ret;
+}
+
+/* 表满时的退路：不统计，但名字和调度规则照样套用 */
+typedef struct {
+    char    name[16];
+    void *(*fn)(void *);
+    void   *arg;
+} BareStart;
+
+static void *bare_trampoline(void *p)
+{
+    BareStart b = *(BareStart *)p;
+    free(p);
+    name_self(b.name);
+    return b.fn(b.arg);
+}
+
+int thread_stats_spawn(pthread_t *th, const char *name, void *(*fn)(void *), void *arg)
+{
+    if (!th || !name || !fn) return -1;
+
+    ThreadSlot *s = NULL, *old = NULL;
+    pthread_mutex_lock(&g_ts_mu);
+    for (int i = 0; i < THREAD_STATS_MAX && !s; i++) {
+        if (!g_ts[i].used) s = &g_ts[i];
+        else if (g_ts[i].exited && !old) old = &g_ts[i];
+    }
+    // 没有空位时腾一个已退出线程的：丢掉它的最终值，总比新线程不统计好
+    if (!s && old) {
+        LOGW("[thread] stats table full, %s reuses the slot of exited %s", name, old->name);
+        s = old;
+    }
+    if (s) {
+        memset(s, 0, sizeof(*s));
+        s->used = 1;
+    }
+    pthread_mutex_unlock(&g_ts_mu);
+
+    if (!s) {
+        LOGW("[thread] stats table full (%d), %s not tracked", THREAD_STATS_MAX, name);
+        BareStart *b = (BareStart *)malloc(sizeof(*b));
+        if (!b) return -1;
+        snprintf(b->name, sizeof(b->name), "%s", name);
+        b->fn = fn;
+        b->arg = arg;
+        if (pthread_create(th, NULL, bare_trampoline, b) != 0) {
+            free(b);
+            return -1;
+        }
+        return 0;
+    }
+
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->fn = fn;
+    s->arg = arg;
+
+    if (pthread_create(th, NULL, thread_trampoline, s) != 0) {
+        pthread_mutex_lock(&g_ts_mu);
+        s->used = 0;
+        pthread_mutex_unlock(&g_ts_mu);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_stats_enable_schedstat(int on)
+{
+    g_ts_schedstat = on;
+}
+
+/* /proc/self/task/<tid>/status: voluntary_ctxt_switches / nonvoluntary_ctxt_switches */
+static void read_ctx_switches(pid_t tid, uint64_t *vol, uint64_t *invol)
+{
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)tid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+
+    unsigned long long v;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "voluntary_ctxt_switches: %llu", &v) == 1) *vol = v;
+        else if (sscanf(line, "nonvoluntary_ctxt_switches: %llu", &v) == 1) *invol = v;
+    }
+    fclose(fp);
+}
+
+/* /proc/self/task/<tid>/stat：第 10 / 12 字段为 minflt / majflt（comm 可能含空格，从最后一个 ')' 后数） */
+static void read_faults(pid_t tid, uint64_t *min_flt, uint64_t *maj_flt)
+{
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)tid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    char *p = strrchr(buf, ')');
+    if (!p) return;
+
+    unsigned long long mn, mj;
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %llu %*u %llu", &mn, &mj) == 2) {
+        *min_flt = mn;
+        *maj_flt = mj;
+    }
+}
+
+/* /proc/self/task/<tid>/schedstat: run_ns wait_ns timeslices */
+static int read_schedstat(pid_t tid, uint64_t *wait_ns, uint64_t *slices)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", (int)tid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    unsigned long long run, wait, sl;
+    int ok = fscanf(fp, "%llu %llu %llu", &run, &wait, &sl) == 3;
+    fclose(fp);
+    if (!ok) return -1;
+    *wait_ns = wait;
+    *slices = sl;
+    return 0;
+}
+
+static void sample_slot(ThreadSlot *s, uint64_t wall_dt_ns)
+{
+    clockid_t cid;
+    uint64_t cpu = s->cpu_ns;
+    if (pthread_getcpuclockid(s->th, &cid) == 0) {
+        uint64_t v = clock_ns(cid);
+        if (v) cpu = v;
+    }
+
+    uint64_t vol = s->vol_cs, invol = s->invol_cs;
+    uint64_t mn = s->min_flt, mj = s->maj_flt;
+    read_ctx_switches(s->tid, &vol, &invol);
+    read_faults(s->tid, &mn, &mj);
+
+    s->cpu_pct    = wall_dt_ns ? (double)(cpu - s->cpu_ns) * 100.0 / (double)wall_dt_ns : 0.0;
+    s->d_vol_cs   = vol - s->vol_cs;
+    s->d_invol_cs = invol - s->invol_cs;
+    s->d_min_flt  = mn - s->min_flt;
+    s->d_maj_flt  = mj - s->maj_flt;
+
+    s->cpu_ns   = cpu;
+    s->vol_cs   = vol;
+    s->invol_cs = invol;
+    s->min_flt  = mn;
+    s->maj_flt  = mj;
+
+    if (g_ts_schedstat) {
+        uint64_t w = s->rq_wait_ns, sl = s->rq_slices;
+        if (read_schedstat(s->tid, &w, &sl) == 0) {
+            s->d_rq_wait_ns = w - s->rq_wait_ns;
+            s->d_rq_slices  = sl - s->rq_slices;
+            s->rq_wait_ns   = w;
+            s->rq_slices    = sl;
+        }
+    }
+}
+
+void thread_stats_tick_print(void)
+{
+    uint64_t wall = clock_ns(CLOCK_MONOTONIC);
+    uint64_t proc = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t dt = g_ts_last_wall_ns ? wall - g_ts_last_wall_ns : 0;
+    double proc_pct = dt ? (double)(proc - g_ts_last_proc_ns) * 100.0 / (double)dt : 0.0;
+    g_ts_last_wall_ns = wall;
+    g_ts_last_proc_ns = proc;
+
+    char line[768], sched[512];
+    int off = snprintf(line, sizeof(line), "[CPU] proc=%.1f%%", proc_pct);
+    int soff = snprintf(sched, sizeof(sched), "[SCHED] rq_wait ms/slice");
+
+    pthread_mutex_lock(&g_ts_mu);
+    for (int i = 0; i < THREAD_STATS_MAX; i++) {
+        ThreadSlot *s = &g_ts[i];
+        if (!s->used || !s->active) continue;
+        sample_slot(s, dt);
+
+        if (off < (int)sizeof(line)) {
+            off += snprintf(line + off, sizeof(line) - (size_t)off,
+                            " | %s=%.1f%% cs=%llu/%llu",
+                            s->name, s->cpu_pct,
+                            (unsigned long long)s->d_vol_cs,
+                            (unsigned long long)s->d_invol_cs);
+        }
+        if (off < (int)sizeof(line) && (s->d_min_flt || s->d_maj_flt)) {
+            off += snprintf(line + off, sizeof(line) - (size_t)off, " pf=%llu/%llu",
+                            (unsigned long long)s->d_min_flt,
+                            (unsigned long long)s->d_maj_flt);
+        }
+        if (g_ts_schedstat && soff < (int)sizeof(sched)) {
+            double per = s->d_rq_slices
+                ? (double)s->d_rq_wait_ns / 1e6 / (double)s->d_rq_slices : 0.0;
+            soff += snprintf(sched + soff, sizeof(sched) - (size_t)soff, " %s=%.2f/%.3f",
+                             s->name, (double)s->d_rq_wait_ns / 1e6, per);
+        }
+    }
+    pthread_mutex_unlock(&g_ts_mu);
+
+    if (!dt) return;  // 第一次只建立基线
+    LOGI("%s", line);
+    if (g_ts_schedstat) LOGI("%s", sched);
+}
+
+size_t thread_stats_snapshot(ThreadStatSample *out, size_t max)
+{
+    if (!out) return 0;
+    size_t n = 0;
+
+    pthread_mutex_lock(&g_ts_mu);
+    for (int i = 0; i < THREAD_STATS_MAX && n < max; i++) {
+        const ThreadSlot *s = &g_ts[i];
+        if (!s->used) continue;
+        out[n].name     = s->name;
+        out[n].active   = s->active;
+        out[n].cpu_sec  = (double)s->cpu_ns / 1e9;
+        out[n].vol_cs   = s->vol_cs;
+        out[n].invol_cs = s->invol_cs;
+        out[n].min_flt  = s->min_flt;
+        out[n].maj_flt  = s->maj_flt;
+        out[n].cpu_pct  = s->cpu_pct;
+        n++;
+    }
+    pthread_mutex_unlock(&g_ts_mu);
+    return n;
+}
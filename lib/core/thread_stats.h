@@ -0,0 +1,53 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*
+ * 每个阶段线程的 CPU / 调度统计。
+ *
+ * 用 thread_stats_spawn() 代替 pthread_create()：线程会被命名为 "rkav-<name>"，
+ * 并登记进全局表；统计线程每秒调用 thread_stats_tick_print() 采样：
+ *   - CPU 时间：pthread_getcpuclockid（ns 精度，可在别的线程读）
+ *   - 主动/被动上下文切换：/proc/self/task/<tid>/status
+ *   - minor/major 缺页：/proc/self/task/<tid>/stat
+ *   - 可选：run-queue 等待时间：/proc/self/task/<tid>/schedstat（需内核 CONFIG_SCHED_INFO）
+ * 线程开始跑之前先套用 thread_sched 里同名的亲和性 / 调度规则（见 thread_sched.h）。
+ * 线程退出前自动注销并用 RUSAGE_THREAD 记下最终值，采样不会碰已经回收的 pthread_t。
+ * 表满时先腾已退出线程的槽；实在没有就不统计（LOGW），名字和调度规则照样套用。
+ */
+
+/* ctl + 图阶段（SG_MAX_STAGES 16）+ pool worker（SG_MAX_WORKERS 8）+ 扇出 sink（FANOUT_MAX_SINKS 8），
+ * 再留些余量；main.c 里有静态断言 */
+#define THREAD_STATS_MAX 40
+
+typedef struct {
+    const char *name;
+    int         active;
+    double      cpu_sec;        // 累计
+    uint64_t    vol_cs;         // 累计
+    uint64_t    invol_cs;       // 累计
+    uint64_t    min_flt;
+    uint64_t    maj_flt;
+    double      cpu_pct;        // 最近一个窗口
+} ThreadStatSample;
+
+int  thread_stats_spawn(pthread_t *th, const char *name, void *(*fn)(void *), void *arg);
+
+/* 是否额外读取 schedstat 统计 run-queue 等待 */
+void thread_stats_enable_schedstat(int on);
+
+/* 采样一次并打印 [CPU] 行（开启 schedstat 时再打一行 [SCHED]） */
+void thread_stats_tick_print(void);
+
+/* 拷贝最近一次采样结果，返回条数（给 /metrics 用） */
+size_t thread_stats_snapshot(ThreadStatSample *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
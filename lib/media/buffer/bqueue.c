@@ -61,8 +61,7 @@ int bq_push(BQueue *q,void *item)
     pthread_mutex_lock(&q->mtx);
 
     while(!q->closed && q->size == q->capacity){
-        pthread_mutex_unlock(&q->mtx);
-        return -1; /* 队列满，直接返回失败 */
+        pthread_cond_wait(&q->not_full, &q->mtx);
     }
 
     if(q->closed){
@@ -0,0 +1,265 @@
+#include "fanout.h"
+#include "thread_stats.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "fanout"
+
+void fanout_init(Fanout *f, void (*ref)(int kind, void *obj), void (*unref)(int kind, void *obj))
+{
+    memset(f, 0, sizeof(*f));
+    f->ref = ref;
+    f->unref = unref;
+}
+
+int fanout_add(Fanout *f, const char *name, FanoutPolicy policy, unsigned depth,
+               FanoutWriteFn write, void *user)
+{
+    if (!f || !write || f->n >= FANOUT_MAX_SINKS) return -1;
+    if (depth < 4) depth = 4;
+    FanoutSink *s = &f->sinks[f->n];
+    memset(s, 0, sizeof(*s));
+    s->ring = (FanoutItem *)calloc(depth, sizeof(FanoutItem));
+    if (!s->ring) {
+        LOGE("[%s] alloc %u items for %s failed", TAG, depth, name);
+        return -1;
+    }
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->policy = policy;
+    s->write = write;
+    s->user = user;
+    s->hub = f;
+    s->cap = depth;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->not_empty, NULL);
+    pthread_cond_init(&s->not_full, NULL);
+    lat_hist_init(&s->lag);
+    return f->n++;
+}
+
+static void *sink_thread(void *arg)
+{
+    FanoutSink *s = (FanoutSink *)arg;
+    Fanout *f = s->hub;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->size && !s->closed) pthread_cond_wait(&s->not_empty, &s->lock);
+        if (!s->size) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        FanoutItem it = s->ring[s->head];
+        s->head = (s->head + 1) % s->cap;
+        s->size--;
+        int skip = 0;
+        if (it.kind == FANOUT_VIDEO && s->pop_need_key) {
+            if (it.key) s->pop_need_key = 0;
+            else {
+                s->dropped_video++;
+                skip = 1;
+            }
+        }
+        pthread_cond_signal(&s->not_full);
+        pthread_mutex_unlock(&s->lock);
+
+        if (!skip) {
+            if (s->write(s->user, it.kind, it.obj) != 0) {
+                atomic_fetch_add_explicit(&s->write_errors, 1, memory_order_relaxed);
+            }
+            atomic_fetch_add_explicit(&s->written, 1, memory_order_relaxed);
+            if (it.kind == FANOUT_VIDEO) {
+                atomic_store_explicit(&s->last_video_pts, it.pts_us, memory_order_relaxed);
+            }
+            lat_hist_record_span(&s->lag, it.t_in_us, rkav_now_monotonic_us());
+        }
+        f->unref(it.kind, it.obj);
+    }
+    return NULL;
+}
+
+int fanout_start(Fanout *f)
+{
+    for (int i = 0; i < f->n; i++) {
+        FanoutSink *s = &f->sinks[i];
+        char tn[16];
+        snprintf(tn, sizeof(tn), "fan-%s", s->name);
+        if (thread_stats_spawn(&s->th, tn, sink_thread, s) != 0) {
+            LOGE("[%s] spawn %s failed", TAG, tn);
+            return -1;
+        }
+        s->started = 1;
+        LOGI("[%s] sink %s: depth=%u policy=%s", TAG, s->name, s->cap, fanout_policy_name(s->policy));
+    }
+    return 0;
+}
+
+static void push_one(Fanout *f, FanoutSink *s, const FanoutItem *in)
+{
+    pthread_mutex_lock(&s->lock);
+    if (s->closed) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    // drop-new 丢过视频：非关键帧一律不进，关键帧到了再恢复（音频照常）
+    if (in->kind == FANOUT_VIDEO && s->push_need_key) {
+        if (!in->key) {
+            s->dropped_video++;
+            pthread_mutex_unlock(&s->lock);
+            return;
+        }
+        s->push_need_key = 0;
+    }
+    if (s->size == s->cap) {
+        if (s->policy == FANOUT_BLOCK) {
+            uint64_t t0 = rkav_now_monotonic_us();
+            s->blocked++;
+            while (s->size == s->cap && !s->closed) pthread_cond_wait(&s->not_full, &s->lock);
+            s->blocked_us += rkav_now_monotonic_us() - t0;
+            if (s->closed) {
+                pthread_mutex_unlock(&s->lock);
+                return;
+            }
+        } else if (s->policy == FANOUT_DROP_NEW) {
+            if (in->kind == FANOUT_VIDEO) {
+                s->dropped_video++;
+                s->push_need_key = 1;
+            } else {
+                s->dropped_audio++;
+            }
+            pthread_mutex_unlock(&s->lock);
+            return;
+        } else {
+            FanoutItem old = s->ring[s->head];
+            s->head = (s->head + 1) % s->cap;
+            s->size--;
+            if (old.kind == FANOUT_VIDEO) {
+                s->dropped_video++;
+                s->pop_need_key = 1;
+            } else {
+                s->dropped_audio++;
+            }
+            // 挤掉的那份在锁内放掉：可能正好是最后一个引用，也就是 free 一块包数据
+            f->unref(old.kind, old.obj);
+        }
+    }
+    f->ref(in->kind, in->obj);
+    s->ring[(s->head + s->size) % s->cap] = *in;
+    s->size++;
+    s->pushed++;
+    if (s->size > s->max_depth) s->max_depth = s->size;
+    if (s->size > s->tick_max_depth) s->tick_max_depth = s->size;
+    pthread_cond_signal(&s->not_empty);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void fanout_publish(Fanout *f, int kind, void *obj, bool key, uint64_t pts_us)
+{
+    if (!f || !f->n || !obj) return;
+    FanoutItem it = { .obj = obj, .kind = kind, .key = key, .pts_us = pts_us, .t_in_us = rkav_now_monotonic_us() };
+    if (kind == FANOUT_VIDEO) atomic_store_explicit(&f->last_video_pts, pts_us, memory_order_relaxed);
+    for (int i = 0; i < f->n; i++) push_one(f, &f->sinks[i], &it);
+}
+
+void fanout_tick_print(Fanout *f)
+{
+    if (!f || !f->n) return;
+    uint64_t newest = atomic_load_explicit(&f->last_video_pts, memory_order_relaxed);
+    char line[512];
+    int off = snprintf(line, sizeof(line), "[FAN]");
+    for (int i = 0; i < f->n && off < (int)sizeof(line); i++) {
+        FanoutSink *s = &f->sinks[i];
+        pthread_mutex_lock(&s->lock);
+        unsigned depth = s->size, peak = s->tick_max_depth;
+        uint64_t dv = s->dropped_video, da = s->dropped_audio, blk = s->blocked;
+        s->tick_max_depth = s->size;
+        pthread_mutex_unlock(&s->lock);
+
+        LatHistSnap snap;
+        lat_hist_take(&s->lag, &snap);
+        uint64_t done = atomic_load_explicit(&s->last_video_pts, memory_order_relaxed);
+        double behind_ms = done && newest > done ? (double)(newest - done) / 1000.0 : 0.0;
+        off += snprintf(line + off, sizeof(line) - (size_t)off,
+                        "%s %s q=%u/%u(peak %u) lag p50/p95/max=%.1f/%.1f/%.1fms behind=%.0fms drop=%llu/%llu blk=%llu",
+                        i ? " |" : "", s->name, depth, s->cap, peak,
+                        lat_hist_percentile_us(&snap, 0.50) / 1000.0, lat_hist_percentile_us(&snap, 0.95) / 1000.0,
+                        (double)snap.max_us / 1000.0, behind_ms,
+                        (unsigned long long)dv, (unsigned long long)da, (unsigned long long)blk);
+    }
+    LOGI("%s", line);
+}
+
+void fanout_stop(Fanout *f)
+{
+    if (!f) return;
+    for (int i = 0; i < f->n; i++) {
+        FanoutSink *s = &f->sinks[i];
+        pthread_mutex_lock(&s->lock);
+        s->closed = 1;
+        // 丢包策略的 sink（网络预览）积压的不再补发，直接放掉；block 的写完为止
+        for (; s->policy != FANOUT_BLOCK && s->size; s->size--) {
+            FanoutItem *it = &s->ring[s->head];
+            if (it->kind == FANOUT_VIDEO) s->dropped_video++;
+            else s->dropped_audio++;
+            f->unref(it->kind, it->obj);
+            s->head = (s->head + 1) % s->cap;
+        }
+        pthread_cond_broadcast(&s->not_empty);
+        pthread_cond_broadcast(&s->not_full);
+        pthread_mutex_unlock(&s->lock);
+    }
+    for (int i = 0; i < f->n; i++) {
+        FanoutSink *s = &f->sinks[i];
+        if (s->started) pthread_join(s->th, NULL);
+        // 没起线程（启动失败）时队列里剩的引用在这里放掉
+        for (; s->size; s->size--) {
+            FanoutItem *it = &s->ring[s->head];
+            f->unref(it->kind, it->obj);
+            s->head = (s->head + 1) % s->cap;
+        }
+        LOGI("[%s] %s closed: pushed=%llu written=%llu dropped video=%llu audio=%llu "
+             "blocked=%llu (%.1fms) max_depth=%u/%u write_err=%llu",
+             TAG, s->name, (unsigned long long)s->pushed, (unsigned long long)atomic_load(&s->written),
+             (unsigned long long)s->dropped_video, (unsigned long long)s->dropped_audio,
+             (unsigned long long)s->blocked, (double)s->blocked_us / 1000.0, s->max_depth, s->cap,
+             (unsigned long long)atomic_load(&s->write_errors));
+    }
+}
+
+void fanout_destroy(Fanout *f)
+{
+    if (!f) return;
+    for (int i = 0; i < f->n; i++) {
+        FanoutSink *s = &f->sinks[i];
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->not_empty);
+        pthread_cond_destroy(&s->not_full);
+        free(s->ring);
+        s->ring = NULL;
+    }
+    f->n = 0;
+}
+
+int fanout_parse_policy(const char *s, FanoutPolicy *out)
+{
+    if (!s || !out) return -1;
+    if (strcmp(s, "block") == 0) *out = FANOUT_BLOCK;
+    else if (strcmp(s, "drop-new") == 0) *out = FANOUT_DROP_NEW;
+    else if (strcmp(s, "drop-old") == 0) *out = FANOUT_DROP_OLD;
+    else return -1;
+    return 0;
+}
+
+const char *fanout_policy_name(FanoutPolicy p)
+{
+    switch (p) {
+        case FANOUT_BLOCK:    return "block";
+        case FANOUT_DROP_NEW: return "drop-new";
+        case FANOUT_DROP_OLD: return "drop-old";
+    }
+    return "?";
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lat_hist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 扇出：一路编码流（视频包 + 音频块）分给多个 sink，不拷贝数据。
+ *
+ * - 包带引用计数：发布时给每个 sink 各加一个引用，sink 写完放手，最后一个放手的释放
+ *   （引用怎么加减由调用方给的 ref / unref 决定，这里只当 void*）
+ * - 每个 sink 一个有界队列 + 一个线程，视频和音频按发布顺序进同一个队列（封装器一路串行写）
+ * - 每个 sink 自己的满队列策略，慢 sink 只影响它自己：
+ *     block     满了等：不丢，但会拖住发布方（只给必须完整的本地文件）
+ *     drop-new  丢新来的；丢过视频后一直丢到下一个关键帧，保证能解
+ *     drop-old  挤掉最老的；挤掉过视频后出队侧跳到下一个关键帧
+ * - 每个 sink 记 lag（入队 -> 写完，直方图）和媒体时间落后量（最新发布的视频 pts - 已写完的）
+ */
+
+#define FANOUT_MAX_SINKS 8
+
+enum { FANOUT_VIDEO = 1, FANOUT_AUDIO = 2 };
+
+typedef enum {
+    FANOUT_BLOCK = 0,
+    FANOUT_DROP_NEW,
+    FANOUT_DROP_OLD,
+} FanoutPolicy;
+
+typedef struct {
+    void     *obj;
+    int       kind;
+    bool      key;
+    uint64_t  pts_us;
+    uint64_t  t_in_us;
+} FanoutItem;
+
+/* sink 线程里调用；返回 -1 计 write_errors（要不要停整个流水线由回调自己决定） */
+typedef int (*FanoutWriteFn)(void *user, int kind, void *obj);
+
+struct Fanout;
+
+typedef struct {
+    char            name[12];
+    FanoutPolicy    policy;
+    FanoutWriteFn   write;
+    void           *user;
+    struct Fanout  *hub;
+    pthread_t       th;
+    int             started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty, not_full;
+    FanoutItem     *ring;
+    unsigned        cap, head, size;
+    int             closed;
+    int             push_need_key;     // drop-new：丢过视频，入队侧等关键帧
+    int             pop_need_key;      // drop-old：挤掉过视频，出队侧等关键帧
+
+    // 锁内更新
+    uint64_t        pushed, dropped_video, dropped_audio, blocked, blocked_us;
+    unsigned        max_depth, tick_max_depth;
+
+    // sink 线程写，tick 读
+    LatHist         lag;
+    atomic_ullong   written, write_errors;
+    atomic_ullong   last_video_pts;
+} FanoutSink;
+
+typedef struct Fanout {
+    FanoutSink      sinks[FANOUT_MAX_SINKS];
+    int             n;
+    void          (*ref)(int kind, void *obj);
+    void          (*unref)(int kind, void *obj);
+    atomic_ullong   last_video_pts;    // 最新发布的视频 pts
+} Fanout;
+
+void fanout_init(Fanout *f, void (*ref)(int kind, void *obj), void (*unref)(int kind, void *obj));
+
+/* 登记一个 sink（启动前）；返回下标，满了 / 分配失败返回 -1 */
+int  fanout_add(Fanout *f, const char *name, FanoutPolicy policy, unsigned depth,
+                FanoutWriteFn write, void *user);
+
+/* 每个 sink 起一个线程（"fan-<name>"） */
+int  fanout_start(Fanout *f);
+
+/* 发布方线程：每个 sink 各拿一个引用；调用方自己的那份不动 */
+void fanout_publish(Fanout *f, int kind, void *obj, bool key, uint64_t pts_us);
+
+/* 控制线程：每秒一行 [FAN]，每个 sink 的队列深度 / lag / 丢弃 */
+void fanout_tick_print(Fanout *f);
+
+/* 关队列：block 的 sink 写完已入队的再退出，丢包策略的积压直接放掉；join 后打印汇总（之后 tick_print 仍可调用） */
+void fanout_stop(Fanout *f);
+
+/* 释放队列；tick_print 的线程停了之后调用 */
+void fanout_destroy(Fanout *f);
+
+/* "block" / "drop-new" / "drop-old" */
+int  fanout_parse_policy(const char *s, FanoutPolicy *out);
+const char *fanout_policy_name(FanoutPolicy p);
+
+#ifdef __cplusplus
+}
+#endif
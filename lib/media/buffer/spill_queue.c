@@ -0,0 +1,363 @@
+#include "spill_queue.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TAG "spill"
+
+#define REC_HDR     8
+#define REC_MAGIC   0x31515053u           // "SPQ1"
+
+static inline size_t rec_size(size_t len)
+{
+    return REC_HDR + ((len + 7) & ~(size_t)7);
+}
+
+static int open_scratch(const char *dir, const char *name, size_t bytes)
+{
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        // 不支持 O_TMPFILE 的文件系统：建了马上 unlink，效果一样
+        char path[512];
+        snprintf(path, sizeof(path), "%s/rkav-spill-%s-XXXXXX", dir, name);
+        fd = mkostemp(path, O_CLOEXEC);
+        if (fd >= 0) unlink(path);
+    }
+    if (fd < 0) {
+        LOGE("[%s] %s: scratch file in %s failed: %s", TAG, name, dir, strerror(errno));
+        return -1;
+    }
+    int err = posix_fallocate(fd, 0, (off_t)bytes);
+    if (err != 0) {
+        LOGE("[%s] %s: reserve %zu MiB in %s failed: %s", TAG, name, bytes >> 20, dir, strerror(err));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int spq_init(SpillQueue *q, const char *name, size_t capacity,
+             const char *spill_dir, size_t spill_bytes, const SpillOps *ops)
+{
+    if (!q || capacity == 0) return -1;
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+    snprintf(q->name, sizeof(q->name), "%s", name ? name : "queue");
+    if (ops) q->ops = *ops;
+
+    q->items = (void **)calloc(capacity, sizeof(void *));
+    if (!q->items) return -1;
+    q->capacity = capacity;
+
+    if (spill_dir && spill_bytes) {
+        if (!ops || !ops->bytes || !ops->store || !ops->load || !ops->release) {
+            LOGE("[%s] %s: spilling needs all SpillOps", TAG, q->name);
+            free(q->items);
+            return -1;
+        }
+        spill_bytes = (spill_bytes + 4095) & ~(size_t)4095;
+        q->fd = open_scratch(spill_dir, q->name, spill_bytes);
+        if (q->fd < 0) {
+            free(q->items);
+            return -1;
+        }
+        void *m = mmap(NULL, spill_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+        if (m == MAP_FAILED) {
+            LOGE("[%s] %s: mmap %zu bytes failed: %s", TAG, q->name, spill_bytes, strerror(errno));
+            close(q->fd);
+            free(q->items);
+            return -1;
+        }
+        q->map = (uint8_t *)m;
+        q->map_size = spill_bytes;
+        LOGI("[%s] %s: ram=%zu items, spill=%zu MiB in %s", TAG, q->name, capacity, spill_bytes >> 20, spill_dir);
+    }
+
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+void spq_close(SpillQueue *q)
+{
+    if (!q) return;
+    pthread_mutex_lock(&q->mtx);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+void spq_destroy(SpillQueue *q)
+{
+    if (!q || !q->items) return;
+    if (q->map && q->spilled_items) {
+        LOGI("[%s] %s: spilled %llu items / %.1f MiB total, high-water %zu items / %.1f MiB, "
+             "full_waits=%llu (%.1fms) load_failed=%llu", TAG, q->name,
+             (unsigned long long)q->spilled_items, (double)q->spilled_bytes / (1024.0 * 1024.0),
+             q->spill_high_items, (double)q->spill_high_bytes / (1024.0 * 1024.0),
+             (unsigned long long)q->full_waits, (double)q->full_wait_us / 1000.0,
+             (unsigned long long)q->load_failed);
+    }
+    if (q->ops.release) {
+        for (; q->size; q->size--) {
+            q->ops.release(q->items[q->head]);
+            q->head = (q->head + 1) % q->capacity;
+        }
+    }
+    free(q->items);
+    if (q->map) munmap(q->map, q->map_size);
+    if (q->fd >= 0) close(q->fd);
+    pthread_mutex_destroy(&q->mtx);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+}
+
+/* ---------- 暂存文件环（锁内） ---------- */
+
+/* 能写下 need 字节时返回写入偏移（回绕时为 0），写不下返回 -1；不改状态 */
+static long spill_fit(const SpillQueue *q, size_t need)
+{
+    if (q->s_count == 0) return need <= q->map_size ? 0 : -1;
+    // 严格小于：写完后 tail 不能追上 head，否则满和空分不清
+    if (q->s_tail > q->s_head) {
+        if (q->map_size - q->s_tail >= need) return (long)q->s_tail;
+        return q->s_head > need ? 0 : -1;
+    }
+    return q->s_head - q->s_tail > need ? (long)q->s_tail : -1;
+}
+
+/* 同 spill_fit，回绕时顺手写回绕标记 */
+static long spill_reserve(SpillQueue *q, size_t need)
+{
+    if (q->s_count == 0) q->s_head = q->s_tail = 0;
+    long off = spill_fit(q, need);
+    if (off == 0 && q->s_count && q->s_tail > q->s_head && q->map_size - q->s_tail >= REC_HDR) {
+        uint32_t mark[2] = { 0, REC_MAGIC };
+        memcpy(q->map + q->s_tail, mark, sizeof(mark));
+    }
+    return off;
+}
+
+/* 记下见过的最大序列化长度：spq_has_room 不知道下一条多大时按它估 */
+static inline void note_item_len(SpillQueue *q, size_t len)
+{
+    if (len > q->item_max) q->item_max = len;
+}
+
+static void spill_store(SpillQueue *q, void *item, size_t len, long off)
+{
+    uint32_t hdr[2] = { (uint32_t)len, REC_MAGIC };
+    memcpy(q->map + off, hdr, sizeof(hdr));
+    q->ops.store(item, q->map + off + REC_HDR);
+    q->ops.release(item);
+    note_item_len(q, len);
+
+    q->s_tail = (size_t)off + rec_size(len);
+    q->s_count++;
+    q->s_bytes += rec_size(len);
+    q->spilled_items++;
+    q->spilled_bytes += len;
+    if (q->s_count > q->spill_high_items) q->spill_high_items = q->s_count;
+    if (q->s_bytes > q->spill_high_bytes) q->spill_high_bytes = q->s_bytes;
+}
+
+static void *spill_load(SpillQueue *q)
+{
+    if (q->map_size - q->s_head < REC_HDR) q->s_head = 0;
+    uint32_t hdr[2];
+    memcpy(hdr, q->map + q->s_head, sizeof(hdr));
+    if (hdr[0] == 0) {                                   // 回绕标记
+        q->s_head = 0;
+        memcpy(hdr, q->map, sizeof(hdr));
+    }
+    size_t len = hdr[0];
+    void *item = NULL;
+    if (hdr[1] == REC_MAGIC) item = q->ops.load(q->map + q->s_head + REC_HDR, len);
+    if (!item) q->load_failed++;
+
+    q->s_head += rec_size(len);
+    q->s_count--;
+    q->s_bytes -= rec_size(len);
+    if (q->s_count == 0) q->s_head = q->s_tail = 0;
+    return item;
+}
+
+/* ---------- API ---------- */
+
+int spq_push(SpillQueue *q, void *item)
+{
+    if (!q) return -1;
+    size_t need = 0;
+    pthread_mutex_lock(&q->mtx);
+    uint64_t t_wait = 0;
+    long off = -1;
+    for (;;) {
+        if (q->closed) {
+            if (t_wait) q->full_wait_us += rkav_now_monotonic_us() - t_wait;
+            pthread_mutex_unlock(&q->mtx);
+            return -1;
+        }
+        // 文件里有东西时必须接着往文件写，否则会插到前面去
+        if (!q->s_count && q->size < q->capacity) break;
+        if (q->map) {
+            if (!need) need = rec_size(q->ops.bytes(item));
+            off = spill_reserve(q, need);
+            if (off >= 0) break;
+        }
+        if (!t_wait) {
+            t_wait = rkav_now_monotonic_us();
+            if (q->map) q->full_waits++;
+        }
+        pthread_cond_wait(&q->not_full, &q->mtx);
+    }
+    if (t_wait) q->full_wait_us += rkav_now_monotonic_us() - t_wait;
+
+    if (off >= 0) {
+        spill_store(q, item, q->ops.bytes(item), off);
+    } else {
+        if (q->map) note_item_len(q, q->ops.bytes(item));
+        q->items[(q->head + q->size) % q->capacity] = item;
+        q->size++;
+        if (q->size > q->ram_high) q->ram_high = q->size;
+    }
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mtx);
+    return 0;
+}
+
+int spq_try_push(SpillQueue *q, void *item)
+{
+    if (!q) return -1;
+    pthread_mutex_lock(&q->mtx);
+    if (q->closed) {
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    if (!q->s_count && q->size < q->capacity) {
+        if (q->map) note_item_len(q, q->ops.bytes(item));
+        q->items[(q->head + q->size) % q->capacity] = item;
+        q->size++;
+        if (q->size > q->ram_high) q->ram_high = q->size;
+    } else {
+        size_t len = q->map ? q->ops.bytes(item) : 0;
+        long off = q->map ? spill_reserve(q, rec_size(len)) : -1;
+        if (off < 0) {
+            pthread_mutex_unlock(&q->mtx);
+            return 1;
+        }
+        spill_store(q, item, len, off);
+    }
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mtx);
+    return 0;
+}
+
+int spq_try_pop(SpillQueue *q, void **out)
+{
+    if (!q || !out) return -1;
+    pthread_mutex_lock(&q->mtx);
+    for (;;) {
+        if (q->size) {
+            *out = q->items[q->head];
+            q->head = (q->head + 1) % q->capacity;
+            q->size--;
+            break;
+        }
+        if (q->s_count) {
+            void *item = spill_load(q);
+            if (!item) continue;
+            *out = item;
+            break;
+        }
+        int r = q->closed ? -1 : 0;
+        pthread_mutex_unlock(&q->mtx);
+        return r;
+    }
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mtx);
+    return 1;
+}
+
+int spq_has_room(SpillQueue *q, size_t bytes)
+{
+    pthread_mutex_lock(&q->mtx);
+    int room = q->closed || (!q->s_count && q->size < q->capacity);
+    if (!room && q->map) room = spill_fit(q, rec_size(bytes ? bytes : q->item_max)) >= 0;
+    pthread_mutex_unlock(&q->mtx);
+    return room;
+}
+
+int spq_pop(SpillQueue *q, void **out)
+{
+    if (!q || !out) return -1;
+    pthread_mutex_lock(&q->mtx);
+    for (;;) {
+        while (!q->size && !q->s_count && !q->closed) pthread_cond_wait(&q->not_empty, &q->mtx);
+        if (q->size) {
+            *out = q->items[q->head];
+            q->head = (q->head + 1) % q->capacity;
+            q->size--;
+            break;
+        }
+        if (q->s_count) {
+            // 内存窗口空了才读文件：内存里的一定更早
+            void *item = spill_load(q);
+            if (!item) continue;
+            *out = item;
+            break;
+        }
+        pthread_mutex_unlock(&q->mtx);
+        return 0;
+    }
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mtx);
+    return 1;
+}
+
+size_t spq_size(SpillQueue *q)
+{
+    pthread_mutex_lock(&q->mtx);
+    size_t n = q->size + q->s_count;
+    pthread_mutex_unlock(&q->mtx);
+    return n;
+}
+
+size_t spq_capacity(SpillQueue *q)
+{
+    return q->capacity;
+}
+
+size_t spq_spilled(SpillQueue *q)
+{
+    pthread_mutex_lock(&q->mtx);
+    size_t n = q->s_count;
+    pthread_mutex_unlock(&q->mtx);
+    return n;
+}
+
+void spq_tick_print(SpillQueue *q)
+{
+    if (!q || !q->map) return;
+    pthread_mutex_lock(&q->mtx);
+    size_t ram = q->size, ram_high = q->ram_high, sc = q->s_count, sb = q->s_bytes;
+    size_t hi = q->spill_high_bytes;
+    uint64_t total = q->spilled_items, d = total - q->last_spilled_items, waits = q->full_waits;
+    q->last_spilled_items = total;
+    pthread_mutex_unlock(&q->mtx);
+
+    LOGI("[SPILL] %s ram=%zu/%zu (high %zu) spill=%zu items %.1fMiB/%zuMiB (high %.1fMiB) spilled=%llu (+%llu) full_waits=%llu",
+         q->name, ram, q->capacity, ram_high, sc, (double)sb / (1024.0 * 1024.0), q->map_size >> 20,
+         (double)hi / (1024.0 * 1024.0), (unsigned long long)total, (unsigned long long)d,
+         (unsigned long long)waits);
+}
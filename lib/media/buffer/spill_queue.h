@@ -0,0 +1,89 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 溢写队列：内存里是一个普通的有界 FIFO（与 BQueue 相同语义），满了不再阻塞生产者，
+ * 而是把新来的条目序列化进一个 mmap 的暂存文件（环形），消费者按序读回来。
+ *
+ * - 顺序：暂存文件里一旦有东西，之后的条目一律进文件，直到读空；内存里的永远比文件里的早，
+ *   pop 先取内存再取文件，整体严格 FIFO
+ * - 暂存文件建在 spill_dir（最好是 tmpfs 或者不是录像那张卡的设备），O_TMPFILE 匿名，进程退出自动回收；
+ *   启动时 fallocate 占满，写满了才退回到阻塞（计 full_waits），不会在 mmap 上 SIGBUS
+ * - 条目怎么序列化由调用方给的 SpillOps 决定；写进文件后原条目立刻释放，读回时重新分配
+ * - 不给 spill_dir 时就是一个 BQueue
+ *
+ * 返回值约定同 BQueue：push 0 = 成功、-1 = 已关闭；pop 1 = 取到、0 = 已关闭且空。
+ * 不阻塞的版本：try_push 1 = 满（条目没动）；try_pop 1 = 取到、0 = 暂时空、-1 = 已关闭且空。
+ */
+
+typedef struct {
+    size_t (*bytes)(const void *item);                 // 序列化后的长度
+    void   (*store)(const void *item, uint8_t *dst);   // 写进 dst（长度 = bytes()）
+    void  *(*load)(const uint8_t *src, size_t len);    // 从 src 重建；失败返回 NULL（计 load_failed）
+    void   (*release)(void *item);                     // 释放原条目（store 之后 / destroy 时）
+} SpillOps;
+
+typedef struct {
+    char            name[16];
+    SpillOps        ops;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    int             closed;
+
+    // 内存窗口
+    void          **items;
+    size_t          capacity, size, head;
+
+    // 暂存文件环
+    int             fd;
+    uint8_t        *map;
+    size_t          map_size;
+    size_t          s_head, s_tail;       // 读 / 写偏移
+    size_t          s_count;              // 文件里的条目数
+    size_t          s_bytes;              // 文件里的有效字节（不含回绕浪费）
+    size_t          item_max;             // 见过的最大序列化长度（spq_has_room 的默认估计）
+
+    // 统计（锁内更新）
+    size_t          ram_high;
+    size_t          spill_high_items;
+    size_t          spill_high_bytes;
+    uint64_t        spilled_items, spilled_bytes;
+    uint64_t        full_waits, full_wait_us;
+    uint64_t        load_failed;
+    uint64_t        last_spilled_items;   // tick 用
+} SpillQueue;
+
+/* spill_dir 为 NULL 或 spill_bytes 为 0 时不溢写 */
+int    spq_init(SpillQueue *q, const char *name, size_t capacity,
+                const char *spill_dir, size_t spill_bytes, const SpillOps *ops);
+void   spq_close(SpillQueue *q);
+void   spq_destroy(SpillQueue *q);          // 释放还在内存窗口里的条目
+
+int    spq_push(SpillQueue *q, void *item);
+int    spq_pop(SpillQueue *q, void **out);
+int    spq_try_push(SpillQueue *q, void *item);
+int    spq_try_pop(SpillQueue *q, void **out);
+
+/* 现在 push 一条 bytes 长（序列化后）的条目会不会阻塞；内存窗口满了再看暂存文件环写不写得下。
+ * bytes 为 0 时按见过的最大条目估——估小了 push 仍可能阻塞，不能阻塞的调用方要用 try_push */
+int    spq_has_room(SpillQueue *q, size_t bytes);
+
+size_t spq_size(SpillQueue *q);             // 内存 + 文件
+size_t spq_capacity(SpillQueue *q);         // 内存窗口
+size_t spq_spilled(SpillQueue *q);          // 文件里的条目数
+
+/* 开了溢写才打印：[SPILL] <name> ram=.. spill=.. high=.. spilled=.. */
+void   spq_tick_print(SpillQueue *q);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,702 @@
+#include "stage_graph.h"
+#include "thread_stats.h"
+#include "span_trace.h"
+#include "lib/utils/log.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "graph"
+
+#define SG_POOL_BATCH 8     // worker 一次最多替一个阶段处理几条，之后让给别的阶段
+
+static const char *policy_name(SgPolicy p)
+{
+    switch (p) {
+        case SG_BLOCK:    return "block";
+        case SG_DROP_NEW: return "drop-new";
+        case SG_DROP_OLD: return "drop-old";
+    }
+    return "?";
+}
+
+void sg_init(SgGraph *g, void *user, const char *spill_dir, size_t spill_bytes, int n_workers)
+{
+    memset(g, 0, sizeof(*g));
+    g->user = user;
+    g->spill_dir = spill_dir;
+    g->spill_bytes = spill_bytes;
+    if (n_workers < 1) n_workers = 1;
+    if (n_workers > SG_MAX_WORKERS) n_workers = SG_MAX_WORKERS;
+    g->n_workers = n_workers;
+    pthread_mutex_init(&g->pool_mu, NULL);
+    pthread_cond_init(&g->pool_cv, NULL);
+    g->inited = 1;
+}
+
+int sg_register_type(SgGraph *g, const SgPortType *t)
+{
+    if (!t || !t->name || !t->unref || g->n_types >= SG_MAX_TYPES) return -1;
+    g->types[g->n_types++] = *t;
+    return 0;
+}
+
+int sg_register_class(SgGraph *g, const SgStageClass *c)
+{
+    if (!c || !c->kind || g->n_classes >= SG_MAX_CLASSES) return -1;
+    if (!c->run == !c->process) {
+        LOGE("[%s] class %s: needs exactly one of run / process", TAG, c->kind);
+        return -1;
+    }
+    if (c->run && c->in[0]) {
+        LOGE("[%s] class %s: run stages can't have inputs", TAG, c->kind);
+        return -1;
+    }
+    g->classes[g->n_classes++] = *c;
+    return 0;
+}
+
+static int find_type(SgGraph *g, const char *name)
+{
+    for (int i = 0; i < g->n_types; i++) {
+        if (strcmp(g->types[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static SgStage *find_stage(SgGraph *g, const char *name)
+{
+    for (int i = 0; i < g->n_stages; i++) {
+        if (strcmp(g->stages[i].name, name) == 0) return &g->stages[i];
+    }
+    return NULL;
+}
+
+SgEdge *sg_find_edge(SgGraph *g, const char *name)
+{
+    for (int i = 0; i < g->n_edges; i++) {
+        if (strcmp(g->edges[i].name, name) == 0) return &g->edges[i];
+    }
+    return NULL;
+}
+
+/* ---------- 解析 ---------- */
+
+static int add_stage(SgGraph *g, char **tok, int n)
+{
+    if (n < 3 || n > 4) {
+        LOGE("[%s] want: stage <name> <kind> [thread|pool]", TAG);
+        return -1;
+    }
+    if (g->n_stages >= SG_MAX_STAGES || strlen(tok[1]) >= sizeof(g->stages[0].name) || find_stage(g, tok[1])) {
+        LOGE("[%s] stage %s: duplicate, name too long or too many stages", TAG, tok[1]);
+        return -1;
+    }
+    const SgStageClass *cls = NULL;
+    for (int i = 0; i < g->n_classes; i++) {
+        if (strcmp(g->classes[i].kind, tok[2]) == 0) cls = &g->classes[i];
+    }
+    if (!cls) {
+        LOGE("[%s] stage %s: unknown kind %s", TAG, tok[1], tok[2]);
+        return -1;
+    }
+    int pool = 0;
+    if (n == 4) {
+        if (strcmp(tok[3], "pool") == 0) pool = 1;
+        else if (strcmp(tok[3], "thread") != 0) {
+            LOGE("[%s] stage %s: want thread or pool, got %s", TAG, tok[1], tok[3]);
+            return -1;
+        }
+    }
+    if (pool && cls->run) {
+        LOGE("[%s] stage %s: %s is a source loop and needs its own thread", TAG, tok[1], cls->kind);
+        return -1;
+    }
+
+    SgStage *st = &g->stages[g->n_stages++];
+    memset(st, 0, sizeof(*st));
+    snprintf(st->name, sizeof(st->name), "%s", tok[1]);
+    st->cls = cls;
+    st->g = g;
+    st->pool = pool;
+    pthread_mutex_init(&st->mu, NULL);
+    pthread_cond_init(&st->cv, NULL);
+    return 0;
+}
+
+/* "<stage>[.<port>]"：port 是下标或端口类型名 */
+static int parse_endpoint(SgGraph *g, char *s, int is_src, SgStage **st, int *port)
+{
+    char *dot = strchr(s, '.');
+    if (dot) *dot = '\0';
+    *st = find_stage(g, s);
+    if (!*st) {
+        LOGE("[%s] unknown stage %s", TAG, s);
+        return -1;
+    }
+    const char *const *ports = is_src ? (*st)->cls->out : (*st)->cls->in;
+    int n = 0;
+    while (n < SG_MAX_PORTS && ports[n]) n++;
+    *port = 0;
+    if (dot) {
+        const char *p = dot + 1;
+        if (isdigit((unsigned char)*p)) *port = atoi(p);
+        else {
+            *port = -1;
+            for (int i = 0; i < n; i++) {
+                if (strcmp(ports[i], p) == 0) *port = i;
+            }
+        }
+    }
+    if (*port < 0 || *port >= n) {
+        LOGE("[%s] stage %s has no %s port %s", TAG, s, is_src ? "output" : "input", dot ? dot + 1 : "0");
+        return -1;
+    }
+    return 0;
+}
+
+static int add_edge(SgGraph *g, char **tok, int n)
+{
+    if (n < 4 || strcmp(tok[2], "->") != 0) {
+        LOGE("[%s] want: edge <src>[.port] -> <dst>[.port] [cap=n] [policy=..] [spill] [name=..]", TAG);
+        return -1;
+    }
+    if (g->n_edges >= SG_MAX_EDGES) {
+        LOGE("[%s] too many edges", TAG);
+        return -1;
+    }
+    SgStage *src, *dst;
+    int sp, dp;
+    char src_name[16], dst_name[16];
+    snprintf(src_name, sizeof(src_name), "%s", tok[1]);
+    snprintf(dst_name, sizeof(dst_name), "%s", tok[3]);
+    if (parse_endpoint(g, tok[1], 1, &src, &sp) != 0) return -1;
+    if (parse_endpoint(g, tok[3], 0, &dst, &dp) != 0) return -1;
+
+    int ts = find_type(g, src->cls->out[sp]);
+    int td = find_type(g, dst->cls->in[dp]);
+    if (ts < 0 || ts != td) {
+        LOGE("[%s] edge %s -> %s: port types differ (%s vs %s)", TAG, src->name, dst->name,
+             src->cls->out[sp], dst->cls->in[dp]);
+        return -1;
+    }
+    if (src->n_out >= SG_MAX_EDGES || dst->n_in >= SG_MAX_EDGES) return -1;
+
+    SgEdge *e = &g->edges[g->n_edges];
+    memset(e, 0, sizeof(*e));
+    e->type = ts;
+    e->src = src;
+    e->dst = dst;
+    e->src_port = sp;
+    e->dst_port = dp;
+    e->policy = SG_BLOCK;
+    snprintf(e->name, sizeof(e->name), "%.7s-%.7s", src->name, dst->name);
+    unsigned cap = 16;
+
+    for (int i = 4; i < n; i++) {
+        if (strncmp(tok[i], "cap=", 4) == 0) {
+            cap = (unsigned)atoi(tok[i] + 4);
+        } else if (strcmp(tok[i], "policy=block") == 0) {
+            e->policy = SG_BLOCK;
+        } else if (strcmp(tok[i], "policy=drop-new") == 0) {
+            e->policy = SG_DROP_NEW;
+        } else if (strcmp(tok[i], "policy=drop-old") == 0) {
+            e->policy = SG_DROP_OLD;
+        } else if (strcmp(tok[i], "spill") == 0) {
+            e->spill = 1;
+        } else if (strncmp(tok[i], "name=", 5) == 0 && tok[i][5] && strlen(tok[i] + 5) < sizeof(e->name)) {
+            snprintf(e->name, sizeof(e->name), "%s", tok[i] + 5);
+        } else {
+            LOGE("[%s] edge %s -> %s: bad attribute %s", TAG, src_name, dst_name, tok[i]);
+            return -1;
+        }
+    }
+    const SgPortType *t = &g->types[ts];
+    if (cap < 1 || cap > 65536) {
+        LOGE("[%s] edge %s: cap must be 1..65536", TAG, e->name);
+        return -1;
+    }
+    if (e->spill && (e->policy != SG_BLOCK || !t->spill)) {
+        LOGE("[%s] edge %s: spill needs policy=block and a serializable type (%s isn't)", TAG, e->name,
+             t->spill ? policy_name(e->policy) : t->name);
+        return -1;
+    }
+    if (sg_find_edge(g, e->name)) {
+        LOGE("[%s] duplicate edge name %s", TAG, e->name);
+        return -1;
+    }
+
+    if (t->spill) e->ops = *t->spill;
+    e->ops.release = t->unref;
+    int spill = e->spill && g->spill_dir;
+    if (spq_init(&e->q, e->name, cap, spill ? g->spill_dir : NULL, spill ? g->spill_bytes : 0, &e->ops) != 0) {
+        LOGE("[%s] edge %s: queue init failed", TAG, e->name);
+        return -1;
+    }
+    atomic_init(&e->pop_need_key, 0);
+    src->out[src->n_out++] = e;
+    dst->in[dst->n_in++] = e;
+    g->n_edges++;
+    return 0;
+}
+
+int sg_build(SgGraph *g, const char *desc)
+{
+    if (!desc) return -1;
+    char *buf = strdup(desc);
+    if (!buf) return -1;
+
+    int rc = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(buf, "\n;", &save); line && rc == 0; line = strtok_r(NULL, "\n;", &save)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *tok[16];
+        int n = 0;
+        char *ts = NULL;
+        for (char *t = strtok_r(line, " \t\r", &ts); t && n < 16; t = strtok_r(NULL, " \t\r", &ts)) tok[n++] = t;
+        if (n == 0) continue;
+        if (strcmp(tok[0], "stage") == 0) rc = add_stage(g, tok, n);
+        else if (strcmp(tok[0], "edge") == 0) rc = add_edge(g, tok, n);
+        else {
+            LOGE("[%s] unknown statement: %s", TAG, tok[0]);
+            rc = -1;
+        }
+    }
+    free(buf);
+    if (rc != 0) return -1;
+
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        for (int p = 0; p < SG_MAX_PORTS && st->cls->out[p]; p++) {
+            int fan = 0;
+            for (int k = 0; k < st->n_out; k++) fan += st->out[k]->src_port == p;
+            if (fan > 1 && !g->types[find_type(g, st->cls->out[p])].ref) {
+                LOGE("[%s] stage %s: %s items can't be shared by %d edges", TAG, st->name, st->cls->out[p], fan);
+                return -1;
+            }
+        }
+        if (st->pool) g->pool_alive++;
+    }
+    g->built = 1;
+    return 0;
+}
+
+/* ---------- 调度 ---------- */
+
+static void pool_schedule(SgStage *st)
+{
+    SgGraph *g = st->g;
+    pthread_mutex_lock(&g->pool_mu);
+    if (st->done) {
+        // 已结束
+    } else if (st->running) {
+        st->again = 1;
+    } else if (!st->queued) {
+        st->queued = 1;
+        g->ready[(g->ready_head + g->ready_n) % SG_MAX_STAGES] = st;
+        g->ready_n++;
+        pthread_cond_signal(&g->pool_cv);
+    }
+    pthread_mutex_unlock(&g->pool_mu);
+}
+
+static void wake(SgStage *st)
+{
+    if (st->pool) {
+        pool_schedule(st);
+        return;
+    }
+    pthread_mutex_lock(&st->mu);
+    st->signals++;
+    pthread_cond_signal(&st->cv);
+    pthread_mutex_unlock(&st->mu);
+}
+
+/* 轮询所有输入边：1 = 取到，0 = 暂时都空，-1 = 都关了且读空 */
+static int pop_any(SgStage *st, void **item, int *port)
+{
+    SgGraph *g = st->g;
+    if (st->n_in == 0) return -1;
+    int closed = 0;
+    for (int k = 0; k < st->n_in; k++) {
+        int i = (st->rr + k) % st->n_in;
+        SgEdge *e = st->in[i];
+        const SgPortType *t = &g->types[e->type];
+        for (;;) {
+            int r = spq_try_pop(&e->q, item);
+            if (r == 0) break;
+            if (r < 0) {
+                closed++;
+                break;
+            }
+            // 下游空出位置：等位置的 pool 上游重新排上
+            if (e->src->pool && atomic_exchange(&e->src->wait_room, 0)) pool_schedule(e->src);
+            if (t->is_key && atomic_load(&e->pop_need_key)) {
+                if (!t->is_key(*item)) {
+                    t->unref(*item);
+                    atomic_fetch_add(&e->dropped, 1);
+                    continue;
+                }
+                atomic_store(&e->pop_need_key, 0);
+            }
+            st->rr = (i + 1) % st->n_in;
+            *port = e->dst_port;
+            return 1;
+        }
+    }
+    return closed == st->n_in ? -1 : 0;
+}
+
+static void finish(SgStage *st)
+{
+    if (st->finished) return;
+    st->finished = 1;
+    if (st->opened && st->cls->close) st->cls->close(st);
+    for (int k = 0; k < st->n_out; k++) {
+        SgEdge *e = st->out[k];
+        // 只有停止时还会剩：正常结束前 outputs_have_room 已经补推过
+        if (e->pending) {
+            st->g->types[e->type].unref(e->pending);
+            e->pending = NULL;
+            atomic_fetch_add(&e->dropped, 1);
+        }
+        spq_close(&e->q);
+        wake(e->dst);
+    }
+}
+
+static void *stage_thread(void *arg)
+{
+    SgStage *st = (SgStage *)arg;
+    SgGraph *g = st->g;
+
+    // 独占线程的阶段在自己线程上 open：打开 FIFO 之类会阻塞的资源时不拖住别的阶段
+    if (st->cls->open) {
+        if (st->cls->open(st) != 0) {
+            LOGE("[%s] stage %s (%s) open failed", TAG, st->name, st->cls->kind);
+            sg_stop(g);
+            finish(st);
+            return NULL;
+        }
+        st->opened = 1;
+    }
+
+    if (st->cls->run) {
+        st->cls->run(st);
+    } else {
+        while (!atomic_load(&g->stop)) {
+            void *item;
+            int port;
+            int r = pop_any(st, &item, &port);
+            if (r < 0) break;
+            if (r > 0) {
+                st->cls->process(st, port, item);
+                atomic_fetch_add_explicit(&st->processed, 1, memory_order_relaxed);
+                continue;
+            }
+            uint64_t sp = st->cls->wait_span >= 0 ? span_begin() : 0;
+            pthread_mutex_lock(&st->mu);
+            while (!st->signals && !atomic_load(&g->stop)) pthread_cond_wait(&st->cv, &st->mu);
+            st->signals = 0;
+            pthread_mutex_unlock(&st->mu);
+            if (st->cls->wait_span >= 0) span_end((SpanId)st->cls->wait_span, sp);
+        }
+    }
+    finish(st);
+    return NULL;
+}
+
+/* 先补推挂着的条目，再看 block 边有没有空位；只在跑这个阶段的 worker 上调用 */
+static int outputs_have_room(SgStage *st)
+{
+    for (int k = 0; k < st->n_out; k++) {
+        SgEdge *e = st->out[k];
+        if (e->pending) {
+            int r = spq_try_push(&e->q, e->pending);
+            if (r == 1) return 0;
+            if (r == 0) {
+                atomic_fetch_add_explicit(&e->pushed, 1, memory_order_relaxed);
+                wake(e->dst);
+            } else {
+                st->g->types[e->type].unref(e->pending);
+            }
+            e->pending = NULL;
+        }
+        if (e->policy == SG_BLOCK && !spq_has_room(&e->q, 0)) return 0;
+    }
+    return 1;
+}
+
+static void *pool_worker(void *arg)
+{
+    SgGraph *g = (SgGraph *)arg;
+    for (;;) {
+        pthread_mutex_lock(&g->pool_mu);
+        while (!atomic_load(&g->stop) && g->pool_alive > 0 && g->ready_n == 0) {
+            pthread_cond_wait(&g->pool_cv, &g->pool_mu);
+        }
+        if (atomic_load(&g->stop) || g->pool_alive == 0) {
+            pthread_mutex_unlock(&g->pool_mu);
+            break;
+        }
+        SgStage *st = g->ready[g->ready_head];
+        g->ready_head = (g->ready_head + 1) % SG_MAX_STAGES;
+        g->ready_n--;
+        st->queued = 0;
+        st->running = 1;
+        st->again = 0;
+        pthread_mutex_unlock(&g->pool_mu);
+
+        int n = 0, eos = 0;
+        while (n < SG_POOL_BATCH && !atomic_load(&g->stop)) {
+            // 输出边满了就不取输入：worker 不能阻塞在 push 上，否则下游可能等不到 worker
+            if (!outputs_have_room(st)) {
+                atomic_store(&st->wait_room, 1);
+                if (!outputs_have_room(st)) break;
+                atomic_store(&st->wait_room, 0);
+            }
+            void *item;
+            int port;
+            int r = pop_any(st, &item, &port);
+            if (r < 0) {
+                eos = 1;
+                break;
+            }
+            if (r == 0) break;
+            st->cls->process(st, port, item);
+            atomic_fetch_add_explicit(&st->processed, 1, memory_order_relaxed);
+            n++;
+        }
+        if (eos) finish(st);
+
+        pthread_mutex_lock(&g->pool_mu);
+        st->running = 0;
+        if (eos) {
+            st->done = 1;
+            if (--g->pool_alive == 0) pthread_cond_broadcast(&g->pool_cv);
+        } else if (!st->queued && (st->again || n == SG_POOL_BATCH)) {
+            st->queued = 1;
+            g->ready[(g->ready_head + g->ready_n) % SG_MAX_STAGES] = st;
+            g->ready_n++;
+            pthread_cond_signal(&g->pool_cv);
+        }
+        pthread_mutex_unlock(&g->pool_mu);
+    }
+    return NULL;
+}
+
+int sg_start(SgGraph *g)
+{
+    if (!g->built) return -1;
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        if (!st->pool) continue;
+        if (st->cls->open && st->cls->open(st) != 0) {
+            LOGE("[%s] stage %s (%s) open failed", TAG, st->name, st->cls->kind);
+            return -1;
+        }
+        st->opened = 1;
+    }
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        if (st->pool) continue;
+        if (thread_stats_spawn(&st->th, st->name, stage_thread, st) != 0) {
+            LOGE("[%s] spawn %s failed", TAG, st->name);
+            return -1;
+        }
+        st->started = 1;
+    }
+    if (g->pool_alive > 0) {
+        for (int i = 0; i < g->n_workers; i++) {
+            char tn[16];
+            snprintf(tn, sizeof(tn), "pool-%d", i);
+            if (thread_stats_spawn(&g->workers[i], tn, pool_worker, g) != 0) {
+                LOGE("[%s] spawn %s failed", TAG, tn);
+                return -1;
+            }
+            g->n_started_workers++;
+        }
+        // 先排一轮：没有输入边的 pool 阶段要靠这一轮发现自己已经结束
+        for (int i = 0; i < g->n_stages; i++) {
+            if (g->stages[i].pool) pool_schedule(&g->stages[i]);
+        }
+    }
+    return 0;
+}
+
+/* ---------- 发布 ---------- */
+
+static int edge_push(SgGraph *g, SgEdge *e, void *item)
+{
+    const SgPortType *t = &g->types[e->type];
+    if (t->is_key && e->push_need_key) {
+        if (!t->is_key(item)) {
+            t->unref(item);
+            atomic_fetch_add(&e->dropped, 1);
+            return 1;
+        }
+        e->push_need_key = 0;
+    }
+
+    int r;
+    switch (e->policy) {
+        case SG_BLOCK:
+            if (e->src->pool && !e->pending) {
+                // pool worker 不阻塞：推不进去先挂着，下游 pop 时把本阶段重新排上，outputs_have_room 补推
+                r = spq_try_push(&e->q, item);
+                if (r == 1) {
+                    e->pending = item;
+                    atomic_store(&e->src->wait_room, 1);
+                    return 0;
+                }
+            } else {
+                r = spq_push(&e->q, item);
+            }
+            break;
+        case SG_DROP_NEW:
+            r = spq_try_push(&e->q, item);
+            if (r == 1) {
+                t->unref(item);
+                atomic_fetch_add(&e->dropped, 1);
+                if (t->is_key) e->push_need_key = 1;
+                return 1;
+            }
+            break;
+        default:
+            for (;;) {
+                r = spq_try_push(&e->q, item);
+                if (r != 1) break;
+                void *old;
+                if (spq_try_pop(&e->q, &old) == 1) {
+                    t->unref(old);
+                    atomic_fetch_add(&e->dropped, 1);
+                    if (t->is_key) atomic_store(&e->pop_need_key, 1);
+                }
+            }
+            break;
+    }
+    if (r != 0) {
+        t->unref(item);
+        return -1;
+    }
+    atomic_fetch_add_explicit(&e->pushed, 1, memory_order_relaxed);
+    wake(e->dst);
+    return 0;
+}
+
+int sg_emit(SgStage *st, int port, void *item)
+{
+    SgGraph *g = st->g;
+    const SgPortType *t = &g->types[find_type(g, st->cls->out[port])];
+    SgEdge *edges[SG_MAX_EDGES];
+    int n = 0;
+    for (int k = 0; k < st->n_out; k++) {
+        if (st->out[k]->src_port == port) edges[n++] = st->out[k];
+    }
+    if (atomic_load(&g->stop)) {
+        t->unref(item);
+        return -1;
+    }
+    if (n == 0) {
+        // 没接边的输出端口：直接放掉
+        t->unref(item);
+        return 0;
+    }
+    // 每条边一个引用：调用方交进来的那个给最后一条
+    for (int k = 0; k < n - 1; k++) t->ref(item);
+
+    int dropped = 0, closed = 0;
+    st->drop_edge = NULL;
+    for (int k = 0; k < n; k++) {
+        int r = edge_push(g, edges[k], item);
+        if (r > 0) {
+            if (!dropped) st->drop_edge = edges[k];
+            dropped = 1;
+        } else if (r < 0) {
+            closed++;
+        }
+    }
+    if (closed == n) return -1;
+    return dropped;
+}
+
+/* ---------- 停止 / 清理 ---------- */
+
+void sg_stop(SgGraph *g)
+{
+    if (!g->inited) return;
+    atomic_store(&g->stop, 1);
+    for (int i = 0; i < g->n_edges; i++) spq_close(&g->edges[i].q);
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        pthread_mutex_lock(&st->mu);
+        st->signals++;
+        pthread_cond_broadcast(&st->cv);
+        pthread_mutex_unlock(&st->mu);
+    }
+    pthread_mutex_lock(&g->pool_mu);
+    pthread_cond_broadcast(&g->pool_cv);
+    pthread_mutex_unlock(&g->pool_mu);
+}
+
+void sg_join(SgGraph *g)
+{
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        if (st->started) pthread_join(st->th, NULL);
+        st->started = 0;
+    }
+    for (int i = 0; i < g->n_started_workers; i++) pthread_join(g->workers[i], NULL);
+    g->n_started_workers = 0;
+    // 停止时 pool 阶段（以及启动失败时没起线程的）在这里收尾
+    for (int i = 0; i < g->n_stages; i++) finish(&g->stages[i]);
+}
+
+void sg_destroy(SgGraph *g)
+{
+    if (!g->inited) return;
+    for (int i = 0; i < g->n_edges; i++) spq_destroy(&g->edges[i].q);
+    for (int i = 0; i < g->n_stages; i++) {
+        pthread_mutex_destroy(&g->stages[i].mu);
+        pthread_cond_destroy(&g->stages[i].cv);
+    }
+    pthread_mutex_destroy(&g->pool_mu);
+    pthread_cond_destroy(&g->pool_cv);
+    g->n_edges = g->n_stages = 0;
+    g->inited = g->built = 0;
+}
+
+void sg_print(SgGraph *g)
+{
+    int pool = 0;
+    for (int i = 0; i < g->n_stages; i++) {
+        SgStage *st = &g->stages[i];
+        pool |= st->pool;
+        LOGI("[GRAPH] stage %-10s %-10s %s", st->name, st->cls->kind, st->pool ? "pool" : "thread");
+    }
+    for (int i = 0; i < g->n_edges; i++) {
+        SgEdge *e = &g->edges[i];
+        LOGI("[GRAPH] edge  %-10s %s.%s -> %s.%s cap=%zu %s%s", e->name, e->src->name,
+             e->src->cls->out[e->src_port], e->dst->name, e->dst->cls->in[e->dst_port],
+             spq_capacity(&e->q), policy_name(e->policy), e->q.map ? " spill" : "");
+    }
+    if (pool) LOGI("[GRAPH] pool workers=%d", g->n_workers);
+}
+
+void sg_tick_print(SgGraph *g)
+{
+    char line[512];
+    int off = snprintf(line, sizeof(line), "[Q]");
+    for (int i = 0; i < g->n_edges && off < (int)sizeof(line); i++) {
+        SgEdge *e = &g->edges[i];
+        unsigned long long d = atomic_load_explicit(&e->dropped, memory_order_relaxed);
+        off += snprintf(line + off, sizeof(line) - (size_t)off, " %s=%zu/%zu", e->name,
+                        spq_size(&e->q), spq_capacity(&e->q));
+        if (d && off < (int)sizeof(line)) off += snprintf(line + off, sizeof(line) - (size_t)off, "(drop %llu)", d);
+    }
+    LOGI("%s", line);
+    for (int i = 0; i < g->n_edges; i++) spq_tick_print(&g->edges[i].q);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lib/media/buffer/spill_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 阶段图：流水线的拓扑（哪些阶段、谁接谁、每条边多大、满了怎么办、谁跑在哪个线程上）从一段描述里建出来，
+ * 不再写死在 main 里。
+ *
+ * - 端口类型（SgPortType）：按名字登记（"raw" / "h264" / "pcm"），带释放 / 加引用 / 关键帧判断 / 溢写序列化；
+ *   边两端的类型必须一致，一个输出端口接多条边时每条边各拿一个引用（类型没有 ref 就不允许一出多）
+ * - 阶段类（SgStageClass）：按 kind 登记，声明输入 / 输出端口类型；
+ *     run      源：自带循环（阻塞在设备上），必须独占线程，返回即结束
+ *     process  每条输入调用一次（条目所有权交给阶段），可以独占线程也可以放进共享线程池
+ *   open：独占线程的阶段在自己线程上、进循环之前执行（失败 = sg_stop 整个图）；pool 阶段在 sg_start 里
+ *   按描述顺序在调用线程上执行。close 在阶段结束（输入读完 / 停止）时在它自己的线程上执行
+ * - 边：SpillQueue 做底（block 的边可以开溢写），策略 block / drop-new / drop-old，
+ *   丢过关键帧类型的条目后一直丢到下一个关键帧（同 fanout）
+ * - 线程池：process 阶段标 pool 时不占独立线程，有输入、并且所有输出边都有空位时由 worker 取去跑一批；
+ *   同一个阶段不会同时在两个 worker 上跑，顺序与独占线程相同。空位是估计（溢写边按见过的最大条目算），
+ *   估错时 block 边上推不进去的那一条先挂在边上（pending），下游腾出位置后补推，worker 不阻塞在 push 上；
+ *   一次 process 往同一条边发多条时，第二条起仍可能阻塞
+ * - 结束：阶段结束时关掉它的输出边，下游读空后依次结束（与原先 bq_close 链相同）；sg_stop 是立即停
+ *
+ * 描述（每行一条或用 ';' 分隔，'#' 到行尾是注释）：
+ *   stage <name> <kind> [thread|pool]
+ *   edge  <src>[.<port>] -> <dst>[.<port>] [cap=<n>] [policy=block|drop-new|drop-old] [spill] [name=<label>]
+ * port 是下标或端口类型名，省略为 0；name 用在 [Q] / [SPILL] / metrics 里，省略为 "<src>-<dst>"。
+ */
+
+#define SG_MAX_TYPES   8
+#define SG_MAX_CLASSES 16
+#define SG_MAX_STAGES  16
+#define SG_MAX_EDGES   24
+#define SG_MAX_PORTS   4
+#define SG_MAX_WORKERS 8
+
+typedef struct {
+    const char     *name;
+    void          (*unref)(void *item);           // 必填：丢弃 / 销毁时释放
+    void          (*ref)(void *item);             // NULL = 不能扇出到多条边
+    int           (*is_key)(const void *item);    // NULL = 每条都能独立使用
+    const SpillOps *spill;                        // NULL = 这种类型的边不能溢写（release 用 unref）
+} SgPortType;
+
+typedef struct SgStage SgStage;
+
+typedef struct {
+    const char *kind;
+    const char *in[SG_MAX_PORTS];                 // 端口类型名，NULL 结尾
+    const char *out[SG_MAX_PORTS];
+    int         wait_span;                        // 独占线程等输入时记的 span（-1 = 不记）
+
+    int   (*open)(SgStage *st);                   // -1 = 失败（见上）
+    void  (*run)(SgStage *st);
+    void  (*process)(SgStage *st, int port, void *item);
+    void  (*close)(SgStage *st);
+} SgStageClass;
+
+typedef enum { SG_BLOCK = 0, SG_DROP_NEW, SG_DROP_OLD } SgPolicy;
+
+typedef struct {
+    char              name[16];
+    int               type;
+    SgStage          *src, *dst;
+    int               src_port, dst_port;
+    SgPolicy          policy;
+    int               spill;
+    SpillQueue        q;
+    SpillOps          ops;
+    int               push_need_key;              // drop-new 丢过关键帧类型：入队侧等关键帧（只有生产方碰）
+    void             *pending;                    // pool 上游 block 边上没推进去的一条（只有生产方碰）
+    atomic_int        pop_need_key;               // drop-old 挤掉过：出队侧等关键帧
+    atomic_ullong     pushed, dropped;
+} SgEdge;
+
+struct SgGraph;
+
+struct SgStage {
+    char                name[16];
+    const SgStageClass *cls;
+    struct SgGraph     *g;
+    void               *state;                    // 阶段私有（open 里设）
+    int                 pool;
+
+    SgEdge             *in[SG_MAX_EDGES];
+    int                 n_in, rr;
+    SgEdge             *out[SG_MAX_EDGES];
+    int                 n_out;
+
+    pthread_t           th;
+    int                 started;
+    int                 opened;
+    int                 finished;                 // close 过、输出边关过
+
+    // 独占线程等输入
+    pthread_mutex_t     mu;
+    pthread_cond_t      cv;
+    int                 signals;
+
+    // 线程池调度（pool_mu 内）
+    int                 queued, running, again, done;
+    atomic_int          wait_room;
+
+    atomic_ullong       processed;
+    SgEdge             *drop_edge;                // 上一次 sg_emit 返回 1 时丢在哪条边上（只有本阶段碰）
+};
+
+typedef struct SgGraph {
+    SgPortType      types[SG_MAX_TYPES];
+    int             n_types;
+    SgStageClass    classes[SG_MAX_CLASSES];
+    int             n_classes;
+    SgStage         stages[SG_MAX_STAGES];
+    int             n_stages;
+    SgEdge          edges[SG_MAX_EDGES];
+    int             n_edges;
+
+    void           *user;                         // 给阶段用（main 的 ThreadArgs）
+    const char     *spill_dir;
+    size_t          spill_bytes;
+    int             n_workers;
+
+    atomic_int      stop;
+    int             inited, built;
+
+    pthread_mutex_t pool_mu;
+    pthread_cond_t  pool_cv;
+    SgStage        *ready[SG_MAX_STAGES];
+    int             ready_head, ready_n;
+    int             pool_alive;                   // 还没结束的 pool 阶段
+    pthread_t       workers[SG_MAX_WORKERS];
+    int             n_started_workers;
+} SgGraph;
+
+void sg_init(SgGraph *g, void *user, const char *spill_dir, size_t spill_bytes, int n_workers);
+int  sg_register_type(SgGraph *g, const SgPortType *t);
+int  sg_register_class(SgGraph *g, const SgStageClass *c);
+
+/* 解析描述、实例化阶段和边、检查类型；出错打 [graph] 日志返回 -1 */
+int  sg_build(SgGraph *g, const char *desc);
+
+/* open pool 阶段，再起线程（独占的 "<name>"，线程池 "pool-<i>"）；返回 -1 时已起的线程要 sg_stop + sg_join */
+int  sg_start(SgGraph *g);
+
+/* 阶段里用：发到输出端口的所有边，条目所有权交出去。0 = 入队，1 = 至少一条边满了丢掉（st->drop_edge 是第一条），
+ * -1 = 都关了 / 已停止 */
+int  sg_emit(SgStage *st, int port, void *item);
+
+/* 立即停：关所有边、叫醒所有阶段（可在任意线程、sg_init 之前调用） */
+void sg_stop(SgGraph *g);
+
+void sg_join(SgGraph *g);
+void sg_destroy(SgGraph *g);                      // 放掉边里剩的条目
+
+/* [GRAPH] 拓扑；[Q] 每条边深度（与原先格式相同） */
+void sg_print(SgGraph *g);
+void sg_tick_print(SgGraph *g);
+
+SgEdge *sg_find_edge(SgGraph *g, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
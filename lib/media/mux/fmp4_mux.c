@@ -0,0 +1,665 @@
+#include "fmp4_mux.h"
+#include "h264_nal.h"
+#include "lib/utils/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "mp4"
+
+#define VIDEO_TRACK_ID   1
+#define AUDIO_TRACK_ID   2
+#define VIDEO_TIMESCALE  90000u
+
+// trun/trex sample_flags
+#define SAMPLE_FLAGS_SYNC     0x02000000u   // depends_on = 2（不依赖其他帧）
+#define SAMPLE_FLAGS_NONSYNC  0x01010000u   // depends_on = 1 + is_non_sync
+
+#define VDATA_INIT_CAP   (1u << 20)
+
+/* ---------- 大端写缓冲 ---------- */
+
+typedef struct {
+    uint8_t *p;
+    size_t   n, cap;
+} Bw;
+
+static inline void bw_u8(Bw *b, uint32_t v)
+{
+    if (b->n < b->cap) b->p[b->n] = (uint8_t)v;
+    b->n++;
+}
+
+static inline void bw_u16(Bw *b, uint32_t v) { bw_u8(b, v >> 8); bw_u8(b, v); }
+static inline void bw_u32(Bw *b, uint32_t v) { bw_u16(b, v >> 16); bw_u16(b, v); }
+static inline void bw_u64(Bw *b, uint64_t v) { bw_u32(b, (uint32_t)(v >> 32)); bw_u32(b, (uint32_t)v); }
+
+static void bw_bytes(Bw *b, const void *d, size_t n)
+{
+    if (b->n + n <= b->cap) memcpy(b->p + b->n, d, n);
+    b->n += n;
+}
+
+static void bw_zero(Bw *b, size_t n)
+{
+    while (n--) bw_u8(b, 0);
+}
+
+static void bw_fourcc(Bw *b, const char *cc)
+{
+    bw_bytes(b, cc, 4);
+}
+
+/* box 头先占位，box_end 回填长度 */
+static size_t box_begin(Bw *b, const char *type)
+{
+    size_t at = b->n;
+    bw_u32(b, 0);
+    bw_fourcc(b, type);
+    return at;
+}
+
+static size_t fullbox_begin(Bw *b, const char *type, uint32_t ver, uint32_t flags)
+{
+    size_t at = box_begin(b, type);
+    bw_u32(b, (ver << 24) | (flags & 0xffffff));
+    return at;
+}
+
+static void box_end(Bw *b, size_t at)
+{
+    uint32_t sz = (uint32_t)(b->n - at);
+    if (at + 4 <= b->cap) {
+        b->p[at]     = (uint8_t)(sz >> 24);
+        b->p[at + 1] = (uint8_t)(sz >> 16);
+        b->p[at + 2] = (uint8_t)(sz >> 8);
+        b->p[at + 3] = (uint8_t)sz;
+    }
+}
+
+static void bw_matrix(Bw *b)
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; i++) bw_u32(b, unity[i]);
+}
+
+/* ---------- init segment（ftyp + moov） ---------- */
+
+static void write_tkhd(Bw *b, uint32_t track_id, int audio, int w, int h)
+{
+    size_t at = fullbox_begin(b, "tkhd", 0, 0x000003);     // enabled | in_movie
+    bw_u32(b, 0);                  // creation_time
+    bw_u32(b, 0);                  // modification_time
+    bw_u32(b, track_id);
+    bw_u32(b, 0);
+    bw_u32(b, 0);                  // duration：片段化文件由 moof 决定
+    bw_zero(b, 8);
+    bw_u16(b, 0);                  // layer
+    bw_u16(b, audio ? 1 : 0);      // alternate_group
+    bw_u16(b, audio ? 0x0100 : 0); // volume
+    bw_u16(b, 0);
+    bw_matrix(b);
+    bw_u32(b, audio ? 0 : (uint32_t)w << 16);
+    bw_u32(b, audio ? 0 : (uint32_t)h << 16);
+    box_end(b, at);
+}
+
+static void write_mdhd_hdlr(Bw *b, uint32_t timescale, const char *handler, const char *name)
+{
+    size_t at = fullbox_begin(b, "mdhd", 0, 0);
+    bw_u32(b, 0);
+    bw_u32(b, 0);
+    bw_u32(b, timescale);
+    bw_u32(b, 0);
+    bw_u16(b, 0x55c4);             // 'und'
+    bw_u16(b, 0);
+    box_end(b, at);
+
+    at = fullbox_begin(b, "hdlr", 0, 0);
+    bw_u32(b, 0);
+    bw_fourcc(b, handler);
+    bw_zero(b, 12);
+    bw_bytes(b, name, strlen(name) + 1);
+    box_end(b, at);
+}
+
+static void write_dinf(Bw *b)
+{
+    size_t dinf = box_begin(b, "dinf");
+    size_t dref = fullbox_begin(b, "dref", 0, 0);
+    bw_u32(b, 1);
+    size_t url = fullbox_begin(b, "url ", 0, 1);            // 数据在本文件内
+    box_end(b, url);
+    box_end(b, dref);
+    box_end(b, dinf);
+}
+
+/* 空样本表：样本都在 moof/trun 里 */
+static void write_empty_tables(Bw *b)
+{
+    static const char *const boxes[] = { "stts", "stsc", "stco" };
+    for (int i = 0; i < 3; i++) {
+        size_t at = fullbox_begin(b, boxes[i], 0, 0);
+        bw_u32(b, 0);
+        box_end(b, at);
+    }
+    size_t at = fullbox_begin(b, "stsz", 0, 0);
+    bw_u32(b, 0);
+    bw_u32(b, 0);
+    box_end(b, at);
+}
+
+static void write_avc1(Bw *b, const Fmp4Mux *m)
+{
+    size_t at = box_begin(b, "avc1");
+    bw_zero(b, 6);
+    bw_u16(b, 1);                  // data_reference_index
+    bw_zero(b, 16);
+    bw_u16(b, (uint32_t)m->width);
+    bw_u16(b, (uint32_t)m->height);
+    bw_u32(b, 0x00480000);         // 72 dpi
+    bw_u32(b, 0x00480000);
+    bw_u32(b, 0);
+    bw_u16(b, 1);                  // frame_count
+    bw_zero(b, 32);                // compressorname
+    bw_u16(b, 0x0018);
+    bw_u16(b, 0xffff);
+
+    size_t avcc = box_begin(b, "avcC");
+    uint8_t profile = m->sps[1];
+    bw_u8(b, 1);
+    bw_u8(b, profile);
+    bw_u8(b, m->sps[2]);           // constraint flags
+    bw_u8(b, m->sps[3]);           // level
+    bw_u8(b, 0xfc | 3);            // lengthSizeMinusOne = 3
+    bw_u8(b, 0xe0 | 1);
+    bw_u16(b, (uint32_t)m->sps_len);
+    bw_bytes(b, m->sps, m->sps_len);
+    bw_u8(b, 1);
+    bw_u16(b, (uint32_t)m->pps_len);
+    bw_bytes(b, m->pps, m->pps_len);
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+        // High 系列的扩展字段：按编码器输出 8 bit 4:2:0
+        bw_u8(b, 0xfc | 1);
+        bw_u8(b, 0xf8 | 0);
+        bw_u8(b, 0xf8 | 0);
+        bw_u8(b, 0);
+    }
+    box_end(b, avcc);
+    box_end(b, at);
+}
+
+static void write_sowt(Bw *b, const Fmp4Mux *m)
+{
+    size_t at = box_begin(b, "sowt");
+    bw_zero(b, 6);
+    bw_u16(b, 1);
+    bw_u16(b, 0);                  // version 0 sound description
+    bw_u16(b, 0);
+    bw_u32(b, 0);                  // vendor
+    bw_u16(b, m->channels);
+    bw_u16(b, 16);
+    bw_u16(b, 0);                  // compression_id
+    bw_u16(b, 0);
+    bw_u32(b, m->sample_rate << 16);
+    box_end(b, at);
+}
+
+static void write_trak(Bw *b, const Fmp4Mux *m, int audio)
+{
+    size_t trak = box_begin(b, "trak");
+    write_tkhd(b, audio ? AUDIO_TRACK_ID : VIDEO_TRACK_ID, audio, m->width, m->height);
+
+    size_t mdia = box_begin(b, "mdia");
+    if (audio) write_mdhd_hdlr(b, m->sample_rate, "soun", "SoundHandler");
+    else write_mdhd_hdlr(b, VIDEO_TIMESCALE, "vide", "VideoHandler");
+
+    size_t minf = box_begin(b, "minf");
+    if (audio) {
+        size_t at = fullbox_begin(b, "smhd", 0, 0);
+        bw_u32(b, 0);
+        box_end(b, at);
+    } else {
+        size_t at = fullbox_begin(b, "vmhd", 0, 1);
+        bw_zero(b, 8);
+        box_end(b, at);
+    }
+    write_dinf(b);
+
+    size_t stbl = box_begin(b, "stbl");
+    size_t stsd = fullbox_begin(b, "stsd", 0, 0);
+    bw_u32(b, 1);
+    if (audio) write_sowt(b, m);
+    else write_avc1(b, m);
+    box_end(b, stsd);
+    write_empty_tables(b);
+    box_end(b, stbl);
+
+    box_end(b, minf);
+    box_end(b, mdia);
+    box_end(b, trak);
+}
+
+static void write_trex(Bw *b, uint32_t track_id, uint32_t dur, uint32_t size, uint32_t flags)
+{
+    size_t at = fullbox_begin(b, "trex", 0, 0);
+    bw_u32(b, track_id);
+    bw_u32(b, 1);                  // default_sample_description_index
+    bw_u32(b, dur);
+    bw_u32(b, size);
+    bw_u32(b, flags);
+    box_end(b, at);
+}
+
+static int write_init_segment(Fmp4Mux *m)
+{
+    uint8_t buf[2048];             // 两个 trak + avcC（SPS/PPS 各 ≤ 64 B）约 1.1 KiB
+    Bw b = { .p = buf, .cap = sizeof(buf) };
+
+    size_t at = box_begin(&b, "ftyp");
+    bw_fourcc(&b, "isom");
+    bw_u32(&b, 0x200);
+    bw_fourcc(&b, "isom");
+    bw_fourcc(&b, "iso6");
+    bw_fourcc(&b, "avc1");
+    bw_fourcc(&b, "mp41");
+    box_end(&b, at);
+
+    size_t moov = box_begin(&b, "moov");
+    at = fullbox_begin(&b, "mvhd", 0, 0);
+    bw_u32(&b, 0);
+    bw_u32(&b, 0);
+    bw_u32(&b, 1000);
+    bw_u32(&b, 0);
+    bw_u32(&b, 0x00010000);        // rate 1.0
+    bw_u16(&b, 0x0100);            // volume 1.0
+    bw_zero(&b, 10);
+    bw_matrix(&b);
+    bw_zero(&b, 24);
+    bw_u32(&b, AUDIO_TRACK_ID + 1); // next_track_ID
+    box_end(&b, at);
+
+    write_trak(&b, m, 0);
+    write_trak(&b, m, 1);
+
+    size_t mvex = box_begin(&b, "mvex");
+    write_trex(&b, VIDEO_TRACK_ID, 0, 0, SAMPLE_FLAGS_NONSYNC);
+    write_trex(&b, AUDIO_TRACK_ID, 1, 2 * m->channels, SAMPLE_FLAGS_SYNC);
+    box_end(&b, mvex);
+    box_end(&b, moov);
+
+    if (b.n > b.cap) {
+        LOGE("[%s] init segment too large: %zu", TAG, b.n);
+        return -1;
+    }
+    if (fwrite(buf, 1, b.n, m->fp) != b.n) return -1;
+    m->bytes += b.n;
+    return 0;
+}
+
+/* ---------- fragment ---------- */
+
+static uint64_t video_ticks(const Fmp4Mux *m, uint64_t pts_us)
+{
+    uint64_t rel = pts_us > m->origin_us ? pts_us - m->origin_us : 0;
+    return rel * VIDEO_TIMESCALE / 1000000u;
+}
+
+static uint64_t audio_ticks(const Fmp4Mux *m, uint64_t pts_us)
+{
+    uint64_t rel = pts_us > m->origin_us ? pts_us - m->origin_us : 0;
+    return rel * m->sample_rate / 1000000u;
+}
+
+/*
+ * 把当前视频样本和 pts < cut_us 的音频样本写成一个 moof + mdat。
+ * next_vticks：下一段第一个视频样本的时间（用来算最后一个样本的 duration），0 = 未知（沿用上一个）。
+ */
+static int flush_fragment(Fmp4Mux *m, uint64_t cut_us, uint64_t next_vticks)
+{
+    int n_as = 0;
+    size_t a_bytes = 0;
+    uint64_t a_frames = 0;
+    while (n_as < m->n_as && m->as[n_as].pts_us < cut_us) {
+        a_bytes += m->as[n_as].size;
+        a_frames += m->as[n_as].frames;
+        n_as++;
+    }
+    if (m->n_vs == 0 && n_as == 0) return 0;
+
+    Bw b = { .p = m->moof, .cap = m->moof_cap };
+    size_t moof = box_begin(&b, "moof");
+    size_t at = fullbox_begin(&b, "mfhd", 0, 0);
+    bw_u32(&b, ++m->seq);
+    box_end(&b, at);
+
+    size_t v_doff_at = 0, a_doff_at = 0;
+
+    if (m->n_vs > 0) {
+        size_t traf = box_begin(&b, "traf");
+        at = fullbox_begin(&b, "tfhd", 0, 0x020000);         // default-base-is-moof
+        bw_u32(&b, VIDEO_TRACK_ID);
+        box_end(&b, at);
+
+        uint64_t t_first = video_ticks(m, m->vs[0].pts_us);
+        at = fullbox_begin(&b, "tfdt", 1, 0);
+        bw_u64(&b, t_first);
+        box_end(&b, at);
+
+        at = fullbox_begin(&b, "trun", 0, 0x000701);         // data_offset | duration | size | flags
+        bw_u32(&b, (uint32_t)m->n_vs);
+        v_doff_at = b.n;
+        bw_u32(&b, 0);
+        for (int i = 0; i < m->n_vs; i++) {
+            uint64_t t = video_ticks(m, m->vs[i].pts_us);
+            uint64_t tn = i + 1 < m->n_vs ? video_ticks(m, m->vs[i + 1].pts_us) : next_vticks;
+            uint64_t dur = tn > t ? tn - t : m->last_vdur_ticks;
+            if (i + 1 < m->n_vs || next_vticks > t) m->last_vdur_ticks = dur;
+            bw_u32(&b, (uint32_t)dur);
+            bw_u32(&b, m->vs[i].size);
+            bw_u32(&b, m->vs[i].key ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NONSYNC);
+        }
+        box_end(&b, at);
+        box_end(&b, traf);
+    }
+
+    if (n_as > 0) {
+        size_t traf = box_begin(&b, "traf");
+        at = fullbox_begin(&b, "tfhd", 0, 0x020000);
+        bw_u32(&b, AUDIO_TRACK_ID);
+        box_end(&b, at);
+
+        // 以块的真实 pts 定位；不早于上一段结束（避免轨内时间倒退）
+        uint64_t t_first = audio_ticks(m, m->as[0].pts_us);
+        if (t_first < m->a_next_ticks) t_first = m->a_next_ticks;
+        m->a_next_ticks = t_first + a_frames;
+        at = fullbox_begin(&b, "tfdt", 1, 0);
+        bw_u64(&b, t_first);
+        box_end(&b, at);
+
+        // PCM 每帧一个样本，duration/size/flags 全走 trex 默认值：trun 没有逐样本表
+        at = fullbox_begin(&b, "trun", 0, 0x000001);
+        bw_u32(&b, (uint32_t)a_frames);
+        a_doff_at = b.n;
+        bw_u32(&b, 0);
+        box_end(&b, at);
+        box_end(&b, traf);
+    }
+    box_end(&b, moof);
+
+    if (b.n > b.cap) {
+        LOGE("[%s] moof overflow: %zu > %zu", TAG, b.n, b.cap);
+        m->error = 1;
+        return -1;
+    }
+
+    // data_offset 相对 moof 起点（default-base-is-moof）：跳过 moof 与 mdat 头
+    uint32_t doff = (uint32_t)b.n + 8;
+    if (v_doff_at) {
+        Bw p = { .p = m->moof + v_doff_at, .cap = 4 };
+        bw_u32(&p, doff);
+    }
+    if (a_doff_at) {
+        Bw p = { .p = m->moof + a_doff_at, .cap = 4 };
+        bw_u32(&p, doff + (uint32_t)m->vdata_len);
+    }
+
+    uint8_t mdat_hdr[8];
+    Bw h = { .p = mdat_hdr, .cap = sizeof(mdat_hdr) };
+    bw_u32(&h, (uint32_t)(8 + m->vdata_len + a_bytes));
+    bw_fourcc(&h, "mdat");
+
+    if (fwrite(m->moof, 1, b.n, m->fp) != b.n ||
+        fwrite(mdat_hdr, 1, 8, m->fp) != 8 ||
+        (m->vdata_len && fwrite(m->vdata, 1, m->vdata_len, m->fp) != m->vdata_len) ||
+        (a_bytes && fwrite(m->adata, 1, a_bytes, m->fp) != a_bytes) ||
+        fflush(m->fp) != 0) {
+        LOGE("[%s] fragment write failed", TAG);
+        m->error = 1;
+        return -1;
+    }
+    m->bytes += b.n + 8 + m->vdata_len + a_bytes;
+    m->fragments++;
+
+    m->n_vs = 0;
+    m->vdata_len = 0;
+    // cut 之后的音频留给下一段
+    if (n_as < m->n_as) {
+        memmove(m->as, m->as + n_as, (size_t)(m->n_as - n_as) * sizeof(m->as[0]));
+        memmove(m->adata, m->adata + a_bytes, m->adata_len - a_bytes);
+    }
+    m->n_as -= n_as;
+    m->adata_len -= a_bytes;
+    return 0;
+}
+
+static int reserve(uint8_t **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap) return 0;
+    size_t nc = *cap ? *cap : 4096;
+    while (nc < need) nc *= 2;
+    uint8_t *p = (uint8_t *)realloc(*buf, nc);
+    if (!p) return -1;
+    *buf = p;
+    *cap = nc;
+    return 0;
+}
+
+/* ---------- API ---------- */
+
+int fmp4_mux_open(Fmp4Mux *m, const char *path, int width, int height, int fps,
+                  unsigned sample_rate, unsigned channels)
+{
+    if (!m || !path || width <= 0 || height <= 0 || sample_rate == 0 || sample_rate > 65535 ||
+        channels == 0) {
+        return -1;
+    }
+    memset(m, 0, sizeof(*m));
+    m->width = width;
+    m->height = height;
+    m->fps = fps > 0 ? fps : 30;
+    m->sample_rate = sample_rate;
+    m->channels = channels;
+    m->last_vdur_ticks = VIDEO_TIMESCALE / (uint64_t)m->fps;
+
+    // moof 上限：mfhd + 视频 traf（逐样本 12 B）+ 音频 traf（无逐样本表）
+    m->moof_cap = 8 + 16 + (8 + 16 + 20 + 20 + 12u * FMP4_MAX_VIDEO_SAMPLES) + (8 + 16 + 20 + 20);
+    m->moof = (uint8_t *)malloc(m->moof_cap);
+    m->vdata_cap = VDATA_INIT_CAP;
+    m->vdata = (uint8_t *)malloc(m->vdata_cap);
+    m->adata_cap = (size_t)sample_rate * channels * 2 * 2;   // 2 s PCM
+    m->adata = (uint8_t *)malloc(m->adata_cap);
+    if (!m->moof || !m->vdata || !m->adata) {
+        LOGE("[%s] alloc failed", TAG);
+        goto fail;
+    }
+
+    m->fp = fopen(path, "wb");
+    if (!m->fp) {
+        LOGE("[%s] open %s failed", TAG, path);
+        goto fail;
+    }
+    LOGI("[%s] opened: %s (avc1 %dx%d + sowt %uHz/%uch, fragment per GOP)",
+         TAG, path, width, height, sample_rate, channels);
+    return 0;
+
+fail:
+    free(m->moof);
+    free(m->vdata);
+    free(m->adata);
+    memset(m, 0, sizeof(*m));
+    return -1;
+}
+
+/* 第一个 IDR 之前先攒着的音频：按 pts 去掉早于原点的块（两路线程到达先后不代表 pts 先后） */
+static void drop_audio_before(Fmp4Mux *m, uint64_t origin_us)
+{
+    int n = 0;
+    size_t bytes = 0;
+    while (n < m->n_as && m->as[n].pts_us < origin_us) bytes += m->as[n++].size;
+    if (n == 0) return;
+    memmove(m->as, m->as + n, (size_t)(m->n_as - n) * sizeof(m->as[0]));
+    memmove(m->adata, m->adata + bytes, m->adata_len - bytes);
+    m->n_as -= n;
+    m->adata_len -= bytes;
+    m->dropped_pre_idr += (uint64_t)n;
+}
+
+/* 从 IDR 访问单元里取 SPS/PPS */
+static void grab_params(Fmp4Mux *m, const uint8_t *data, size_t size)
+{
+    size_t off = 0;
+    const uint8_t *nal;
+    size_t len;
+    while (h264_next_nal(data, size, &off, &nal, &len)) {
+        int t = h264_nal_type(nal);
+        if (t == H264_NAL_SPS && len >= 4 && len <= sizeof(m->sps)) {
+            memcpy(m->sps, nal, len);
+            m->sps_len = len;
+        } else if (t == H264_NAL_PPS && len <= sizeof(m->pps)) {
+            memcpy(m->pps, nal, len);
+            m->pps_len = len;
+        }
+    }
+}
+
+int fmp4_mux_write_video(Fmp4Mux *m, const uint8_t *data, size_t size,
+                         uint64_t pts_us, bool keyframe)
+{
+    if (!m || !m->fp || !data || size == 0) return -1;
+
+    int ret = 0;
+    if (m->error) {
+        ret = -1;
+        goto out;
+    }
+
+    if (!m->header_written) {
+        if (keyframe) grab_params(m, data, size);
+        if (!keyframe || !m->sps_len || !m->pps_len) {
+            m->dropped_pre_idr++;
+            goto out;
+        }
+        m->origin_us = pts_us;
+        if (write_init_segment(m) != 0) {
+            LOGE("[%s] init segment write failed", TAG);
+            m->error = 1;
+            ret = -1;
+            goto out;
+        }
+        m->header_written = 1;
+        drop_audio_before(m, pts_us);
+    }
+
+    // 新 GOP 开始或样本表满：上一段落盘
+    if ((keyframe && m->n_vs > 0) || m->n_vs == FMP4_MAX_VIDEO_SAMPLES) {
+        if (flush_fragment(m, pts_us, video_ticks(m, pts_us)) != 0) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    // Annex-B -> 长度前缀；参数集已在 avcC 里，AUD 无意义
+    if (reserve(&m->vdata, &m->vdata_cap, m->vdata_len + size + 64) != 0) {
+        LOGE("[%s] video buffer grow failed", TAG);
+        m->error = 1;
+        ret = -1;
+        goto out;
+    }
+    size_t start = m->vdata_len;
+    size_t off = 0;
+    const uint8_t *nal;
+    size_t len;
+    while (h264_next_nal(data, size, &off, &nal, &len)) {
+        int t = h264_nal_type(nal);
+        if (t == H264_NAL_SPS || t == H264_NAL_PPS || t == H264_NAL_AUD) continue;
+        if (m->vdata_len + 4 + len > m->vdata_cap &&
+            reserve(&m->vdata, &m->vdata_cap, m->vdata_len + 4 + len) != 0) {
+            m->error = 1;
+            ret = -1;
+            goto out;
+        }
+        Bw b = { .p = m->vdata + m->vdata_len, .cap = 4 };
+        bw_u32(&b, (uint32_t)len);
+        memcpy(m->vdata + m->vdata_len + 4, nal, len);
+        m->vdata_len += 4 + len;
+    }
+    if (m->vdata_len == start) goto out;     // 只有参数集
+
+    Fmp4VSample *s = &m->vs[m->n_vs++];
+    s->pts_us = pts_us;
+    s->size = (uint32_t)(m->vdata_len - start);
+    s->key = keyframe ? 1 : 0;
+
+out:
+    return ret;
+}
+
+int fmp4_mux_write_audio(Fmp4Mux *m, const uint8_t *pcm, size_t bytes,
+                         uint32_t frames, uint64_t pts_us)
+{
+    if (!m || !m->fp || !pcm || bytes == 0 || frames == 0) return -1;
+
+    int ret = 0;
+    if (m->error) {
+        ret = -1;
+        goto out;
+    }
+    if (m->header_written && pts_us < m->origin_us) {
+        m->dropped_pre_idr++;
+        goto out;
+    }
+
+    if (m->n_as == FMP4_MAX_AUDIO_SAMPLES) {
+        // 还没有 moov 时写不出去，只能丢；否则视频停了（或 GOP 极长）：先把已有的写出去
+        if (!m->header_written) {
+            m->dropped_pre_idr++;
+            goto out;
+        }
+        if (flush_fragment(m, UINT64_MAX, 0) != 0) {
+            ret = -1;
+            goto out;
+        }
+    }
+    if (reserve(&m->adata, &m->adata_cap, m->adata_len + bytes) != 0) {
+        LOGE("[%s] audio buffer grow failed", TAG);
+        m->error = 1;
+        ret = -1;
+        goto out;
+    }
+    memcpy(m->adata + m->adata_len, pcm, bytes);
+    m->adata_len += bytes;
+
+    Fmp4ASample *s = &m->as[m->n_as++];
+    s->pts_us = pts_us;
+    s->size = (uint32_t)bytes;
+    s->frames = frames;
+
+out:
+    return ret;
+}
+
+int fmp4_mux_close(Fmp4Mux *m)
+{
+    if (!m || !m->fp) return -1;
+
+    int ret = 0;
+    if (m->header_written && !m->error) {
+        ret = flush_fragment(m, UINT64_MAX, 0);
+    } else if (!m->header_written && !m->error) {
+        LOGW("[%s] no keyframe received, file has no init segment", TAG);
+    }
+    if (fclose(m->fp) != 0) ret = -1;
+    m->fp = NULL;
+    if (m->error) ret = -1;
+
+    LOGI("[%s] closed: fragments=%llu bytes=%llu dropped_pre_idr=%llu",
+         TAG, (unsigned long long)m->fragments, (unsigned long long)m->bytes,
+         (unsigned long long)m->dropped_pre_idr);
+
+    free(m->moof);
+    free(m->vdata);
+    free(m->adata);
+    m->moof = m->vdata = m->adata = NULL;
+    return ret;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fragmented MP4（ISO BMFF）封装：H.264 + PCM 进同一个带时间戳的文件。
+ *
+ * 文件布局：ftyp + moov（空 stbl + mvex）+ 每个 GOP 一个 moof/mdat。
+ * - 视频：Annex-B -> 4 字节长度前缀；SPS/PPS 从第一个 IDR 里取出写进 avcC，样本里去掉 SPS/PPS/AUD
+ * - 音频：S16LE 存成 'sowt'，每个 PCM 帧一个样本（trex 默认 duration/size，trun 不带逐样本表）；
+ *   每段的 tfdt 取该段第一个 AudioChunk 的 pts，段内按帧连续
+ * - 时间：两路都按 pts_us 相对第一个 IDR 的 pts 换算（视频 90 kHz，音频 = 采样率）
+ * - 遇到下一个 IDR 就把上一段 GOP 写成一个 fragment 并 fflush：崩溃最多丢一个 GOP
+ * - 第一个 IDR 之前的视频丢弃（还没有 avcC，moov 写不出来）；音频先攒着，IDR 到了再去掉 pts 更早的块
+ *
+ * 样本表（trun）与 moof 缓冲在 open 时按上限预分配；mdat 数据缓冲只在 GOP 超过当前容量时扩容。
+ * 不加锁：write_video / write_audio 只由扇出里这一路自己的 sink 线程（fan-mp4）按发布顺序调用，
+ * close 在那个线程 join 之后。
+ */
+
+#define FMP4_MAX_VIDEO_SAMPLES 512     // 单个 fragment 的视频样本上限（超过则提前切）
+#define FMP4_MAX_AUDIO_SAMPLES 1024
+
+typedef struct {
+    uint64_t pts_us;
+    uint32_t size;
+    uint8_t  key;
+} Fmp4VSample;
+
+typedef struct {
+    uint64_t pts_us;
+    uint32_t size;
+    uint32_t frames;
+} Fmp4ASample;
+
+typedef struct {
+    FILE           *fp;
+
+    int             width, height, fps;
+    unsigned        sample_rate, channels;
+
+    uint8_t         sps[64];
+    size_t          sps_len;
+    uint8_t         pps[64];
+    size_t          pps_len;
+    int             header_written;
+    uint64_t        origin_us;       // 第一个 IDR 的 pts
+
+    Fmp4VSample     vs[FMP4_MAX_VIDEO_SAMPLES];
+    int             n_vs;
+    uint8_t        *vdata;
+    size_t          vdata_len, vdata_cap;
+    uint64_t        last_vdur_ticks; // 收尾时最后一个样本沿用
+
+    Fmp4ASample     as[FMP4_MAX_AUDIO_SAMPLES];
+    int             n_as;            // 按块记录：切段时按块 pts 分界
+    uint8_t        *adata;
+    size_t          adata_len, adata_cap;
+    uint64_t        a_next_ticks;    // 上一段音频的结束时间
+
+    uint8_t        *moof;            // 预分配：按两张样本表上限算好的大小
+    size_t          moof_cap;
+
+    uint32_t        seq;             // mfhd sequence_number
+    uint64_t        fragments;
+    uint64_t        bytes;
+    uint64_t        dropped_pre_idr;
+    int             error;
+} Fmp4Mux;
+
+int  fmp4_mux_open(Fmp4Mux *m, const char *path, int width, int height, int fps,
+                   unsigned sample_rate, unsigned channels);
+
+/* Annex-B 一个访问单元 */
+int  fmp4_mux_write_video(Fmp4Mux *m, const uint8_t *data, size_t size,
+                          uint64_t pts_us, bool keyframe);
+
+/* S16LE 交织 PCM */
+int  fmp4_mux_write_audio(Fmp4Mux *m, const uint8_t *pcm, size_t bytes,
+                          uint32_t frames, uint64_t pts_us);
+
+/* 写出最后一个 fragment 并关闭 */
+int  fmp4_mux_close(Fmp4Mux *m);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Annex-B 字节流里逐个取 NAL（不含起始码）。封装器共用。
+ *
+ *   size_t off = 0;
+ *   const uint8_t *nal; size_t len;
+ *   while (h264_next_nal(buf, size, &off, &nal, &len)) { ... }
+ */
+
+#define H264_NAL_SLICE   1
+#define H264_NAL_IDR     5
+#define H264_NAL_SEI     6
+#define H264_NAL_SPS     7
+#define H264_NAL_PPS     8
+#define H264_NAL_AUD     9
+
+static inline int h264_nal_type(const uint8_t *nal)
+{
+    return nal[0] & 0x1f;
+}
+
+/* 从 *off 开始找下一个起始码（00 00 01 或 00 00 00 01），返回 NAL 起点，找不到返回 n */
+static inline size_t h264_find_start(const uint8_t *p, size_t n, size_t off, size_t *sc_len)
+{
+    for (size_t i = off; i + 3 <= n; i++) {
+        if (p[i] == 0 && p[i + 1] == 0) {
+            if (p[i + 2] == 1) {
+                *sc_len = 3;
+                return i;
+            }
+            if (i + 4 <= n && p[i + 2] == 0 && p[i + 3] == 1) {
+                *sc_len = 4;
+                return i;
+            }
+        }
+    }
+    *sc_len = 0;
+    return n;
+}
+
+static inline int h264_next_nal(const uint8_t *p, size_t n, size_t *off,
+                                const uint8_t **nal, size_t *nal_len)
+{
+    size_t sc = 0;
+    size_t s = h264_find_start(p, n, *off, &sc);
+    if (s >= n) return 0;
+    s += sc;
+
+    size_t sc2 = 0;
+    size_t e = h264_find_start(p, n, s, &sc2);
+    // 下一个 NAL 前的 trailing zero 归到起始码里
+    size_t end = e;
+    while (end > s && e < n && p[end - 1] == 0) end--;
+
+    *nal = p + s;
+    *nal_len = end - s;
+    *off = e;
+    return *nal_len > 0 ? 1 : h264_next_nal(p, n, off, nal, nal_len);
+}
+
+#ifdef __cplusplus
+}
+#endif
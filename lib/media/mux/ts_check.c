@@ -0,0 +1,202 @@
+#include "ts_mux.h"
+#include "lib/utils/log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "ts_check"
+
+/*
+ * 逐包回读 TS：同步字节、CC 连续性、PAT/PMT（CRC + 内容）、PES 头、PCR 单调/间隔、
+ * PTS 相对 PCR 的提前量、LPCM 头长度。只认本封装器的布局（单节目、PSI 不跨包）。
+ */
+
+typedef struct {
+    int      seen;
+    uint8_t  cc;
+} PidState;
+
+static uint64_t get_ts(const uint8_t *p)
+{
+    return ((uint64_t)(p[0] & 0x0e) << 29) | ((uint64_t)p[1] << 22) |
+           ((uint64_t)(p[2] & 0xfe) << 14) | ((uint64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+static int ts_markers_ok(const uint8_t *p, unsigned prefix)
+{
+    return (p[0] >> 4) == prefix && (p[0] & 1) && (p[2] & 1) && (p[4] & 1);
+}
+
+static int check_section(const uint8_t *pl, size_t n, TsCheckReport *r, const uint8_t **sec,
+                         size_t *sec_len)
+{
+    if (n < 1 || (size_t)pl[0] + 1 + 3 > n) return -1;
+    const uint8_t *s = pl + 1 + pl[0];
+    size_t len = 3 + (((size_t)(s[1] & 0x0f) << 8) | s[2]);
+    if (len < 12 || s + len > pl + n) return -1;
+    if (ts_crc32(s, len) != 0) {                         // 含 CRC 一起算，结果应为 0
+        r->crc_errors++;
+        return -1;
+    }
+    *sec = s;
+    *sec_len = len;
+    return 0;
+}
+
+int ts_check_file(const char *path, TsCheckReport *r)
+{
+    if (!path || !r) return -1;
+    memset(r, 0, sizeof(*r));
+    r->pts_min_lead_ms = 1e9;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        LOGE("[%s] open %s failed", TAG, path);
+        return -1;
+    }
+
+    static PidState pids[8192];
+    memset(pids, 0, sizeof(pids));
+    int pmt_pid = -1, vpid = -1, apid = -1, pcr_pid = -1;
+    int64_t last_pcr = -1;
+
+    uint8_t pkt[TS_PACKET_SIZE];
+    while (fread(pkt, 1, sizeof(pkt), fp) == sizeof(pkt)) {
+        r->packets++;
+        if (pkt[0] != 0x47) {
+            r->sync_errors++;
+            continue;
+        }
+        int pusi = (pkt[1] >> 6) & 1;
+        int pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+        int afc = (pkt[3] >> 4) & 3;
+        uint8_t cc = pkt[3] & 0x0f;
+
+        PidState *ps = &pids[pid];
+        if (afc & 1) {
+            if (ps->seen && cc != ((ps->cc + 1) & 0x0f)) r->cc_errors++;
+            ps->seen = 1;
+            ps->cc = cc;
+        }
+
+        size_t off = 4;
+        if (afc & 2) {
+            size_t af = pkt[4];
+            if (af > 183) {
+                r->pes_errors++;
+                continue;
+            }
+            if (af >= 7 && (pkt[5] & 0x10)) {
+                const uint8_t *q = pkt + 6;
+                uint64_t base = ((uint64_t)q[0] << 25) | ((uint64_t)q[1] << 17) |
+                                ((uint64_t)q[2] << 9) | ((uint64_t)q[3] << 1) | (q[4] >> 7);
+                uint64_t ext = ((uint64_t)(q[4] & 1) << 8) | q[5];
+                int64_t pcr = (int64_t)(base * 300 + ext);
+                if (pid != pcr_pid && pcr_pid >= 0) r->pes_errors++;
+                if (last_pcr >= 0) {
+                    if (pcr < last_pcr) r->pcr_backwards++;
+                    double gap = (double)(pcr - last_pcr) / 27000.0;
+                    if (gap > r->pcr_max_gap_ms) r->pcr_max_gap_ms = gap;
+                }
+                last_pcr = pcr;
+                r->pcr_count++;
+            }
+            off += 1 + af;
+        }
+        if (!(afc & 1) || off >= TS_PACKET_SIZE) continue;
+
+        const uint8_t *pl = pkt + off;
+        size_t n = TS_PACKET_SIZE - off;
+
+        if (pid == 0 && pusi) {
+            const uint8_t *s;
+            size_t len;
+            if (check_section(pl, n, r, &s, &len) != 0 || s[0] != 0x00) continue;
+            r->pat++;
+            for (size_t i = 8; i + 4 <= len - 4; i += 4) {
+                if (((s[i] << 8) | s[i + 1]) != 0) pmt_pid = ((s[i + 2] & 0x1f) << 8) | s[i + 3];
+            }
+            continue;
+        }
+        if (pid == pmt_pid && pusi) {
+            const uint8_t *s;
+            size_t len;
+            if (check_section(pl, n, r, &s, &len) != 0 || s[0] != 0x02) continue;
+            r->pmt++;
+            pcr_pid = ((s[8] & 0x1f) << 8) | s[9];
+            size_t pil = ((size_t)(s[10] & 0x0f) << 8) | s[11];
+            int hdmv = pil >= 6 && s[12] == 0x05 && memcmp(s + 14, "HDMV", 4) == 0;
+            for (size_t i = 12 + pil; i + 5 <= len - 4;) {
+                int st = s[i];
+                int epid = ((s[i + 1] & 0x1f) << 8) | s[i + 2];
+                size_t eil = ((size_t)(s[i + 3] & 0x0f) << 8) | s[i + 4];
+                if (st == 0x1b) vpid = epid;
+                if (st == 0x80 && hdmv) apid = epid;
+                i += 5 + eil;
+            }
+            r->pmt_ok = vpid >= 0 && apid >= 0 && pcr_pid == apid;
+            continue;
+        }
+
+        if (!pusi || (pid != vpid && pid != apid)) continue;
+
+        // PES 起始
+        if (n < 14 || pl[0] != 0 || pl[1] != 0 || pl[2] != 1 || (pl[6] & 0xc0) != 0x80) {
+            r->pes_errors++;
+            continue;
+        }
+        unsigned flags = pl[7] >> 6;
+        size_t hdr_len = pl[8];
+        if (flags == 0 || flags == 1 || 9 + hdr_len > n ||
+            !ts_markers_ok(pl + 9, flags == 3 ? 3 : 2) ||
+            (flags == 3 && !ts_markers_ok(pl + 14, 1))) {
+            r->pes_errors++;
+            continue;
+        }
+        uint64_t pts = get_ts(pl + 9);
+        if (last_pcr >= 0) {
+            double lead = ((double)pts * 300.0 - (double)last_pcr) / 27000.0;
+            if (lead < r->pts_min_lead_ms) r->pts_min_lead_ms = lead;
+        }
+
+        if (pid == vpid) {
+            r->pes_video++;
+        } else {
+            r->pes_audio++;
+            size_t pes_len = ((size_t)pl[4] << 8) | pl[5];
+            const uint8_t *lh = pl + 9 + hdr_len;
+            if (9 + hdr_len + 4 > n ||
+                (((size_t)lh[0] << 8) | lh[1]) + 4 + 3 + hdr_len != pes_len) {
+                r->lpcm_bad++;
+            }
+        }
+    }
+
+    fclose(fp);
+    if (r->pcr_count == 0 || r->pts_min_lead_ms == 1e9) r->pts_min_lead_ms = 0;
+    return 0;
+}
+
+int ts_check_ok(const TsCheckReport *r)
+{
+    return r && r->packets > 0 &&
+           r->sync_errors == 0 && r->cc_errors == 0 && r->pes_errors == 0 &&
+           r->crc_errors == 0 && r->lpcm_bad == 0 &&
+           r->pmt_ok && r->pcr_count > 0 && r->pcr_backwards == 0 &&
+           r->pcr_max_gap_ms <= 100.0 && r->pts_min_lead_ms >= 0.0;
+}
+
+void ts_check_print(const char *path, const TsCheckReport *r)
+{
+    if (!r) return;
+    LOGI("[%s] %s: %s packets=%llu pat=%llu pmt=%llu pes video=%llu audio=%llu | "
+         "sync_err=%llu cc_err=%llu pes_err=%llu crc_err=%llu lpcm_bad=%llu | "
+         "pcr=%llu backwards=%llu max_gap=%.1fms | pts_min_lead=%.1fms",
+         TAG, path ? path : "-", ts_check_ok(r) ? "OK" : "FAIL",
+         (unsigned long long)r->packets, (unsigned long long)r->pat, (unsigned long long)r->pmt,
+         (unsigned long long)r->pes_video, (unsigned long long)r->pes_audio,
+         (unsigned long long)r->sync_errors, (unsigned long long)r->cc_errors,
+         (unsigned long long)r->pes_errors, (unsigned long long)r->crc_errors,
+         (unsigned long long)r->lpcm_bad, (unsigned long long)r->pcr_count,
+         (unsigned long long)r->pcr_backwards, r->pcr_max_gap_ms, r->pts_min_lead_ms);
+}
@@ -0,0 +1,514 @@
+#include "ts_mux.h"
+#include "h264_nal.h"
+#include "lib/utils/log.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAG "ts"
+
+#define TS_PAYLOAD          184
+#define BATCH_PKTS_FILE     348            // ≈ 64 KiB
+#define BATCH_PKTS_UDP      7              // 1316 B/数据报
+#define TABLES_INTERVAL_US  100000
+#define ORIGIN_SLACK_US     1000000        // 另一路 pts 比第一个包早时不至于变负
+
+#define STREAM_TYPE_H264    0x1b
+#define STREAM_TYPE_LPCM    0x80           // HDMV LPCM
+#define STREAM_ID_VIDEO     0xe0
+#define STREAM_ID_PRIVATE1  0xbd
+
+#define PES_HDR_MAX         19             // 9 + PTS + DTS
+// 音频 PES：PES_packet_length 16 位，减去扩展头（3 + PTS 5）与 LPCM 头
+#define AUDIO_PES_MAX_PCM   (65535 - 8 - 4)
+
+uint32_t ts_crc32(const uint8_t *p, size_t n)
+{
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= (uint32_t)p[i] << 24;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/* ---------- 输出批 ---------- */
+
+static int write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int batch_flush(TsMux *m)
+{
+    if (m->n_pkts == 0) return 0;
+    size_t n = (size_t)m->n_pkts * TS_PACKET_SIZE;
+
+    if (m->is_udp) {
+        // 本机没人收时是 ECONNREFUSED：直播语义下丢掉即可，不算错误
+        if (send(m->fd, m->batch, n, MSG_NOSIGNAL) < 0 &&
+            errno != ECONNREFUSED && errno != EAGAIN) {
+            LOGE("[%s] send failed: %s", TAG, strerror(errno));
+            m->error = 1;
+            return -1;
+        }
+    } else if (write_all(m->fd, m->batch, n) != 0) {
+        LOGE("[%s] write failed: %s", TAG, strerror(errno));
+        m->error = 1;
+        return -1;
+    }
+    m->bytes += n;
+    m->n_pkts = 0;
+    return 0;
+}
+
+static uint8_t *next_packet(TsMux *m)
+{
+    if (m->n_pkts == m->batch_pkts && batch_flush(m) != 0) return NULL;
+    m->packets++;
+    return m->batch + (size_t)(m->n_pkts++) * TS_PACKET_SIZE;
+}
+
+/* ---------- 时间 ---------- */
+
+static uint64_t rel_us(const TsMux *m, uint64_t pts_us)
+{
+    return pts_us > m->origin_us ? pts_us - m->origin_us : 0;
+}
+
+static uint64_t pts90(const TsMux *m, uint64_t pts_us)
+{
+    uint64_t us = rel_us(m, pts_us) + (uint64_t)TS_MUX_DELAY_MS * 1000;
+    return (us * 9 / 100) & ((1ULL << 33) - 1);
+}
+
+static void put_ts(uint8_t *p, unsigned prefix, uint64_t ts)
+{
+    p[0] = (uint8_t)((prefix << 4) | ((ts >> 29) & 0x0e) | 1);
+    p[1] = (uint8_t)(ts >> 22);
+    p[2] = (uint8_t)(((ts >> 14) & 0xfe) | 1);
+    p[3] = (uint8_t)(ts >> 7);
+    p[4] = (uint8_t)(((ts << 1) & 0xfe) | 1);
+}
+
+static void put_pcr(uint8_t *p, uint64_t pcr27)
+{
+    uint64_t base = (pcr27 / 300) & ((1ULL << 33) - 1);
+    unsigned ext = (unsigned)(pcr27 % 300);
+    p[0] = (uint8_t)(base >> 25);
+    p[1] = (uint8_t)(base >> 17);
+    p[2] = (uint8_t)(base >> 9);
+    p[3] = (uint8_t)(base >> 1);
+    p[4] = (uint8_t)(((base & 1) << 7) | 0x7e | (ext >> 8));
+    p[5] = (uint8_t)ext;
+}
+
+/* ---------- 打包 ---------- */
+
+/*
+ * 一个 PES（hdr 前缀 + data）切成 TS 包写进批缓冲。
+ * 最后一个包不满时用 adaptation field 填充；with_pcr 时第一个包带 PCR。
+ */
+static int packetize(TsMux *m, uint16_t pid, uint8_t *cc,
+                     const uint8_t *hdr, size_t hl, const uint8_t *data, size_t dl,
+                     int with_pcr, uint64_t pcr27)
+{
+    size_t total = hl + dl, done = 0;
+    int first = 1;
+
+    while (done < total) {
+        uint8_t *pkt = next_packet(m);
+        if (!pkt) return -1;
+
+        size_t remain = total - done;
+        size_t af = (first && with_pcr) ? 8 : 0;        // 长度字节 + flags + PCR(6)
+        if (remain < TS_PAYLOAD - af) af = TS_PAYLOAD - remain;
+        size_t pl = TS_PAYLOAD - af;
+
+        pkt[0] = 0x47;
+        pkt[1] = (uint8_t)((first ? 0x40 : 0) | ((pid >> 8) & 0x1f));
+        pkt[2] = (uint8_t)pid;
+        pkt[3] = (uint8_t)((af ? 0x30 : 0x10) | (*cc & 0x0f));
+        *cc = (uint8_t)((*cc + 1) & 0x0f);
+
+        uint8_t *q = pkt + 4;
+        if (af) {
+            q[0] = (uint8_t)(af - 1);
+            if (af >= 2) {
+                size_t used = 2;
+                q[1] = 0;
+                if (first && with_pcr) {
+                    q[1] = 0x10;
+                    put_pcr(q + 2, pcr27);
+                    used += 6;
+                }
+                memset(q + used, 0xff, af - used);
+            }
+            q += af;
+        }
+
+        // payload 可能跨 hdr / data 两段
+        size_t n = pl;
+        if (done < hl) {
+            size_t c = hl - done < n ? hl - done : n;
+            memcpy(q, hdr + done, c);
+            q += c;
+            done += c;
+            n -= c;
+        }
+        if (n) {
+            memcpy(q, data + (done - hl), n);
+            done += n;
+        }
+        first = 0;
+    }
+    return 0;
+}
+
+static int write_section(TsMux *m, uint16_t pid, uint8_t *cc, const uint8_t *sec, size_t len)
+{
+    uint8_t *pkt = next_packet(m);
+    if (!pkt) return -1;
+    pkt[0] = 0x47;
+    pkt[1] = (uint8_t)(0x40 | ((pid >> 8) & 0x1f));
+    pkt[2] = (uint8_t)pid;
+    pkt[3] = (uint8_t)(0x10 | (*cc & 0x0f));
+    *cc = (uint8_t)((*cc + 1) & 0x0f);
+    pkt[4] = 0;                                         // pointer_field
+    memcpy(pkt + 5, sec, len);
+    memset(pkt + 5 + len, 0xff, TS_PAYLOAD - 1 - len);
+    return 0;
+}
+
+static void put_crc(uint8_t *sec, size_t len)
+{
+    uint32_t crc = ts_crc32(sec, len);
+    sec[len]     = (uint8_t)(crc >> 24);
+    sec[len + 1] = (uint8_t)(crc >> 16);
+    sec[len + 2] = (uint8_t)(crc >> 8);
+    sec[len + 3] = (uint8_t)crc;
+}
+
+static int write_tables(TsMux *m)
+{
+    uint8_t pat[16] = {
+        0x00, 0xb0, 13,                                 // table_id, section_length
+        0x00, 0x01, 0xc1, 0x00, 0x00,                   // tsid=1, version 0, current
+        0x00, 0x01, 0xe0 | (TS_PID_PMT >> 8), TS_PID_PMT & 0xff,
+    };
+    put_crc(pat, 12);
+
+    uint8_t pmt[32] = {
+        0x02, 0xb0, 0,
+        0x00, 0x01, 0xc1, 0x00, 0x00,
+        0xe0 | (TS_PID_AUDIO >> 8), TS_PID_AUDIO & 0xff,          // PCR_PID = 音频
+        0xf0, 6,
+        0x05, 4, 'H', 'D', 'M', 'V',                              // registration：LPCM 按 HDMV 解
+        STREAM_TYPE_H264, 0xe0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xff, 0xf0, 0,
+        STREAM_TYPE_LPCM, 0xe0 | (TS_PID_AUDIO >> 8), TS_PID_AUDIO & 0xff, 0xf0, 0,
+    };
+    size_t pmt_len = 28;                                 // 到 CRC 之前
+    pmt[2] = (uint8_t)(pmt_len + 4 - 3);
+    put_crc(pmt, pmt_len);
+
+    if (write_section(m, 0, &m->cc_pat, pat, sizeof(pat)) != 0) return -1;
+    return write_section(m, TS_PID_PMT, &m->cc_pmt, pmt, pmt_len + 4);
+}
+
+static size_t build_pes_hdr(uint8_t *h, uint8_t stream_id, size_t payload_len,
+                            uint64_t pts, int with_dts, uint64_t dts, int aligned)
+{
+    size_t ext = with_dts ? 10 : 5;
+    size_t len = payload_len ? 3 + ext + payload_len : 0;   // 视频用 0（不限长）
+
+    h[0] = 0; h[1] = 0; h[2] = 1;
+    h[3] = stream_id;
+    h[4] = (uint8_t)(len >> 8);
+    h[5] = (uint8_t)len;
+    h[6] = aligned ? 0x84 : 0x80;
+    h[7] = with_dts ? 0xc0 : 0x80;
+    h[8] = (uint8_t)ext;
+    put_ts(h + 9, with_dts ? 3 : 2, pts);
+    if (with_dts) put_ts(h + 14, 1, dts);
+    return 9 + ext;
+}
+
+static void maybe_origin(TsMux *m, uint64_t pts_us)
+{
+    if (m->have_origin) return;
+    m->origin_us = pts_us > ORIGIN_SLACK_US ? pts_us - ORIGIN_SLACK_US : 0;
+    m->have_origin = 1;
+}
+
+static int maybe_tables(TsMux *m, uint64_t pts_us, int force)
+{
+    if (!force && m->last_tables_us && pts_us < m->last_tables_us + TABLES_INTERVAL_US) return 0;
+    m->last_tables_us = pts_us ? pts_us : 1;
+    return write_tables(m);
+}
+
+/* ---------- API ---------- */
+
+static int open_udp(const char *hostport)
+{
+    char host[64];
+    const char *colon = strrchr(hostport, ':');
+    if (!colon || (size_t)(colon - hostport) >= sizeof(host)) return -1;
+    memcpy(host, hostport, (size_t)(colon - hostport));
+    host[colon - hostport] = '\0';
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)atoi(colon + 1));
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) return -1;
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ts_mux_open(TsMux *m, const char *target, unsigned sample_rate, unsigned channels)
+{
+    if (!m || !target) return -1;
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+
+    uint8_t rate_code;
+    switch (sample_rate) {
+        case 48000:  rate_code = 1; break;
+        case 96000:  rate_code = 4; break;
+        case 192000: rate_code = 5; break;
+        default:
+            LOGE("[%s] LPCM needs 48/96/192 kHz, got %u", TAG, sample_rate);
+            return -1;
+    }
+    if (channels != 1 && channels != 2) {
+        LOGE("[%s] LPCM supports 1/2 channels, got %u", TAG, channels);
+        return -1;
+    }
+    m->sample_rate = sample_rate;
+    m->channels = channels;
+    // HDMV LPCM 头：[payload_size:16][channel_assignment:4 | sample_rate:4][bits:2 | 0:6]
+    m->lpcm_hdr[2] = (uint8_t)(((channels == 1 ? 1 : 3) << 4) | rate_code);
+    m->lpcm_hdr[3] = 0x40;                               // 16 bit
+
+    if (strncmp(target, "udp://", 6) == 0) {
+        m->fd = open_udp(target + 6);
+        m->is_udp = 1;
+        m->batch_pkts = BATCH_PKTS_UDP;
+    } else {
+        struct stat st;
+        if (stat(target, &st) == 0 && S_ISFIFO(st.st_mode)) {
+            LOGI("[%s] waiting for FIFO reader: %s", TAG, target);
+        }
+        m->fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        m->batch_pkts = BATCH_PKTS_FILE;
+    }
+    if (m->fd < 0) {
+        LOGE("[%s] open %s failed", TAG, target);
+        return -1;
+    }
+
+    m->batch = (uint8_t *)malloc((size_t)m->batch_pkts * TS_PACKET_SIZE);
+    // 单声道也按双声道存（HDMV LPCM 声道数按偶数对齐）
+    m->pcm_be_cap = AUDIO_PES_MAX_PCM;
+    m->pcm_be = (uint8_t *)malloc(4 + m->pcm_be_cap);
+    if (!m->batch || !m->pcm_be) {
+        LOGE("[%s] alloc failed", TAG);
+        free(m->batch);
+        free(m->pcm_be);
+        close(m->fd);
+        m->fd = -1;
+        return -1;
+    }
+
+    LOGI("[%s] opened: %s (h264 pid=0x%x, lpcm pid=0x%x %uHz/%uch, pcr on audio, batch=%d pkts)",
+         TAG, target, TS_PID_VIDEO, TS_PID_AUDIO, sample_rate, channels, m->batch_pkts);
+    return 0;
+}
+
+static void grab_params(TsMux *m, const uint8_t *data, size_t size, int *has_sps, int *has_aud)
+{
+    size_t off = 0;
+    const uint8_t *nal;
+    size_t len;
+    int first = 1;
+    while (h264_next_nal(data, size, &off, &nal, &len)) {
+        int t = h264_nal_type(nal);
+        if (first && t == H264_NAL_AUD) *has_aud = 1;
+        first = 0;
+        if (t == H264_NAL_SPS && len <= sizeof(m->sps)) {
+            memcpy(m->sps, nal, len);
+            m->sps_len = len;
+            *has_sps = 1;
+        } else if (t == H264_NAL_PPS && len <= sizeof(m->pps)) {
+            memcpy(m->pps, nal, len);
+            m->pps_len = len;
+        } else if (t == H264_NAL_SLICE || t == H264_NAL_IDR) {
+            break;                                       // 参数集/AUD 只会在片之前
+        }
+    }
+}
+
+int ts_mux_write_video(TsMux *m, const uint8_t *data, size_t size, uint64_t pts_us, bool keyframe)
+{
+    if (!m || m->fd < 0 || !data || size == 0) return -1;
+
+    int ret = 0;
+    if (m->error) {
+        ret = -1;
+        goto out;
+    }
+
+    int has_sps = 0, has_aud = 0;
+    grab_params(m, data, size, &has_sps, &has_aud);
+    if (!m->video_started) {
+        if (!keyframe || !m->sps_len || !m->pps_len) {
+            m->dropped_pre_idr++;
+            goto out;
+        }
+        m->video_started = 1;
+    }
+    maybe_origin(m, pts_us);
+
+    if (maybe_tables(m, pts_us, keyframe) != 0) {
+        ret = -1;
+        goto out;
+    }
+
+    // 前缀：PES 头 + [AUD] + [SPS/PPS]（IDR 没带时补上，解码器从任意 IDR 都能起播）
+    uint8_t hdr[PES_HDR_MAX + 6 + 2 * (4 + 64)];
+    uint64_t t90 = pts90(m, pts_us);
+    size_t hl = build_pes_hdr(hdr, STREAM_ID_VIDEO, 0, t90, 1, t90, 1);
+    static const uint8_t aud[6] = { 0, 0, 0, 1, H264_NAL_AUD, 0xf0 };
+    if (!has_aud) {
+        memcpy(hdr + hl, aud, sizeof(aud));
+        hl += sizeof(aud);
+    }
+    if (keyframe && !has_sps) {
+        static const uint8_t sc[4] = { 0, 0, 0, 1 };
+        memcpy(hdr + hl, sc, 4);
+        memcpy(hdr + hl + 4, m->sps, m->sps_len);
+        hl += 4 + m->sps_len;
+        memcpy(hdr + hl, sc, 4);
+        memcpy(hdr + hl + 4, m->pps, m->pps_len);
+        hl += 4 + m->pps_len;
+    }
+
+    if (packetize(m, TS_PID_VIDEO, &m->cc_video, hdr, hl, data, size, 0, 0) != 0 ||
+        batch_flush(m) != 0) {                           // 一个 AU 写完就出批：延迟 ≤ 1 帧
+        ret = -1;
+        goto out;
+    }
+    m->pes_video++;
+
+out:
+    return ret;
+}
+
+int ts_mux_write_audio(TsMux *m, const uint8_t *pcm, size_t bytes, uint32_t frames, uint64_t pts_us)
+{
+    if (!m || m->fd < 0 || !pcm || bytes == 0 || frames == 0) return -1;
+
+    int ret = 0;
+    if (m->error || !m->video_started) {
+        // 第一个 IDR 前不出音频：播放端从 PAT/PMT + IDR 开始，前面的音频没有意义
+        if (!m->error) m->dropped_pre_idr++;
+        else ret = -1;
+        goto out;
+    }
+
+    size_t in_bpf = (size_t)m->channels * 2;
+    size_t out_bpf = 4;                                  // 按双声道存
+    uint32_t max_frames = (uint32_t)(m->pcm_be_cap / out_bpf);
+    if ((size_t)frames * in_bpf > bytes) frames = (uint32_t)(bytes / in_bpf);
+
+    // 超过一个 PES 的上限时拆成多个，后面的 pts 按帧数推
+    uint32_t done = 0;
+    while (done < frames) {
+        uint32_t n = frames - done < max_frames ? frames - done : max_frames;
+        uint64_t t_us = pts_us + (uint64_t)done * 1000000u / m->sample_rate;
+        const uint8_t *src = pcm + (size_t)done * in_bpf;
+
+        uint8_t *dst = m->pcm_be;
+        size_t plen = (size_t)n * out_bpf;
+        memcpy(dst, m->lpcm_hdr, 4);
+        dst[0] = (uint8_t)(plen >> 8);
+        dst[1] = (uint8_t)plen;
+        dst += 4;
+        for (uint32_t i = 0; i < n; i++) {
+            // S16LE -> 大端；单声道第二声道补零
+            dst[0] = src[1];
+            dst[1] = src[0];
+            if (m->channels == 2) {
+                dst[2] = src[3];
+                dst[3] = src[2];
+            } else {
+                dst[2] = 0;
+                dst[3] = 0;
+            }
+            src += in_bpf;
+            dst += 4;
+        }
+
+        if (maybe_tables(m, t_us, 0) != 0) {
+            ret = -1;
+            goto out;
+        }
+        uint8_t hdr[PES_HDR_MAX];
+        size_t hl = build_pes_hdr(hdr, STREAM_ID_PRIVATE1, 4 + plen, pts90(m, t_us), 0, 0, 1);
+        // PCR = 音频时钟（不加 PTS 的提前量）
+        uint64_t pcr27 = rel_us(m, t_us) * 27;
+        if (packetize(m, TS_PID_AUDIO, &m->cc_audio, hdr, hl, m->pcm_be, 4 + plen, 1, pcr27) != 0) {
+            ret = -1;
+            goto out;
+        }
+        m->pes_audio++;
+        done += n;
+    }
+
+out:
+    return ret;
+}
+
+int ts_mux_close(TsMux *m)
+{
+    if (!m || m->fd < 0) return -1;
+
+    int ret = m->error ? -1 : batch_flush(m);
+    if (close(m->fd) != 0) ret = -1;
+    m->fd = -1;
+
+    LOGI("[%s] closed: packets=%llu bytes=%llu pes video=%llu audio=%llu dropped_pre_idr=%llu",
+         TAG, (unsigned long long)m->packets, (unsigned long long)m->bytes,
+         (unsigned long long)m->pes_video, (unsigned long long)m->pes_audio,
+         (unsigned long long)m->dropped_pre_idr);
+
+    free(m->batch);
+    free(m->pcm_be);
+    m->batch = m->pcm_be = NULL;
+    return ret;
+}
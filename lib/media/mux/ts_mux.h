@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * MPEG-2 TS 封装：H.264 + PCM 复用成一路可直播的传输流。
+ *
+ * - 输出：普通文件 / FIFO（按路径 open）或 "udp://127.0.0.1:port"（每个数据报 7 个 TS 包）
+ * - PID：PMT 0x1000，视频 0x100（stream_type 0x1b），音频 0x101
+ * - 音频：TS 没有裸 PCM，按 Blu-ray LPCM 装（stream_type 0x80 + 'HDMV' 注册描述符，
+ *   4 字节 LPCM 头 + 大端样本），只支持 48/96/192 kHz、1/2 声道
+ * - 时间：PTS/DTS 由 pts_us 换算（90 kHz，相对第一个包再加 TS_MUX_DELAY_MS）；
+ *   PCR 挂在音频 PID 上，取音频块的 pts（音频是主时钟），每个音频 PES 带一次
+ * - 每个 IDR 前（以及至少每 100 ms）重发 PAT/PMT；IDR 缺 SPS/PPS 时补上，AU 前补 AUD
+ * - 零逐包分配：PES 头拼在栈上，TS 包直接写进 open 时分配好的批缓冲；
+ *   视频 AU 结束或批满时整批写出（UDP 每 7 包一个数据报）
+ *
+ * 不加锁：write_video / write_audio 只由扇出里这一路自己的 sink 线程（fan-ts）按发布顺序调用，
+ * close 在那个线程 join 之后。
+ */
+
+#define TS_PACKET_SIZE    188
+#define TS_MUX_DELAY_MS   700          // PTS 相对 PCR 的提前量（解码缓冲）
+
+#define TS_PID_PMT        0x1000
+#define TS_PID_VIDEO      0x100
+#define TS_PID_AUDIO      0x101
+
+typedef struct {
+    int             fd;
+    int             is_udp;
+
+    unsigned        sample_rate, channels;
+    uint8_t         lpcm_hdr[4];
+
+    uint8_t        *batch;             // batch_pkts * 188
+    int             batch_pkts;
+    int             n_pkts;
+
+    uint8_t        *pcm_be;            // 音频大端转换缓冲（一个 PES 的上限）
+    size_t          pcm_be_cap;
+
+    uint8_t         sps[64];
+    size_t          sps_len;
+    uint8_t         pps[64];
+    size_t          pps_len;
+
+    uint8_t         cc_pat, cc_pmt, cc_video, cc_audio;
+    int             have_origin;
+    uint64_t        origin_us;
+    int             video_started;     // 第一个 IDR 之后才出视频
+    uint64_t        last_tables_us;    // 上次 PAT/PMT 的 pts（媒体时间）
+
+    uint64_t        packets;
+    uint64_t        bytes;
+    uint64_t        pes_video, pes_audio;
+    uint64_t        dropped_pre_idr;
+    int             error;
+} TsMux;
+
+/* target：文件/FIFO 路径，或 udp://ip:port */
+int  ts_mux_open(TsMux *m, const char *target, unsigned sample_rate, unsigned channels);
+
+/* Annex-B 一个访问单元 */
+int  ts_mux_write_video(TsMux *m, const uint8_t *data, size_t size, uint64_t pts_us, bool keyframe);
+
+/* S16LE 交织 PCM */
+int  ts_mux_write_audio(TsMux *m, const uint8_t *pcm, size_t bytes, uint32_t frames, uint64_t pts_us);
+
+int  ts_mux_close(TsMux *m);
+
+/* PSI 段用的 CRC32/MPEG-2（封装与自检共用） */
+uint32_t ts_crc32(const uint8_t *p, size_t n);
+
+/* ---- 回读自检（tools/ts_check 与 --out-ts 写文件时收尾调用） ---- */
+
+typedef struct {
+    uint64_t packets;
+    uint64_t sync_errors;              // 0x47 丢失
+    uint64_t cc_errors;                // continuity_counter 跳变
+    uint64_t pes_errors;               // PES 起始码 / 头长度 / PTS 标记位不对
+    uint64_t crc_errors;               // PAT/PMT CRC32
+    uint64_t pes_video, pes_audio;
+    uint64_t pat, pmt;
+    int      pmt_ok;                   // PMT 里找到了两个预期的 ES
+    uint64_t pcr_count;
+    uint64_t pcr_backwards;
+    double   pcr_max_gap_ms;
+    double   pts_min_lead_ms;          // min(PTS - 最近 PCR)，负数说明 PTS 落后于 PCR
+    uint64_t lpcm_bad;                 // LPCM 头里的 payload 长度与 PES 不符
+} TsCheckReport;
+
+int  ts_check_file(const char *path, TsCheckReport *r);
+
+/* 按约束判定：无同步/CC/PES/CRC 错误、PMT 正确、PCR 间隔 ≤ 100 ms 且单调、PTS 不落后 PCR */
+int  ts_check_ok(const TsCheckReport *r);
+
+void ts_check_print(const char *path, const TsCheckReport *r);
+
+#ifdef __cplusplus
+}
+#endif
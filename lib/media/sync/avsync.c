@@ -11,8 +11,7 @@
 
 #define RK_NAN (0.0/0.0)
 
-#define MAX_VJ  128   // 30fps -> <=30/s
-#define MAX_AJ  256   // 48k/1024 -> ~46/s
+#define MAX_PAIR 128  // 每秒视频事件配对样本上限
 
 static inline double us_to_ms(double us) { return us / 1000.0; }
 
@@ -26,6 +25,19 @@ static int cmp_double(const void *a, const void *b)
     return (da > db) - (da < db);
 }
 
+static double percentile_linear(double *arr, int n, double q)
+{
+    if (!arr || n <= 0) return RK_NAN;
+    if (q <= 0.0) return arr[0];
+    if (q >= 1.0) return arr[n - 1];
+
+    double pos = q * (double)(n - 1);
+    int lo = (int)pos;
+    if (lo >= n - 1) return arr[n - 1];
+    double frac = pos - (double)lo;
+    return arr[lo] + (arr[lo + 1] - arr[lo]) * frac;
+}
+
 static double percentile_nearest(double *arr, int n, double q)
 {
     if (!arr || n <= 0) return RK_NAN;
@@ -41,6 +53,29 @@ static double percentile_nearest(double *arr, int n, double q)
     return arr[rank - 1];
 }
 
+static double percentile(const AvSync *s, double *arr, int n, double q)
+{
+    if (s->params.pct_method == AVSYNC_PCT_LINEAR) return percentile_linear(arr, n, q);
+    return percentile_nearest(arr, n, q);
+}
+
+/* 排序后取 p50/p95；n==0 时保持 NaN */
+static void sorted_p50_p95(const AvSync *s, double *arr, int n, double *p50, double *p95)
+{
+    *p50 = RK_NAN;
+    *p95 = RK_NAN;
+    if (n <= 0) return;
+    qsort(arr, n, sizeof(double), cmp_double);
+    *p50 = percentile(s, arr, n, 0.50);
+    *p95 = percentile(s, arr, n, 0.95);
+}
+
+static void fmt_ms(char *buf, size_t n, double v)
+{
+    if (is_nan(v)) snprintf(buf, n, "n/a");
+    else snprintf(buf, n, "%.3f", v);
+}
+
 static void try_lock_offset(AvSync *s)
 {
     if (s->offset_locked) return;
@@ -55,11 +90,43 @@ static void try_lock_offset(AvSync *s)
     }
 }
 
+static void free_samples(AvSync *s)
+{
+    free(s->vj_ms);
+    free(s->aj_ms);
+    free(s->off_ms);
+    free(s->res_ms);
+    s->vj_ms = s->aj_ms = s->off_ms = s->res_ms = NULL;
+}
+
 int avsync_init(AvSync *s, int video_fps)
+{
+    return avsync_init_ex(s, video_fps, NULL);
+}
+
+int avsync_init_ex(AvSync *s, int video_fps, const AvSyncParams *params)
 {
     if (!s) return -1;
     memset(s, 0, sizeof(*s));
-    if (pthread_mutex_init(&s->mu, NULL) != 0) return -1;
+
+    if (params) s->params = *params;
+    if (s->params.window_ms == 0) s->params.window_ms = 1000;
+
+    // 样本容量按窗口秒数等比放大（1s 窗口时与原先固定数组一致）
+    int scale = (int)((s->params.window_ms + 999) / 1000);
+    s->vj_cap   = AVSYNC_MAX_VJ * scale;
+    s->aj_cap   = AVSYNC_MAX_AJ * scale;
+    s->pair_cap = MAX_PAIR * scale;
+
+    s->vj_ms  = (double *)calloc((size_t)s->vj_cap, sizeof(double));
+    s->aj_ms  = (double *)calloc((size_t)s->aj_cap, sizeof(double));
+    s->off_ms = (double *)calloc((size_t)s->pair_cap, sizeof(double));
+    s->res_ms = (double *)calloc((size_t)s->pair_cap, sizeof(double));
+    if (!s->vj_ms || !s->aj_ms || !s->off_ms || !s->res_ms ||
+        pthread_mutex_init(&s->mu, NULL) != 0) {
+        free_samples(s);
+        return -1;
+    }
 
     if (video_fps <= 0) video_fps = 30;
     s->expected_video_delta_us = 1000000ULL / (uint64_t)video_fps;
@@ -70,9 +137,48 @@ void avsync_deinit(AvSync *s)
 {
     if (!s) return;
     pthread_mutex_destroy(&s->mu);
+    free_samples(s);
+}
+
+void avsync_seed_offset(AvSync *s, uint64_t video0_us, uint64_t audio0_us)
+{
+    if (!s) return;
+    pthread_mutex_lock(&s->mu);
+    s->has_video0 = 1;
+    s->video0_us = video0_us;
+    s->has_audio0 = 1;
+    s->audio0_us = audio0_us;
+    try_lock_offset(s);
+    pthread_mutex_unlock(&s->mu);
+}
+
+void avsync_seed_drift(AvSync *s, uint64_t t0_us, double residual0_ms)
+{
+    if (!s) return;
+    pthread_mutex_lock(&s->mu);
+    s->drift_base_set = t0_us != 0;
+    s->drift_t0_us = t0_us;
+    s->residual0_ms = residual0_ms;
+    pthread_mutex_unlock(&s->mu);
+}
+
+static void add_pair(AvSync *s, int64_t v, int64_t a)
+{
+    double off_ms = us_to_ms((double)(v - a));
+    if (s->off_n < s->pair_cap) s->off_ms[s->off_n++] = off_ms;
+
+    if (s->offset_locked) {
+        double res_ms = us_to_ms((double)((v + s->offset_us) - a));
+        if (s->res_n < s->pair_cap) s->res_ms[s->res_n++] = res_ms;
+    }
 }
 
 void avsync_on_video(AvSync *s, uint64_t video_pts_us)
+{
+    avsync_on_video_at(s, video_pts_us, rkav_now_monotonic_us());
+}
+
+void avsync_on_video_at(AvSync *s, uint64_t video_pts_us, uint64_t arrival_us)
 {
     if (!s) return;
     pthread_mutex_lock(&s->mu);
@@ -85,23 +191,28 @@ void avsync_on_video(AvSync *s, uint64_t video_pts_us)
     try_lock_offset(s);
 
     // paired offset/residual on every VIDEO event (audio as reference)
-    if (s->has_last_audio) {
+    if (s->has_last_audio && s->params.pairing != AVSYNC_PAIR_REPORT_TICK) {
         int64_t v = (int64_t)video_pts_us;
         int64_t a = (int64_t)s->last_audio_us;
 
-        double off_ms = us_to_ms((double)(v - a));
-        if (s->off_n < 128) s->off_ms[s->off_n++] = off_ms;
-
-        if (s->offset_locked) {
-            double res_ms = us_to_ms((double)((v + s->offset_us) - a));
-            if (s->res_n < 128) s->res_ms[s->res_n++] = res_ms;
+        if (s->params.pairing == AVSYNC_PAIR_INTERP &&
+            s->has_last_audio_arrival && arrival_us > s->last_audio_arrival_us) {
+            // 音频时钟按到达时刻外推，最多外推一个 chunk（音频停顿时不无限外推）
+            uint64_t ext_us = arrival_us - s->last_audio_arrival_us;
+            uint64_t chunk_us = s->has_last_audio_meta && s->last_audio_sr
+                ? (uint64_t)s->last_audio_frames * 1000000ULL / (uint64_t)s->last_audio_sr
+                : 0;
+            if (ext_us > chunk_us) ext_us = chunk_us;
+            a += (int64_t)ext_us;
         }
+
+        add_pair(s, v, a);
     }
 
     if (s->has_last_video && video_pts_us > s->last_video_us) {
         uint64_t delta_us = video_pts_us - s->last_video_us;
         double jitter_ms = dabs(us_to_ms((double)delta_us - (double)s->expected_video_delta_us));
-        if (s->vj_n < MAX_VJ) s->vj_ms[s->vj_n++] = jitter_ms;
+        if (s->vj_n < s->vj_cap) s->vj_ms[s->vj_n++] = jitter_ms;
     }
 
     s->has_last_video = 1;
@@ -111,10 +222,15 @@ void avsync_on_video(AvSync *s, uint64_t video_pts_us)
 }
 
 void avsync_on_audio(AvSync *s, uint64_t audio_pts_us, uint32_t frames, uint32_t sample_rate)
+{
+    avsync_on_audio_at(s, audio_pts_us, frames, sample_rate, rkav_now_monotonic_us());
+}
+
+void avsync_on_audio_at(AvSync *s, uint64_t audio_pts_us, uint32_t frames,
+                        uint32_t sample_rate, uint64_t now_us)
 {
     if (!s) return;
     if (sample_rate == 0) return;
-    uint64_t now_us = rkav_now_monotonic_us();
     pthread_mutex_lock(&s->mu);
 
     if (!s->has_audio0) {
@@ -129,7 +245,7 @@ void avsync_on_audio(AvSync *s, uint64_t audio_pts_us, uint32_t frames, uint32_t
         // expected delta = previous chunk duration
         uint64_t expected_us = (uint64_t)s->last_audio_frames * 1000000ULL / (uint64_t)s->last_audio_sr;
         double jitter_ms = dabs(us_to_ms((double)delta_us - (double)expected_us));
-        if (s->aj_n < MAX_AJ) s->aj_ms[s->aj_n++] = jitter_ms;
+        if (s->aj_n < s->aj_cap) s->aj_ms[s->aj_n++] = jitter_ms;
     }
 
     s->has_last_audio = 1;
@@ -143,83 +259,79 @@ void avsync_on_audio(AvSync *s, uint64_t audio_pts_us, uint32_t frames, uint32_t
     pthread_mutex_unlock(&s->mu);
 }
 
-void avsync_report_1s(AvSync *s, uint64_t now_us)
+void avsync_report(AvSync *s, uint64_t now_us, AvSyncReport *out)
 {
-    if (!s) return;
+    if (!s || !out) return;
 
     pthread_mutex_lock(&s->mu);
 
-    const int has_v = s->has_last_video;
-    const int has_a = s->has_last_audio;
-    const int locked = s->offset_locked;
-
-    uint64_t v_us = s->last_video_us;
-    uint64_t a_us = s->last_audio_us;
-    int64_t  off  = s->offset_us;
-
-    // jitter percentiles
-    double v_p50 = RK_NAN, v_p95 = RK_NAN;
-    double a_p50 = RK_NAN, a_p95 = RK_NAN;
+    memset(out, 0, sizeof(*out));
+    out->now_us    = now_us;
+    out->locked    = s->offset_locked;
+    out->offset_us = s->offset_us;
 
-        // paired offset/residual percentiles (computed on video events)
-    double off_p50 = RK_NAN, off_p95 = RK_NAN;
-    double res_p50 = RK_NAN, res_p95 = RK_NAN;
+    // 早期口径：report 时刻直接相减（仅作对照）
+    if (s->params.pairing == AVSYNC_PAIR_REPORT_TICK && s->has_last_video && s->has_last_audio) {
+        add_pair(s, (int64_t)s->last_video_us, (int64_t)s->last_audio_us);
+    }
 
+    out->n_video = s->vj_n;
+    out->n_audio = s->aj_n;
+    out->n_pairs = s->off_n;
 
-    if (s->vj_n > 0) {
-        qsort(s->vj_ms, s->vj_n, sizeof(double), cmp_double);
-        v_p50 = percentile_nearest(s->vj_ms, s->vj_n, 0.50);
-        v_p95 = percentile_nearest(s->vj_ms, s->vj_n, 0.95);
-    }
-    if (s->aj_n > 0) {
-        qsort(s->aj_ms, s->aj_n, sizeof(double), cmp_double);
-        a_p50 = percentile_nearest(s->aj_ms, s->aj_n, 0.50);
-        a_p95 = percentile_nearest(s->aj_ms, s->aj_n, 0.95);
-    }
-    if (s->off_n > 0) {
-        qsort(s->off_ms, s->off_n, sizeof(double), cmp_double);
-        off_p50 = percentile_nearest(s->off_ms, s->off_n, 0.50);
-        off_p95 = percentile_nearest(s->off_ms, s->off_n, 0.95);
-    }
-    if (s->res_n > 0) {
-        qsort(s->res_ms, s->res_n, sizeof(double), cmp_double);
-        res_p50 = percentile_nearest(s->res_ms, s->res_n, 0.50);
-        res_p95 = percentile_nearest(s->res_ms, s->res_n, 0.95);
-    }
+    // jitter percentiles
+    sorted_p50_p95(s, s->vj_ms, s->vj_n, &out->v_jitter_p50_ms, &out->v_jitter_p95_ms);
+    sorted_p50_p95(s, s->aj_ms, s->aj_n, &out->a_jitter_p50_ms, &out->a_jitter_p95_ms);
 
+    // paired offset/residual percentiles (computed on video events)
+    sorted_p50_p95(s, s->off_ms, s->off_n, &out->av_offset_ms, &out->av_offset_p95_ms);
+    sorted_p50_p95(s, s->res_ms, s->res_n, &out->residual_ms, &out->residual_p95_ms);
 
-    // reset bucket for next second
+    // reset bucket for next window
     s->vj_n = 0;
     s->aj_n = 0;
     s->off_n = 0;
     s->res_n = 0;
 
-
-    char v50_s[32], v95_s[32], a50_s[32], a95_s[32];
-    if (is_nan(v_p50)) snprintf(v50_s, sizeof(v50_s), "n/a"); else snprintf(v50_s, sizeof(v50_s), "%.3f", v_p50);
-    if (is_nan(v_p95)) snprintf(v95_s, sizeof(v95_s), "n/a"); else snprintf(v95_s, sizeof(v95_s), "%.3f", v_p95);
-    if (is_nan(a_p50)) snprintf(a50_s, sizeof(a50_s), "n/a"); else snprintf(a50_s, sizeof(a50_s), "%.3f", a_p50);
-    if (is_nan(a_p95)) snprintf(a95_s, sizeof(a95_s), "n/a"); else snprintf(a95_s, sizeof(a95_s), "%.3f", a_p95);
-
-       // compute offsets & drift (use paired samples on video events)
-    double av_offset_ms = off_p50;     // p50 of paired (video-audio)
-    double residual_ms  = res_p50;     // p50 of paired aligned residual
-    double drift_msps   = RK_NAN;      // ms/s
-
-    if (!is_nan(residual_ms) && locked) {
+    // drift: residual p50 相对首个有效窗口的斜率
+    out->drift_msps = RK_NAN;
+    if (!is_nan(out->residual_ms) && s->offset_locked) {
         if (!s->drift_base_set) {
             s->drift_base_set = 1;
             s->drift_t0_us = now_us;
-            s->residual0_ms = residual_ms;
+            s->residual0_ms = out->residual_ms;
         } else if (now_us > s->drift_t0_us) {
             double elapsed_s = (double)(now_us - s->drift_t0_us) / 1000000.0;
             if (elapsed_s > 0.0) {
-                drift_msps = (residual_ms - s->residual0_ms) / elapsed_s;
+                out->drift_msps = (out->residual_ms - s->residual0_ms) / elapsed_s;
             }
         }
     }
 
+    pthread_mutex_unlock(&s->mu);
+}
 
+void avsync_report_1s(AvSync *s, uint64_t now_us)
+{
+    if (!s) return;
+
+    AvSyncReport r;
+    avsync_report(s, now_us, &r);
+    avsync_log_report(&r);
+}
+
+void avsync_log_report(const AvSyncReport *rp)
+{
+    if (!rp) return;
+    const AvSyncReport r = *rp;
+
+    char v50_s[32], v95_s[32], a50_s[32], a95_s[32];
+    fmt_ms(v50_s, sizeof(v50_s), r.v_jitter_p50_ms);
+    fmt_ms(v95_s, sizeof(v95_s), r.v_jitter_p95_ms);
+    fmt_ms(a50_s, sizeof(a50_s), r.a_jitter_p50_ms);
+    fmt_ms(a95_s, sizeof(a95_s), r.a_jitter_p95_ms);
+
+    double drift_msps = r.drift_msps;
     const char *dir = "n/a";
     if (!is_nan(drift_msps)) {
         if (drift_msps > 0.0) dir = "video_faster_or_audio_slower";
@@ -227,26 +339,24 @@ void avsync_report_1s(AvSync *s, uint64_t now_us)
         else dir = "stable";
     }
 
-    if (is_nan(av_offset_ms)) {
+    if (is_nan(r.av_offset_ms)) {
         LOGI("[%s] av_offset_ms=n/a drift_msps=n/a | v_jitter_ms p50=%s p95=%s | a_jitter_ms p50=%s p95=%s",
              TAG, v50_s, v95_s, a50_s, a95_s);
     } else {
-        if (locked) {
+        if (r.locked) {
             if (is_nan(drift_msps)) drift_msps = 0.0;
 
             LOGI("[%s] av_offset_ms=%.3f aligned_residual_ms=%.3f drift_msps=%.6f (%s) | "
                  "v_jitter_ms p50=%s p95=%s | a_jitter_ms p50=%s p95=%s",
                  TAG,
-                 av_offset_ms,
-                 residual_ms,
+                 r.av_offset_ms,
+                 r.residual_ms,
                  drift_msps,
                  dir,
                  v50_s, v95_s, a50_s, a95_s);
         } else {
             LOGI("[%s] av_offset_ms=%.3f drift_msps=n/a | v_jitter_ms p50=%s p95=%s | a_jitter_ms p50=%s p95=%s",
-                 TAG, av_offset_ms, v50_s, v95_s, a50_s, a95_s);
+                 TAG, r.av_offset_ms, v50_s, v95_s, a50_s, a95_s);
         }
     }
-
-    pthread_mutex_unlock(&s->mu);
 }
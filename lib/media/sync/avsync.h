@@ -10,9 +10,48 @@ extern "C" {
 #define AVSYNC_MAX_VJ 128
 #define AVSYNC_MAX_AJ 256
 
+/* 百分位算法 */
+typedef enum {
+    AVSYNC_PCT_NEAREST = 0,  // nearest-rank：rank = ceil(q*n)（默认，与历史日志一致）
+    AVSYNC_PCT_LINEAR  = 1,  // 线性插值：pos = q*(n-1)
+} AvSyncPctMethod;
+
+/* offset/residual 的配对口径（见 README 第 8 章） */
+typedef enum {
+    AVSYNC_PAIR_VIDEO_EVENT = 0,  // 每个视频事件配最近一次 audio_pts（默认）
+    AVSYNC_PAIR_INTERP      = 1,  // 按到达时刻把音频时钟外推到视频事件时刻再配对
+    AVSYNC_PAIR_REPORT_TICK = 2,  // 早期口径：report 时刻 last_video - last_audio（用于对照）
+} AvSyncPairing;
+
+typedef struct {
+    AvSyncPctMethod pct_method;
+    AvSyncPairing   pairing;
+    unsigned int    window_ms;  // 两次 report 的间隔，用于决定样本缓冲容量（默认 1000）
+} AvSyncParams;
+
+/* 一次 report 的结果（NaN 表示该项本窗口无样本） */
+typedef struct {
+    uint64_t now_us;
+    int      locked;
+    int64_t  offset_us;
+    int      n_video;
+    int      n_audio;
+    int      n_pairs;
+    double   av_offset_ms;      // paired (video - audio) p50
+    double   av_offset_p95_ms;
+    double   residual_ms;       // aligned residual p50
+    double   residual_p95_ms;
+    double   drift_msps;
+    double   v_jitter_p50_ms;
+    double   v_jitter_p95_ms;
+    double   a_jitter_p50_ms;
+    double   a_jitter_p95_ms;
+} AvSyncReport;
+
 typedef struct AvSync{
     pthread_mutex_t mu;
 
+    AvSyncParams params;
     uint64_t expected_video_delta_us;
 
     int has_video0;
@@ -28,16 +67,20 @@ typedef struct AvSync{
     uint64_t last_video_us;
     uint64_t last_audio_us;
 
-    double vj_ms[AVSYNC_MAX_VJ];
+    /* 样本缓冲：容量按 window_ms 在 init 时分配 */
+    double *vj_ms;
     int vj_n;
-    double aj_ms[AVSYNC_MAX_AJ];
+    int vj_cap;
+    double *aj_ms;
     int aj_n;
+    int aj_cap;
 
-    double res_ms[128];
+    double *res_ms;
     int res_n;
 
-    double off_ms[128];
+    double *off_ms;
     int off_n;
+    int pair_cap;
 
     uint32_t last_audio_frames;
     uint32_t last_audio_sr;
@@ -59,21 +102,53 @@ typedef struct AvSync{
  */
 int avsync_init(AvSync *s, int video_fps);
 
-/* 释放资源（主要是 mutex） */
+/*
+ * 同 avsync_init，但可指定百分位算法 / 配对口径 / 窗口长度。
+ * params 为 NULL 时等价于 avsync_init。
+ */
+int avsync_init_ex(AvSync *s, int video_fps, const AvSyncParams *params);
+
+/* 释放资源（mutex + 样本缓冲） */
 void avsync_deinit(AvSync *s);
 
+/*
+ * 预置 offset 锁定点（离线分段回放用：每段都用整条 trace 的首个 audio/video pts 锁定）。
+ */
+void avsync_seed_offset(AvSync *s, uint64_t video0_us, uint64_t audio0_us);
+
+/*
+ * 预置 drift 基准（离线分段回放用：后面的段沿用整条 trace 首个有效窗口的 residual）。
+ * t0_us = 0 表示还没有基准，由之后第一个有效窗口确定。
+ */
+void avsync_seed_drift(AvSync *s, uint64_t t0_us, double residual0_ms);
+
 /*
  * 输入：视频 PTS（微秒，基于 CLOCK_MONOTONIC）。
  * 在 h264 sink 消费端调用最合适（代表下游真实看到的节奏）。
  */
 void avsync_on_video(AvSync *s, uint64_t video_pts_us);
 
+/* 同上，但由调用方给出事件到达时刻（离线回放用虚拟时钟） */
+void avsync_on_video_at(AvSync *s, uint64_t video_pts_us, uint64_t arrival_us);
+
 /*
  * 输入：音频 PTS（微秒，基于 CLOCK_MONOTONIC），以及该 chunk 的 frames/sample_rate。
  * 其中 frames 为“每声道帧数”，sample_rate 为 Hz。
  */
 void avsync_on_audio(AvSync *s, uint64_t audio_pts_us, uint32_t frames, uint32_t sample_rate);
 
+/* 同上，但由调用方给出到达时刻（arrival-jitter 按它计算） */
+void avsync_on_audio_at(AvSync *s, uint64_t audio_pts_us, uint32_t frames,
+                        uint32_t sample_rate, uint64_t arrival_us);
+
+/*
+ * 计算本窗口指标并清空样本（不打印）。
+ */
+void avsync_report(AvSync *s, uint64_t now_us, AvSyncReport *out);
+
+/* 按 [AVSYNC] 固定格式打印一次 report 结果 */
+void avsync_log_report(const AvSyncReport *r);
+
 /*
  * 每秒报告一次（打印到日志）。
  *
@@ -83,4 +158,4 @@ void avsync_report_1s(AvSync *s, uint64_t now_us);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,339 @@
+#include "synth.h"
+#include "rkav/time.h"
+#include "lib/utils/log.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TAG "synth"
+
+/* 按 speed 把媒体时间映射到墙钟，sleep 到该时刻（speed <= 0 不等） */
+static void pace_until(uint64_t start_us, uint64_t media_us, double speed)
+{
+    if (speed <= 0.0) return;
+
+    uint64_t due = start_us + (uint64_t)((double)media_us / speed);
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(due / 1000000ULL);
+    ts.tv_nsec = (long)(due % 1000000ULL) * 1000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+/* ---------------- video ---------------- */
+
+int synth_video_init(SynthVideo *v, int width, int height, int fps,
+                     double speed, unsigned int duration_sec)
+{
+    if (!v || width <= 0 || height <= 0 || fps <= 0) return -1;
+    memset(v, 0, sizeof(*v));
+
+    v->width = width;
+    v->height = height;
+    v->fps = fps;
+    v->speed = speed;
+    v->max_frames = (uint64_t)duration_sec * (uint64_t)fps;
+
+    size_t y_size = (size_t)width * height;
+    v->frame_size = y_size * 3 / 2;
+    v->y_plane = malloc(y_size);
+    v->uv_plane = malloc(y_size / 2);
+    v->nv12_frame = malloc(v->frame_size);
+    if (!v->y_plane || !v->uv_plane || !v->nv12_frame) {
+        synth_video_deinit(v);
+        return -1;
+    }
+
+    // 灰度渐变 + 中性色度，便于肉眼看出帧号条纹
+    for (int y = 0; y < height; y++) {
+        memset(v->y_plane + (size_t)y * width, 16 + (y * 219) / height, (size_t)width);
+    }
+    memset(v->uv_plane, 0x80, y_size / 2);
+
+    v->start_us = rkav_now_monotonic_us();
+    v->pts0_us = v->start_us;
+
+    LOGI("[%s] video %dx%d@%d speed=%.2f frames=%llu", TAG, width, height, fps, speed,
+         (unsigned long long)v->max_frames);
+    return 0;
+}
+
+int synth_video_next(SynthVideo *v, const uint8_t **data, size_t *len,
+                     uint64_t *pts_us, uint32_t *sequence)
+{
+    if (!v || !v->nv12_frame) return -1;
+    if (v->max_frames && v->frame_idx >= v->max_frames) return 1;
+
+    uint64_t media_us = v->frame_idx * 1000000ULL / (uint64_t)v->fps;
+    pace_until(v->start_us, media_us, v->speed);
+
+    // 每帧改动首行（帧号条纹），其余内容不变
+    size_t y_size = (size_t)v->width * v->height;
+    memset(v->y_plane, (int)(v->frame_idx & 0xff), (size_t)v->width);
+
+    // 与 v4l2_capture_dqbuf 一致：Y、UV 两次拷贝合成连续 NV12
+    memcpy(v->nv12_frame, v->y_plane, y_size);
+    memcpy(v->nv12_frame + y_size, v->uv_plane, y_size / 2);
+
+    *data = v->nv12_frame;
+    *len = v->frame_size;
+    *pts_us = v->pts0_us + media_us;
+    if (sequence) *sequence = (uint32_t)v->frame_idx;
+    v->frame_idx++;
+    return 0;
+}
+
+void synth_video_deinit(SynthVideo *v)
+{
+    if (!v) return;
+    free(v->y_plane);
+    free(v->uv_plane);
+    free(v->nv12_frame);
+    v->y_plane = v->uv_plane = v->nv12_frame = NULL;
+}
+
+/* ---------------- audio ---------------- */
+
+int synth_audio_init(SynthAudio *a, unsigned int sample_rate, unsigned int channels,
+                     unsigned int chunk_ms, double speed, unsigned int duration_sec)
+{
+    if (!a || sample_rate == 0 || channels == 0) return -1;
+    memset(a, 0, sizeof(*a));
+
+    a->sample_rate = sample_rate;
+    a->channels = channels;
+    a->chunk_frames = (uint32_t)((uint64_t)sample_rate * (chunk_ms ? chunk_ms : 20) / 1000);
+    if (a->chunk_frames == 0) a->chunk_frames = 1;
+    a->speed = speed;
+    a->max_frames = (uint64_t)duration_sec * sample_rate;
+    a->start_us = rkav_now_monotonic_us();
+    a->pts0_us = a->start_us;
+
+    LOGI("[%s] audio sr=%u ch=%u chunk=%u frames speed=%.2f", TAG, sample_rate, channels,
+         a->chunk_frames, speed);
+    return 0;
+}
+
+int synth_audio_read(SynthAudio *a, uint8_t *buf, size_t bytes,
+                     uint32_t *frames, uint64_t *pts_us)
+{
+    if (!a || !buf) return -1;
+    if (a->max_frames && a->frames_done >= a->max_frames) return 1;
+
+    uint32_t n = a->chunk_frames;
+    if (bytes < (size_t)n * a->channels * 2) n = (uint32_t)(bytes / (a->channels * 2));
+    if (n == 0) return -1;
+    if (a->max_frames && a->frames_done + n > a->max_frames)
+        n = (uint32_t)(a->max_frames - a->frames_done);
+
+    // 与 ALSA 阻塞读一致：这一块"采完"的时刻才返回
+    uint64_t media_end_us = (a->frames_done + n) * 1000000ULL / a->sample_rate;
+    pace_until(a->start_us, media_end_us, a->speed);
+
+    int16_t *s = (int16_t *)buf;
+    double step = 2.0 * M_PI * 1000.0 / (double)a->sample_rate;  // 1 kHz
+    for (uint32_t i = 0; i < n; i++) {
+        int16_t v = (int16_t)(sin(a->phase) * 8000.0);
+        a->phase += step;
+        if (a->phase > 2.0 * M_PI) a->phase -= 2.0 * M_PI;
+        for (unsigned int c = 0; c < a->channels; c++) *s++ = v;
+    }
+
+    *frames = n;
+    *pts_us = a->pts0_us + a->frames_done * 1000000ULL / a->sample_rate;
+    a->frames_done += n;
+    return 0;
+}
+
+/* ---------------- cost-model encoder ---------------- */
+
+typedef struct {
+    uint8_t *p;
+    size_t   cap;
+    size_t   bit;
+} BitWriter;
+
+static void bw_put(BitWriter *w, uint32_t v, int n)
+{
+    for (int i = n - 1; i >= 0; i--) {
+        size_t byte = w->bit >> 3;
+        if (byte >= w->cap) return;
+        if ((v >> i) & 1) w->p[byte] |= (uint8_t)(0x80 >> (w->bit & 7));
+        w->bit++;
+    }
+}
+
+static void bw_ue(BitWriter *w, uint32_t v)
+{
+    uint32_t x = v + 1;
+    int len = 0;
+    while ((x >> len) > 1) len++;
+    bw_put(w, 0, len);
+    bw_put(w, x, len + 1);
+}
+
+static void bw_se(BitWriter *w, int32_t v)
+{
+    bw_ue(w, v <= 0 ? (uint32_t)(-2 * v) : (uint32_t)(2 * v - 1));
+}
+
+/* rbsp 结尾 + 防竞争字节，写成带 4 字节起始码的 NAL，返回长度 */
+static size_t bw_finish_nal(BitWriter *w, uint8_t nal_header, uint8_t *out, size_t cap)
+{
+    bw_put(w, 1, 1);
+    while (w->bit & 7) bw_put(w, 0, 1);
+    size_t rbsp_len = w->bit >> 3;
+
+    size_t o = 0;
+    if (cap < 5) return 0;
+    out[o++] = 0; out[o++] = 0; out[o++] = 0; out[o++] = 1;
+    out[o++] = nal_header;
+
+    int zeros = 0;
+    for (size_t i = 0; i < rbsp_len && o + 2 < cap; i++) {
+        if (zeros >= 2 && w->p[i] <= 3) {
+            out[o++] = 3;
+            zeros = 0;
+        }
+        out[o++] = w->p[i];
+        zeros = w->p[i] == 0 ? zeros + 1 : 0;
+    }
+    return o;
+}
+
+/* Baseline SPS：尺寸真实，可被封装器/解析器读出宽高 */
+static void build_sps_pps(CostEncoder *e)
+{
+    uint8_t rbsp[32];
+    BitWriter w;
+
+    memset(rbsp, 0, sizeof(rbsp));
+    w = (BitWriter){ rbsp, sizeof(rbsp), 0 };
+    int mbs_w = (e->width + 15) / 16;
+    int mbs_h = (e->height + 15) / 16;
+
+    bw_put(&w, 66, 8);        // profile_idc: Baseline
+    bw_put(&w, 0xC0, 8);      // constraint_set0/1
+    bw_put(&w, 31, 8);        // level 3.1
+    bw_ue(&w, 0);             // sps_id
+    bw_ue(&w, 0);             // log2_max_frame_num_minus4
+    bw_ue(&w, 2);             // pic_order_cnt_type
+    bw_ue(&w, 1);             // max_num_ref_frames
+    bw_put(&w, 0, 1);         // gaps_in_frame_num_allowed
+    bw_ue(&w, (uint32_t)(mbs_w - 1));
+    bw_ue(&w, (uint32_t)(mbs_h - 1));
+    bw_put(&w, 1, 1);         // frame_mbs_only
+    bw_put(&w, 1, 1);         // direct_8x8_inference
+    int crop_r = (mbs_w * 16 - e->width) / 2;
+    int crop_b = (mbs_h * 16 - e->height) / 2;
+    if (crop_r || crop_b) {
+        bw_put(&w, 1, 1);
+        bw_ue(&w, 0);
+        bw_ue(&w, (uint32_t)crop_r);
+        bw_ue(&w, 0);
+        bw_ue(&w, (uint32_t)crop_b);
+    } else {
+        bw_put(&w, 0, 1);
+    }
+    bw_put(&w, 0, 1);         // vui_parameters_present
+    e->sps_len = bw_finish_nal(&w, 0x67, e->sps, sizeof(e->sps));
+
+    memset(rbsp, 0, sizeof(rbsp));
+    w = (BitWriter){ rbsp, sizeof(rbsp), 0 };
+    bw_ue(&w, 0);             // pps_id
+    bw_ue(&w, 0);             // sps_id
+    bw_put(&w, 0, 1);         // entropy_coding_mode (CAVLC)
+    bw_put(&w, 0, 1);         // bottom_field_pic_order_in_frame_present
+    bw_ue(&w, 0);             // num_slice_groups_minus1
+    bw_ue(&w, 0);             // num_ref_idx_l0_default_active_minus1
+    bw_ue(&w, 0);             // num_ref_idx_l1_default_active_minus1
+    bw_put(&w, 0, 1);         // weighted_pred
+    bw_put(&w, 0, 2);         // weighted_bipred_idc
+    bw_se(&w, 0);             // pic_init_qp_minus26
+    bw_se(&w, 0);             // pic_init_qs_minus26
+    bw_se(&w, 0);             // chroma_qp_index_offset
+    bw_put(&w, 1, 1);         // deblocking_filter_control_present
+    bw_put(&w, 0, 1);         // constrained_intra_pred
+    bw_put(&w, 0, 1);         // redundant_pic_cnt_present
+    e->pps_len = bw_finish_nal(&w, 0x68, e->pps, sizeof(e->pps));
+}
+
+int cost_encoder_init(CostEncoder *e, int width, int height, int fps,
+                      int bitrate, unsigned int ns_per_px)
+{
+    if (!e || width <= 0 || height <= 0 || fps <= 0) return -1;
+    memset(e, 0, sizeof(*e));
+    e->width = width;
+    e->height = height;
+    e->fps = fps;
+    e->bitrate = bitrate > 0 ? bitrate : 2000000;
+    e->gop = fps;             // 与 MPP 配置一致：每秒一个 IDR
+    e->ns_per_px = ns_per_px;
+    e->rng = 0x12345678u;
+    build_sps_pps(e);
+
+    LOGI("[%s] cost encoder %dx%d@%d bitrate=%d cost=%uns/px (%.2fms/frame)", TAG,
+         width, height, fps, e->bitrate, ns_per_px,
+         (double)ns_per_px * width * height / 1e6);
+    return 0;
+}
+
+static uint32_t xorshift(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+int cost_encoder_encode(CostEncoder *e, const uint8_t *frame, size_t frame_size,
+                        uint8_t **out_data, size_t *out_size, bool *out_keyframe)
+{
+    if (!e || !frame || !frame_size || !out_data || !out_size) return -1;
+
+    // 模拟编码耗时：读一遍输入（带宽）+ 按像素忙等（算力）
+    uint64_t t0 = rkav_now_monotonic_us();
+    uint32_t sum = 0;
+    for (size_t i = 0; i < frame_size; i += 64) sum += frame[i];
+    uint64_t cost_us = (uint64_t)e->ns_per_px * (uint64_t)e->width * (uint64_t)e->height / 1000ULL;
+    while (rkav_now_monotonic_us() - t0 < cost_us) {
+    }
+
+    bool key = (e->frame_idx % (uint64_t)e->gop) == 0;
+
+    // 码率模型：P 帧 ±25% 抖动，I 帧约 4 倍
+    size_t avg = (size_t)e->bitrate / 8 / (size_t)e->fps;
+    size_t payload = key ? avg * 4 : avg * 3 / 4 + (xorshift(&e->rng) % (avg / 2 + 1));
+    if (payload < 16) payload = 16;
+
+    size_t hdr = key ? e->sps_len + e->pps_len : 0;
+    size_t total = hdr + 5 + payload;
+    uint8_t *p = malloc(total);
+    if (!p) return -1;
+
+    size_t o = 0;
+    if (key) {
+        memcpy(p + o, e->sps, e->sps_len); o += e->sps_len;
+        memcpy(p + o, e->pps, e->pps_len); o += e->pps_len;
+    }
+    p[o++] = 0; p[o++] = 0; p[o++] = 0; p[o++] = 1;
+    p[o++] = key ? 0x65 : 0x41;
+    // 负载不含 00 00，免去防竞争处理；首字节带一点输入相关性
+    memset(p + o, 0x5A, payload);
+    p[o] = (uint8_t)(0x80 | (sum & 0x7f));
+
+    e->frame_idx++;
+    *out_data = p;
+    *out_size = total;
+    if (out_keyframe) *out_keyframe = key;
+    return 0;
+}
+
+void cost_encoder_deinit(CostEncoder *e)
+{
+    (void)e;
+}
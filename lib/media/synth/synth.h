@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 合成数据源 + 代价模型编码器（--synthetic 无头模式用）。
+ *
+ * - 不依赖 V4L2 / ALSA / MPP，任何 Linux 主机都能跑完整线程图
+ * - speed：1.0 = 实时；>1 按倍速产出；0 = 不限速（测吞吐上限）
+ * - pts 按媒体时间推进（帧号 / 采样数），与 speed 无关；到达时刻仍是墙钟
+ * - 数据源产出 duration_sec 的媒体时长后返回 EOF（1）
+ */
+
+/* ---- 视频：NV12，Y / UV 分 plane 生成后按 v4l2_capture_dqbuf 的方式合帧 ---- */
+typedef struct {
+    int       width;
+    int       height;
+    int       fps;
+    double    speed;
+    uint64_t  max_frames;     // 0 = 不限
+
+    uint8_t  *y_plane;
+    uint8_t  *uv_plane;
+    uint8_t  *nv12_frame;
+    size_t    frame_size;
+
+    uint64_t  frame_idx;
+    uint64_t  start_us;       // 第 0 帧的墙钟时刻（monotonic）
+    uint64_t  pts0_us;
+} SynthVideo;
+
+int  synth_video_init(SynthVideo *v, int width, int height, int fps,
+                      double speed, unsigned int duration_sec);
+
+/*
+ * 取下一帧（必要时 sleep 到该帧的到达时刻）。
+ * 返回 0 = 取到；1 = 已到时长；-1 = 错误
+ */
+int  synth_video_next(SynthVideo *v, const uint8_t **data, size_t *len,
+                      uint64_t *pts_us, uint32_t *sequence);
+
+void synth_video_deinit(SynthVideo *v);
+
+/* ---- 音频：S16LE 正弦 ---- */
+typedef struct {
+    unsigned int sample_rate;
+    unsigned int channels;
+    uint32_t     chunk_frames;
+    double       speed;
+    uint64_t     max_frames;  // 0 = 不限
+
+    uint64_t     frames_done;
+    uint64_t     start_us;
+    uint64_t     pts0_us;
+    double       phase;
+} SynthAudio;
+
+int  synth_audio_init(SynthAudio *a, unsigned int sample_rate, unsigned int channels,
+                      unsigned int chunk_ms, double speed, unsigned int duration_sec);
+
+/* 读一块到 buf（bytes >= chunk_frames * channels * 2），返回 0 / 1(EOF) / -1 */
+int  synth_audio_read(SynthAudio *a, uint8_t *buf, size_t bytes,
+                      uint32_t *frames, uint64_t *pts_us);
+
+/* ---- 代价模型编码器：按像素数忙等模拟编码耗时，输出 Annex-B 结构的假 H.264 ---- */
+typedef struct {
+    int       width;
+    int       height;
+    int       fps;
+    int       bitrate;
+    int       gop;
+    unsigned  ns_per_px;      // 每像素编码耗时（ns），0 = 不模拟耗时
+
+    uint8_t   sps[32];
+    size_t    sps_len;
+    uint8_t   pps[16];
+    size_t    pps_len;
+
+    uint64_t  frame_idx;
+    uint32_t  rng;
+} CostEncoder;
+
+int  cost_encoder_init(CostEncoder *e, int width, int height, int fps,
+                       int bitrate, unsigned int ns_per_px);
+
+/* 输出由 malloc 分配，调用方 free；关键帧前带 SPS/PPS */
+int  cost_encoder_encode(CostEncoder *e, const uint8_t *frame, size_t frame_size,
+                         uint8_t **out_data, size_t *out_size, bool *out_keyframe);
+
+void cost_encoder_deinit(CostEncoder *e);
+
+#ifdef __cplusplus
+}
+#endif
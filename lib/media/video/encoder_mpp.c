@@ -1,6 +1,8 @@
 #include "encoder_mpp.h"
 #include "lib/utils/log.h"
+#include "span_trace.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #define TAG "mpp_enc"
@@ -269,6 +271,7 @@ int encoder_mpp_encode_packet(EncoderMPP *enc,
         return -1; 
     }
 
+    uint64_t sp = span_begin();
     void *dst = mpp_buffer_get_ptr(enc->frm_buf);
     size_t copy_size = frame_size > enc->frame_size ? enc->frame_size : frame_size;
     memcpy(dst, frame_data, copy_size);
@@ -293,13 +296,16 @@ int encoder_mpp_encode_packet(EncoderMPP *enc,
 
     ret = enc->mpi->encode_put_frame(enc->ctx, frame);
     mpp_frame_deinit(&frame);
+    span_end(SPAN_V_ENC_PUT, sp);
     if(ret){
         LOGE("[%s] encode_put_frame failed: %d", TAG, ret);
         return -1;
     }
 
     MppPacket pkt = NULL;
+    sp = span_begin();
     ret = enc->mpi->encode_get_packet(enc->ctx, &pkt);
+    span_end(SPAN_V_ENC_GET, sp);
     if(ret){
         LOGE("[%s] encode_get_packet failed: %d", TAG, ret);
         return -1;
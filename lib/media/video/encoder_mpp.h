@@ -60,9 +60,9 @@ int encoder_mpp_encode(EncoderMPP *enc,
 
 void encoder_mpp_deinit(EncoderMPP *enc);
 
-int encoder_mpp_encoder_packet(EncoderMPP *enc,
-                               const uint8_t *frame_data,
-                               size_t frame_size,
-                               uint8_t **out_data,
-                               EncSink *out_size,
-                               bool *out_keyframe);
\ No newline at end of file
+int encoder_mpp_encode_packet(EncoderMPP *enc,
+                              const uint8_t *frame_data,
+                              size_t frame_size,
+                              uint8_t **out_data,
+                              size_t *out_size,
+                              bool *out_keyframe);
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "frame_pool.h"
+#include "lib/utils/log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TAG "fpool"
+
+int frame_pool_init(FramePool *p, unsigned n, unsigned width, unsigned height, unsigned scale)
+{
+    if (!p || n == 0 || width == 0 || height == 0) return -1;
+    memset(p, 0, sizeof(*p));
+    for (unsigned i = 0; i < FRAME_POOL_MAX; i++) p->bufs[i].fd = p->bufs[i].ro_fd = -1;
+    if (n > FRAME_POOL_MAX) n = FRAME_POOL_MAX;
+    if (scale != 0 && scale != 2 && scale != 4 && scale != 8) {
+        LOGE("[%s] scale must be 2, 4 or 8 (got %u)", TAG, scale);
+        return -1;
+    }
+
+    p->width = width;
+    p->height = height;
+    p->frame_size = (size_t)width * height * 3 / 2;
+    size_t end = p->frame_size;
+    if (scale) {
+        p->scale = scale;
+        p->small_w = (width / scale) & ~1u;
+        p->small_h = (height / scale) & ~1u;
+        p->small_off = (p->frame_size + 63) & ~(size_t)63;
+        p->small_size = (size_t)p->small_w * p->small_h * 3 / 2;
+        end = p->small_off + p->small_size;
+    }
+    long pg = sysconf(_SC_PAGESIZE);
+    p->buf_size = (end + (size_t)pg - 1) & ~((size_t)pg - 1);
+
+    for (unsigned i = 0; i < n; i++) {
+        FramePoolBuf *b = &p->bufs[i];
+        char name[32];
+        snprintf(name, sizeof(name), "rkav-frame%u", i);
+        b->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (b->fd < 0 || ftruncate(b->fd, (off_t)p->buf_size) != 0) {
+            LOGE("[%s] memfd %zu bytes failed: %s", TAG, p->buf_size, strerror(errno));
+            goto fail;
+        }
+        fcntl(b->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+        char proc[64];
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", b->fd);
+        b->ro_fd = open(proc, O_RDONLY | O_CLOEXEC);
+        void *m = mmap(NULL, p->buf_size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+        if (b->ro_fd < 0 || m == MAP_FAILED) {
+            LOGE("[%s] map buffer %u failed: %s", TAG, i, strerror(errno));
+            goto fail;
+        }
+        b->base = (uint8_t *)m;
+        memset(b->base, 0, p->buf_size);   // 页启动时就分配好
+        atomic_init(&b->ref, 0);
+        p->n++;
+    }
+
+    LOGI("[%s] %u x %.1f MiB NV12 %ux%u%s", TAG, p->n, (double)p->buf_size / (1024.0 * 1024.0),
+         width, height, scale ? " + small variant" : "");
+    return 0;
+
+fail:
+    for (unsigned i = 0; i < FRAME_POOL_MAX; i++) {
+        FramePoolBuf *b = &p->bufs[i];
+        if (b->base) munmap(b->base, p->buf_size);
+        if (b->ro_fd >= 0) close(b->ro_fd);
+        if (b->fd >= 0) close(b->fd);
+    }
+    memset(p, 0, sizeof(*p));
+    return -1;
+}
+
+int frame_pool_acquire(FramePool *p)
+{
+    for (unsigned k = 0; k < p->n; k++) {
+        unsigned i = (p->next + k) % p->n;
+        int expect = 0;
+        if (atomic_compare_exchange_strong(&p->bufs[i].ref, &expect, 1)) {
+            p->next = (i + 1) % p->n;
+            return (int)i;
+        }
+    }
+    p->exhausted++;
+    return -1;
+}
+
+void frame_pool_ref(FramePool *p, int slot)
+{
+    atomic_fetch_add(&p->bufs[slot].ref, 1);
+}
+
+void frame_pool_unref(FramePool *p, int slot)
+{
+    int prev = atomic_fetch_sub(&p->bufs[slot].ref, 1);
+    if (prev <= 0) LOGE_RL("[%s] buffer %d unref underflow", TAG, slot);
+}
+
+void frame_pool_make_small(FramePool *p, int slot)
+{
+    if (!p->scale) return;
+    const unsigned f = p->scale, w = p->width, h = p->height;
+    const unsigned sw = p->small_w, sh = p->small_h;
+    const uint8_t *src = p->bufs[slot].base;
+    uint8_t *dst = p->bufs[slot].base + p->small_off;
+    const unsigned shift = f == 2 ? 2 : f == 4 ? 4 : 6;   // log2(f*f)
+
+    // Y：f×f 块平均
+    for (unsigned y = 0; y < sh; y++) {
+        uint8_t *d = dst + (size_t)y * sw;
+        for (unsigned x = 0; x < sw; x++) {
+            unsigned sum = 0;
+            for (unsigned j = 0; j < f; j++) {
+                const uint8_t *s = src + (size_t)(y * f + j) * w + x * f;
+                for (unsigned i = 0; i < f; i++) sum += s[i];
+            }
+            d[x] = (uint8_t)(sum >> shift);
+        }
+    }
+    // UV：交织平面本身是半分辨率，同样按 f×f 个 UV 对平均
+    const uint8_t *suv = src + (size_t)w * h;
+    uint8_t *duv = dst + (size_t)sw * sh;
+    for (unsigned y = 0; y < sh / 2; y++) {
+        uint8_t *d = duv + (size_t)y * sw;
+        for (unsigned x = 0; x < sw / 2; x++) {
+            unsigned su = 0, sv = 0;
+            for (unsigned j = 0; j < f; j++) {
+                const uint8_t *s = suv + (size_t)(y * f + j) * w + (size_t)x * f * 2;
+                for (unsigned i = 0; i < f; i++) {
+                    su += s[i * 2];
+                    sv += s[i * 2 + 1];
+                }
+            }
+            d[x * 2] = (uint8_t)(su >> shift);
+            d[x * 2 + 1] = (uint8_t)(sv >> shift);
+        }
+    }
+}
+
+unsigned frame_pool_in_use(const FramePool *p)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < p->n; i++) {
+        if (atomic_load(&((FramePool *)p)->bufs[i].ref) > 0) n++;
+    }
+    return n;
+}
+
+void frame_pool_deinit(FramePool *p)
+{
+    if (!p || p->n == 0) return;
+    unsigned busy = frame_pool_in_use(p);
+    if (busy) LOGW("[%s] %u buffers still referenced at deinit", TAG, busy);
+    for (unsigned i = 0; i < p->n; i++) {
+        FramePoolBuf *b = &p->bufs[i];
+        munmap(b->base, p->buf_size);
+        close(b->ro_fd);
+        close(b->fd);
+    }
+    memset(p, 0, sizeof(*p));
+}
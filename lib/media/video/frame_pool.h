@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 采集帧池（--frame-export 时启用）：n 块 NV12 帧缓冲，每块一个 memfd，启动时映射好。
+ *
+ * - 采集直接把帧合进池里的 buffer（不再 malloc + memcpy 一份进 VideoFrame），编码器和本机消费者
+ *   共享同一块内存，谁用谁持一个引用，引用归零 buffer 回池
+ * - 每块 buffer 可以带一个整数倍缩小的变体（紧跟在原图后面），给只要小图的推理进程
+ * - 只有采集线程 acquire；ref / unref 任意线程
+ */
+
+#define FRAME_POOL_MAX 32
+
+typedef struct {
+    int         fd;            // memfd（读写）
+    int         ro_fd;         // 只读重开，发给消费者
+    uint8_t    *base;
+    atomic_int  ref;
+} FramePoolBuf;
+
+typedef struct {
+    FramePoolBuf bufs[FRAME_POOL_MAX];
+    unsigned     n;
+    unsigned     width, height;
+    unsigned     scale;                  // 0 = 无缩小变体
+    unsigned     small_w, small_h;
+    size_t       frame_size;             // NV12 原图 w*h*3/2
+    size_t       small_off, small_size;  // 缩小变体在 buffer 里的位置
+    size_t       buf_size;               // 按页对齐
+    unsigned     next;                   // acquire 轮转起点
+    uint64_t     exhausted;              // acquire 找不到空 buffer 的次数（采集线程写）
+} FramePool;
+
+/* scale：0 或 2/4/8，缩小变体宽高 = 原图 / scale（按偶数取整） */
+int      frame_pool_init(FramePool *p, unsigned n, unsigned width, unsigned height, unsigned scale);
+
+/* 找一块空闲 buffer，引用置 1 交给调用方；全被占着返回 -1 */
+int      frame_pool_acquire(FramePool *p);
+void     frame_pool_ref(FramePool *p, int slot);
+void     frame_pool_unref(FramePool *p, int slot);
+
+static inline uint8_t *frame_pool_data(FramePool *p, int slot)
+{
+    return p->bufs[slot].base;
+}
+
+/* 原图 -> 缩小变体（NV12 按 scale×scale 块求平均）；没配 scale 时空操作 */
+void     frame_pool_make_small(FramePool *p, int slot);
+
+/* 当前被占用（ref > 0）的 buffer 数 */
+unsigned frame_pool_in_use(const FramePool *p);
+
+void     frame_pool_deinit(FramePool *p);
+
+#ifdef __cplusplus
+}
+#endif
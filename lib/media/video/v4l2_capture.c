@@ -216,7 +216,16 @@ int v4l2_capture_start(V4L2Capture *cap)
 int v4l2_capture_dqbuf(V4L2Capture *cap, int *index,
                        void **data, size_t *length)
 {
-    if (!cap || cap->fd < 0 || !index || !data || !length)
+    if (!cap || !data) return -1;
+    int r = v4l2_capture_dqbuf_to(cap, index, cap->nv12_frame, length);
+    if (r == 0) *data = cap->nv12_frame;
+    return r;
+}
+
+int v4l2_capture_dqbuf_to(V4L2Capture *cap, int *index,
+                          uint8_t *dst, size_t *length)
+{
+    if (!cap || cap->fd < 0 || !index || !length)
         return -1;
 
     struct v4l2_buffer buf;
@@ -234,7 +243,7 @@ int v4l2_capture_dqbuf(V4L2Capture *cap, int *index,
     if (r < 0) {
         /* 非阻塞模式下，EAGAIN 表示当前没有帧可取 */
         if (errno == EAGAIN) return 1;   // 暂时没数据
-        LOGE("[%s] DQBUF failed: %s", TAG, strerror(errno));
+        LOGE_RL("[%s] DQBUF failed: %s", TAG, strerror(errno));
         return -1;
     }
 
@@ -256,18 +265,17 @@ int v4l2_capture_dqbuf(V4L2Capture *cap, int *index,
     if (planes[1].bytesused && planes[1].bytesused < uv_size)
         uv_size = planes[1].bytesused;
 
-    uint8_t *dst = cap->nv12_frame;
-
-    /* 合帧：Y 紧跟 UV，组成连续 NV12 */
-    memcpy(dst,
-           cap->bufs[idx].planes[0],
-           y_size);
+    /* 合帧：Y 紧跟 UV，组成连续 NV12；dst 为 NULL 时只出队不合帧（调用方要丢这一帧） */
+    if (dst) {
+        memcpy(dst,
+               cap->bufs[idx].planes[0],
+               y_size);
 
-    memcpy(dst + cap->width * cap->height,
-           cap->bufs[idx].planes[1],
-           uv_size);
+        memcpy(dst + cap->width * cap->height,
+               cap->bufs[idx].planes[1],
+               uv_size);
+    }
 
-    *data   = cap->nv12_frame;
     *length = cap->frame_size;
 
     return 0;
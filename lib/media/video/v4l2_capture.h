@@ -35,6 +35,9 @@ int  v4l2_capture_open (V4L2Capture *cap, const char *dev,
 int  v4l2_capture_start(V4L2Capture *cap);
 int  v4l2_capture_dqbuf(V4L2Capture *cap, int *index,
                         void **data, size_t *length);
+/* 同上，但直接合进调用方给的 frame_size 大小的 dst（帧池 buffer），省一次拷贝 */
+int  v4l2_capture_dqbuf_to(V4L2Capture *cap, int *index,
+                           uint8_t *dst, size_t *length);
 int  v4l2_capture_qbuf (V4L2Capture *cap, int index);
 void v4l2_capture_dump_format(V4L2Capture *cap);
 void v4l2_capture_close(V4L2Capture *cap);
@@ -1,18 +1,312 @@
 #include "log.h"
+
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
-void log_print(int level, const char *fmt, ...)
+#define LOG_LINE_MAX 512
+
+atomic_int g_log_level = LOG_LEVEL_INFO;
+
+/* 每线程一份格式化缓冲：不再共用 static buf，也不在热路径上分配 */
+static __thread char t_line[LOG_LINE_MAX];
+
+/* ---------------- MPSC ring（Vyukov bounded queue，单消费者） ---------------- */
+
+typedef struct {
+    atomic_size_t seq;
+    uint16_t      len;
+    char          text[LOG_LINE_MAX];
+} LogSlot;
+
+typedef struct {
+    LogSlot        *slots;
+    size_t          mask;
+    atomic_size_t   tail;      // 生产者 CAS 抢位
+    size_t          head;      // 仅 writer 线程访问
+
+    atomic_int      running;
+    atomic_int      stop;
+    atomic_int      sleeping;  // writer 即将阻塞在 eventfd 上
+    int             wake_fd;
+    pthread_t       th;
+
+    atomic_uint_fast64_t dropped;
+    uint64_t        dropped_reported;
+} LogAsync;
+
+static LogAsync g_la = { .wake_fd = -1 };
+
+static const char *level_tag(int level)
+{
+    switch (level) {
+    case LOG_LEVEL_DEBUG: return "D";
+    case LOG_LEVEL_WARN:  return "W";
+    case LOG_LEVEL_ERROR: return "E";
+    default:              return "I";
+    }
+}
+
+static void write_all(const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(STDERR_FILENO, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static int ring_push(const char *line, size_t len)
+{
+    size_t pos = atomic_load_explicit(&g_la.tail, memory_order_relaxed);
+    LogSlot *slot;
+
+    for (;;) {
+        slot = &g_la.slots[pos & g_la.mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_la.tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;  // 满
+        } else {
+            pos = atomic_load_explicit(&g_la.tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot->text, line, len);
+    slot->len = (uint16_t)len;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    // writer 睡眠时才付出一次 eventfd write
+    if (atomic_load_explicit(&g_la.sleeping, memory_order_seq_cst) &&
+        atomic_exchange(&g_la.sleeping, 0)) {
+        uint64_t one = 1;
+        ssize_t r = write(g_la.wake_fd, &one, sizeof(one));
+        (void)r;
+    }
+    return 0;
+}
+
+/* 取出当前可读的全部条目拼进 out，返回拼入的字节数 */
+static size_t ring_drain(char *out, size_t cap)
+{
+    size_t used = 0;
+    for (;;) {
+        LogSlot *slot = &g_la.slots[g_la.head & g_la.mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != g_la.head + 1) break;
+        if (used + slot->len > cap) break;
+
+        memcpy(out + used, slot->text, slot->len);
+        used += slot->len;
+        atomic_store_explicit(&slot->seq, g_la.head + g_la.mask + 1, memory_order_release);
+        g_la.head++;
+    }
+    return used;
+}
+
+static size_t format_line(char *buf, size_t cap, int level, const char *fmt, va_list ap)
+{
+    char ts[32];
+    log_format_timestamp(ts, sizeof(ts));
+
+    int n = snprintf(buf, cap, "[%s %s] ", level_tag(level), ts);
+    if (n < 0) n = 0;
+    if ((size_t)n >= cap - 1) n = (int)cap - 2;
+
+    int m = vsnprintf(buf + n, cap - (size_t)n, fmt, ap);
+    if (m < 0) m = 0;
+    size_t len = (size_t)n + (size_t)m;
+    if (len > cap - 2) len = cap - 2;  // 截断，留出 '\n'
+
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+static void report_drops(void)
+{
+    uint64_t d = atomic_load_explicit(&g_la.dropped, memory_order_relaxed);
+    if (d == g_la.dropped_reported) return;
+
+    char ts[32], line[128];
+    log_format_timestamp(ts, sizeof(ts));
+    int n = snprintf(line, sizeof(line), "[W %s] [log] dropped %llu messages (ring full, total=%llu)\n",
+                     ts, (unsigned long long)(d - g_la.dropped_reported), (unsigned long long)d);
+    if (n > 0) write_all(line, (size_t)n);
+    g_la.dropped_reported = d;
+}
+
+static void *log_writer_thread(void *arg)
 {
-    const char *lv = "I";
-    if (level == LOG_LEVEL_WARN)  lv = "W";
-    if (level == LOG_LEVEL_ERROR) lv = "E";
+    (void)arg;
+    static char batch[64 * 1024];
+    pthread_setname_np(pthread_self(), "rkav-log");
 
-    fprintf(stderr, "[%s %s] ", lv, log_timestamp());
+    for (;;) {
+        size_t n = ring_drain(batch, sizeof(batch));
+        if (n > 0) {
+            write_all(batch, n);
+            report_drops();
+            continue;
+        }
 
+        if (atomic_load(&g_la.stop)) {
+            report_drops();
+            break;
+        }
+
+        // 先声明要睡，再复查一次，避免错过刚发布的条目
+        atomic_store(&g_la.sleeping, 1);
+        n = ring_drain(batch, sizeof(batch));
+        if (n > 0) {
+            atomic_store(&g_la.sleeping, 0);
+            write_all(batch, n);
+            report_drops();
+            continue;
+        }
+        if (atomic_load(&g_la.stop)) {
+            atomic_store(&g_la.sleeping, 0);
+            continue;
+        }
+
+        uint64_t v;
+        ssize_t r = read(g_la.wake_fd, &v, sizeof(v));
+        (void)r;
+        atomic_store(&g_la.sleeping, 0);
+    }
+    return NULL;
+}
+
+void log_print(int level, const char *fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    size_t len = format_line(t_line, sizeof(t_line), level, fmt, args);
     va_end(args);
 
-    fprintf(stderr, "\n");
-}
\ No newline at end of file
+    if (atomic_load_explicit(&g_la.running, memory_order_acquire)) {
+        if (ring_push(t_line, len) == 0) return;
+        atomic_fetch_add_explicit(&g_la.dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    // 同步回退：一次 write，整行不会和其他线程交错
+    write_all(t_line, len);
+}
+
+int log_async_start(unsigned int slots)
+{
+    if (atomic_load(&g_la.running)) return 0;
+
+    // ring 只分配一次、进程内不释放（见 log_async_stop）；再次 start 沿用原来的 ring 和游标
+    if (!g_la.slots) {
+        size_t cap = 1;
+        if (slots < 64) slots = 64;
+        while (cap < slots) cap <<= 1;
+
+        g_la.slots = calloc(cap, sizeof(LogSlot));
+        if (!g_la.slots) return -1;
+        for (size_t i = 0; i < cap; i++) atomic_init(&g_la.slots[i].seq, i);
+
+        g_la.mask = cap - 1;
+        g_la.head = 0;
+        atomic_store(&g_la.tail, 0);
+        atomic_store(&g_la.dropped, 0);
+        g_la.dropped_reported = 0;
+    }
+    atomic_store(&g_la.stop, 0);
+    atomic_store(&g_la.sleeping, 0);
+
+    g_la.wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (g_la.wake_fd < 0) return -1;
+
+    if (pthread_create(&g_la.th, NULL, log_writer_thread, NULL) != 0) {
+        close(g_la.wake_fd);
+        g_la.wake_fd = -1;
+        return -1;
+    }
+
+    atomic_store_explicit(&g_la.running, 1, memory_order_release);
+    return 0;
+}
+
+void log_async_stop(void)
+{
+    if (!atomic_load(&g_la.running)) return;
+
+    // 先切回同步写；已进 ring 的由 writer 排空。
+    // 出错提前返回时 metrics / 扇出 / 帧导出等线程可能还在打日志：ring 不释放，
+    // 已经看到 running=1 的调用者仍然写得进去，之后的都走同步 write
+    atomic_store_explicit(&g_la.running, 0, memory_order_seq_cst);
+    atomic_store(&g_la.stop, 1);
+
+    uint64_t one = 1;
+    ssize_t r = write(g_la.wake_fd, &one, sizeof(one));
+    (void)r;
+    pthread_join(g_la.th, NULL);
+
+    close(g_la.wake_fd);
+    g_la.wake_fd = -1;
+
+    // writer 退出后才发布完的条目：这里已是唯一的消费者，同步写掉
+    static char tail[16 * 1024];
+    size_t n;
+    while ((n = ring_drain(tail, sizeof(tail))) > 0) write_all(tail, n);
+    report_drops();
+}
+
+uint64_t log_dropped_count(void)
+{
+    return atomic_load_explicit(&g_la.dropped, memory_order_relaxed);
+}
+
+void log_set_level(int level)
+{
+    if (level < LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+    if (level > LOG_LEVEL_ERROR) level = LOG_LEVEL_ERROR;
+    atomic_store_explicit(&g_log_level, level, memory_order_relaxed);
+}
+
+int log_parse_level(const char *s)
+{
+    if (!s) return -1;
+    if (!strcasecmp(s, "debug") || !strcmp(s, "0")) return LOG_LEVEL_DEBUG;
+    if (!strcasecmp(s, "info")  || !strcmp(s, "1")) return LOG_LEVEL_INFO;
+    if (!strcasecmp(s, "warn")  || !strcmp(s, "2")) return LOG_LEVEL_WARN;
+    if (!strcasecmp(s, "error") || !strcmp(s, "3")) return LOG_LEVEL_ERROR;
+    return -1;
+}
+
+int log_rl_allow(LogRateLimit *rl, unsigned int *suppressed_out)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now_ms = (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+
+    uint64_t win = atomic_load_explicit(&rl->window_ms, memory_order_relaxed);
+    if (now_ms - win >= LOG_RL_INTERVAL_MS &&
+        atomic_compare_exchange_strong(&rl->window_ms, &win, now_ms)) {
+        atomic_store(&rl->count, 0);
+    }
+
+    if (atomic_fetch_add(&rl->count, 1) < LOG_RL_BURST) {
+        if (suppressed_out) *suppressed_out = atomic_exchange(&rl->suppressed, 0);
+        return 1;
+    }
+    atomic_fetch_add(&rl->suppressed, 1);
+    return 0;
+}
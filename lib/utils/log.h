@@ -1,36 +1,100 @@
 // src/log.h
 #pragma once
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 
-/* 打印当前时间，格式：HH:MM:SS.mmm */
-static inline const char *log_timestamp(void)
+/* 把当前时间写进调用方缓冲，格式：HH:MM:SS.mmm（线程安全，不再共用 static buf） */
+static inline int log_format_timestamp(char *buf, size_t n)
 {
-    static char buf[32];
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
 
     struct tm tm_now;
     localtime_r(&ts.tv_sec, &tm_now);
 
-    snprintf(buf, sizeof(buf), "%02d:%02d:%02d.%03d",
-             tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec,
-             (int)(ts.tv_nsec / 1000000));
-    return buf;
+    return snprintf(buf, n, "%02d:%02d:%02d.%03d",
+                    tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec,
+                    (int)(ts.tv_nsec / 1000000));
 }
 
 /* 日志级别 */
 enum {
+    LOG_LEVEL_DEBUG = 0,
     LOG_LEVEL_INFO  = 1,
     LOG_LEVEL_WARN  = 2,
     LOG_LEVEL_ERROR = 3,
 };
 
+/* 编译期级别：低于它的宏直接编译掉（make CFLAGS+=-DLOG_COMPILE_LEVEL=2） */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+/* 运行期级别（log_set_level 修改） */
+extern atomic_int g_log_level;
+
+static inline int log_level_enabled(int level)
+{
+    return level >= atomic_load_explicit(&g_log_level, memory_order_relaxed);
+}
+
+void log_set_level(int level);
+
+/* "debug" / "info" / "warn" / "error" -> 级别；无法识别返回 -1 */
+int log_parse_level(const char *s);
+
 /* 实际的打印函数，在 log.c 里实现 */
-void log_print(int level, const char *fmt, ...);
+void log_print(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/*
+ * 异步模式：格式化在调用线程的 thread-local 缓冲里完成，
+ * 然后投进无锁 MPSC ring，由后台线程统一 write(2)。stderr 阻塞不会再卡住采集/编码线程。
+ * ring 满时丢弃并计数，后台线程会补一条 "[log] dropped N" 提示。
+ * 未 start 或 stop 之后回退为同步写；stop 不释放 ring，别的线程还在打日志时调用也安全。
+ */
+int      log_async_start(unsigned int slots);
+void     log_async_stop(void);
+uint64_t log_dropped_count(void);
+
+/* ---- 限流：同一调用点每 LOG_RL_INTERVAL_MS 最多 LOG_RL_BURST 条 ---- */
+
+#define LOG_RL_INTERVAL_MS 1000
+#define LOG_RL_BURST       5
+
+typedef struct {
+    atomic_uint_fast64_t window_ms;
+    atomic_uint          count;
+    atomic_uint          suppressed;
+} LogRateLimit;
+
+/* 返回 1 表示放行；*suppressed_out 为放行前被吞掉的条数 */
+int log_rl_allow(LogRateLimit *rl, unsigned int *suppressed_out);
+
+#define LOG_IF(level, fmt, ...) do { \
+    if ((level) >= LOG_COMPILE_LEVEL && log_level_enabled(level)) \
+        log_print(level, fmt, ##__VA_ARGS__); \
+} while (0)
+
+#define LOG_RL(level, fmt, ...) do { \
+    if ((level) >= LOG_COMPILE_LEVEL && log_level_enabled(level)) { \
+        static LogRateLimit log_rl_; \
+        unsigned int log_sup_ = 0; \
+        if (log_rl_allow(&log_rl_, &log_sup_)) { \
+            if (log_sup_) log_print(level, fmt " (suppressed %u similar)", ##__VA_ARGS__, log_sup_); \
+            else log_print(level, fmt, ##__VA_ARGS__); \
+        } \
+    } \
+} while (0)
 
 /* 对外用的简化宏 */
-#define LOGI(fmt, ...) log_print(LOG_LEVEL_INFO,  fmt, ##__VA_ARGS__)
-#define LOGW(fmt, ...) log_print(LOG_LEVEL_WARN,  fmt, ##__VA_ARGS__)
-#define LOGE(fmt, ...) log_print(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) LOG_IF(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...) LOG_IF(LOG_LEVEL_INFO,  fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) LOG_IF(LOG_LEVEL_WARN,  fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) LOG_IF(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+/* 热路径里可能刷屏的错误（如 DQBUF failed）用限流版本 */
+#define LOGW_RL(fmt, ...) LOG_RL(LOG_LEVEL_WARN,  fmt, ##__VA_ARGS__)
+#define LOGE_RL(fmt, ...) LOG_RL(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
@@ -0,0 +1,396 @@
+#include "frame_export.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define TAG "fexport"
+
+/* ---------- 服务端 ---------- */
+
+/* 持锁：收回一个读者借走的某块 buffer */
+static void client_drop_lease(FrameExport *fx, FxClient *c, unsigned buf)
+{
+    c->held[buf] = 0;
+    c->n_held--;
+    frame_pool_unref(fx->pool, (int)buf);
+}
+
+/* 持锁：断开读者，借走的全部归还 */
+static void client_remove(FrameExport *fx, FxClient *c)
+{
+    for (unsigned i = 0; i < fx->pool->n; i++) {
+        if (c->held[i]) client_drop_lease(fx, c, i);
+    }
+    LOGI("[%s] reader fd=%d detached: sent=%llu released=%llu expired=%llu skipped=%llu", TAG, c->fd,
+         (unsigned long long)c->sent, (unsigned long long)c->released,
+         (unsigned long long)c->expired, (unsigned long long)c->skipped);
+    close(c->fd);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    atomic_fetch_sub(&fx->n_clients, 1);
+}
+
+static int send_hello(FrameExport *fx, int sock)
+{
+    FramePool *p = fx->pool;
+    FxHello h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FX_MAGIC, sizeof(h.magic));
+    h.version = FX_VERSION;
+    h.n_bufs = p->n;
+    h.width = p->width;
+    h.height = p->height;
+    h.small_w = p->small_w;
+    h.small_h = p->small_h;
+    h.buf_size = p->buf_size;
+    h.small_off = p->small_off;
+    h.lease_ms = fx->lease_ms;
+    h.max_held = fx->max_held;
+
+    struct iovec iov = { .iov_base = &h, .iov_len = sizeof(h) };
+    union {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(int) * FRAME_POOL_MAX)];
+    } cm;
+    memset(&cm, 0, sizeof(cm));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * p->n);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * p->n);
+    int fds[FRAME_POOL_MAX];
+    for (unsigned i = 0; i < p->n; i++) fds[i] = p->bufs[i].ro_fd;
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * p->n);
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(h) ? 0 : -1;
+}
+
+static void handle_accept(FrameExport *fx)
+{
+    int s;
+    while ((s = accept4(fx->listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+        if (send_hello(fx, s) != 0) {
+            LOGW_RL("[%s] hello failed: %s", TAG, strerror(errno));
+            close(s);
+            continue;
+        }
+        pthread_mutex_lock(&fx->lock);
+        FxClient *slot = NULL;
+        for (int i = 0; i < FX_MAX_CLIENTS; i++) {
+            if (fx->clients[i].fd < 0) {
+                slot = &fx->clients[i];
+                break;
+            }
+        }
+        if (slot) {
+            memset(slot, 0, sizeof(*slot));
+            slot->fd = s;
+            fx->attached++;
+            int n = atomic_fetch_add(&fx->n_clients, 1) + 1;
+            LOGI("[%s] reader fd=%d attached (%d connected)", TAG, s, n);
+        }
+        pthread_mutex_unlock(&fx->lock);
+        if (!slot) {
+            LOGW_RL("[%s] too many readers (%d), refusing", TAG, FX_MAX_CLIENTS);
+            close(s);
+        }
+    }
+}
+
+static void handle_client(FrameExport *fx, FxClient *c, short revents)
+{
+    FxMsg m;
+    ssize_t n;
+    while ((n = recv(c->fd, &m, sizeof(m), MSG_DONTWAIT)) > 0) {
+        if (n != (ssize_t)sizeof(m) || m.type != FX_MSG_RELEASE || m.buf >= fx->pool->n) {
+            LOGW_RL("[%s] reader fd=%d: bad message (%zd bytes)", TAG, c->fd, n);
+            continue;
+        }
+        // 过期收回之后才到的 release（frame_id 对不上）直接忽略
+        if (c->held[m.buf] == m.frame_id + 1) {
+            client_drop_lease(fx, c, m.buf);
+            c->released++;
+            fx->released_total++;
+        }
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN) || (revents & (POLLHUP | POLLERR))) client_remove(fx, c);
+}
+
+/* 持锁：到期的借出强制收回，告诉读者这块不再归它 */
+static void expire_leases(FrameExport *fx, uint64_t now)
+{
+    for (int k = 0; k < FX_MAX_CLIENTS; k++) {
+        FxClient *c = &fx->clients[k];
+        if (c->fd < 0 || c->n_held == 0) continue;
+        for (unsigned i = 0; i < fx->pool->n; i++) {
+            if (!c->held[i] || now < c->deadline_us[i]) continue;
+            FxMsg m = { .type = FX_MSG_REVOKE, .buf = i, .frame_id = c->held[i] - 1 };
+            send(c->fd, &m, sizeof(m), MSG_DONTWAIT | MSG_NOSIGNAL);
+            client_drop_lease(fx, c, i);
+            c->expired++;
+            fx->expired_total++;
+            LOGW_RL("[%s] reader fd=%d held buffer %u past %ums lease, reclaimed", TAG, c->fd, i,
+                    fx->lease_ms);
+        }
+    }
+}
+
+static void *fx_thread(void *arg)
+{
+    FrameExport *fx = (FrameExport *)arg;
+    pthread_setname_np(pthread_self(), "fexport");
+
+    // 租约检查粒度：lease / 4，夹在 5..50ms
+    int period = (int)fx->lease_ms / 4;
+    if (period < 5) period = 5;
+    if (period > 50) period = 50;
+
+    while (!atomic_load(&fx->stop)) {
+        struct pollfd pfd[2 + FX_MAX_CLIENTS];
+        FxClient *who[2 + FX_MAX_CLIENTS];
+        int n = 0;
+        pfd[n] = (struct pollfd){ .fd = fx->wake_fd, .events = POLLIN };
+        who[n++] = NULL;
+        pfd[n] = (struct pollfd){ .fd = fx->listen_fd, .events = POLLIN };
+        who[n++] = NULL;
+        pthread_mutex_lock(&fx->lock);
+        for (int i = 0; i < FX_MAX_CLIENTS; i++) {
+            if (fx->clients[i].fd < 0) continue;
+            pfd[n] = (struct pollfd){ .fd = fx->clients[i].fd, .events = POLLIN };
+            who[n++] = &fx->clients[i];
+        }
+        pthread_mutex_unlock(&fx->lock);
+
+        int r = poll(pfd, (nfds_t)n, period);
+        if (r < 0 && errno != EINTR) {
+            LOGE("[%s] poll failed: %s", TAG, strerror(errno));
+            break;
+        }
+        if (r > 0 && (pfd[1].revents & POLLIN)) handle_accept(fx);
+
+        pthread_mutex_lock(&fx->lock);
+        for (int i = 2; r > 0 && i < n; i++) {
+            if (pfd[i].revents && who[i]->fd == pfd[i].fd) handle_client(fx, who[i], pfd[i].revents);
+        }
+        expire_leases(fx, rkav_now_monotonic_us());
+        pthread_mutex_unlock(&fx->lock);
+    }
+    return NULL;
+}
+
+int frame_export_start(FrameExport *fx, FramePool *pool, const char *path,
+                       unsigned lease_ms, unsigned max_held)
+{
+    struct sockaddr_un sa;
+    if (!fx || !pool || !path || strlen(path) >= sizeof(sa.sun_path)) return -1;
+    memset(fx, 0, sizeof(*fx));
+    fx->pool = pool;
+    fx->lease_ms = lease_ms ? lease_ms : 500;
+    fx->max_held = max_held ? max_held : 2;
+    for (int i = 0; i < FX_MAX_CLIENTS; i++) fx->clients[i].fd = -1;
+    snprintf(fx->path, sizeof(fx->path), "%s", path);
+
+    fx->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    fx->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fx->listen_fd < 0 || fx->wake_fd < 0) goto fail;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path, strlen(path));
+    unlink(path);
+    if (bind(fx->listen_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fx->listen_fd, 4) != 0) {
+        LOGE("[%s] bind/listen %s failed: %s", TAG, path, strerror(errno));
+        goto fail;
+    }
+    pthread_mutex_init(&fx->lock, NULL);
+    if (pthread_create(&fx->th, NULL, fx_thread, fx) != 0) {
+        pthread_mutex_destroy(&fx->lock);
+        unlink(path);
+        goto fail;
+    }
+    LOGI("[%s] serving %u frame buffers on %s (lease=%ums, max %u held per reader)", TAG, pool->n, path,
+         fx->lease_ms, fx->max_held);
+    return 0;
+
+fail:
+    if (fx->listen_fd >= 0) close(fx->listen_fd);
+    if (fx->wake_fd >= 0) close(fx->wake_fd);
+    fx->listen_fd = fx->wake_fd = -1;
+    fx->pool = NULL;
+    return -1;
+}
+
+void frame_export_publish(FrameExport *fx, int slot, uint64_t frame_id, uint64_t pts_us)
+{
+    if (!fx->pool || !frame_export_has_clients(fx)) return;
+    frame_pool_make_small(fx->pool, slot);
+
+    uint64_t deadline = rkav_now_monotonic_us() + (uint64_t)fx->lease_ms * 1000;
+    FxMsg m = { .type = FX_MSG_FRAME, .buf = (uint32_t)slot, .frame_id = frame_id, .pts_us = pts_us };
+
+    pthread_mutex_lock(&fx->lock);
+    for (int i = 0; i < FX_MAX_CLIENTS; i++) {
+        FxClient *c = &fx->clients[i];
+        if (c->fd < 0) continue;
+        // 手上已经满额（或 socket 塞满）的读者跳过这一帧，不等它
+        if (c->n_held >= fx->max_held) {
+            c->skipped++;
+            continue;
+        }
+        frame_pool_ref(fx->pool, slot);
+        if (send(c->fd, &m, sizeof(m), MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(m)) {
+            frame_pool_unref(fx->pool, slot);
+            c->skipped++;
+            continue;
+        }
+        c->held[slot] = frame_id + 1;
+        c->deadline_us[slot] = deadline;
+        c->n_held++;
+        c->sent++;
+    }
+    pthread_mutex_unlock(&fx->lock);
+}
+
+void frame_export_tick_print(FrameExport *fx)
+{
+    if (!fx || !fx->pool) return;
+    pthread_mutex_lock(&fx->lock);
+    uint64_t sent = 0, skipped = 0;
+    unsigned held = 0;
+    for (int i = 0; i < FX_MAX_CLIENTS; i++) {
+        if (fx->clients[i].fd < 0) continue;
+        sent += fx->clients[i].sent;
+        skipped += fx->clients[i].skipped;
+        held += fx->clients[i].n_held;
+    }
+    uint64_t expired = fx->expired_total;
+    pthread_mutex_unlock(&fx->lock);
+    LOGI("[FX] readers=%d pool=%u/%u in use, held=%u sent=%llu skipped=%llu expired=%llu exhausted=%llu",
+         atomic_load(&fx->n_clients), frame_pool_in_use(fx->pool), fx->pool->n, held,
+         (unsigned long long)sent, (unsigned long long)skipped, (unsigned long long)expired,
+         (unsigned long long)fx->pool->exhausted);
+}
+
+void frame_export_stop(FrameExport *fx)
+{
+    if (!fx || !fx->pool) return;
+    atomic_store(&fx->stop, 1);
+    uint64_t one = 1;
+    ssize_t r = write(fx->wake_fd, &one, sizeof(one));
+    (void)r;
+    pthread_join(fx->th, NULL);
+
+    pthread_mutex_lock(&fx->lock);
+    for (int i = 0; i < FX_MAX_CLIENTS; i++) {
+        if (fx->clients[i].fd >= 0) client_remove(fx, &fx->clients[i]);
+    }
+    pthread_mutex_unlock(&fx->lock);
+    LOGI("[%s] stopped: readers attached=%llu released=%llu expired=%llu", TAG,
+         (unsigned long long)fx->attached, (unsigned long long)fx->released_total,
+         (unsigned long long)fx->expired_total);
+
+    close(fx->listen_fd);
+    close(fx->wake_fd);
+    unlink(fx->path);
+    pthread_mutex_destroy(&fx->lock);
+    fx->pool = NULL;
+}
+
+/* ---------- 读者 ---------- */
+
+int fx_reader_connect(FxReader *r, const char *path)
+{
+    struct sockaddr_un sa;
+    if (!r || !path || strlen(path) >= sizeof(sa.sun_path)) return -1;
+    memset(r, 0, sizeof(*r));
+    for (int i = 0; i < FRAME_POOL_MAX; i++) r->fds[i] = -1;
+
+    r->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (r->sock < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path, strlen(path));
+    if (connect(r->sock, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        LOGE("[%s] connect %s failed: %s", TAG, path, strerror(errno));
+        goto fail;
+    }
+
+    struct iovec iov = { .iov_base = &r->hello, .iov_len = sizeof(r->hello) };
+    union {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(int) * FRAME_POOL_MAX)];
+    } cm;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof(cm.buf);
+    if (recvmsg(r->sock, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(r->hello) ||
+        memcmp(r->hello.magic, FX_MAGIC, sizeof(r->hello.magic)) != 0 || r->hello.version != FX_VERSION ||
+        r->hello.n_bufs == 0 || r->hello.n_bufs > FRAME_POOL_MAX) {
+        LOGE("[%s] bad hello from %s", TAG, path);
+        goto fail;
+    }
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(sizeof(int) * r->hello.n_bufs)) {
+        LOGE("[%s] hello without %u fds", TAG, r->hello.n_bufs);
+        goto fail;
+    }
+    memcpy(r->fds, CMSG_DATA(c), sizeof(int) * r->hello.n_bufs);
+    for (unsigned i = 0; i < r->hello.n_bufs; i++) {
+        void *m = mmap(NULL, r->hello.buf_size, PROT_READ, MAP_SHARED, r->fds[i], 0);
+        if (m == MAP_FAILED) {
+            LOGE("[%s] mmap buffer %u failed: %s", TAG, i, strerror(errno));
+            goto fail;
+        }
+        r->maps[i] = (const uint8_t *)m;
+    }
+    return 0;
+
+fail:
+    fx_reader_close(r);
+    return -1;
+}
+
+int fx_reader_next(FxReader *r, FxMsg *m, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = r->sock, .events = POLLIN };
+    int pr = poll(&pfd, 1, timeout_ms);
+    if (pr == 0) return 0;
+    if (pr < 0) return errno == EINTR ? 0 : -1;
+    ssize_t n = recv(r->sock, m, sizeof(*m), 0);
+    if (n != (ssize_t)sizeof(*m) || m->buf >= r->hello.n_bufs) return -1;
+    return 1;
+}
+
+int fx_reader_release(FxReader *r, const FxMsg *frame)
+{
+    FxMsg m = { .type = FX_MSG_RELEASE, .buf = frame->buf, .frame_id = frame->frame_id };
+    return send(r->sock, &m, sizeof(m), MSG_NOSIGNAL) == (ssize_t)sizeof(m) ? 0 : -1;
+}
+
+void fx_reader_close(FxReader *r)
+{
+    if (!r) return;
+    for (int i = 0; i < FRAME_POOL_MAX; i++) {
+        if (r->maps[i]) munmap((void *)r->maps[i], r->hello.buf_size);
+        if (r->fds[i] >= 0) close(r->fds[i]);
+        r->maps[i] = NULL;
+        r->fds[i] = -1;
+    }
+    if (r->sock >= 0) close(r->sock);
+    r->sock = -1;
+}
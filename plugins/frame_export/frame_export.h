@@ -0,0 +1,122 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 原始帧导出（--frame-export <sock>）：本机推理进程直接拿采集的 NV12 帧，不用再开一次 V4L2 或解码。
+ *
+ * 协议（unix SOCK_SEQPACKET，一条消息一个结构体）：
+ *   连上 -> 服务端发 FxHello，SCM_RIGHTS 带上帧池每块 buffer 的只读 memfd（一次性，读者各自 mmap）
+ *   每帧 -> FxFrame{buf, frame_id, pts}：这块 buffer 借给你，引用 +1
+ *   用完 -> 读者回 FxRelease{buf, frame_id}，引用 -1
+ *   超时 -> 租约（--frame-export-lease-ms）到了还没还，服务端强制收回并发 FxRevoke，之后这块内存随时会被覆盖
+ *
+ * - 零拷贝：采集把帧合进帧池，编码器和所有读者看的是同一块内存
+ * - 每个读者同时最多持有 max_held 帧，再多就跳过不发（计 skipped）；帧池按 raw 队列 + 读者上限留够，
+ *   加上租约，不还帧的读者饿不着编码器
+ * - 发帧在采集线程（非阻塞 send），收 release / 查租约 / accept 在服务线程 "fexport"
+ */
+
+#define FX_MAGIC       "RKAVFRM1"
+#define FX_VERSION     1
+#define FX_MAX_CLIENTS 4
+
+enum {
+    FX_MSG_FRAME   = 1,   // 服务端 -> 读者
+    FX_MSG_RELEASE = 2,   // 读者 -> 服务端
+    FX_MSG_REVOKE  = 3,   // 服务端 -> 读者：租约到期已收回
+};
+
+typedef struct {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  n_bufs;            // 随消息带的 fd 个数，下标即 FxFrame.buf
+    uint32_t  width, height;     // 原图 NV12，stride = width，UV 紧跟 Y
+    uint32_t  small_w, small_h;  // 缩小变体（0 = 没有）
+    uint64_t  buf_size;          // 每个 fd 的映射长度
+    uint64_t  small_off;         // 缩小变体在 buffer 里的偏移
+    uint32_t  lease_ms;
+    uint32_t  max_held;
+} FxHello;
+
+typedef struct {
+    uint32_t  type;              // FX_MSG_*
+    uint32_t  buf;
+    uint64_t  frame_id;
+    uint64_t  pts_us;            // FRAME 才有
+} FxMsg;
+
+/* ---------- 服务端 ---------- */
+
+typedef struct {
+    int       fd;
+    uint64_t  held[FRAME_POOL_MAX];      // frame_id + 1，0 = 没借
+    uint64_t  deadline_us[FRAME_POOL_MAX];
+    unsigned  n_held;
+    uint64_t  sent, released, expired, skipped;
+} FxClient;
+
+typedef struct {
+    FramePool      *pool;
+    int             listen_fd;
+    int             wake_fd;
+    char            path[108];
+    pthread_t       th;
+    atomic_int      stop;
+    atomic_int      n_clients;          // 采集线程无读者时连锁都不拿
+
+    pthread_mutex_t lock;               // clients[]：采集线程发帧 / 服务线程收 release、收租约
+    FxClient        clients[FX_MAX_CLIENTS];
+    unsigned        lease_ms;
+    unsigned        max_held;
+    uint64_t        attached, expired_total, released_total;
+} FrameExport;
+
+int  frame_export_start(FrameExport *fx, FramePool *pool, const char *path,
+                        unsigned lease_ms, unsigned max_held);
+
+/* 采集线程：帧已在 pool 的 slot 里；给每个读者借出一份（各 +1 引用）。有读者时才做缩小变体 */
+void frame_export_publish(FrameExport *fx, int slot, uint64_t frame_id, uint64_t pts_us);
+
+/* 有读者连着（采集侧据此决定要不要算缩小变体） */
+static inline bool frame_export_has_clients(FrameExport *fx)
+{
+    return atomic_load_explicit(&fx->n_clients, memory_order_relaxed) > 0;
+}
+
+void frame_export_tick_print(FrameExport *fx);
+
+/* 停服务线程，收回所有借出的帧 */
+void frame_export_stop(FrameExport *fx);
+
+/* ---------- 读者 ---------- */
+
+typedef struct {
+    int       sock;
+    FxHello   hello;
+    int       fds[FRAME_POOL_MAX];
+    const uint8_t *maps[FRAME_POOL_MAX];
+} FxReader;
+
+int  fx_reader_connect(FxReader *r, const char *path);
+
+/* 1 = 收到一条（FRAME / REVOKE）；0 = 超时；-1 = 服务端关了 */
+int  fx_reader_next(FxReader *r, FxMsg *m, int timeout_ms);
+
+int  fx_reader_release(FxReader *r, const FxMsg *frame);
+
+void fx_reader_close(FxReader *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,416 @@
+#include "metrics_http.h"
+#include "lib/utils/log.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define TAG "metrics"
+
+#define BODY_CAP      (128u * 1024u)
+#define REQ_MAX       2048
+#define EOF_LINE      "# EOF\n"
+
+static const char k_content_type[] =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+// ============ Snapshot builder ============
+
+void metrics_snap_reset(MetricsSnap *s)
+{
+    if (!s) return;
+    s->n_samples = 0;
+    s->n_hists = 0;
+}
+
+static MetricSample *add_sample(MetricsSnap *s, const char *name, const char *help,
+                                const char *labels, MetricType type)
+{
+    if (!s || s->n_samples >= METRICS_MAX_SAMPLES) return NULL;
+    MetricSample *m = &s->samples[s->n_samples++];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    snprintf(m->labels, sizeof(m->labels), "%s", labels ? labels : "");
+    m->help = help;
+    m->type = type;
+    m->value = 0.0;
+    m->hist = -1;
+    m->hist_scale = 1.0;
+    return m;
+}
+
+void metrics_snap_counter(MetricsSnap *s, const char *name, const char *help,
+                          const char *labels, double value)
+{
+    MetricSample *m = add_sample(s, name, help, labels, METRIC_COUNTER);
+    if (m) m->value = value;
+}
+
+void metrics_snap_gauge(MetricsSnap *s, const char *name, const char *help,
+                        const char *labels, double value)
+{
+    MetricSample *m = add_sample(s, name, help, labels, METRIC_GAUGE);
+    if (m) m->value = value;
+}
+
+void metrics_snap_histogram_us(MetricsSnap *s, const char *name, const char *help,
+                               const char *labels, const LatHistSnap *hist)
+{
+    if (!s || !hist || s->n_hists >= METRICS_MAX_HISTS) return;
+    MetricSample *m = add_sample(s, name, help, labels, METRIC_HISTOGRAM);
+    if (!m) return;
+    m->hist = s->n_hists;
+    m->hist_scale = 1e-6;
+    s->hists[s->n_hists++] = *hist;
+}
+
+// ============ Rendering ============
+
+typedef struct {
+    char  *buf;
+    size_t cap;
+    size_t len;
+    int    overflow;
+} Out;
+
+static void out_printf(Out *o, const char *fmt, ...)
+{
+    if (o->overflow) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= o->cap - o->len) {
+        o->overflow = 1;
+        return;
+    }
+    o->len += (size_t)n;
+}
+
+static void out_value(Out *o, double v)
+{
+    if (v != v) out_printf(o, "NaN");
+    else out_printf(o, "%.17g", v);
+}
+
+/* name{labels,extra} —— labels/extra 任一可空 */
+static void out_series(Out *o, const char *name, const char *suffix,
+                       const char *labels, const char *extra)
+{
+    int has_l = labels && labels[0];
+    int has_e = extra && extra[0];
+    out_printf(o, "%s%s", name, suffix);
+    if (has_l || has_e) {
+        out_printf(o, "{%s%s%s}", has_l ? labels : "", (has_l && has_e) ? "," : "",
+                   has_e ? extra : "");
+    }
+    out_printf(o, " ");
+}
+
+static void render_histogram(Out *o, const MetricsSnap *s, const MetricSample *m)
+{
+    const LatHistSnap *h = &s->hists[m->hist];
+    char le[48];
+    uint64_t acc = 0;
+
+    // 只在每个 2 的幂区间的上界出一个 bucket，避免 200 行
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS - 1; i++) {
+        acc += h->bucket[i];
+        uint64_t upper = lat_hist_bucket_upper_us(i);
+        if (i >= LAT_HIST_SUB && ((i + 1 - LAT_HIST_SUB) % LAT_HIST_SUB) != 0) continue;
+        if (i < LAT_HIST_SUB && (upper & (upper - 1)) != 0) continue;
+        snprintf(le, sizeof(le), "le=\"%.9g\"", (double)upper * m->hist_scale);
+        out_series(o, m->name, "_bucket", m->labels, le);
+        out_printf(o, "%llu\n", (unsigned long long)acc);
+    }
+    acc += h->bucket[LAT_HIST_BUCKETS - 1];
+    out_series(o, m->name, "_bucket", m->labels, "le=\"+Inf\"");
+    out_printf(o, "%llu\n", (unsigned long long)acc);
+
+    out_series(o, m->name, "_count", m->labels, NULL);
+    out_printf(o, "%llu\n", (unsigned long long)acc);
+    out_series(o, m->name, "_sum", m->labels, NULL);
+    out_value(o, (double)h->sum_us * m->hist_scale);
+    out_printf(o, "\n");
+}
+
+size_t metrics_render_openmetrics(const MetricsSnap *s, char *buf, size_t cap)
+{
+    const size_t eof_len = sizeof(EOF_LINE) - 1;
+    if (!buf || cap <= eof_len) return 0;
+
+    Out o = { .buf = buf, .cap = cap - eof_len, .len = 0, .overflow = 0 };
+    static const char *const type_names[] = { "counter", "gauge", "histogram" };
+
+    size_t family_start = 0;
+    for (int i = 0; s && i < s->n_samples; i++) {
+        const MetricSample *m = &s->samples[i];
+        int new_family = (i == 0) || strcmp(m->name, s->samples[i - 1].name) != 0;
+        if (new_family) {
+            family_start = o.len;
+            out_printf(&o, "# TYPE %s %s\n", m->name, type_names[m->type]);
+            if (m->help) out_printf(&o, "# HELP %s %s\n", m->name, m->help);
+        }
+
+        switch (m->type) {
+        case METRIC_COUNTER:
+            out_series(&o, m->name, "_total", m->labels, NULL);
+            out_value(&o, m->value);
+            out_printf(&o, "\n");
+            break;
+        case METRIC_GAUGE:
+            out_series(&o, m->name, "", m->labels, NULL);
+            out_value(&o, m->value);
+            out_printf(&o, "\n");
+            break;
+        case METRIC_HISTOGRAM:
+            render_histogram(&o, s, m);
+            break;
+        }
+
+        if (o.overflow) {
+            // 缓冲不够：丢掉写了一半的 family，保证输出仍是合法文本
+            o.len = family_start;
+            break;
+        }
+    }
+
+    memcpy(buf + o.len, EOF_LINE, eof_len);
+    return o.len + eof_len;
+}
+
+// ============ HTTP ============
+
+static int parse_listen(const char *addr, struct sockaddr_storage *ss, socklen_t *len,
+                        char *unix_path, size_t unix_cap)
+{
+    memset(ss, 0, sizeof(*ss));
+    unix_path[0] = '\0';
+
+    if (strncmp(addr, "unix:", 5) == 0) {
+        struct sockaddr_un *un = (struct sockaddr_un *)ss;
+        const char *path = addr + 5;
+        if (strlen(path) >= sizeof(un->sun_path) || strlen(path) >= unix_cap) return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        strcpy(unix_path, path);
+        *len = (socklen_t)sizeof(*un);
+        return 0;
+    }
+
+    struct sockaddr_in *in = (struct sockaddr_in *)ss;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_ANY);
+
+    char host[64] = {0};
+    const char *colon = strrchr(addr, ':');
+    const char *port_s = addr;
+    if (colon) {
+        size_t hl = (size_t)(colon - addr);
+        if (hl >= sizeof(host)) return -1;
+        memcpy(host, addr, hl);
+        port_s = colon + 1;
+        if (hl > 0 && inet_pton(AF_INET, host, &in->sin_addr) != 1) return -1;
+    }
+    int port = atoi(port_s);
+    if (port <= 0 || port > 65535) return -1;
+    in->sin_port = htons((uint16_t)port);
+    *len = (socklen_t)sizeof(*in);
+    return 0;
+}
+
+static int send_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void send_status(int fd, const char *status)
+{
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 %s\r\nContent-Type: text/plain\r\n"
+                     "Content-Length: 0\r\nConnection: close\r\n\r\n", status);
+    send_all(fd, hdr, (size_t)n);
+}
+
+static void serve_client(MetricsHttp *m, int fd)
+{
+    // 慢客户端不能卡住导出线程
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char req[REQ_MAX];
+    size_t got = 0;
+    while (got < sizeof(req) - 1) {
+        ssize_t r = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n")) break;
+    }
+    req[got] = '\0';
+
+    int is_get = strncmp(req, "GET ", 4) == 0;
+    int is_head = strncmp(req, "HEAD ", 5) == 0;
+    if (!is_get && !is_head) {
+        send_status(fd, "405 Method Not Allowed");
+        return;
+    }
+    const char *path = req + (is_get ? 4 : 5);
+    if (strncmp(path, "/metrics", 8) != 0 || (path[8] != ' ' && path[8] != '?')) {
+        send_status(fd, "404 Not Found");
+        return;
+    }
+
+    pthread_mutex_lock(&m->mu);
+    int has = m->has_shared;
+    if (has) memcpy(&m->scratch, &m->shared, sizeof(m->scratch));
+    pthread_mutex_unlock(&m->mu);
+    if (!has) metrics_snap_reset(&m->scratch);
+
+    size_t body_len = metrics_render_openmetrics(&m->scratch, m->body, m->body_cap);
+
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     k_content_type, body_len);
+    if (send_all(fd, hdr, (size_t)n) == 0 && is_get) {
+        send_all(fd, m->body, body_len);
+    }
+    m->scrapes++;
+}
+
+static void *http_thread(void *arg)
+{
+    MetricsHttp *m = (MetricsHttp *)arg;
+    pthread_setname_np(pthread_self(), "rkav-metrics");
+
+    for (;;) {
+        struct pollfd pfd[2] = {
+            { .fd = m->listen_fd, .events = POLLIN },
+            { .fd = m->wake_fd,   .events = POLLIN },
+        };
+        int r = poll(pfd, 2, -1);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            LOGE("[%s] poll failed: %s", TAG, strerror(errno));
+            break;
+        }
+        if (pfd[1].revents) break;
+        if (!(pfd[0].revents & POLLIN)) continue;
+
+        int cfd = accept4(m->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (cfd < 0) continue;
+        serve_client(m, cfd);
+        close(cfd);
+    }
+    return NULL;
+}
+
+int metrics_http_start(MetricsHttp *m, const char *addr)
+{
+    if (!m || !addr) return -1;
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+    m->wake_fd = -1;
+
+    struct sockaddr_storage ss;
+    socklen_t slen = 0;
+    if (parse_listen(addr, &ss, &slen, m->unix_path, sizeof(m->unix_path)) != 0) {
+        LOGE("[%s] invalid listen address: %s", TAG, addr);
+        return -1;
+    }
+
+    m->body_cap = BODY_CAP;
+    m->body = (char *)malloc(m->body_cap);
+    if (!m->body) return -1;
+
+    m->listen_fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m->listen_fd < 0) goto fail;
+
+    if (ss.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(m->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    } else {
+        unlink(m->unix_path);
+    }
+
+    if (bind(m->listen_fd, (struct sockaddr *)&ss, slen) != 0 ||
+        listen(m->listen_fd, 8) != 0) {
+        LOGE("[%s] bind/listen %s failed: %s", TAG, addr, strerror(errno));
+        goto fail;
+    }
+
+    m->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (m->wake_fd < 0) goto fail;
+
+    pthread_mutex_init(&m->mu, NULL);
+    if (pthread_create(&m->th, NULL, http_thread, m) != 0) {
+        pthread_mutex_destroy(&m->mu);
+        goto fail;
+    }
+    m->running = 1;
+
+    LOGI("[%s] serving OpenMetrics on %s /metrics", TAG, addr);
+    return 0;
+
+fail:
+    if (m->listen_fd >= 0) close(m->listen_fd);
+    if (m->wake_fd >= 0) close(m->wake_fd);
+    free(m->body);
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+    m->wake_fd = -1;
+    return -1;
+}
+
+void metrics_http_publish(MetricsHttp *m, const MetricsSnap *snap)
+{
+    if (!m || !m->running || !snap) return;
+    pthread_mutex_lock(&m->mu);
+    memcpy(&m->shared, snap, sizeof(m->shared));
+    m->has_shared = 1;
+    pthread_mutex_unlock(&m->mu);
+}
+
+void metrics_http_stop(MetricsHttp *m)
+{
+    if (!m || !m->running) return;
+
+    uint64_t one = 1;
+    ssize_t w = write(m->wake_fd, &one, sizeof(one));
+    (void)w;
+    pthread_join(m->th, NULL);
+
+    close(m->listen_fd);
+    close(m->wake_fd);
+    if (m->unix_path[0]) unlink(m->unix_path);
+    pthread_mutex_destroy(&m->mu);
+    free(m->body);
+
+    LOGI("[%s] stopped after %llu scrapes", TAG, (unsigned long long)m->scrapes);
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+    m->wake_fd = -1;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lat_hist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * OpenMetrics /metrics 导出（最小 HTTP/1.1 responder）。
+ *
+ * 数据流：
+ *   统计线程：metrics_snap_reset() + metrics_snap_*() 填本地快照 -> metrics_http_publish() 拷贝进共享槽
+ *   HTTP 线程：抓取时从共享槽拷贝一份私有快照 -> 渲染到预分配缓冲 -> send
+ * 媒体线程不参与；每次抓取不做堆分配。
+ */
+
+#define METRICS_MAX_SAMPLES 192
+#define METRICS_MAX_HISTS   16
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} MetricType;
+
+typedef struct {
+    char        name[48];     // family 名（counter 不带 _total）
+    char        labels[80];   // 形如 stream="video",stage="enc"；可为空
+    const char *help;         // 静态字符串
+    MetricType  type;
+    double      value;        // counter/gauge
+    int         hist;         // histogram：hists[] 下标
+    double      hist_scale;   // 直方图 us -> 导出单位（秒 = 1e-6）
+} MetricSample;
+
+typedef struct {
+    MetricSample samples[METRICS_MAX_SAMPLES];
+    int          n_samples;
+    LatHistSnap  hists[METRICS_MAX_HISTS];
+    int          n_hists;
+} MetricsSnap;
+
+void metrics_snap_reset(MetricsSnap *s);
+
+/* 同名 family 的样本需连续添加（渲染时按相邻同名合并 HELP/TYPE） */
+void metrics_snap_counter(MetricsSnap *s, const char *name, const char *help,
+                          const char *labels, double value);
+void metrics_snap_gauge(MetricsSnap *s, const char *name, const char *help,
+                        const char *labels, double value);
+/* hist 的单位为 us，导出为秒 */
+void metrics_snap_histogram_us(MetricsSnap *s, const char *name, const char *help,
+                               const char *labels, const LatHistSnap *hist);
+
+typedef struct {
+    int             listen_fd;
+    int             wake_fd;      // eventfd：stop 时唤醒 poll
+    char            unix_path[108];
+    pthread_t       th;
+    int             running;
+
+    pthread_mutex_t mu;
+    MetricsSnap     shared;       // 最近一次 publish
+    int             has_shared;
+
+    MetricsSnap     scratch;      // HTTP 线程私有
+    char           *body;         // 预分配渲染缓冲
+    size_t          body_cap;
+    uint64_t        scrapes;
+} MetricsHttp;
+
+/*
+ * addr: "9100" / "127.0.0.1:9100" / "unix:/run/rkav.sock"
+ */
+int  metrics_http_start(MetricsHttp *m, const char *addr);
+void metrics_http_publish(MetricsHttp *m, const MetricsSnap *snap);
+void metrics_http_stop(MetricsHttp *m);
+
+/* 渲染 OpenMetrics 文本，返回长度（超出 cap 时截断到最后一个完整 family 并补 # EOF） */
+size_t metrics_render_openmetrics(const MetricsSnap *s, char *buf, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
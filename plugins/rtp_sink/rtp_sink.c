@@ -0,0 +1,492 @@
+#include "rtp_sink.h"
+#include "lib/media/mux/h264_nal.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAG "rtp"
+
+#define SR_INTERVAL_US    1000000ULL
+#define PACE_BURST_US     2000ULL      // 桶深：按速率 2 ms 的量
+#define NTP_UNIX_OFFSET   2208988800ULL
+
+/* ---------- 套接字 ---------- */
+
+static int open_udp(const char *host, unsigned port)
+{
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) return -1;
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int sndbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint32_t rand32(void)
+{
+    uint32_t v = 0;
+    if (getrandom(&v, sizeof(v), GRND_NONBLOCK) != (ssize_t)sizeof(v)) {
+        v = (uint32_t)rkav_now_monotonic_us() ^ ((uint32_t)getpid() << 16);
+    }
+    return v;
+}
+
+static int stream_open(RtpStream *st, const char *host, unsigned port, uint32_t clock)
+{
+    st->fd = open_udp(host, port);
+    st->rtcp_fd = open_udp(host, port + 1);
+    if (st->fd < 0 || st->rtcp_fd < 0) return -1;
+    st->ssrc = rand32();
+    st->seq = (uint16_t)rand32();
+    st->ts_base = rand32();
+    st->clock = clock;
+    for (unsigned i = 0; i < RTP_BATCH; i++) {
+        st->iov[i][0].iov_base = st->hdr[i];
+        st->msgs[i].msg_hdr.msg_iov = st->iov[i];
+        st->msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    return 0;
+}
+
+static void stream_close(RtpStream *st)
+{
+    if (st->fd >= 0) close(st->fd);
+    if (st->rtcp_fd >= 0) close(st->rtcp_fd);
+    st->fd = st->rtcp_fd = -1;
+}
+
+static inline uint32_t rtp_ts(const RtpStream *st, uint64_t pts_us)
+{
+    return st->ts_base + (uint32_t)(pts_us * st->clock / 1000000ULL);
+}
+
+/* ---------- 批 + 节拍 ---------- */
+
+static void pace_wait(RtpSink *s, RtpStream *st, size_t bytes)
+{
+    uint64_t now = rkav_now_monotonic_us();
+    st->tokens += (double)(now - st->t_refill_us) * (double)s->pace_Bps / 1e6;
+    if (st->tokens > s->burst_bytes) st->tokens = s->burst_bytes;
+    st->t_refill_us = now;
+    if (st->tokens < (double)bytes) {
+        uint64_t us = (uint64_t)(((double)bytes - st->tokens) * 1e6 / (double)s->pace_Bps);
+        struct timespec ts = { .tv_sec = (time_t)(us / 1000000ULL), .tv_nsec = (long)(us % 1000000ULL) * 1000 };
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        uint64_t after = rkav_now_monotonic_us();
+        st->tokens += (double)(after - st->t_refill_us) * (double)s->pace_Bps / 1e6;
+        st->t_refill_us = after;
+        atomic_fetch_add_explicit(&st->pace_sleeps, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->pace_sleep_us, us, memory_order_relaxed);
+    }
+    st->tokens -= (double)bytes;
+}
+
+static int flush(RtpSink *s, RtpStream *st, int paced)
+{
+    if (!st->n) return 0;
+    if (paced) pace_wait(s, st, st->n_bytes);
+
+    unsigned off = 0;
+    int refused = 0, rc = 0;
+    while (off < st->n) {
+        int r = sendmmsg(st->fd, st->msgs + off, st->n - off, 0);
+        atomic_fetch_add_explicit(&st->calls, 1, memory_order_relaxed);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            // 接收端没起来时 ICMP 不可达会回到下一次发送上；报一次就清掉了，重试一回
+            if (errno == ECONNREFUSED && !refused++) continue;
+            LOGW_RL("[%s] sendmmsg: %s (%u packets dropped)", TAG, strerror(errno), st->n - off);
+            atomic_fetch_add_explicit(&st->errors, st->n - off, memory_order_relaxed);
+            rc = errno == ECONNREFUSED ? 0 : -1;
+            break;
+        }
+        off += (unsigned)r;
+    }
+    atomic_fetch_add_explicit(&st->packets, off, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->bytes, st->n_bytes, memory_order_relaxed);
+    st->n = 0;
+    st->n_bytes = 0;
+    return rc;
+}
+
+/* 批里追加一包：hdr_extra 是 FU 头（0 或 2 字节），payload 不拷贝 */
+static int queue_packet(RtpSink *s, RtpStream *st, uint8_t pt, uint32_t ts,
+                        const uint8_t *extra, size_t extra_len, const void *payload, size_t len, int paced)
+{
+    size_t total = RTP_HDR_SIZE + extra_len + len;
+    if (st->n == RTP_BATCH || (paced && st->n && st->n_bytes + total > s->burst_bytes)) {
+        if (flush(s, st, paced) != 0) return -1;
+    }
+    uint8_t *h = st->hdr[st->n];
+    h[0] = 0x80;                                         // V=2
+    h[1] = pt;
+    h[2] = (uint8_t)(st->seq >> 8);
+    h[3] = (uint8_t)st->seq;
+    h[4] = (uint8_t)(ts >> 24);
+    h[5] = (uint8_t)(ts >> 16);
+    h[6] = (uint8_t)(ts >> 8);
+    h[7] = (uint8_t)ts;
+    h[8] = (uint8_t)(st->ssrc >> 24);
+    h[9] = (uint8_t)(st->ssrc >> 16);
+    h[10] = (uint8_t)(st->ssrc >> 8);
+    h[11] = (uint8_t)st->ssrc;
+    if (extra_len) memcpy(h + RTP_HDR_SIZE, extra, extra_len);
+    st->iov[st->n][0].iov_len = RTP_HDR_SIZE + extra_len;
+    st->iov[st->n][1].iov_base = (void *)payload;
+    st->iov[st->n][1].iov_len = len;
+    st->n++;
+    st->n_bytes += total;
+    st->seq++;
+    st->sr_packets++;
+    st->sr_octets += (uint32_t)(extra_len + len);
+    return 0;
+}
+
+/* ---------- RTCP ---------- */
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* SR + SDES(CNAME) 复合包；NTP 时间 = 这个 pts 对应的墙钟 */
+static void send_sr(RtpSink *s, RtpStream *st, uint64_t pts_us)
+{
+    uint8_t pkt[28 + 8 + 64 + 4];
+    uint64_t wall_us = (uint64_t)((int64_t)pts_us + s->real_minus_mono_us);
+    uint64_t sec = wall_us / 1000000ULL + NTP_UNIX_OFFSET;
+    uint32_t frac = (uint32_t)(((wall_us % 1000000ULL) << 32) / 1000000ULL);
+
+    pkt[0] = 0x80;                                       // V=2 RC=0
+    pkt[1] = 200;                                        // SR
+    pkt[2] = 0;
+    pkt[3] = 6;
+    put32(pkt + 4, st->ssrc);
+    put32(pkt + 8, (uint32_t)sec);
+    put32(pkt + 12, frac);
+    put32(pkt + 16, rtp_ts(st, pts_us));
+    put32(pkt + 20, st->sr_packets);
+    put32(pkt + 24, st->sr_octets);
+
+    size_t cl = strlen(s->cname);
+    size_t sdes = 4 + 4 + 2 + cl + 1;                    // 头 + SSRC + CNAME 项 + 结束符
+    sdes = (sdes + 3) & ~(size_t)3;
+    uint8_t *d = pkt + 28;
+    memset(d, 0, sdes);
+    d[0] = 0x81;                                         // V=2 SC=1
+    d[1] = 202;                                          // SDES
+    d[2] = (uint8_t)((sdes / 4 - 1) >> 8);
+    d[3] = (uint8_t)(sdes / 4 - 1);
+    put32(d + 4, st->ssrc);
+    d[8] = 1;                                            // CNAME
+    d[9] = (uint8_t)cl;
+    memcpy(d + 10, s->cname, cl);
+
+    if (send(st->rtcp_fd, pkt, 28 + sdes, MSG_DONTWAIT) < 0 && errno != ECONNREFUSED) {
+        LOGW_RL("[%s] rtcp send: %s", TAG, strerror(errno));
+    }
+}
+
+static void maybe_sr(RtpSink *s, RtpStream *st, uint64_t pts_us)
+{
+    if (st->last_sr_pts && pts_us < st->last_sr_pts + SR_INTERVAL_US) return;
+    st->last_sr_pts = pts_us ? pts_us : 1;
+    send_sr(s, st, pts_us);
+}
+
+/* ---------- SDP ---------- */
+
+static int write_sdp(const RtpSink *s, const char *path, const char *host, unsigned port,
+                     unsigned ptime_ms)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        LOGE("[%s] open %s failed: %s", TAG, path, strerror(errno));
+        return -1;
+    }
+    fprintf(f,
+            "v=0\n"
+            "o=- %u 1 IN IP4 %s\n"
+            "s=s2-rk-avsync\n"
+            "c=IN IP4 %s\n"
+            "t=0 0\n"
+            "m=video %u RTP/AVP %d\n"
+            "a=rtpmap:%d H264/90000\n"
+            "a=fmtp:%d packetization-mode=1\n"
+            "m=audio %u RTP/AVP %d\n"
+            "a=rtpmap:%d L16/%u/%u\n",
+            s->v.ssrc, host, host, port, RTP_PT_H264, RTP_PT_H264, RTP_PT_H264,
+            port + 2, RTP_PT_L16, RTP_PT_L16, s->sample_rate, s->channels);
+    if (ptime_ms) fprintf(f, "a=ptime:%u\n", ptime_ms);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* ---------- API ---------- */
+
+int rtp_sink_open(RtpSink *s, const char *target, unsigned mtu, unsigned pace_kbps,
+                  unsigned sample_rate, unsigned channels, unsigned audio_ptime_ms,
+                  const char *sdp_path)
+{
+    if (!s || !target) return -1;
+    memset(s, 0, sizeof(*s));
+    s->v.fd = s->v.rtcp_fd = s->a.fd = s->a.rtcp_fd = -1;
+
+    if (strncmp(target, "udp://", 6) != 0) {
+        LOGE("[%s] target must be udp://ip:port (got %s)", TAG, target);
+        return -1;
+    }
+    char host[64];
+    const char *hp = target + 6;
+    const char *colon = strrchr(hp, ':');
+    if (!colon || (size_t)(colon - hp) >= sizeof(host)) {
+        LOGE("[%s] bad target %s", TAG, target);
+        return -1;
+    }
+    memcpy(host, hp, (size_t)(colon - hp));
+    host[colon - hp] = '\0';
+    unsigned port = (unsigned)atoi(colon + 1);
+    if (port == 0 || port + 3 > 65535) {
+        LOGE("[%s] bad port in %s", TAG, target);
+        return -1;
+    }
+
+    if (mtu < 256 || mtu > 65000) mtu = RTP_MTU_DEFAULT;
+    s->mtu = mtu;
+    s->sample_rate = sample_rate;
+    s->channels = channels;
+    if (pace_kbps) {
+        s->pace_Bps = (uint64_t)pace_kbps * 1000 / 8;
+        s->burst_bytes = (double)s->pace_Bps * PACE_BURST_US / 1e6;
+        if (s->burst_bytes < 2.0 * mtu) s->burst_bytes = 2.0 * mtu;
+    }
+
+    if (stream_open(&s->v, host, port, 90000) != 0 || stream_open(&s->a, host, port + 2, sample_rate) != 0) {
+        LOGE("[%s] open %s failed: %s", TAG, target, strerror(errno));
+        rtp_sink_close(s);
+        return -1;
+    }
+    // 一批音频包的负载都得在 sendmmsg 之前活着，按整批留
+    s->pcm_be_cap = (size_t)RTP_BATCH * mtu;
+    s->pcm_be = (uint8_t *)malloc(s->pcm_be_cap);
+    if (!s->pcm_be) {
+        LOGE("[%s] alloc failed", TAG);
+        rtp_sink_close(s);
+        return -1;
+    }
+
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    s->real_minus_mono_us = (int64_t)((uint64_t)rt.tv_sec * 1000000ULL + (uint64_t)rt.tv_nsec / 1000ULL) -
+                            (int64_t)rkav_now_monotonic_us();
+    char hn[40] = "rkav";
+    gethostname(hn, sizeof(hn) - 1);
+    snprintf(s->cname, sizeof(s->cname), "rkav@%s", hn);
+    s->v.t_refill_us = rkav_now_monotonic_us();
+    s->v.tokens = s->burst_bytes;
+    s->t_last_tick_us = rkav_now_monotonic_us();
+
+    if (sdp_path && write_sdp(s, sdp_path, host, port, audio_ptime_ms) != 0) {
+        rtp_sink_close(s);
+        return -1;
+    }
+
+    char pace[32] = "off";
+    if (pace_kbps) snprintf(pace, sizeof(pace), "%ukbps burst=%.0fB", pace_kbps, s->burst_bytes);
+    LOGI("[%s] open %s: video pt=%d port %u, audio L16/%u/%u pt=%d port %u, mtu=%u pace=%s%s%s", TAG,
+         host, RTP_PT_H264, port, sample_rate, channels, RTP_PT_L16, port + 2, mtu, pace,
+         sdp_path ? " sdp=" : "", sdp_path ? sdp_path : "");
+    return 0;
+}
+
+static void grab_params(RtpSink *s, const uint8_t *data, size_t size, int *has_sps)
+{
+    size_t off = 0;
+    const uint8_t *nal;
+    size_t len;
+    while (h264_next_nal(data, size, &off, &nal, &len)) {
+        int t = h264_nal_type(nal);
+        if (t == H264_NAL_SPS && len <= sizeof(s->sps)) {
+            memcpy(s->sps, nal, len);
+            s->sps_len = len;
+            *has_sps = 1;
+        } else if (t == H264_NAL_PPS && len <= sizeof(s->pps)) {
+            memcpy(s->pps, nal, len);
+            s->pps_len = len;
+        } else if (t == H264_NAL_SLICE || t == H264_NAL_IDR) {
+            break;                                       // 参数集只会在片之前
+        }
+    }
+}
+
+static int send_nal(RtpSink *s, uint32_t ts, const uint8_t *nal, size_t len)
+{
+    RtpStream *st = &s->v;
+    const int paced = s->pace_Bps != 0;
+    const size_t max = s->mtu - RTP_HDR_SIZE;
+    if (len <= max) {
+        s->single++;
+        return queue_packet(s, st, RTP_PT_H264, ts, NULL, 0, nal, len, paced);
+    }
+    // FU-A：indicator 取原 NAL 头的 F/NRI，type = 28；FU 头带 S/E 和原 type；负载跳过原 NAL 头
+    uint8_t fu[2] = { (uint8_t)((nal[0] & 0xe0) | 28), 0 };
+    const uint8_t *p = nal + 1;
+    size_t left = len - 1, chunk = max - 2;
+    int first = 1;
+    while (left) {
+        size_t n = left < chunk ? left : chunk;
+        fu[1] = (uint8_t)((first ? 0x80 : 0) | (n == left ? 0x40 : 0) | (nal[0] & 0x1f));
+        if (queue_packet(s, st, RTP_PT_H264, ts, fu, 2, p, n, paced) != 0) return -1;
+        s->fu_a++;
+        p += n;
+        left -= n;
+        first = 0;
+    }
+    return 0;
+}
+
+int rtp_sink_write_video(RtpSink *s, const uint8_t *data, size_t size, uint64_t pts_us, bool keyframe)
+{
+    if (!s || s->v.fd < 0 || !data || !size) return -1;
+
+    int has_sps = 0;
+    grab_params(s, data, size, &has_sps);
+    if (!s->video_started) {
+        if (!keyframe || !s->sps_len || !s->pps_len) {
+            s->dropped_pre_idr++;
+            return 0;
+        }
+        s->video_started = 1;
+    }
+
+    RtpStream *st = &s->v;
+    uint32_t ts = rtp_ts(st, pts_us);
+    maybe_sr(s, st, pts_us);
+    if (keyframe && !has_sps) {
+        if (send_nal(s, ts, s->sps, s->sps_len) != 0 || send_nal(s, ts, s->pps, s->pps_len) != 0) return -1;
+    }
+
+    size_t off = 0;
+    const uint8_t *nal;
+    size_t len;
+    while (h264_next_nal(data, size, &off, &nal, &len)) {
+        if (!len || h264_nal_type(nal) == H264_NAL_AUD) continue;
+        if (send_nal(s, ts, nal, len) != 0) return -1;
+    }
+    // 入队前先判满，AU 的最后一包一定还在批里
+    if (st->n) st->hdr[st->n - 1][1] |= 0x80;
+    st->last_ts = ts;
+    return flush(s, st, s->pace_Bps != 0);
+}
+
+int rtp_sink_write_audio(RtpSink *s, const uint8_t *pcm, size_t bytes, uint32_t frames, uint64_t pts_us)
+{
+    if (!s || s->a.fd < 0 || !pcm || !bytes || !frames) return -1;
+    RtpStream *st = &s->a;
+    const size_t fb = (size_t)s->channels * 2;
+    if ((size_t)frames * fb > bytes) frames = (uint32_t)(bytes / fb);
+    if (!frames) return -1;     // 不到一帧的残块：截完是 0，下面会除零
+
+    // 按 MTU 均分：960 帧双声道 -> 3 包 x 320 帧，而不是 347 + 347 + 266
+    uint32_t max = (uint32_t)((s->mtu - RTP_HDR_SIZE) / fb);
+    uint32_t n_pkts = (frames + max - 1) / max;
+    uint32_t per = (frames + n_pkts - 1) / n_pkts;
+
+    maybe_sr(s, st, pts_us);
+    uint32_t ts = rtp_ts(st, pts_us);
+    size_t used = 0;
+    for (uint32_t done = 0; done < frames;) {
+        uint32_t n = frames - done < per ? frames - done : per;
+        size_t len = (size_t)n * fb;
+        if (st->n == RTP_BATCH || used + len > s->pcm_be_cap) {
+            if (flush(s, st, 0) != 0) return -1;
+            used = 0;
+        }
+        // L16 是网络字节序
+        const uint8_t *src = pcm + (size_t)done * fb;
+        uint8_t *dst = s->pcm_be + used;
+        for (size_t i = 0; i < len; i += 2) {
+            dst[i] = src[i + 1];
+            dst[i + 1] = src[i];
+        }
+        if (queue_packet(s, st, RTP_PT_L16, ts + done, NULL, 0, dst, len, 0) != 0) return -1;
+        used += len;
+        done += n;
+    }
+    st->last_ts = ts + frames;
+    return flush(s, st, 0);
+}
+
+static void tick_stream(const char *name, RtpStream *st, double sec, char *out, size_t cap)
+{
+    uint64_t pk = atomic_load_explicit(&st->packets, memory_order_relaxed);
+    uint64_t ca = atomic_load_explicit(&st->calls, memory_order_relaxed);
+    uint64_t by = atomic_load_explicit(&st->bytes, memory_order_relaxed);
+    uint64_t dp = pk - st->last_packets, dc = ca - st->last_calls;
+    snprintf(out, cap, "%s %.0f pkt/s %.0f calls/s (%.1f pkt/call) %.2fMbps", name,
+             (double)dp / sec, (double)dc / sec, dc ? (double)dp / (double)dc : 0.0,
+             (double)(by - st->last_bytes) * 8.0 / sec / 1e6);
+    st->last_packets = pk;
+    st->last_calls = ca;
+    st->last_bytes = by;
+}
+
+void rtp_sink_tick_print(RtpSink *s)
+{
+    if (!s || s->v.fd < 0) return;
+    uint64_t now = rkav_now_monotonic_us();
+    double sec = (double)(now - s->t_last_tick_us) / 1e6;
+    if (sec <= 0) return;
+    s->t_last_tick_us = now;
+
+    char v[96], a[96];
+    tick_stream("video", &s->v, sec, v, sizeof(v));
+    tick_stream("audio", &s->a, sec, a, sizeof(a));
+    uint64_t err = atomic_load_explicit(&s->v.errors, memory_order_relaxed) +
+                   atomic_load_explicit(&s->a.errors, memory_order_relaxed);
+    LOGI("[RTP] %s | %s | pace_sleeps=%llu send_err=%llu", v, a,
+         (unsigned long long)atomic_load_explicit(&s->v.pace_sleeps, memory_order_relaxed),
+         (unsigned long long)err);
+}
+
+void rtp_sink_close(RtpSink *s)
+{
+    if (!s) return;
+    if (s->v.fd >= 0) {
+        uint64_t vp = atomic_load(&s->v.packets), vc = atomic_load(&s->v.calls);
+        uint64_t ap = atomic_load(&s->a.packets), ac = atomic_load(&s->a.calls);
+        LOGI("[%s] closed: video packets=%llu (single=%llu fu_a=%llu) sendmmsg=%llu (%.1f pkt/call) "
+             "pace_sleeps=%llu (%.1fms) | audio packets=%llu sendmmsg=%llu | send_err=%llu dropped_pre_idr=%llu",
+             TAG, (unsigned long long)vp, (unsigned long long)s->single, (unsigned long long)s->fu_a,
+             (unsigned long long)vc, vc ? (double)vp / (double)vc : 0.0,
+             (unsigned long long)atomic_load(&s->v.pace_sleeps),
+             (double)atomic_load(&s->v.pace_sleep_us) / 1000.0,
+             (unsigned long long)ap, (unsigned long long)ac,
+             (unsigned long long)(atomic_load(&s->v.errors) + atomic_load(&s->a.errors)),
+             (unsigned long long)s->dropped_pre_idr);
+    }
+    stream_close(&s->v);
+    stream_close(&s->a);
+    free(s->pcm_be);
+    s->pcm_be = NULL;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RTP 直出（--out-rtp udp://ip:port）：局域网低延迟预览，不经过文件。
+ *
+ * - 视频：每个 EncodedPacket 按起始码拆成 NAL，<= MTU 的走 single NAL unit，大的切 FU-A（RFC 6184
+ *   packetization-mode=1）；AU 最后一包置 marker；AUD 不发，IDR 缺 SPS/PPS 时补上缓存的那份
+ * - 音频：L16（RFC 3551，大端），发到 port + 2；一块 PCM 按 MTU 均分成几包，时间戳按样本推进
+ * - 时间戳：视频 90 kHz、音频按采样率，都由 pts_us 换算再加随机起点；每秒每路发一个 RTCP SR
+ *   （port + 1 / port + 3），NTP 与 RTP 时间戳取自同一个 pts，接收端据此对齐音画
+ * - 发送：包头拼在批缓冲里，负载用 iovec 直接指向包数据（零拷贝），攒满一批或 AU 结束时一次 sendmmsg
+ * - 节拍（--rtp-pace-kbps）：视频按令牌桶分小批发，桶深约 2 ms 的量，IDR 不再一口气打到网卡上；
+ *   等令牌时睡的是扇出的 fan-rtp 线程，只会让 rtp 扇出队列积压；速率仍要明显高于码率（建议 2~3 倍）
+ *
+ * 视频和音频都只由 fan-rtp 线程按发布顺序写，不加锁；
+ * 计数是原子的，控制线程 tick 时读。
+ */
+
+#define RTP_PT_H264     96
+#define RTP_PT_L16      97
+#define RTP_HDR_SIZE    12
+#define RTP_BATCH       64             // 一次 sendmmsg 最多几包
+#define RTP_MTU_DEFAULT 1400
+
+typedef struct {
+    int             fd;                // RTP（connect 过的 UDP）
+    int             rtcp_fd;           // RTCP SR，port + 1
+    uint32_t        ssrc;
+    uint16_t        seq;
+    uint32_t        clock;             // 90000 / 采样率
+    uint32_t        ts_base;           // 随机起点
+    uint32_t        last_ts;
+    uint64_t        last_sr_pts;
+    uint32_t        sr_packets, sr_octets;   // SR 里报的累计（只算负载）
+
+    struct mmsghdr  msgs[RTP_BATCH];
+    struct iovec    iov[RTP_BATCH][2]; // [0] = RTP 头（+ FU 头），[1] = 负载
+    uint8_t         hdr[RTP_BATCH][RTP_HDR_SIZE + 2];
+    unsigned        n;                 // 批里已有的包
+    size_t          n_bytes;
+
+    // 令牌桶（只有视频用）
+    double          tokens;
+    uint64_t        t_refill_us;
+
+    atomic_ullong   packets, bytes, calls, errors, pace_sleeps, pace_sleep_us;
+    uint64_t        last_packets, last_calls, last_bytes;   // tick 用（控制线程）
+} RtpStream;
+
+typedef struct {
+    RtpStream       v, a;
+    unsigned        mtu;
+    uint64_t        pace_Bps;          // 0 = 不限速
+    double          burst_bytes;
+    int64_t         real_minus_mono_us;   // pts（monotonic）-> 墙钟，SR 里的 NTP 时间用
+    char            cname[64];
+
+    unsigned        sample_rate, channels;
+    uint8_t        *pcm_be;            // 一批音频包的大端负载
+    size_t          pcm_be_cap;
+
+    uint8_t         sps[64];
+    size_t          sps_len;
+    uint8_t         pps[64];
+    size_t          pps_len;
+    int             video_started;     // 第一个带参数集的 IDR 之后才发
+    uint64_t        dropped_pre_idr;
+    uint64_t        fu_a, single;      // 视频包按打包方式计数（sink 线程写，收尾打印）
+
+    uint64_t        t_last_tick_us;
+} RtpSink;
+
+/* target：udp://ip:port（视频 port，音频 port + 2）；pace_kbps = 0 不限速；sdp_path 可为 NULL */
+int  rtp_sink_open(RtpSink *s, const char *target, unsigned mtu, unsigned pace_kbps,
+                   unsigned sample_rate, unsigned channels, unsigned audio_ptime_ms,
+                   const char *sdp_path);
+
+/* Annex-B 一个访问单元；数据在返回前全部发出（负载不拷贝，调用方随后即可释放） */
+int  rtp_sink_write_video(RtpSink *s, const uint8_t *data, size_t size, uint64_t pts_us, bool keyframe);
+
+/* S16LE 交织 PCM */
+int  rtp_sink_write_audio(RtpSink *s, const uint8_t *pcm, size_t bytes, uint32_t frames, uint64_t pts_us);
+
+/* 控制线程：每秒一行 [RTP] 包率 / 系统调用数 / 节拍睡眠 */
+void rtp_sink_tick_print(RtpSink *s);
+
+void rtp_sink_close(RtpSink *s);
+
+#ifdef __cplusplus
+}
+#endif
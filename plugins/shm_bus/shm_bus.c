@@ -0,0 +1,519 @@
+#include "shm_bus.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAG "bus"
+#define SHM_BUS_ALIGN 64
+
+static int futex_wait(_Atomic uint32_t *addr, uint32_t val, const struct timespec *rel)
+{
+    // 共享映射上的 futex，不能带 FUTEX_PRIVATE_FLAG
+    return (int)syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, rel, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr)
+{
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static uint64_t round_pow2(uint64_t v)
+{
+    uint64_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+/* ---------- 生产者 ---------- */
+
+static int listen_open(ShmBus *b, const char *path)
+{
+    struct sockaddr_un sa;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        LOGE("[%s] socket path too long: %s", TAG, path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path, strlen(path));
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 8) != 0) {
+        LOGE("[%s] bind/listen %s failed: %s", TAG, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    snprintf(b->sock_path, sizeof(b->sock_path), "%s", path);
+    b->listen_fd = fd;
+    return 0;
+}
+
+int shm_bus_open(ShmBus *b, const char *sock_path, size_t data_bytes, uint32_t slots,
+                 const ShmBusInfo *info)
+{
+    if (!b || data_bytes == 0 || slots == 0) return -1;
+    memset(b, 0, sizeof(*b));
+    b->memfd = b->ro_fd = b->listen_fd = -1;
+    for (int i = 0; i < SHM_BUS_MAX_CLIENTS; i++) b->clients[i] = -1;
+
+    uint64_t n_slots = round_pow2(slots);
+    uint64_t dsize = round_pow2(data_bytes);
+    uint64_t slot_off = SHM_BUS_HDR_SIZE;
+    uint64_t data_off = (slot_off + n_slots * sizeof(ShmBusSlot) + 4095) & ~(uint64_t)4095;
+    b->map_len = (size_t)(data_off + dsize);
+
+    b->memfd = memfd_create("rkav-bus", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (b->memfd < 0 || ftruncate(b->memfd, (off_t)b->map_len) != 0) {
+        LOGE("[%s] memfd %zu bytes failed: %s", TAG, b->map_len, strerror(errno));
+        goto fail;
+    }
+    // 读者拿到的 fd 改不了大小；只读重开一份，读者 mmap 不出可写映射
+    fcntl(b->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    char proc[64];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", b->memfd);
+    b->ro_fd = open(proc, O_RDONLY | O_CLOEXEC);
+    if (b->ro_fd < 0) {
+        LOGE("[%s] reopen read-only failed: %s", TAG, strerror(errno));
+        goto fail;
+    }
+
+    void *p = mmap(NULL, b->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, b->memfd, 0);
+    if (p == MAP_FAILED) {
+        LOGE("[%s] mmap failed: %s", TAG, strerror(errno));
+        goto fail;
+    }
+    b->map = (uint8_t *)p;
+    // 先碰一遍：页在启动时就分配好，发布路径不缺页
+    memset(b->map, 0, b->map_len);
+
+    b->hdr = (ShmBusHdr *)b->map;
+    b->slots = (ShmBusSlot *)(b->map + slot_off);
+    b->data = b->map + data_off;
+
+    ShmBusHdr *h = b->hdr;
+    h->version = SHM_BUS_VERSION;
+    h->slot_count = (uint32_t)n_slots;
+    h->slot_size = (uint32_t)sizeof(ShmBusSlot);
+    h->producer_pid = (uint32_t)getpid();
+    h->slot_off = slot_off;
+    h->data_off = data_off;
+    h->data_size = dsize;
+    if (info) {
+        h->width = info->width;
+        h->height = info->height;
+        h->fps = info->fps;
+        h->sample_rate = info->sample_rate;
+        h->channels = info->channels;
+    }
+    // magic 最后写：读者看到 magic 时其余字段都已就绪
+    atomic_thread_fence(memory_order_release);
+    memcpy(h->magic, SHM_BUS_MAGIC, sizeof(h->magic));
+
+    pthread_mutex_init(&b->lock, NULL);
+    if (sock_path && listen_open(b, sock_path) != 0) {
+        pthread_mutex_destroy(&b->lock);
+        goto fail;
+    }
+
+    LOGI("[%s] memfd ring: %llu slots, %.1f MiB data%s%s", TAG,
+         (unsigned long long)n_slots, (double)dsize / (1024.0 * 1024.0),
+         sock_path ? ", socket " : "", sock_path ? sock_path : "");
+    return 0;
+
+fail:
+    if (b->map) munmap(b->map, b->map_len);
+    if (b->ro_fd >= 0) close(b->ro_fd);
+    if (b->memfd >= 0) close(b->memfd);
+    b->map = NULL;
+    b->memfd = b->ro_fd = -1;
+    return -1;
+}
+
+int shm_bus_publish(ShmBus *b, unsigned type, const void *data, size_t len, uint64_t pts_us,
+                    unsigned flags, uint32_t frames)
+{
+    if (!b || !b->map || !data || len == 0) return -1;
+    ShmBusHdr *h = b->hdr;
+    uint64_t dsize = h->data_size;
+    if (len > dsize / 4) {
+        pthread_mutex_lock(&b->lock);
+        b->too_big++;
+        pthread_mutex_unlock(&b->lock);
+        LOGW_RL("[%s] message %zu bytes too big for %llu-byte ring, dropped", TAG, len,
+                (unsigned long long)dsize);
+        return -1;
+    }
+
+    pthread_mutex_lock(&b->lock);
+    uint64_t seq = atomic_load_explicit(&h->write_seq, memory_order_relaxed);
+    uint64_t pos = (b->pos + SHM_BUS_ALIGN - 1) & ~(uint64_t)(SHM_BUS_ALIGN - 1);
+    uint64_t off = pos & (dsize - 1);
+    if (off + len > dsize) pos += dsize - off;   // 不跨环尾，整条连续
+    ShmBusSlot *s = &b->slots[seq & (h->slot_count - 1)];
+
+    // seqlock 写端：先作废 slot、公布要覆盖到哪，fence 之后才动数据
+    atomic_store_explicit(&s->seq, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->data_end, pos + len, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(b->data + (pos & (dsize - 1)), data, len);
+    s->data_pos = pos;
+    s->pts_us = pts_us;
+    s->t_pub_us = rkav_now_monotonic_us();
+    s->len = (uint32_t)len;
+    s->type = (uint16_t)type;
+    s->flags = (uint16_t)flags;
+    s->frames = frames;
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+    atomic_store_explicit(&h->write_seq, seq + 1, memory_order_release);
+    atomic_fetch_add(&h->futex_word, 1);
+
+    b->pos = pos + len;
+    b->published++;
+    b->bytes += len;
+    pthread_mutex_unlock(&b->lock);
+
+    if (b->listen_fd < 0 || atomic_load_explicit(&b->readers, memory_order_relaxed) > 0) {
+        futex_wake(&h->futex_word);
+    }
+    return 0;
+}
+
+static int send_fd(int sock, int fd)
+{
+    char byte = 'B';
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } cm;
+    memset(&cm, 0, sizeof(cm));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof(cm.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+void shm_bus_on_accept(void *user, int fd)
+{
+    ShmBus *b = (ShmBus *)user;
+    int c;
+    while ((c = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+        if (b->n_clients == SHM_BUS_MAX_CLIENTS) {
+            LOGW_RL("[%s] too many readers (%d), refusing", TAG, SHM_BUS_MAX_CLIENTS);
+            close(c);
+            continue;
+        }
+        if (send_fd(c, b->ro_fd) != 0) {
+            LOGW_RL("[%s] send fd failed: %s", TAG, strerror(errno));
+            close(c);
+            continue;
+        }
+        for (int i = 0; i < SHM_BUS_MAX_CLIENTS; i++) {
+            if (b->clients[i] < 0) {
+                b->clients[i] = c;
+                break;
+            }
+        }
+        b->n_clients++;
+        b->attached++;
+        atomic_store(&b->readers, b->n_clients);
+        LOGI("[%s] reader attached (%d connected)", TAG, b->n_clients);
+    }
+}
+
+/* 读者不发数据，连接可读只可能是断开（或多余字节，读掉） */
+static void reap_clients(ShmBus *b)
+{
+    for (int i = 0; i < SHM_BUS_MAX_CLIENTS; i++) {
+        if (b->clients[i] < 0) continue;
+        struct pollfd pfd = { .fd = b->clients[i], .events = POLLIN | POLLRDHUP };
+        if (poll(&pfd, 1, 0) <= 0) continue;
+        char buf[64];
+        ssize_t n = 0;
+        if (!(pfd.revents & (POLLHUP | POLLRDHUP | POLLERR))) {
+            n = recv(b->clients[i], buf, sizeof(buf), 0);
+            if (n > 0 || (n < 0 && errno == EAGAIN)) continue;
+        }
+        close(b->clients[i]);
+        b->clients[i] = -1;
+        b->n_clients--;
+        atomic_store(&b->readers, b->n_clients);
+        LOGI("[%s] reader detached (%d connected)", TAG, b->n_clients);
+    }
+}
+
+void shm_bus_tick_print(ShmBus *b)
+{
+    if (!b || !b->map) return;
+    if (b->listen_fd >= 0) reap_clients(b);
+
+    pthread_mutex_lock(&b->lock);
+    uint64_t pub = b->published, bytes = b->bytes, big = b->too_big;
+    pthread_mutex_unlock(&b->lock);
+
+    LOGI("[BUS] readers=%d msgs=%llu (+%llu) bytes=%.1fMiB too_big=%llu", b->n_clients,
+         (unsigned long long)pub, (unsigned long long)(pub - b->last_published),
+         (double)bytes / (1024.0 * 1024.0), (unsigned long long)big);
+    b->last_published = pub;
+}
+
+void shm_bus_close(ShmBus *b)
+{
+    if (!b || !b->map) return;
+    atomic_store(&b->hdr->closed, 1);
+    atomic_fetch_add(&b->hdr->futex_word, 1);
+    futex_wake(&b->hdr->futex_word);
+
+    for (int i = 0; i < SHM_BUS_MAX_CLIENTS; i++) {
+        if (b->clients[i] >= 0) close(b->clients[i]);
+        b->clients[i] = -1;
+    }
+    if (b->listen_fd >= 0) {
+        close(b->listen_fd);
+        unlink(b->sock_path);
+        b->listen_fd = -1;
+    }
+    LOGI("[%s] closed: %llu messages, %.1f MiB, %llu readers attached over the run", TAG,
+         (unsigned long long)b->published, (double)b->bytes / (1024.0 * 1024.0),
+         (unsigned long long)b->attached);
+
+    // 读者手里的映射各自有效，生产者这边关掉不影响他们把剩下的读完
+    munmap(b->map, b->map_len);
+    b->map = NULL;
+    close(b->ro_fd);
+    close(b->memfd);
+    b->memfd = b->ro_fd = -1;
+    pthread_mutex_destroy(&b->lock);
+}
+
+/* ---------- 读者 ---------- */
+
+static int reader_attach(ShmBusReader *r, int fd, int sock)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->sock = sock;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SHM_BUS_HDR_SIZE) {
+        LOGE("[%s] bad bus fd", TAG);
+        goto fail;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        LOGE("[%s] mmap failed: %s", TAG, strerror(errno));
+        goto fail;
+    }
+    r->map = (const uint8_t *)p;
+    r->map_len = (size_t)st.st_size;
+    r->hdr = (const ShmBusHdr *)r->map;
+
+    const ShmBusHdr *h = r->hdr;
+    if (memcmp(h->magic, SHM_BUS_MAGIC, sizeof(h->magic)) != 0 || h->version != SHM_BUS_VERSION ||
+        h->slot_size != sizeof(ShmBusSlot) || h->data_off + h->data_size > r->map_len ||
+        h->slot_off + (uint64_t)h->slot_count * sizeof(ShmBusSlot) > h->data_off) {
+        LOGE("[%s] not a v%d bus (magic/version/layout mismatch)", TAG, SHM_BUS_VERSION);
+        goto fail;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    r->slots = (const ShmBusSlot *)(r->map + h->slot_off);
+    r->data = r->map + h->data_off;
+    r->next = atomic_load_explicit(&((ShmBusHdr *)h)->write_seq, memory_order_acquire);
+    return 0;
+
+fail:
+    if (r->map) munmap((void *)r->map, r->map_len);
+    r->map = NULL;
+    close(fd);
+    r->fd = -1;
+    return -1;
+}
+
+int shm_bus_reader_attach(ShmBusReader *r, int fd)
+{
+    if (!r || fd < 0) return -1;
+    return reader_attach(r, fd, -1);
+}
+
+static int recv_fd(int sock)
+{
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } cm;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof(cm.buf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) return -1;
+    int fd;
+    memcpy(&fd, CMSG_DATA(c), sizeof(int));
+    return fd;
+}
+
+int shm_bus_connect(ShmBusReader *r, const char *sock_path)
+{
+    struct sockaddr_un sa;
+    if (!r || !sock_path || strlen(sock_path) >= sizeof(sa.sun_path)) return -1;
+    memset(r, 0, sizeof(*r));
+    r->fd = r->sock = -1;
+
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, sock_path, strlen(sock_path));
+    if (connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        LOGE("[%s] connect %s failed: %s", TAG, sock_path, strerror(errno));
+        close(s);
+        return -1;
+    }
+    int fd = recv_fd(s);
+    if (fd < 0) {
+        LOGE("[%s] no fd from %s", TAG, sock_path);
+        close(s);
+        return -1;
+    }
+    if (reader_attach(r, fd, s) != 0) {
+        close(s);
+        r->sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int timespec_left(const struct timespec *deadline, struct timespec *left)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ns = (long long)(deadline->tv_sec - now.tv_sec) * 1000000000LL +
+                   (deadline->tv_nsec - now.tv_nsec);
+    if (ns <= 0) return 0;
+    left->tv_sec = (time_t)(ns / 1000000000LL);
+    left->tv_nsec = (long)(ns % 1000000000LL);
+    return 1;
+}
+
+int shm_bus_next(ShmBusReader *r, ShmBusMsg *m, int timeout_ms)
+{
+    if (!r || !r->map || !m) return -1;
+    // 读端只有只读映射；atomic load 不写内存，去掉 const 只是为了满足 stdatomic 的签名
+    ShmBusHdr *h = (ShmBusHdr *)r->hdr;
+    uint64_t mask = h->slot_count - 1;
+    uint64_t skipped = 0;
+
+    struct timespec deadline;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (;;) {
+        uint64_t ws = atomic_load_explicit(&h->write_seq, memory_order_acquire);
+        if (r->next < ws) {
+            // 落后超过一圈：slot 早被覆盖，直接跳到还可能有效的最老一条
+            if (ws - r->next > h->slot_count) {
+                skipped += ws - h->slot_count - r->next;
+                r->next = ws - h->slot_count;
+            }
+            ShmBusSlot *s = (ShmBusSlot *)&r->slots[r->next & mask];
+            uint64_t s1 = atomic_load_explicit(&s->seq, memory_order_acquire);
+            if (s1 == r->next + 1) {
+                m->seq = r->next;
+                m->data_pos = s->data_pos;
+                m->pts_us = s->pts_us;
+                m->t_pub_us = s->t_pub_us;
+                m->len = s->len;
+                m->type = s->type;
+                m->flags = s->flags;
+                m->frames = s->frames;
+                atomic_thread_fence(memory_order_acquire);
+                uint64_t s2 = atomic_load_explicit(&s->seq, memory_order_relaxed);
+                uint64_t end = atomic_load_explicit(&h->data_end, memory_order_relaxed);
+                if (s2 == s1 && end <= m->data_pos + h->data_size && m->len <= h->data_size) {
+                    m->data = r->data + (m->data_pos & (h->data_size - 1));
+                    m->lost = skipped;
+                    r->lost += skipped;
+                    r->next++;
+                    return 1;
+                }
+            }
+            // 读的同时被下一圈覆盖了：这一条算丢
+            skipped++;
+            r->next++;
+            continue;
+        }
+
+        if (atomic_load(&h->closed) || timeout_ms == 0) {
+            r->lost += skipped;
+            return atomic_load(&h->closed) ? -1 : 0;
+        }
+
+        uint32_t w = atomic_load(&h->futex_word);
+        if (atomic_load(&h->write_seq) != ws) continue;
+        if (timeout_ms < 0) {
+            futex_wait(&h->futex_word, w, NULL);
+            continue;
+        }
+        struct timespec left;
+        if (!timespec_left(&deadline, &left)) {
+            r->lost += skipped;
+            return 0;
+        }
+        futex_wait(&h->futex_word, w, &left);
+    }
+}
+
+bool shm_bus_msg_valid(const ShmBusReader *r, const ShmBusMsg *m)
+{
+    if (!r || !r->map || !m) return false;
+    ShmBusHdr *h = (ShmBusHdr *)r->hdr;
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t end = atomic_load_explicit(&h->data_end, memory_order_relaxed);
+    return end <= m->data_pos + h->data_size;
+}
+
+void shm_bus_reader_close(ShmBusReader *r)
+{
+    if (!r) return;
+    if (r->map) munmap((void *)r->map, r->map_len);
+    r->map = NULL;
+    if (r->fd >= 0) close(r->fd);
+    if (r->sock >= 0) close(r->sock);
+    r->fd = r->sock = -1;
+}
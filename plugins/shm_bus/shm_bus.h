@@ -0,0 +1,163 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 本机共享内存包总线（--shm-bus <sock>）：编码后的 h264 包和 PCM 块发布进一块 memfd 环，
+ * 本机其它进程（分析、上传）只读映射后直接跟读，不再回读 output.h264。
+ *
+ * 布局（一个 memfd，封住 grow/shrink）：
+ *   [ShmBusHdr 4 KiB][ShmBusSlot × slot_count][数据环 data_size]
+ * - 每条消息一个序号；slot[seq % slot_count] 记元数据，数据在数据环里连续存放（放不下就跳到环头）
+ * - 生产者只管往前写，从不等读者：读者落后超过一圈就是 overrun，跳到还有效的最老消息并计 lost
+ * - 读者拿到的是指向共享内存的指针（零拷贝）；用完后 shm_bus_msg_valid() 确认期间没被覆盖，
+ *   seqlock 式校验：slot.seq 前后一致 + 数据环写到的位置没越过这条消息
+ * - 唤醒：每次发布 futex_word++ 并 FUTEX_WAKE（有读者连着才调），读者 FUTEX_WAIT 在只读映射上
+ *
+ * 取 fd：连 unix 流 socket，生产者用 SCM_RIGHTS 发一个只读重开的 fd；连接保持到读者退出，
+ * 生产者据此知道有没有读者。读者进程用下面的 shm_bus_connect / shm_bus_next 即可。
+ */
+
+#define SHM_BUS_MAGIC       "RKAVBUS1"
+#define SHM_BUS_VERSION     1
+#define SHM_BUS_HDR_SIZE    4096
+#define SHM_BUS_MAX_CLIENTS 16
+
+enum {
+    SHM_BUS_VIDEO = 1,      // data = Annex-B 访问单元
+    SHM_BUS_AUDIO = 2,      // data = S16LE 交织 PCM，frames = 采样帧数
+};
+
+#define SHM_BUS_FLAG_KEY 1u
+
+typedef struct {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  slot_count;              // 2 的幂
+    uint32_t  slot_size;               // sizeof(ShmBusSlot)
+    uint32_t  producer_pid;
+    uint64_t  slot_off;
+    uint64_t  data_off;
+    uint64_t  data_size;               // 2 的幂
+    uint32_t  width, height, fps;
+    uint32_t  sample_rate, channels;
+
+    _Alignas(64) _Atomic uint64_t write_seq;   // 已发布的消息数（= 下一条的序号）
+    _Atomic uint32_t  futex_word;              // 每次发布 +1，读者在它上面睡
+    _Atomic uint32_t  closed;                  // 生产者已退出
+
+    _Alignas(64) _Atomic uint64_t data_end;    // 数据环已预留到的单调位置（先于写数据更新）
+} ShmBusHdr;
+
+typedef struct {
+    _Atomic uint64_t seq;              // 消息序号 + 1；0 = 正在写
+    uint64_t  data_pos;                // 单调位置，实际偏移 data_off + data_pos % data_size
+    uint64_t  pts_us;
+    uint64_t  t_pub_us;                // 发布时刻（CLOCK_MONOTONIC，同机进程间可直接比）
+    uint32_t  len;
+    uint16_t  type;
+    uint16_t  flags;
+    uint32_t  frames;
+    uint32_t  _pad;
+} ShmBusSlot;
+
+typedef struct {
+    unsigned  width, height, fps;
+    unsigned  sample_rate, channels;
+} ShmBusInfo;
+
+/* ---------- 生产者 ---------- */
+
+typedef struct {
+    int              memfd;
+    int              ro_fd;            // 只读重开的同一个 memfd，发给读者
+    uint8_t         *map;
+    size_t           map_len;
+    ShmBusHdr       *hdr;
+    ShmBusSlot      *slots;
+    uint8_t         *data;
+
+    pthread_mutex_t  lock;             // 视频 / 音频两个 sink 线程都发
+    uint64_t         pos;              // 下一条数据的位置（持锁）
+    uint64_t         published, bytes, too_big;
+    uint64_t         last_published;   // tick 打印用
+
+    int              listen_fd;
+    char             sock_path[108];
+    int              clients[SHM_BUS_MAX_CLIENTS];   // 控制线程独占
+    int              n_clients;
+    atomic_int       readers;          // 连着的读者数，有 socket 时 > 0 才 FUTEX_WAKE
+    uint64_t         attached;
+} ShmBus;
+
+/*
+ * data_bytes / slots 向上取到 2 的幂。sock_path 为 NULL 时不监听（同进程读者用 ro_fd 自己 attach）。
+ */
+int  shm_bus_open(ShmBus *b, const char *sock_path, size_t data_bytes, uint32_t slots,
+                  const ShmBusInfo *info);
+
+/*
+ * 不阻塞；没有 sock_path 时每次发布都 FUTEX_WAKE（读者在本进程里），否则只在有读者连着时唤醒。
+ * len 超过数据环 1/4 的消息丢掉（计 too_big）返回 -1
+ */
+int  shm_bus_publish(ShmBus *b, unsigned type, const void *data, size_t len, uint64_t pts_us,
+                     unsigned flags, uint32_t frames);
+
+/* 监听 fd 交给 ctl_loop_watch_fd，可读时 accept 并发 fd；tick 里回收断开的读者并打印 */
+void shm_bus_on_accept(void *user, int fd);
+void shm_bus_tick_print(ShmBus *b);
+
+/* 标记 closed 并唤醒读者，断开连接、删 socket、解除映射 */
+void shm_bus_close(ShmBus *b);
+
+/* ---------- 读者 ---------- */
+
+typedef struct {
+    int               fd;
+    int               sock;            // 保持连接，生产者靠它数读者
+    const uint8_t    *map;
+    size_t            map_len;
+    const ShmBusHdr  *hdr;
+    const ShmBusSlot *slots;
+    const uint8_t    *data;
+    uint64_t          next;            // 下一条要读的序号
+    uint64_t          lost;            // 累计被覆盖没读到的消息
+} ShmBusReader;
+
+typedef struct {
+    uint64_t       seq;
+    unsigned       type;
+    unsigned       flags;
+    uint32_t       frames;
+    uint64_t       pts_us;
+    uint64_t       t_pub_us;
+    const uint8_t *data;               // 指向共享内存，不拷贝
+    size_t         len;
+    uint64_t       data_pos;
+    uint64_t       lost;               // 这条之前跳过的消息数
+} ShmBusMsg;
+
+int  shm_bus_connect(ShmBusReader *r, const char *sock_path);
+
+/* 直接用一个 memfd（只读即可）attach；接管 fd。从当前最新位置开始跟 */
+int  shm_bus_reader_attach(ShmBusReader *r, int fd);
+
+/* 1 = 拿到一条；0 = 超时（timeout_ms < 0 一直等）；-1 = 生产者已关闭且读完 / 出错 */
+int  shm_bus_next(ShmBusReader *r, ShmBusMsg *m, int timeout_ms);
+
+/* 消息数据用完后调用：false 表示读的过程中被生产者覆盖了，结果要丢弃 */
+bool shm_bus_msg_valid(const ShmBusReader *r, const ShmBusMsg *m);
+
+void shm_bus_reader_close(ShmBusReader *r);
+
+#ifdef __cplusplus
+}
+#endif
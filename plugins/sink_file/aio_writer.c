@@ -0,0 +1,552 @@
+#include "aio_writer.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    define RKAV_HAVE_IO_URING 1
+#  endif
+#endif
+#ifndef RKAV_HAVE_IO_URING
+#  define RKAV_HAVE_IO_URING 0
+#endif
+
+#define TAG "aio"
+
+#define URING_STOP_TAG 0xffffffffull
+
+const char *aio_backend_name(AioBackend b)
+{
+    switch (b) {
+    case AIO_BACKEND_URING:   return "io_uring";
+    case AIO_BACKEND_THREADS: return "threads";
+    case AIO_BACKEND_AUTO:
+    default:                  return "auto";
+    }
+}
+
+void aio_writer_opts_default(AioWriterOpts *o)
+{
+    if (!o) return;
+    o->backend = AIO_BACKEND_AUTO;
+    o->depth = 4;
+    o->buf_bytes = 1u << 20;
+    o->direct = 0;
+}
+
+/* ---------------- 完成通知（后台线程调用） ---------------- */
+
+static void buf_complete(AioWriter *w, int idx, int res)
+{
+    pthread_mutex_lock(&w->lock);
+    w->bufs[idx].res = res;
+    w->bufs[idx].t_done_us = rkav_now_monotonic_us();
+    w->bufs[idx].state = 2;
+    pthread_cond_signal(&w->cond_done);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* ---------------- io_uring（裸 syscall） ---------------- */
+
+#if RKAV_HAVE_IO_URING && defined(__NR_io_uring_setup)
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_unmap(AioWriter *w)
+{
+    if (w->sqes) munmap(w->sqes, w->sqes_map_len);
+    if (w->cq_ptr && w->cq_ptr != w->sq_ptr) munmap(w->cq_ptr, w->cq_map_len);
+    if (w->sq_ptr) munmap(w->sq_ptr, w->sq_map_len);
+    if (w->ring_fd >= 0) close(w->ring_fd);
+    w->sqes = w->cq_ptr = w->sq_ptr = NULL;
+    w->ring_fd = -1;
+}
+
+/* 只有写线程调用（单生产者），SQ 不需要锁 */
+static void uring_queue(AioWriter *w, uint8_t opcode, const void *addr, unsigned len,
+                        uint64_t off, uint64_t tag)
+{
+    unsigned tail = *w->sq_tail;
+    unsigned idx = tail & *w->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *)w->sqes)[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = w->fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = tag;
+    w->sq_array[idx] = idx;
+    __atomic_store_n(w->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_submit(AioWriter *w)
+{
+    for (;;) {
+        int r = uring_enter(w->ring_fd, 1, 0, 0);
+        if (r >= 0) return 0;
+        if (errno != EINTR) return -1;
+    }
+}
+
+static void *uring_reaper(void *arg)
+{
+    AioWriter *w = (AioWriter *)arg;
+    int stop = 0;
+
+    while (!stop) {
+        if (uring_enter(w->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            LOGE("[%s] %s: io_uring_enter failed: %s", TAG, w->name, strerror(errno));
+            break;
+        }
+
+        unsigned head = *w->cq_head;
+        unsigned tail = __atomic_load_n(w->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe =
+                &((const struct io_uring_cqe *)w->cqes)[head & *w->cq_mask];
+            if (cqe->user_data == URING_STOP_TAG) stop = 1;
+            else buf_complete(w, (int)cqe->user_data, cqe->res);
+        }
+        __atomic_store_n(w->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* 建环 + 同步探测 IORING_OP_WRITE（5.6+）是否可用 */
+static int uring_init(AioWriter *w)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    w->ring_fd = (int)syscall(__NR_io_uring_setup, (unsigned)(w->depth + 1), &p);
+    if (w->ring_fd < 0) return -1;
+
+    w->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    w->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (w->cq_map_len > w->sq_map_len) w->sq_map_len = w->cq_map_len;
+        w->cq_map_len = w->sq_map_len;
+    }
+
+    w->sq_ptr = mmap(NULL, w->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     w->ring_fd, IORING_OFF_SQ_RING);
+    if (w->sq_ptr == MAP_FAILED) {
+        w->sq_ptr = NULL;
+        uring_unmap(w);
+        return -1;
+    }
+    if (single) {
+        w->cq_ptr = w->sq_ptr;
+    } else {
+        w->cq_ptr = mmap(NULL, w->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         w->ring_fd, IORING_OFF_CQ_RING);
+        if (w->cq_ptr == MAP_FAILED) {
+            w->cq_ptr = NULL;
+            uring_unmap(w);
+            return -1;
+        }
+    }
+    w->sqes_map_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    w->sqes = mmap(NULL, w->sqes_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   w->ring_fd, IORING_OFF_SQES);
+    if (w->sqes == MAP_FAILED) {
+        w->sqes = NULL;
+        uring_unmap(w);
+        return -1;
+    }
+
+    uint8_t *sq = (uint8_t *)w->sq_ptr;
+    uint8_t *cq = (uint8_t *)w->cq_ptr;
+    w->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    w->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    w->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    w->sq_array = (unsigned *)(sq + p.sq_off.array);
+    w->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    w->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    w->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    w->cqes     = cq + p.cq_off.cqes;
+
+    // 0 字节写：支持 IORING_OP_WRITE 的内核返回 0，老内核返回 -EINVAL
+    uring_queue(w, IORING_OP_WRITE, w->bufs[0].data, 0, 0, 0);
+    if (uring_enter(w->ring_fd, 1, 1, IORING_ENTER_GETEVENTS) < 0) {
+        uring_unmap(w);
+        return -1;
+    }
+    unsigned head = *w->cq_head;
+    int res = ((const struct io_uring_cqe *)w->cqes)[head & *w->cq_mask].res;
+    __atomic_store_n(w->cq_head, head + 1, __ATOMIC_RELEASE);
+    if (res < 0) {
+        uring_unmap(w);
+        errno = -res;
+        return -1;
+    }
+
+    if (pthread_create(&w->reaper, NULL, uring_reaper, w) != 0) {
+        uring_unmap(w);
+        return -1;
+    }
+    return 0;
+}
+
+static void uring_shutdown(AioWriter *w)
+{
+    uring_queue(w, IORING_OP_NOP, NULL, 0, 0, URING_STOP_TAG);
+    uring_submit(w);
+    pthread_join(w->reaper, NULL);
+    uring_unmap(w);
+}
+
+#else
+
+static int  uring_init(AioWriter *w) { (void)w; errno = ENOSYS; return -1; }
+static void uring_shutdown(AioWriter *w) { (void)w; }
+
+#endif
+
+/* ---------------- 线程池 pwrite ---------------- */
+
+static void *pool_worker(void *arg)
+{
+    AioWriter *w = (AioWriter *)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->job_count == 0 && !w->pool_stop) pthread_cond_wait(&w->cond_job, &w->lock);
+        if (w->job_count == 0 && w->pool_stop) break;
+
+        int idx = w->job_q[w->job_head];
+        w->job_head = (w->job_head + 1) % AIO_WRITER_MAX_DEPTH;
+        w->job_count--;
+        pthread_mutex_unlock(&w->lock);
+
+        AioBuf *b = &w->bufs[idx];
+        size_t done = 0;
+        int res = 0;
+        while (done < b->io_len) {
+            ssize_t n = pwrite(w->fd, b->data + done, b->io_len - done, (off_t)(b->off + done));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                res = -errno;
+                break;
+            }
+            done += (size_t)n;
+        }
+        buf_complete(w, idx, res < 0 ? res : (int)done);
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static int pool_init(AioWriter *w)
+{
+    w->pool_n = w->depth - 1;
+    if (w->pool_n < 1) w->pool_n = 1;
+    if (w->pool_n > 4) w->pool_n = 4;
+
+    for (int i = 0; i < w->pool_n; i++) {
+        if (pthread_create(&w->pool[i], NULL, pool_worker, w) != 0) {
+            w->pool_n = i;
+            return i > 0 ? 0 : -1;
+        }
+    }
+    return 0;
+}
+
+static void pool_shutdown(AioWriter *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->pool_stop = 1;
+    pthread_cond_broadcast(&w->cond_job);
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < w->pool_n; i++) pthread_join(w->pool[i], NULL);
+}
+
+/* ---------------- 写线程侧 ---------------- */
+
+/* 持锁：回收已完成的缓冲，记统计；短写在这里同步补完 */
+static void reap_locked(AioWriter *w)
+{
+    for (int i = 0; i < w->depth; i++) {
+        AioBuf *b = &w->bufs[i];
+        if (b->state != 2) continue;
+
+        int res = b->res;
+        if (res >= 0 && (size_t)res < b->io_len) {
+            size_t done = (size_t)res;
+            while (done < b->io_len) {
+                ssize_t n = pwrite(w->fd, b->data + done, b->io_len - done, (off_t)(b->off + done));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    res = n < 0 ? -errno : -EIO;
+                    break;
+                }
+                done += (size_t)n;
+            }
+            if (done == b->io_len) res = (int)done;
+        }
+
+        if (res < 0) {
+            if (!w->error) {
+                w->error = -res;
+                LOGE("[%s] %s: write at %llu failed: %s", TAG, w->name,
+                     (unsigned long long)b->off, strerror(-res));
+            }
+        } else {
+            uint64_t us = b->t_done_us > b->t_submit_us ? b->t_done_us - b->t_submit_us : 0;
+            lat_hist_record(&w->lat, us);
+            lat_hist_record(&w->tput, (uint64_t)b->len * 1000000ULL / 1024 / (us ? us : 1));
+            atomic_fetch_add_explicit(&w->bytes_done, b->len, memory_order_relaxed);
+            atomic_fetch_add_explicit(&w->writes_done, 1, memory_order_relaxed);
+        }
+
+        b->state = 0;
+        b->len = 0;
+        w->inflight--;
+    }
+}
+
+static int submit_buf(AioWriter *w, int idx)
+{
+    AioBuf *b = &w->bufs[idx];
+    b->io_len = b->len;
+    if (w->direct && (b->io_len & (AIO_ALIGN - 1))) {
+        // O_DIRECT 尾块：补零到对齐，关闭时再截断
+        size_t padded = (b->io_len + AIO_ALIGN - 1) & ~(size_t)(AIO_ALIGN - 1);
+        memset(b->data + b->io_len, 0, padded - b->io_len);
+        b->io_len = padded;
+    }
+    b->off = w->file_off;
+    w->file_off += b->io_len;
+
+    pthread_mutex_lock(&w->lock);
+    b->state = 1;
+    b->t_submit_us = rkav_now_monotonic_us();
+    w->inflight++;
+    int cur_max = atomic_load_explicit(&w->inflight_max, memory_order_relaxed);
+    if (w->inflight > cur_max) atomic_store_explicit(&w->inflight_max, w->inflight, memory_order_relaxed);
+
+    if (w->backend == AIO_BACKEND_THREADS) {
+        w->job_q[(w->job_head + w->job_count) % AIO_WRITER_MAX_DEPTH] = idx;
+        w->job_count++;
+        pthread_cond_signal(&w->cond_job);
+        pthread_mutex_unlock(&w->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+#if RKAV_HAVE_IO_URING && defined(__NR_io_uring_setup)
+    uring_queue(w, IORING_OP_WRITE, b->data, (unsigned)b->io_len, b->off, (uint64_t)idx);
+    if (uring_submit(w) != 0) {
+        buf_complete(w, idx, -errno);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/* 找一个空闲缓冲；都在飞就等完成 */
+static int next_free_buf(AioWriter *w)
+{
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        reap_locked(w);
+        for (int i = 0; i < w->depth; i++) {
+            if (w->bufs[i].state == 0) {
+                pthread_mutex_unlock(&w->lock);
+                return i;
+            }
+        }
+        pthread_cond_wait(&w->cond_done, &w->lock);
+    }
+}
+
+int aio_writer_open(AioWriter *w, const char *path, const char *name, const AioWriterOpts *o)
+{
+    if (!w || !path) return -1;
+
+    AioWriterOpts def;
+    if (!o) {
+        aio_writer_opts_default(&def);
+        o = &def;
+    }
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->ring_fd = -1;
+    snprintf(w->name, sizeof(w->name), "%s", name ? name : "aio");
+    w->depth = o->depth < 2 ? 2 : (o->depth > AIO_WRITER_MAX_DEPTH ? AIO_WRITER_MAX_DEPTH : o->depth);
+    w->buf_bytes = (o->buf_bytes + AIO_ALIGN - 1) & ~(size_t)(AIO_ALIGN - 1);
+    if (w->buf_bytes == 0) w->buf_bytes = AIO_ALIGN;
+    w->cur = -1;
+
+    lat_hist_init(&w->lat);
+    lat_hist_init(&w->tput);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond_job, NULL);
+    pthread_cond_init(&w->cond_done, NULL);
+
+    for (int i = 0; i < w->depth; i++) {
+        if (posix_memalign((void **)&w->bufs[i].data, AIO_ALIGN, w->buf_bytes) != 0) {
+            LOGE("[%s] %s: buffer alloc failed", TAG, w->name);
+            goto fail;
+        }
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (o->direct) {
+        w->fd = open(path, flags | O_DIRECT, 0644);
+        if (w->fd >= 0) {
+            w->direct = 1;
+        } else {
+            LOGW("[%s] %s: O_DIRECT unavailable on %s (%s), using page cache",
+                 TAG, w->name, path, strerror(errno));
+        }
+    }
+    if (w->fd < 0) w->fd = open(path, flags, 0644);
+    if (w->fd < 0) {
+        LOGE("[%s] %s: open %s failed: %s", TAG, w->name, path, strerror(errno));
+        goto fail;
+    }
+
+    if (o->backend != AIO_BACKEND_THREADS) {
+        if (uring_init(w) == 0) {
+            w->backend = AIO_BACKEND_URING;
+        } else if (o->backend == AIO_BACKEND_URING) {
+            LOGE("[%s] %s: io_uring unavailable: %s", TAG, w->name, strerror(errno));
+            goto fail;
+        } else {
+            LOGW("[%s] %s: io_uring unavailable (%s), using pwrite threads",
+                 TAG, w->name, strerror(errno));
+        }
+    }
+    if (w->backend != AIO_BACKEND_URING) {
+        if (pool_init(w) != 0) {
+            LOGE("[%s] %s: pwrite pool start failed", TAG, w->name);
+            goto fail;
+        }
+        w->backend = AIO_BACKEND_THREADS;
+    }
+
+    LOGI("[%s] %s: %s backend=%s depth=%d buf=%zuKiB direct=%d",
+         TAG, w->name, path, aio_backend_name(w->backend), w->depth, w->buf_bytes / 1024, w->direct);
+    return 0;
+
+fail:
+    if (w->fd >= 0) close(w->fd);
+    for (int i = 0; i < w->depth; i++) free(w->bufs[i].data);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond_job);
+    pthread_cond_destroy(&w->cond_done);
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->ring_fd = -1;
+    return -1;
+}
+
+int aio_writer_write(AioWriter *w, const void *data, size_t len)
+{
+    if (!w || w->fd < 0) return -1;
+    if (w->error) return -1;
+
+    const uint8_t *p = (const uint8_t *)data;
+    w->logical_size += len;
+
+    while (len > 0) {
+        if (w->cur < 0) w->cur = next_free_buf(w);
+
+        AioBuf *b = &w->bufs[w->cur];
+        size_t n = w->buf_bytes - b->len;
+        if (n > len) n = len;
+        memcpy(b->data + b->len, p, n);
+        b->len += n;
+        p += n;
+        len -= n;
+
+        if (b->len == w->buf_bytes) {
+            int idx = w->cur;
+            w->cur = -1;
+            if (submit_buf(w, idx) != 0) return -1;
+        }
+    }
+    return w->error ? -1 : 0;
+}
+
+int aio_writer_close(AioWriter *w)
+{
+    if (!w || w->fd < 0) return -1;
+
+    if (w->cur >= 0 && w->bufs[w->cur].len > 0) submit_buf(w, w->cur);
+    w->cur = -1;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        reap_locked(w);
+        if (w->inflight == 0) break;
+        pthread_cond_wait(&w->cond_done, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (w->backend == AIO_BACKEND_URING) uring_shutdown(w);
+    else pool_shutdown(w);
+
+    if (w->direct && ftruncate(w->fd, (off_t)w->logical_size) != 0 && !w->error) {
+        w->error = errno;
+    }
+    if (close(w->fd) != 0 && !w->error) w->error = errno;
+    w->fd = -1;
+
+    for (int i = 0; i < w->depth; i++) {
+        free(w->bufs[i].data);
+        w->bufs[i].data = NULL;
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond_job);
+    pthread_cond_destroy(&w->cond_done);
+
+    LOGI("[%s] %s: closed, %llu bytes in %llu writes%s",
+         TAG, w->name, (unsigned long long)w->logical_size,
+         (unsigned long long)atomic_load(&w->writes_done), w->error ? " (with errors)" : "");
+    return w->error ? -1 : 0;
+}
+
+void aio_writer_tick_print(AioWriter *w)
+{
+    if (!w) return;
+
+    LatHistSnap lat, tput;
+    lat_hist_take(&w->lat, &lat);
+    lat_hist_take(&w->tput, &tput);
+    int inflight_max = atomic_exchange(&w->inflight_max, 0);
+
+    if (lat.count == 0) {
+        LOGI("[AIO] %s: writes=0 inflight_max=%d", w->name, inflight_max);
+        return;
+    }
+    LOGI("[AIO] %s: writes=%llu lat_ms p50=%.2f p99=%.2f max=%.2f | MiBps p50=%.1f p5=%.1f | inflight_max=%d",
+         w->name, (unsigned long long)lat.count,
+         lat_hist_percentile_us(&lat, 0.50) / 1000.0,
+         lat_hist_percentile_us(&lat, 0.99) / 1000.0,
+         (double)lat.max_us / 1000.0,
+         lat_hist_percentile_us(&tput, 0.50) / 1024.0,
+         lat_hist_percentile_us(&tput, 0.05) / 1024.0,
+         inflight_max);
+}
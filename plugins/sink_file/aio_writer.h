@@ -0,0 +1,119 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lat_hist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sink 用的异步顺序写：把小包攒进大块对齐缓冲，整块提交，写盘不再直接卡住 sink 线程。
+ *
+ * - 后端：io_uring（裸 syscall，不依赖 liburing）；不可用时（老内核 / seccomp）退到线程池 pwrite
+ * - depth 个缓冲轮转：一个在填，其余在飞；全部在飞时 aio_writer_write 才阻塞等完成
+ * - 完成由后台线程收（io_uring 的 reaper / 线程池 worker），写线程只在下次 write 时回收缓冲
+ * - direct=1 用 O_DIRECT 打开（文件系统不支持时回退普通打开）；最后不满一块的尾巴补零对齐写出，
+ *   关闭时 ftruncate 回真实长度
+ * - 每次完成记录提交->完成延迟（us）与该次吞吐（KiB/s，复用 LatHist 的对数分桶）
+ *
+ * 单生产者：write/close 只能由同一个线程调用。
+ */
+
+typedef enum {
+    AIO_BACKEND_AUTO = 0,
+    AIO_BACKEND_URING,
+    AIO_BACKEND_THREADS,
+} AioBackend;
+
+typedef struct {
+    AioBackend backend;
+    int        depth;          // 缓冲个数（在飞上限 = depth - 1..depth）
+    size_t     buf_bytes;      // 每块大小，向上取整到 4096
+    int        direct;         // O_DIRECT
+} AioWriterOpts;
+
+#define AIO_WRITER_MAX_DEPTH 32
+#define AIO_ALIGN            4096u
+
+typedef struct {
+    uint8_t   *data;
+    size_t     len;            // 有效数据
+    size_t     io_len;         // 实际提交长度（O_DIRECT 尾块补齐后）
+    uint64_t   off;
+    uint64_t   t_submit_us;
+    uint64_t   t_done_us;
+    int        state;          // 0 = 空闲 / 填充中，1 = 在飞，2 = 已完成待回收
+    int        res;            // 完成结果：写出的字节数，< 0 为 -errno
+} AioBuf;
+
+typedef struct {
+    int         fd;
+    char        name[16];
+    AioBackend  backend;       // 实际使用的后端
+    int         direct;
+    int         depth;
+    size_t      buf_bytes;
+
+    AioBuf      bufs[AIO_WRITER_MAX_DEPTH];
+    int         cur;           // 正在填充的缓冲
+    int         inflight;
+    uint64_t    file_off;      // 下一块的文件偏移（已对齐）
+    uint64_t    logical_size;  // 用户写入的总字节
+    int         error;         // 第一个写错误（errno）
+
+    /* io_uring */
+    int         ring_fd;
+    void       *sq_ptr;
+    size_t      sq_map_len;
+    void       *cq_ptr;
+    size_t      cq_map_len;
+    void       *sqes;
+    size_t      sqes_map_len;
+    unsigned   *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned   *cq_head, *cq_tail, *cq_mask;
+    void       *cqes;
+    pthread_t   reaper;        // 阻塞在 io_uring_enter(GETEVENTS) 上收完成
+
+    /* 线程池 */
+    int             job_q[AIO_WRITER_MAX_DEPTH];
+    int             job_head, job_count;
+    int             pool_n;
+    int             pool_stop;
+    pthread_t       pool[4];
+
+    /* 完成通知：后台线程（reaper / pool）置 state=2，写线程回收 */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_job;
+    pthread_cond_t  cond_done;
+
+    /* 统计（写线程回收缓冲时记录，统计线程读） */
+    LatHist               lat;        // 提交 -> 完成（us）
+    LatHist               tput;       // 单次写吞吐（KiB/s）
+    atomic_uint_fast64_t  bytes_done;
+    atomic_uint_fast64_t  writes_done;
+    atomic_int            inflight_max;   // 本周期最大在飞数
+} AioWriter;
+
+void aio_writer_opts_default(AioWriterOpts *o);
+
+int  aio_writer_open(AioWriter *w, const char *path, const char *name, const AioWriterOpts *o);
+
+/* 拷贝进当前缓冲；缓冲满时提交。返回 0 / -1（此前有写失败） */
+int  aio_writer_write(AioWriter *w, const void *data, size_t len);
+
+/* 提交尾块、等待全部完成、截断到真实长度并关闭。返回 0 / -1 */
+int  aio_writer_close(AioWriter *w);
+
+const char *aio_backend_name(AioBackend b);
+
+/* 打印一行 [AIO] 并清零本周期直方图（统计线程调用） */
+void aio_writer_tick_print(AioWriter *w);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,582 @@
+#include "dvr_ring.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define TAG "dvr"
+#define DVR_BATCH 32
+
+/* ---------- 单路环：字节环 + 记录表 ---------- */
+
+static DvrRec *lane_at(const DvrLane *l, uint64_t seq)
+{
+    return &l->rec[seq % l->rec_cap];
+}
+
+static int lane_init(DvrLane *l, size_t bytes, uint32_t recs)
+{
+    memset(l, 0, sizeof(*l));
+    l->buf = (uint8_t *)malloc(bytes);
+    l->rec = (DvrRec *)calloc(recs, sizeof(DvrRec));
+    if (!l->buf || !l->rec) return -1;
+    l->cap = bytes;
+    l->rec_cap = recs;
+    // 先碰一遍：环的内存在启动时就真正占住，运行期不会因为缺页抖动
+    memset(l->buf, 0, bytes);
+    return 0;
+}
+
+static void lane_free(DvrLane *l)
+{
+    free(l->buf);
+    free(l->rec);
+    l->buf = NULL;
+    l->rec = NULL;
+}
+
+/*
+ * 数据区间：head > tail 时是 [tail, head)；head < tail 时是 [tail, 上次绕回点) + [0, head)。
+ * 非空且 head == tail 即满。
+ */
+static int lane_alloc(const DvrLane *l, size_t len, size_t *off)
+{
+    if (len == 0 || len > l->cap || l->end - l->first == l->rec_cap) return -1;
+    if (l->first == l->end) {
+        *off = 0;
+        return 0;
+    }
+    size_t tail = lane_at(l, l->first)->off;
+    if (l->head > tail) {
+        if (l->cap - l->head >= len) {
+            *off = l->head;
+            return 0;
+        }
+        if (len <= tail) {
+            *off = 0;
+            return 0;
+        }
+        return -1;
+    }
+    if (l->head < tail && tail - l->head >= len) {
+        *off = l->head;
+        return 0;
+    }
+    return -1;
+}
+
+static void lane_pop(DvrLane *l)
+{
+    l->bytes -= lane_at(l, l->first)->len;
+    l->first++;
+}
+
+static void lane_publish(DvrLane *l, size_t off, size_t len, uint64_t pts_us, uint32_t key)
+{
+    *lane_at(l, l->end) = (DvrRec){ .pts_us = pts_us, .off = (uint32_t)off, .len = (uint32_t)len, .key = key };
+    l->end++;
+    l->bytes += len;
+    if (l->bytes > l->bytes_max) l->bytes_max = l->bytes;
+}
+
+static uint64_t audio_rec_end(const DvrRing *d, const DvrRec *r)
+{
+    return r->pts_us + (uint64_t)(r->len / d->a_bpf) * 1000000u / d->a_rate;
+}
+
+/* ---------- 淘汰（持锁） ---------- */
+
+/* 从头淘汰一个完整 GOP（到下一个关键帧为止）；保存中不越过读游标。返回淘汰条数 */
+static uint64_t evict_gop_locked(DvrRing *d)
+{
+    DvrLane *l = &d->v;
+    uint64_t limit = d->saving ? d->rd_v : l->end;
+    if (l->first >= limit) return 0;
+    uint64_t k = l->first + 1;
+    while (k < limit && !lane_at(l, k)->key) k++;
+    uint64_t n = k - l->first;
+    while (l->first < k) lane_pop(l);
+    return n;
+}
+
+/* 起点留在 pts <= 最新 - pre 的最后一个关键帧 */
+static void trim_video_locked(DvrRing *d)
+{
+    DvrLane *l = &d->v;
+    uint64_t limit = d->saving ? d->rd_v : l->end;
+    for (;;) {
+        uint64_t k = l->first + 1;
+        while (k < limit && !lane_at(l, k)->key) k++;
+        if (k >= limit || lane_at(l, k)->pts_us + d->pre_us > d->v_last_pts) break;
+        while (l->first < k) lane_pop(l);
+    }
+}
+
+/* 音频跟视频起点走；还没有视频时按 pre 秒留 */
+static void trim_audio_locked(DvrRing *d)
+{
+    DvrLane *l = &d->a;
+    uint64_t limit = d->saving ? d->rd_a : l->end;
+    int have_v = d->v.first < d->v.end;
+    uint64_t v_start = have_v ? lane_at(&d->v, d->v.first)->pts_us : 0;
+    while (l->first < limit) {
+        const DvrRec *r = lane_at(l, l->first);
+        int old = have_v ? audio_rec_end(d, r) <= v_start : r->pts_us + d->pre_us < d->a_last_pts;
+        if (!old) break;
+        lane_pop(l);
+    }
+}
+
+/* ---------- 事件文件 ---------- */
+
+static void split_path(const char *path, char *base, size_t base_cap, char *ext, size_t ext_cap)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (!dot || (slash && dot < slash) || strlen(dot) >= ext_cap) dot = path + strlen(path);
+    size_t n = (size_t)(dot - path);
+    if (n >= base_cap) n = base_cap - 1;
+    memcpy(base, path, n);
+    base[n] = '\0';
+    snprintf(ext, ext_cap, "%s", dot);
+}
+
+static void event_path(const char *base, unsigned event, const char *ext, const char *suffix,
+                       char *out, size_t cap)
+{
+    snprintf(out, cap, "%.255s.dvr%03u%.15s%s", base, event, ext, suffix);
+}
+
+static FILE *open_event_file(const char *base, unsigned event, const char *ext, const char *suffix)
+{
+    char path[300];
+    event_path(base, event, ext, suffix, path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        LOGE("[%s] open %s failed: %s", TAG, path, strerror(errno));
+        return NULL;
+    }
+    setvbuf(fp, NULL, _IOFBF, 256 * 1024);
+    return fp;
+}
+
+/* 提前打开下一个事件的文件：触发时不用再等 open/创建 inode（保存线程调用，不持锁） */
+static void prepare_next(DvrRing *d)
+{
+    d->next_v = open_event_file(d->base, d->event, d->ext_v, "");
+    d->next_a = open_event_file(d->base_a, d->event, d->ext_a, "");
+    d->next_x = d->index_fps ? open_event_file(d->base, d->event, d->ext_v, ".idx") : NULL;
+}
+
+static void discard_next(DvrRing *d)
+{
+    char path[300];
+    if (d->next_v) {
+        fclose(d->next_v);
+        event_path(d->base, d->event, d->ext_v, "", path, sizeof(path));
+        unlink(path);
+    }
+    if (d->next_a) {
+        fclose(d->next_a);
+        event_path(d->base_a, d->event, d->ext_a, "", path, sizeof(path));
+        unlink(path);
+    }
+    if (d->next_x) {
+        fclose(d->next_x);
+        event_path(d->base, d->event, d->ext_v, ".idx", path, sizeof(path));
+        unlink(path);
+    }
+    d->next_v = d->next_a = d->next_x = NULL;
+}
+
+/* ---------- 保存线程 ---------- */
+
+/* 一块音频按 [from, to) 裁：返回要写的 [*skip, *skip + 返回值) */
+static size_t audio_clip(const DvrRing *d, const DvrRec *r, uint64_t from_pts, uint64_t to_pts, size_t *skip)
+{
+    size_t s = 0, e = r->len;
+    if (r->pts_us < from_pts) s = (size_t)((from_pts - r->pts_us) * d->a_rate / 1000000u) * d->a_bpf;
+    if (audio_rec_end(d, r) > to_pts) {
+        size_t keep = to_pts > r->pts_us
+            ? (size_t)((to_pts - r->pts_us) * d->a_rate / 1000000u) * d->a_bpf : 0;
+        if (keep < e) e = keep;
+    }
+    if (s > e) s = e;
+    *skip = s;
+    return e - s;
+}
+
+/* 持锁进入、持锁返回；写盘期间放锁 */
+static void save_event_locked(DvrRing *d)
+{
+    DvrLane *v = &d->v, *a = &d->a;
+
+    uint64_t rd = v->first;
+    while (rd < v->end && !lane_at(v, rd)->key) rd++;
+    if (rd == v->end) {
+        LOGW("[%s] trigger (%s) ignored: no keyframe buffered yet", TAG, d->pending_src);
+        return;
+    }
+    const char *src = d->pending_src;
+    uint64_t t_trig = d->t_trigger_us;
+    uint64_t start_pts = lane_at(v, rd)->pts_us;
+    uint64_t pre_us = d->v_last_pts - start_pts;
+    d->rd_v = rd;
+    d->rd_a = a->first;
+    while (d->rd_a < a->end && audio_rec_end(d, lane_at(a, d->rd_a)) <= start_pts) d->rd_a++;
+    d->stop_pts = d->v_last_pts + d->post_us;
+    d->saving = 1;
+
+    unsigned ev = d->event;
+    FILE *fv = d->next_v, *fa = d->next_a, *fx = d->next_x;
+    d->next_v = d->next_a = d->next_x = NULL;
+    pthread_mutex_unlock(&d->lock);
+
+    if (!fv) fv = open_event_file(d->base, ev, d->ext_v, "");
+    if (!fa) fa = open_event_file(d->base_a, ev, d->ext_a, "");
+    if (!fx && d->index_fps) fx = open_event_file(d->base, ev, d->ext_v, ".idx");
+    PktIndex ix;
+    memset(&ix, 0, sizeof(ix));
+    if (fx) pkt_index_attach(&ix, fx, d->index_fps);
+
+    uint64_t v_off = 0, bytes_a = 0, first_byte_us = 0, n_v = 0;
+    uint64_t end_pts = start_pts;
+    int err = 0;
+    DvrRec vb[DVR_BATCH], ab[DVR_BATCH];
+
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        // 两路都读到停止点之后的包才算结束；停止点可能被新的触发往后推，所以每轮重新判断
+        int nv = 0, na = 0, v_done = 0, a_done = 0;
+        while (nv < DVR_BATCH && d->rd_v + (uint64_t)nv < v->end) {
+            const DvrRec *r = lane_at(v, d->rd_v + (uint64_t)nv);
+            if (r->pts_us >= d->stop_pts) {
+                v_done = 1;
+                break;
+            }
+            vb[nv++] = *r;
+        }
+        while (na < DVR_BATCH && d->rd_a + (uint64_t)na < a->end) {
+            const DvrRec *r = lane_at(a, d->rd_a + (uint64_t)na);
+            if (r->pts_us >= d->stop_pts) {
+                a_done = 1;
+                break;
+            }
+            ab[na++] = *r;
+        }
+        uint64_t stop_pts = d->stop_pts;
+        if (nv == 0 && na == 0) {
+            if ((v_done && a_done) || d->stop) break;       // 结束时环里有多少写多少
+            pthread_cond_wait(&d->cond, &d->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&d->lock);
+
+        // [rd, rd + n) 不会被淘汰，也不会被生产者覆盖：放锁直接从环里写
+        for (int i = 0; i < nv && fv; i++) {
+            if (fwrite(v->buf + vb[i].off, 1, vb[i].len, fv) != vb[i].len) err = 1;
+            if (ix.fp) {
+                pkt_index_add(&ix, v_off, vb[i].len, vb[i].pts_us,
+                              pkt_index_flags(v->buf + vb[i].off, vb[i].len, (int)vb[i].key));
+            }
+            v_off += vb[i].len;
+            end_pts = vb[i].pts_us;
+            n_v++;
+            if (!first_byte_us) {
+                fflush(fv);
+                first_byte_us = rkav_now_monotonic_us() - t_trig;
+                lat_hist_record(&d->first_byte_lat, first_byte_us);
+            }
+        }
+        for (int i = 0; i < na && fa; i++) {
+            size_t skip = 0;
+            size_t n = audio_clip(d, &ab[i], start_pts, stop_pts, &skip);
+            if (n && fwrite(a->buf + ab[i].off + skip, 1, n, fa) != n) err = 1;
+            bytes_a += n;
+        }
+
+        pthread_mutex_lock(&d->lock);
+        d->rd_v += (uint64_t)nv;
+        d->rd_a += (uint64_t)na;
+    }
+    d->saving = 0;
+    d->rd_v = d->rd_a = 0;
+    d->event++;
+    d->events++;
+    pthread_mutex_unlock(&d->lock);
+
+    if (ix.fp && pkt_index_close(&ix) != 0) err = 1;
+    if (fv && fclose(fv) != 0) err = 1;
+    if (fa && fclose(fa) != 0) err = 1;
+    if (!fv || !fa) err = 1;
+
+    char path[300];
+    event_path(d->base, ev, d->ext_v, "", path, sizeof(path));
+    LOGI("[%s] event #%u (%s) -> %s: pre-roll=%.2fs total=%.2fs video=%lluKiB/%llu pkts audio=%lluKiB "
+         "first_byte=%lluus%s",
+         TAG, ev, src, path, (double)pre_us / 1e6, (double)(end_pts - start_pts) / 1e6,
+         (unsigned long long)(v_off >> 10), (unsigned long long)n_v,
+         (unsigned long long)(bytes_a >> 10), (unsigned long long)first_byte_us,
+         err ? " (write errors)" : "");
+
+    pthread_mutex_lock(&d->lock);
+    int stop = d->stop;
+    pthread_mutex_unlock(&d->lock);
+    if (!stop) prepare_next(d);
+    pthread_mutex_lock(&d->lock);
+}
+
+static void *saver_thread(void *arg)
+{
+    DvrRing *d = (DvrRing *)arg;
+    prepare_next(d);
+
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        while (!d->pending && !d->stop) pthread_cond_wait(&d->cond, &d->lock);
+        if (!d->pending) break;
+        d->pending = 0;
+        save_event_locked(d);
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    discard_next(d);
+    return NULL;
+}
+
+/* ---------- API ---------- */
+
+int dvr_ring_open(DvrRing *d, const char *h264_path, const char *pcm_path,
+                  unsigned sample_rate, unsigned channels, unsigned pre_sec, unsigned post_sec,
+                  size_t video_bytes, uint32_t video_recs, size_t audio_bytes, uint32_t audio_recs,
+                  unsigned index_fps)
+{
+    if (!d || !h264_path || !pcm_path || !sample_rate || !channels || !pre_sec ||
+        video_bytes > UINT32_MAX || audio_bytes > UINT32_MAX || !video_recs || !audio_recs) {
+        return -1;
+    }
+    memset(d, 0, sizeof(*d));
+    d->pre_us = (uint64_t)pre_sec * 1000000u;
+    d->post_us = (uint64_t)post_sec * 1000000u;
+    d->a_rate = sample_rate;
+    d->a_bpf = (size_t)channels * 2;
+    d->index_fps = index_fps;
+    lat_hist_init(&d->first_byte_lat);
+    split_path(h264_path, d->base, sizeof(d->base), d->ext_v, sizeof(d->ext_v));
+    split_path(pcm_path, d->base_a, sizeof(d->base_a), d->ext_a, sizeof(d->ext_a));
+
+    if (lane_init(&d->v, video_bytes, video_recs) != 0 ||
+        lane_init(&d->a, audio_bytes, audio_recs) != 0) {
+        LOGE("[%s] ring alloc failed (%zu + %zu bytes)", TAG, video_bytes, audio_bytes);
+        lane_free(&d->v);
+        lane_free(&d->a);
+        return -1;
+    }
+
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    if (pthread_create(&d->saver, NULL, saver_thread, d) != 0) {
+        LOGE("[%s] saver thread create failed", TAG);
+        pthread_mutex_destroy(&d->lock);
+        pthread_cond_destroy(&d->cond);
+        lane_free(&d->v);
+        lane_free(&d->a);
+        return -1;
+    }
+    pthread_setname_np(d->saver, "dvrsave");
+
+    size_t mem = video_bytes + audio_bytes + ((size_t)video_recs + audio_recs) * sizeof(DvrRec);
+    LOGI("[%s] ring: pre=%us post=%us video=%zuKiB/%u recs audio=%zuKiB/%u recs (%.1f MiB total)",
+         TAG, pre_sec, post_sec, video_bytes >> 10, video_recs, audio_bytes >> 10, audio_recs,
+         (double)mem / (1024.0 * 1024.0));
+    return 0;
+}
+
+int dvr_ring_put_video(DvrRing *d, const void *data, size_t len, uint64_t pts_us, bool keyframe)
+{
+    if (!d || !d->v.buf || !data || !len) return -1;
+    DvrLane *l = &d->v;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->v_need_key && !keyframe) {
+        l->dropped++;
+        pthread_mutex_unlock(&d->lock);
+        return 0;
+    }
+    size_t off;
+    while (lane_alloc(l, len, &off) != 0) {
+        uint64_t n = evict_gop_locked(d);
+        if (n == 0) {
+            // 保存线程还没写到这里：丢新包，下个关键帧再开始收，环里的流保持可解码
+            if (l->dropped++ == 0) LOGW("[%s] video ring full while saving, dropping until next keyframe", TAG);
+            d->v_need_key = 1;
+            pthread_mutex_unlock(&d->lock);
+            return 0;
+        }
+        l->evicted_early += n;
+    }
+    d->v_need_key = 0;
+    l->head = off + len;                    // 先占位：只有本线程分配，放锁拷贝不会冲突
+    pthread_mutex_unlock(&d->lock);
+
+    memcpy(l->buf + off, data, len);
+
+    pthread_mutex_lock(&d->lock);
+    lane_publish(l, off, len, pts_us, keyframe ? 1u : 0u);
+    d->v_last_pts = pts_us;
+    if (keyframe) trim_video_locked(d);
+    if (d->saving) pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+int dvr_ring_put_audio(DvrRing *d, const void *data, size_t len, uint64_t pts_us)
+{
+    if (!d || !d->a.buf || !data || !len) return -1;
+    DvrLane *l = &d->a;
+
+    pthread_mutex_lock(&d->lock);
+    size_t off;
+    while (lane_alloc(l, len, &off) != 0) {
+        uint64_t limit = d->saving ? d->rd_a : l->end;
+        if (l->first >= limit) {
+            if (l->dropped++ == 0) LOGW("[%s] audio ring full while saving, dropping", TAG);
+            pthread_mutex_unlock(&d->lock);
+            return 0;
+        }
+        lane_pop(l);
+        l->evicted_early++;
+    }
+    l->head = off + len;
+    pthread_mutex_unlock(&d->lock);
+
+    memcpy(l->buf + off, data, len);
+
+    pthread_mutex_lock(&d->lock);
+    lane_publish(l, off, len, pts_us, 0);
+    d->a_last_pts = pts_us;
+    trim_audio_locked(d);
+    if (d->saving) pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+void dvr_ring_trigger(DvrRing *d, const char *src)
+{
+    if (!d || !d->v.buf) return;
+    uint64_t now = rkav_now_monotonic_us();
+
+    pthread_mutex_lock(&d->lock);
+    d->triggers++;
+    if (d->saving) {
+        uint64_t stop = d->v_last_pts + d->post_us;
+        if (stop > d->stop_pts) {
+            d->stop_pts = stop;
+            LOGD("[%s] trigger (%s) while saving event #%u: extended by %.1fs",
+                 TAG, src, d->event, (double)d->post_us / 1e6);
+        }
+    } else if (!d->pending) {
+        d->pending = 1;
+        d->pending_src = src;
+        d->t_trigger_us = now;
+        pthread_cond_signal(&d->cond);
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+void dvr_ring_tick_print(DvrRing *d)
+{
+    if (!d || !d->v.buf) return;
+
+    pthread_mutex_lock(&d->lock);
+    double v_sec = d->v.first < d->v.end
+        ? (double)(d->v_last_pts - lane_at(&d->v, d->v.first)->pts_us) / 1e6 : 0.0;
+    double a_sec = d->a.first < d->a.end
+        ? (double)(d->a_last_pts - lane_at(&d->a, d->a.first)->pts_us) / 1e6 : 0.0;
+    size_t vb = d->v.bytes, ab = d->a.bytes;
+    uint64_t vd = d->v.dropped, ad = d->a.dropped, ve = d->v.evicted_early;
+    int saving = d->saving;
+    pthread_mutex_unlock(&d->lock);
+
+    LOGI("[DVR] ring video=%.1fs %zu/%zuKiB audio=%.1fs %zu/%zuKiB | evicted_early=%llu dropped v=%llu a=%llu | %s",
+         v_sec, vb >> 10, d->v.cap >> 10, a_sec, ab >> 10, d->a.cap >> 10,
+         (unsigned long long)ve, (unsigned long long)vd, (unsigned long long)ad,
+         saving ? "saving" : "armed");
+}
+
+int dvr_ring_close(DvrRing *d)
+{
+    if (!d || !d->v.buf) return -1;
+
+    pthread_mutex_lock(&d->lock);
+    d->stop = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+    pthread_join(d->saver, NULL);
+
+    LatHistSnap snap;
+    lat_hist_take(&d->first_byte_lat, &snap);
+    LOGI("[%s] closed: events=%llu triggers=%llu first_byte_us p50=%.0f max=%llu | "
+         "peak video=%zuKiB audio=%zuKiB evicted_early v=%llu a=%llu dropped v=%llu a=%llu",
+         TAG, (unsigned long long)d->events, (unsigned long long)d->triggers,
+         snap.count ? lat_hist_percentile_us(&snap, 0.50) : 0.0, (unsigned long long)snap.max_us,
+         d->v.bytes_max >> 10, d->a.bytes_max >> 10,
+         (unsigned long long)d->v.evicted_early, (unsigned long long)d->a.evicted_early,
+         (unsigned long long)d->v.dropped, (unsigned long long)d->a.dropped);
+
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->cond);
+    lane_free(&d->v);
+    lane_free(&d->a);
+    return 0;
+}
+
+/* ---------- 控制 socket ---------- */
+
+int dvr_ctl_open(const char *path)
+{
+    struct sockaddr_un sa;
+    if (!path || strlen(path) >= sizeof(sa.sun_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path, strlen(path));
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        LOGE("[%s] bind %s failed: %s", TAG, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    LOGI("[%s] control socket: %s (send \"trigger\")", TAG, path);
+    return fd;
+}
+
+void dvr_ctl_on_readable(void *user, int fd)
+{
+    DvrRing *d = (DvrRing *)user;
+    char buf[64];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r' || buf[n - 1] == ' ')) n--;
+        buf[n] = '\0';
+        if (strcmp(buf, "trigger") == 0) {
+            dvr_ring_trigger(d, "ctl");
+        } else {
+            LOGW_RL("[%s] control socket: unknown command '%s'", TAG, buf);
+        }
+    }
+}
+
+void dvr_ctl_close(int fd, const char *path)
+{
+    if (fd < 0) return;
+    close(fd);
+    if (path) unlink(path);
+}
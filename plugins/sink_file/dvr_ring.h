@@ -0,0 +1,112 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lat_hist.h"
+#include "pkt_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DVR 预录环（--dvr）：平时编码后的 h264 和 PCM 只进内存环，不碰磁盘；
+ * 触发时把环里的预录段 + 之后 post 秒写成一个事件文件 <base>.dvrNNN.h264 / .pcm（+ .idx）。
+ *
+ * - 内存：两路各一块启动时分配好的字节环 + 定长记录表，运行期不 malloc；放不下时淘汰最老的 GOP，
+ *   还放不下（保存追不上）就丢新包并等下一个关键帧，内存永远不超过启动时的上限
+ * - 视频按 GOP 淘汰：起点始终是一个关键帧，且是 pts <= 最新 - pre 的最后一个关键帧（不少于 pre 秒）
+ * - 音频跟着视频起点淘汰；保存时第一块按采样裁到关键帧 pts，结尾按采样裁到停止点
+ * - 保存由后台线程 "dvrsave" 做：直接从环里 fwrite，已写出的记录才允许被淘汰；
+ *   下一个事件的文件提前打开好，触发 -> 首字节落到内核的耗时记进直方图
+ * - 保存期间再触发：把停止点往后延 post 秒
+ *
+ * put_video / put_audio 各自只能由一个线程调用；trigger 任意线程可调。
+ */
+
+typedef struct {
+    uint64_t pts_us;
+    uint32_t off;
+    uint32_t len;
+    uint32_t key;
+} DvrRec;
+
+typedef struct {
+    uint8_t  *buf;
+    size_t    cap;
+    size_t    head;                    // 下一次写入位置
+    DvrRec   *rec;
+    uint32_t  rec_cap;
+    uint64_t  first, end;              // 环里的记录序号 [first, end)，rec[seq % rec_cap]
+    size_t    bytes;                   // 环里的有效字节
+    size_t    bytes_max;
+    uint64_t  evicted_early;           // 容量不够被迫提前淘汰的记录
+    uint64_t  dropped;                 // 放不下直接丢掉的包
+} DvrLane;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       saver;
+    int             stop;
+
+    DvrLane         v, a;
+    uint64_t        pre_us, post_us;
+    unsigned        a_rate;
+    size_t          a_bpf;
+    int             v_need_key;        // 丢过包：下一个关键帧之前的视频都不收
+    uint64_t        v_last_pts, a_last_pts;
+
+    /* 触发 / 保存（持锁） */
+    int             pending;
+    const char     *pending_src;
+    uint64_t        t_trigger_us;
+    int             saving;
+    uint64_t        stop_pts;
+    uint64_t        rd_v, rd_a;        // 保存中：还没写出去的第一条记录
+    uint64_t        triggers;
+
+    /* 事件文件 */
+    char            base[256], base_a[256], ext_v[16], ext_a[16];
+    unsigned        index_fps;
+    unsigned        event;             // 下一个事件号
+    FILE           *next_v, *next_a, *next_x;   // 提前打开的下一个事件（保存线程独占）
+
+    LatHist         first_byte_lat;    // 触发 -> 首字节写出（us）
+    uint64_t        events;
+} DvrRing;
+
+/*
+ * h264_path / pcm_path：事件文件按它们命名（output.h264 -> output.dvr000.h264）。
+ * *_bytes / *_recs：两路环的容量，决定内存上限。index_fps > 0 时事件视频带 .idx。
+ */
+int  dvr_ring_open(DvrRing *d, const char *h264_path, const char *pcm_path,
+                   unsigned sample_rate, unsigned channels, unsigned pre_sec, unsigned post_sec,
+                   size_t video_bytes, uint32_t video_recs, size_t audio_bytes, uint32_t audio_recs,
+                   unsigned index_fps);
+
+int  dvr_ring_put_video(DvrRing *d, const void *data, size_t len, uint64_t pts_us, bool keyframe);
+
+int  dvr_ring_put_audio(DvrRing *d, const void *data, size_t len, uint64_t pts_us);
+
+/* src 只用于日志（"signal" / "ctl" / "avsync"），需是静态字符串 */
+void dvr_ring_trigger(DvrRing *d, const char *src);
+
+/* 每秒打印环的占用（控制循环 tick） */
+void dvr_ring_tick_print(DvrRing *d);
+
+/* 正在保存的事件写完（环里有多少写多少）再关 */
+int  dvr_ring_close(DvrRing *d);
+
+/* 控制 socket：unix 数据报，收到 "trigger" 就触发。返回 fd（-1 失败），交给 ctl_loop_watch_fd */
+int  dvr_ctl_open(const char *path);
+void dvr_ctl_on_readable(void *user, int fd);   // user = DvrRing*
+void dvr_ctl_close(int fd, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,172 @@
+#include "pkt_index.h"
+#include "lib/media/mux/h264_nal.h"
+#include "lib/utils/log.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAG "idx"
+
+_Static_assert(sizeof(PktIndexRec) == 24, "PktIndexRec must stay 24 bytes");
+
+static int write_batch(PktIndex *ix)
+{
+    if (ix->n == 0) return 0;
+    size_t n = (size_t)ix->n;
+    ix->n = 0;
+    if (fwrite(ix->batch, sizeof(PktIndexRec), n, ix->fp) != n || fflush(ix->fp) != 0) {
+        if (!ix->error) LOGW("[%s] write failed", TAG);
+        ix->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+int pkt_index_attach(PktIndex *ix, FILE *fp, unsigned fps)
+{
+    if (!ix || !fp) return -1;
+    memset(ix, 0, sizeof(*ix));
+    ix->fp = fp;
+
+    uint8_t hdr[PKT_INDEX_HDR_SIZE];
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, PKT_INDEX_MAGIC, 8);
+    uint32_t fields[3] = { PKT_INDEX_VERSION, (uint32_t)sizeof(PktIndexRec), fps };
+    memcpy(hdr + 8, fields, sizeof(fields));
+    if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+        ix->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+FILE *pkt_index_detach(PktIndex *ix)
+{
+    if (!ix || !ix->fp) return NULL;
+    if (ix->n) {
+        // 分段切换时走这里：只拷进 stdio 缓冲，fflush/fclose 交给调用方（后台线程）
+        fwrite(ix->batch, sizeof(PktIndexRec), (size_t)ix->n, ix->fp);
+        ix->n = 0;
+    }
+    FILE *fp = ix->fp;
+    ix->fp = NULL;
+    return fp;
+}
+
+int pkt_index_open(PktIndex *ix, const char *path, unsigned fps)
+{
+    if (!ix || !path) return -1;
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        LOGE("[%s] open %s failed", TAG, path);
+        return -1;
+    }
+    if (pkt_index_attach(ix, fp, fps) != 0) {
+        fclose(fp);
+        ix->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int pkt_index_add(PktIndex *ix, uint64_t offset, uint32_t size, uint64_t pts_us, uint32_t flags)
+{
+    if (!ix || !ix->fp) return -1;
+    ix->batch[ix->n++] = (PktIndexRec){ .offset = offset, .pts_us = pts_us, .size = size, .flags = flags };
+    ix->records++;
+    return ix->n == PKT_INDEX_BATCH ? write_batch(ix) : 0;
+}
+
+int pkt_index_close(PktIndex *ix)
+{
+    if (!ix || !ix->fp) return -1;
+    int ret = write_batch(ix);
+    if (fclose(ix->fp) != 0) ret = -1;
+    ix->fp = NULL;
+    return ix->error ? -1 : ret;
+}
+
+uint32_t pkt_index_flags(const uint8_t *au, size_t size, int keyframe)
+{
+    if (!keyframe) return 0;
+    // 只看 NAL 头，不去找片的结尾：关键帧大，整帧扫一遍不划算
+    size_t off = 0, sc = 0;
+    for (;;) {
+        size_t s = h264_find_start(au, size, off, &sc);
+        if (s + sc >= size) break;
+        int t = h264_nal_type(au + s + sc);
+        if (t == H264_NAL_SPS) return PKT_IDX_KEY | PKT_IDX_PARAMS;
+        if (t == H264_NAL_SLICE || t == H264_NAL_IDR) break;
+        off = s + sc;
+    }
+    return PKT_IDX_KEY;
+}
+
+/* ---------- 读端 ---------- */
+
+int pkt_index_load(const char *path, uint64_t data_size, PktIndexView *v)
+{
+    if (!path || !v) return -1;
+    memset(v, 0, sizeof(*v));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("[%s] open %s failed", TAG, path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < PKT_INDEX_HDR_SIZE) {
+        LOGE("[%s] %s: too short", TAG, path);
+        close(fd);
+        return -1;
+    }
+    v->map_len = (size_t)st.st_size;
+    v->map = mmap(NULL, v->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (v->map == MAP_FAILED) {
+        v->map = NULL;
+        LOGE("[%s] mmap %s failed", TAG, path);
+        return -1;
+    }
+
+    const uint8_t *h = (const uint8_t *)v->map;
+    uint32_t fields[3];
+    memcpy(fields, h + 8, sizeof(fields));
+    if (memcmp(h, PKT_INDEX_MAGIC, 8) != 0 || fields[0] != PKT_INDEX_VERSION ||
+        fields[1] != sizeof(PktIndexRec)) {
+        LOGE("[%s] %s: bad header", TAG, path);
+        pkt_index_unload(v);
+        return -1;
+    }
+    v->fps = fields[2];
+    v->rec = (const PktIndexRec *)(h + PKT_INDEX_HDR_SIZE);
+    v->n = (v->map_len - PKT_INDEX_HDR_SIZE) / sizeof(PktIndexRec);   // 半条记录不算
+
+    // 索引比数据先落盘（或数据被截断）时，越界的尾部记录不可信
+    while (data_size && v->n > 0 &&
+           v->rec[v->n - 1].offset + v->rec[v->n - 1].size > data_size) {
+        v->n--;
+    }
+    return 0;
+}
+
+void pkt_index_unload(PktIndexView *v)
+{
+    if (!v) return;
+    if (v->map) munmap(v->map, v->map_len);
+    memset(v, 0, sizeof(*v));
+}
+
+size_t pkt_index_lower_bound(const PktIndexView *v, uint64_t pts_us)
+{
+    size_t lo = 0, hi = v->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (v->rec[mid].pts_us < pts_us) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
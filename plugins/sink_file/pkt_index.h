@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 裸 .h264 的包索引（<file>.idx）：定长记录，按时间二分就能定位，不用扫码流。
+ *
+ *   文件头 32 B：magic "RKAVIDX1" | version u32 | record_size u32 | fps u32 | reserved
+ *   记录   24 B：offset u64 | pts_us u64 | size u32 | flags u32     （小端）
+ *
+ * - offset/size 指向同名 .h264 里的一个访问单元（Annex-B）
+ * - flags：PKT_IDX_KEY = 关键帧；PKT_IDX_PARAMS = 这个包里带 SPS/PPS
+ * - 写端攒 PKT_INDEX_BATCH 条整批 fwrite + fflush；崩溃时读端丢掉半条记录和越过数据文件末尾的记录
+ */
+
+#define PKT_INDEX_MAGIC      "RKAVIDX1"
+#define PKT_INDEX_VERSION    1u
+#define PKT_INDEX_HDR_SIZE   32u
+#define PKT_INDEX_BATCH      64
+
+#define PKT_IDX_KEY          0x1u
+#define PKT_IDX_PARAMS       0x2u
+
+typedef struct {
+    uint64_t offset;
+    uint64_t pts_us;
+    uint32_t size;
+    uint32_t flags;
+} PktIndexRec;                          // 24 B
+
+typedef struct {
+    FILE        *fp;
+    PktIndexRec  batch[PKT_INDEX_BATCH];
+    int          n;
+    uint64_t     records;
+    int          error;
+} PktIndex;
+
+/* 接管一个已打开的 FILE* 并写文件头（分段时由后台线程预先打开） */
+int   pkt_index_attach(PktIndex *ix, FILE *fp, unsigned fps);
+
+/* 把没写出去的记录交给 FILE*（只 fwrite 不 fclose），返回 FILE* 供调用方关闭 */
+FILE *pkt_index_detach(PktIndex *ix);
+
+int   pkt_index_open(PktIndex *ix, const char *path, unsigned fps);
+int   pkt_index_add(PktIndex *ix, uint64_t offset, uint32_t size, uint64_t pts_us, uint32_t flags);
+int   pkt_index_close(PktIndex *ix);
+
+/* 记录的 flags：关键帧再看第一个片之前有没有 SPS（非关键帧不扫） */
+uint32_t pkt_index_flags(const uint8_t *au, size_t size, int keyframe);
+
+/* ---- 读端（tools/h264_trim） ---- */
+
+typedef struct {
+    void              *map;
+    size_t             map_len;
+    const PktIndexRec *rec;
+    size_t             n;
+    unsigned           fps;
+} PktIndexView;
+
+/* mmap 索引；data_size > 0 时丢掉越过数据文件末尾的记录 */
+int    pkt_index_load(const char *path, uint64_t data_size, PktIndexView *v);
+void   pkt_index_unload(PktIndexView *v);
+
+/* 第一个 pts >= t 的记录下标（没有则 n） */
+size_t pkt_index_lower_bound(const PktIndexView *v, uint64_t pts_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,479 @@
+#include "segment_writer.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAG "seg"
+
+static const char *const k_stream_names[SEG_STREAMS] = { "video", "audio", "index" };
+
+/* "out.h264" -> base="out" ext=".h264" */
+static void split_path(SegStream *st, const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (!dot || (slash && dot < slash) || strlen(dot) >= sizeof(st->ext)) dot = path + strlen(path);
+
+    size_t n = (size_t)(dot - path);
+    if (n >= sizeof(st->base)) n = sizeof(st->base) - 1;
+    memcpy(st->base, path, n);
+    st->base[n] = '\0';
+    snprintf(st->ext, sizeof(st->ext), "%s", dot);
+}
+
+static void seg_path(const SegStream *st, unsigned index, char *out, size_t cap)
+{
+    snprintf(out, cap, "%.255s.%03u%.15s", st->base, index, st->ext);
+}
+
+/* 打开并预分配：KEEP_SIZE 只占块不改文件长度，写到哪长度就到哪 */
+static FILE *open_segment(SegWriter *s, SegStream *st, unsigned index)
+{
+    char path[300];
+    seg_path(st, index, path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        LOGE("[%s] open %s failed: %s", TAG, path, strerror(errno));
+        return NULL;
+    }
+    if (st->prealloc && !s->prealloc_unsupported &&
+        fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, (off_t)st->prealloc) != 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+            s->prealloc_unsupported = 1;
+            LOGW("[%s] fallocate unsupported on this filesystem, segments not preallocated", TAG);
+        } else {
+            LOGW("[%s] fallocate %s failed: %s", TAG, path, strerror(errno));
+        }
+    }
+    return fp;
+}
+
+/* 收尾：截到真实长度（释放 EOF 之后预分配的块）再关 */
+static void finish_segment(FILE *fp)
+{
+    if (!fp) return;
+    fflush(fp);
+    long end = ftell(fp);
+    if (end >= 0 && ftruncate(fileno(fp), (off_t)end) != 0) {
+        LOGW("[%s] ftruncate failed: %s", TAG, strerror(errno));
+    }
+    fclose(fp);
+}
+
+/* ---------- 后台线程：开下一段 / 关旧段 ---------- */
+
+static void *helper_thread(void *arg)
+{
+    SegWriter *s = (SegWriter *)arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        int did = 0;
+        for (int k = 0; k < SEG_STREAMS; k++) {
+            SegStream *st = &s->st[k];
+            if (!st->cur) continue;
+
+            if (st->n_closing > 0) {
+                FILE *old = st->closing[--st->n_closing];
+                pthread_mutex_unlock(&s->lock);
+                finish_segment(old);
+                pthread_mutex_lock(&s->lock);
+                did = 1;
+            }
+            if (!st->next && !s->stop) {
+                unsigned index = st->index + 1;
+                pthread_mutex_unlock(&s->lock);
+                FILE *fp = open_segment(s, st, index);
+                pthread_mutex_lock(&s->lock);
+                st->next = fp;                 // 失败时为 NULL：切段时退回写当前段
+                if (!fp) st->prealloc = 0;
+                pthread_cond_broadcast(&s->cond_ready);
+                did = 1;
+                if (!fp) {
+                    // 打不开就别反复重试刷日志，等下次切段再试
+                    pthread_cond_wait(&s->cond_work, &s->lock);
+                }
+            }
+        }
+        if (did) continue;
+        if (s->stop) break;
+        pthread_cond_wait(&s->cond_work, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* ---------- 切段（持锁调用） ---------- */
+
+/* 后台通常早就把下一段开好了；切得太密时才会等。0 = 就绪 */
+static int wait_next_locked(SegWriter *s, int k)
+{
+    SegStream *st = &s->st[k];
+    if (st->next) return 0;
+
+    s->waits++;
+    pthread_cond_signal(&s->cond_work);
+    while (!st->next && !s->stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        if (pthread_cond_timedwait(&s->cond_ready, &s->lock, &ts) == ETIMEDOUT) break;
+    }
+    if (!st->next) {
+        LOGW("[%s] %s: next segment not ready, staying on #%u", TAG, k_stream_names[k], st->index);
+        return -1;
+    }
+    return 0;
+}
+
+static void swap_locked(SegWriter *s, int k)
+{
+    SegStream *st = &s->st[k];
+    FILE *old = st->cur;
+    st->cur = st->next;
+    st->next = NULL;
+    st->index++;
+    st->cur_bytes = 0;
+
+    if (st->n_closing < SEG_CLOSE_MAX) {
+        st->closing[st->n_closing++] = old;
+    } else {
+        finish_segment(old);
+    }
+    pthread_cond_signal(&s->cond_work);
+}
+
+static void rotate_locked(SegWriter *s, int k, uint64_t pts_us, uint64_t t0_us)
+{
+    SegStream *st = &s->st[k];
+    if (wait_next_locked(s, k) != 0) return;
+
+    // 索引段跟视频段同进退：任何一个没准备好都不切，免得偏移对不上
+    if (k == SEG_VIDEO && s->st[SEG_INDEX].cur) {
+        if (wait_next_locked(s, SEG_INDEX) != 0) return;
+        pkt_index_detach(&s->vidx);
+        swap_locked(s, SEG_INDEX);
+        pkt_index_attach(&s->vidx, s->st[SEG_INDEX].cur, s->index_fps);
+    }
+    swap_locked(s, k);
+
+    uint64_t dt = rkav_now_monotonic_us() - t0_us;
+    lat_hist_record(&s->rotate_lat, dt);
+    s->rotations++;
+
+    char path[300];
+    seg_path(st, st->index, path, sizeof(path));
+    LOGI("[%s] %s -> %s at pts=%.3fs rotate=%lluus",
+         TAG, k_stream_names[k], path,
+         (double)(pts_us - s->cut_pts[0]) / 1e6, (unsigned long long)dt);
+}
+
+static int armed_for(const SegWriter *s, unsigned index, uint64_t pts_us)
+{
+    unsigned r = index % SEG_CUT_RING;
+    return (s->seg_us && pts_us >= s->cut_pts[r] + s->seg_us) ||
+           (s->seg_bytes && s->pair_bytes[r] >= s->seg_bytes);
+}
+
+static uint64_t audio_end_pts(const SegWriter *s, uint64_t pts_us, size_t len)
+{
+    return pts_us + (uint64_t)(len / s->a_bpf) * 1000000u / s->a_rate;
+}
+
+/* 视频还没公布切点、但这块已经够到阈值：先暂存 */
+static int audio_should_hold_locked(const SegWriter *s, uint64_t pts_us, size_t len)
+{
+    if (!s->v_started || s->st[SEG_VIDEO].index > s->st[SEG_AUDIO].index) return 0;
+    return armed_for(s, s->st[SEG_AUDIO].index, audio_end_pts(s, pts_us, len));
+}
+
+static int write_audio_locked(SegWriter *s, const void *data, size_t len)
+{
+    SegStream *a = &s->st[SEG_AUDIO];
+    a->cur_bytes += len;
+    s->pair_bytes[a->index % SEG_CUT_RING] += len;
+    return fwrite(data, 1, len, a->cur) == len ? 0 : -1;
+}
+
+/*
+ * 按已公布的切点写一块音频：跨切点的块按采样拆开，前半进旧段、后半进新段。
+ * 返回 0 / -1（写失败）。
+ */
+static int audio_put_locked(SegWriter *s, const uint8_t *data, size_t len, uint64_t pts_us)
+{
+    SegStream *a = &s->st[SEG_AUDIO];
+    int ret = 0;
+    while (len > 0) {
+        if (s->st[SEG_VIDEO].index <= a->index) break;
+        uint64_t cut = s->cut_pts[(a->index + 1) % SEG_CUT_RING];
+
+        if (pts_us >= cut) {
+            unsigned before = a->index;
+            rotate_locked(s, SEG_AUDIO, cut, rkav_now_monotonic_us());
+            if (a->index == before) break;             // 下一段没开出来：留在当前段
+            continue;
+        }
+        if (audio_end_pts(s, pts_us, len) <= cut) break;
+
+        size_t head = (size_t)((cut - pts_us) * s->a_rate / 1000000u) * s->a_bpf;
+        if (head > len) head = len;
+        if (head && write_audio_locked(s, data, head) != 0) ret = -1;
+        data += head;
+        len -= head;
+        pts_us = cut;
+    }
+    if (len && write_audio_locked(s, data, len) != 0) ret = -1;
+    return ret;
+}
+
+/* 暂存区里能落盘的块写掉（切点已公布的部分），force = 不管切点全写 */
+static int drain_held_locked(SegWriter *s, int force)
+{
+    int n = 0, ret = 0;
+    while (n < s->held_n) {
+        SegHeld *h = &s->held_tab[n];
+        if (!force && audio_should_hold_locked(s, h->pts_us, h->len)) break;
+        if (audio_put_locked(s, s->held + h->off, h->len, h->pts_us) != 0) ret = -1;
+        n++;
+    }
+    if (n == 0) return ret;
+
+    size_t consumed = n < s->held_n ? s->held_tab[n].off : s->held_len;
+    memmove(s->held_tab, s->held_tab + n, (size_t)(s->held_n - n) * sizeof(SegHeld));
+    memmove(s->held, s->held + consumed, s->held_len - consumed);
+    s->held_n -= n;
+    s->held_len -= consumed;
+    for (int i = 0; i < s->held_n; i++) s->held_tab[i].off -= (uint32_t)consumed;
+    return ret;
+}
+
+static int hold_locked(SegWriter *s, const void *data, size_t len, uint64_t pts_us)
+{
+    // 满了（视频长时间没有关键帧）：最老的块退回写当前段，不丢数据、只是切点不再对齐
+    while ((s->held_n == s->held_max || s->held_len + len > s->held_cap) && s->held_n > 0) {
+        if (s->held_overflow++ == 0) {
+            LOGW("[%s] audio hold full waiting for a keyframe, writing to current segment", TAG);
+        }
+        SegHeld h0 = s->held_tab[0];
+        if (audio_put_locked(s, s->held + h0.off, h0.len, h0.pts_us) != 0) return -1;
+        memmove(s->held_tab, s->held_tab + 1, (size_t)(s->held_n - 1) * sizeof(SegHeld));
+        memmove(s->held, s->held + h0.len, s->held_len - h0.len);
+        s->held_n--;
+        s->held_len -= h0.len;
+        for (int i = 0; i < s->held_n; i++) s->held_tab[i].off -= h0.len;
+    }
+    if (s->held_len + len > s->held_cap) return audio_put_locked(s, data, len, pts_us);
+
+    memcpy(s->held + s->held_len, data, len);
+    s->held_tab[s->held_n++] = (SegHeld){ .pts_us = pts_us, .off = (uint32_t)s->held_len,
+                                          .len = (uint32_t)len };
+    s->held_len += len;
+    return 0;
+}
+
+/* ---------- API ---------- */
+
+int seg_writer_open(SegWriter *s, const char *h264_path, const char *pcm_path,
+                    unsigned sample_rate, unsigned channels,
+                    unsigned seg_sec, uint64_t seg_bytes,
+                    uint64_t prealloc_video, uint64_t prealloc_audio, size_t audio_hold_bytes,
+                    unsigned index_fps)
+{
+    if (!s || !h264_path || !pcm_path || !sample_rate || !channels || (!seg_sec && !seg_bytes)) {
+        return -1;
+    }
+    memset(s, 0, sizeof(*s));
+    s->a_rate = sample_rate;
+    s->a_bpf = (size_t)channels * 2;
+    s->seg_us = (uint64_t)seg_sec * 1000000u;
+    s->seg_bytes = seg_bytes;
+    lat_hist_init(&s->rotate_lat);
+
+    split_path(&s->st[SEG_VIDEO], h264_path);
+    split_path(&s->st[SEG_AUDIO], pcm_path);
+    s->st[SEG_VIDEO].prealloc = prealloc_video;
+    s->st[SEG_AUDIO].prealloc = prealloc_audio;
+    if (index_fps) {
+        SegStream *ix = &s->st[SEG_INDEX];
+        snprintf(ix->base, sizeof(ix->base), "%s", s->st[SEG_VIDEO].base);
+        snprintf(ix->ext, sizeof(ix->ext), "%.6s.idx", s->st[SEG_VIDEO].ext);
+        s->index_fps = index_fps;
+    }
+
+    s->held_cap = audio_hold_bytes ? audio_hold_bytes : 1u << 20;
+    s->held_max = 512;
+    s->held = (uint8_t *)malloc(s->held_cap);
+    s->held_tab = (SegHeld *)calloc((size_t)s->held_max, sizeof(SegHeld));
+    if (!s->held || !s->held_tab) goto fail;
+
+    // 第 0 段同步打开，之后的由后台线程提前准备
+    for (int k = 0; k < SEG_STREAMS; k++) {
+        if (k == SEG_INDEX && !index_fps) continue;
+        s->st[k].cur = open_segment(s, &s->st[k], 0);
+        if (!s->st[k].cur) goto fail;
+    }
+    if (index_fps) pkt_index_attach(&s->vidx, s->st[SEG_INDEX].cur, index_fps);
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond_work, NULL);
+    pthread_cond_init(&s->cond_ready, NULL);
+    if (pthread_create(&s->helper, NULL, helper_thread, s) != 0) {
+        LOGE("[%s] helper thread create failed", TAG);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond_work);
+        pthread_cond_destroy(&s->cond_ready);
+        goto fail;
+    }
+    pthread_setname_np(s->helper, "segprep");
+
+    char p0[300], p1[300];
+    seg_path(&s->st[SEG_VIDEO], 0, p0, sizeof(p0));
+    seg_path(&s->st[SEG_AUDIO], 0, p1, sizeof(p1));
+    LOGI("[%s] opened: %s + %s%s (every %us / %lluMiB, prealloc video=%lluKiB audio=%lluKiB)",
+         TAG, p0, p1, index_fps ? " + .idx" : "", seg_sec, (unsigned long long)(seg_bytes >> 20),
+         (unsigned long long)(prealloc_video >> 10), (unsigned long long)(prealloc_audio >> 10));
+    return 0;
+
+fail:
+    for (int k = 0; k < SEG_STREAMS; k++) {
+        if (s->st[k].cur) fclose(s->st[k].cur);
+    }
+    free(s->held);
+    free(s->held_tab);
+    memset(s, 0, sizeof(*s));
+    return -1;
+}
+
+int seg_writer_write_video(SegWriter *s, const void *data, size_t len, uint64_t pts_us, bool keyframe)
+{
+    if (!s || !s->st[SEG_VIDEO].cur || !data || !len) return -1;
+    SegStream *v = &s->st[SEG_VIDEO];
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->v_started) {
+        s->v_started = 1;
+        s->cut_pts[0] = pts_us;
+    }
+    if (!s->v_armed) s->v_armed = armed_for(s, v->index, pts_us);
+
+    // 段里至少有一帧视频才切（音频先到时可能已经把大小阈值撑满）；
+    // 音频落后太多段时也先不公布新切点（环会覆盖它还没用到的切点）
+    if (s->v_armed && keyframe && v->cur_bytes > 0 &&
+        v->index + 1 < s->st[SEG_AUDIO].index + SEG_CUT_RING) {
+        uint64_t t0 = rkav_now_monotonic_us();
+        unsigned before = v->index;
+        rotate_locked(s, SEG_VIDEO, pts_us, t0);
+        if (v->index != before) {
+            unsigned r = v->index % SEG_CUT_RING;
+            s->cut_pts[r] = pts_us;
+            s->pair_bytes[r] = 0;
+            s->v_armed = 0;
+        }
+    }
+    uint64_t off = v->cur_bytes;
+    v->cur_bytes += len;
+    s->pair_bytes[v->index % SEG_CUT_RING] += len;
+    FILE *fp = v->cur;
+    pthread_mutex_unlock(&s->lock);
+
+    // FILE* 只有本线程写，切段也只在本线程发生：写盘不占锁
+    int ret = fwrite(data, 1, len, fp) == len ? 0 : -1;
+    if (s->vidx.fp) {
+        pkt_index_add(&s->vidx, off, (uint32_t)len, pts_us,
+                      pkt_index_flags((const uint8_t *)data, len, keyframe));
+    }
+    return ret;
+}
+
+int seg_writer_write_audio(SegWriter *s, const void *data, size_t len, uint64_t pts_us)
+{
+    if (!s || !s->st[SEG_AUDIO].cur || !data || !len) return -1;
+
+    int ret = 0;
+    pthread_mutex_lock(&s->lock);
+    if (s->held_n > 0 && drain_held_locked(s, 0) != 0) ret = -1;
+
+    if (s->held_n > 0 || audio_should_hold_locked(s, pts_us, len)) {
+        // 暂存区里还有更早的块，或者正等切点：按顺序排在后面
+        if (hold_locked(s, data, len, pts_us) != 0) ret = -1;
+        pthread_mutex_unlock(&s->lock);
+        return ret;
+    }
+
+    SegStream *a = &s->st[SEG_AUDIO];
+    if (s->st[SEG_VIDEO].index > a->index) {
+        // 切点已公布：这块可能要切段 / 拆开，直接在锁里写
+        if (audio_put_locked(s, (const uint8_t *)data, len, pts_us) != 0) ret = -1;
+        pthread_mutex_unlock(&s->lock);
+        return ret;
+    }
+
+    a->cur_bytes += len;
+    s->pair_bytes[a->index % SEG_CUT_RING] += len;
+    FILE *fp = a->cur;
+    pthread_mutex_unlock(&s->lock);
+
+    if (fwrite(data, 1, len, fp) != len) ret = -1;
+    return ret;
+}
+
+int seg_writer_close(SegWriter *s)
+{
+    if (!s || !s->st[SEG_VIDEO].cur) return -1;
+
+    pthread_mutex_lock(&s->lock);
+    int ret = drain_held_locked(s, 1);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond_work);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->helper, NULL);
+
+    if (s->vidx.fp) pkt_index_detach(&s->vidx);
+
+    unsigned segs[SEG_STREAMS];
+    for (int k = 0; k < SEG_STREAMS; k++) {
+        SegStream *st = &s->st[k];
+        if (!st->cur) {
+            segs[k] = 0;
+            continue;
+        }
+        for (int i = 0; i < st->n_closing; i++) finish_segment(st->closing[i]);
+        st->n_closing = 0;
+        finish_segment(st->cur);
+        st->cur = NULL;
+        // 提前开好但没用上的下一段删掉
+        if (st->next) {
+            char path[300];
+            seg_path(st, st->index + 1, path, sizeof(path));
+            fclose(st->next);
+            st->next = NULL;
+            unlink(path);
+        }
+        segs[k] = st->index + 1;
+    }
+
+    LatHistSnap snap;
+    lat_hist_take(&s->rotate_lat, &snap);
+    LOGI("[%s] closed: segments video=%u audio=%u rotations=%llu rotate_us p50=%.0f p99=%.0f max=%llu "
+         "waits=%llu held_overflow=%llu",
+         TAG, segs[SEG_VIDEO], segs[SEG_AUDIO], (unsigned long long)s->rotations,
+         snap.count ? lat_hist_percentile_us(&snap, 0.50) : 0.0,
+         snap.count ? lat_hist_percentile_us(&snap, 0.99) : 0.0,
+         (unsigned long long)snap.max_us, (unsigned long long)s->waits,
+         (unsigned long long)s->held_overflow);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond_work);
+    pthread_cond_destroy(&s->cond_ready);
+    free(s->held);
+    free(s->held_tab);
+    s->held = NULL;
+    s->held_tab = NULL;
+    return ret;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lat_hist.h"
+#include "pkt_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 分段录制：h264/pcm 按时长或大小切成 <base>.000.h264 / <base>.000.pcm、.001 ...
+ *
+ * - 视频只在关键帧处切：达到阈值后"待切"，下一个 is_keyframe 包开新段，其 pts 即切点
+ * - 音频按同一个切点切（跨切点的块按采样拆开）。音频往往比视频先到，
+ *   待切期间音频块先拷进预分配的暂存区，等视频公布切点后再分流（暂存满时退回写旧段，不丢数据）
+ * - 下一段文件由后台线程提前打开并 fallocate(KEEP_SIZE) 预分配；旧段的 fflush/ftruncate/fclose
+ *   也交给后台线程，sink 线程切段只是换一个 FILE*
+ * - 每次切段记录"决定切 -> 新文件可写"的耗时（us），后台还没准备好时包含等待时间
+ *
+ * 视频 / 音频各自只能由一个线程写（h264sink / pcmsink），两者之间可并发。
+ */
+
+#define SEG_CUT_RING      8            // 音频最多落后视频的段数
+#define SEG_CLOSE_MAX     4
+
+enum { SEG_VIDEO = 0, SEG_AUDIO = 1, SEG_INDEX = 2, SEG_STREAMS = 3 };
+
+typedef struct {
+    char      base[256];               // 不含扩展名
+    char      ext[16];                 // ".h264" / ".pcm" / ".h264.idx"
+    uint64_t  prealloc;                // 每段预分配字节
+    FILE     *cur;
+    unsigned  index;                   // 当前段号
+    uint64_t  cur_bytes;
+    FILE     *next;                    // 后台已打开的下一段（index + 1）
+    FILE     *closing[SEG_CLOSE_MAX];  // 等后台收尾的旧段
+    int       n_closing;
+} SegStream;
+
+typedef struct {
+    uint64_t  pts_us;
+    uint32_t  off, len;
+} SegHeld;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_work;         // 通知后台：有段要开 / 要关
+    pthread_cond_t  cond_ready;        // 通知 sink：下一段已就绪
+    pthread_t       helper;
+    int             stop;
+
+    uint64_t        seg_us;            // 0 = 不按时长
+    uint64_t        seg_bytes;         // 0 = 不按大小（两路合计）
+    unsigned        a_rate;            // 音频采样率 / 每帧字节：按切点拆块用
+    size_t          a_bpf;
+
+    SegStream       st[SEG_STREAMS];   // SEG_INDEX.cur == NULL：不写索引
+    PktIndex        vidx;
+    unsigned        index_fps;
+
+    /* 切点：视频公布，音频消费 */
+    uint64_t        cut_pts[SEG_CUT_RING];         // 第 i 段的起点 pts（i % RING）
+    uint64_t        pair_bytes[SEG_CUT_RING];      // 第 i 段两路合计字节
+    int             v_started;
+    int             v_armed;
+
+    /* 音频暂存（按块） */
+    uint8_t        *held;
+    size_t          held_cap, held_len;
+    SegHeld        *held_tab;
+    int             held_n, held_max;
+    uint64_t        held_overflow;
+
+    /* 统计 */
+    LatHist         rotate_lat;        // us
+    uint64_t        rotations;
+    uint64_t        waits;             // 后台未就绪、sink 需要等待的次数
+    int             prealloc_unsupported;
+} SegWriter;
+
+/*
+ * h264_path / pcm_path：按原输出路径给（扩展名保留，段号插在前面）；音频为 S16LE 交织。
+ * prealloc_*：每段预分配的字节数（0 = 不预分配）。audio_hold_bytes：音频暂存区大小。
+ * index_fps：> 0 时给每个视频段写包索引（记进索引头）。
+ */
+int  seg_writer_open(SegWriter *s, const char *h264_path, const char *pcm_path,
+                     unsigned sample_rate, unsigned channels,
+                     unsigned seg_sec, uint64_t seg_bytes,
+                     uint64_t prealloc_video, uint64_t prealloc_audio, size_t audio_hold_bytes,
+                     unsigned index_fps);
+
+int  seg_writer_write_video(SegWriter *s, const void *data, size_t len, uint64_t pts_us, bool keyframe);
+
+int  seg_writer_write_audio(SegWriter *s, const void *data, size_t len, uint64_t pts_us);
+
+/* 把暂存的音频写完，关掉当前段并停掉后台线程 */
+int  seg_writer_close(SegWriter *s);
+
+#ifdef __cplusplus
+}
+#endif
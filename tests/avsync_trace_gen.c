@@ -0,0 +1,60 @@
+/*
+ * avsync_trace_gen：写一条确定性的合成 avsync 事件 trace，给 avsync_replay 的回归检查用。
+ *
+ * 视频 30 fps、音频 1024 帧 / 48 kHz 块，到达时刻带伪随机抖动（相邻事件的 arrival 会乱序），
+ * 音频 pts 每秒漂 0.2 ms，中间停 3.5 s（跨好几个空窗口），每秒一条 report 事件。
+ *
+ * 用法：avsync_trace_gen <out> [seconds]
+ */
+#include "evtrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint32_t g_rng = 12345u;
+
+static uint64_t jitter_us(uint32_t max_us)
+{
+    g_rng = g_rng * 1103515245u + 12345u;
+    return (g_rng >> 8) % max_us;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <out> [seconds]\n", argv[0]);
+        return 1;
+    }
+    unsigned sec = argc > 2 ? (unsigned)atoi(argv[2]) : 20;
+    if (sec < 8) sec = 8;
+
+    EvTraceMeta meta = { .video_fps = 30, .audio_sample_rate = 48000, .audio_channels = 2 };
+    EvTrace t;
+    if (evtrace_open(&t, argv[1], 1u << 16, &meta) != 0) return 1;
+
+    const uint64_t t0 = t.hdr->created_us + 1000;
+    const uint64_t end = t0 + (uint64_t)sec * 1000000ULL;
+    const uint64_t gap_begin = t0 + 4200000ULL, gap_end = gap_begin + 3500000ULL;
+    const uint64_t v_step = 33333, a_step = 1024ULL * 1000000ULL / 48000ULL;
+
+    uint64_t v = t0, a = t0 + 7000, rep = t0 + 1000000ULL;
+    while (v < end || a < end) {
+        uint64_t next = v < a ? v : a;
+        if (rep <= next) {
+            evtrace_emit(&t, EV_AVSYNC_REPORT, rep, rep, 0, 0, 0);
+            rep += 1000000ULL;
+            continue;
+        }
+        int in_gap = next >= gap_begin && next < gap_end;
+        if (v <= a) {
+            if (!in_gap) evtrace_emit(&t, EV_AVSYNC_VIDEO, v, v + jitter_us(4000), 0, 0, 0);
+            v += v_step;
+        } else {
+            uint64_t drift = (a - t0) / 5000;   // 0.2 ms / s
+            if (!in_gap) evtrace_emit(&t, EV_AVSYNC_AUDIO, a + drift, a + jitter_us(6000), 48000, 1024, 0);
+            a += a_step;
+        }
+    }
+    evtrace_close(&t);
+    return 0;
+}
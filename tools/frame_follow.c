@@ -0,0 +1,134 @@
+/*
+ * frame_follow：--frame-export 的参考读者。连上拿到帧池的只读 fd，逐帧读完就 release。
+ *
+ *   bin/frame_follow /tmp/rkav.frames                       # 统计：帧数 / 平均亮度 / 借出->归还耗时
+ *   bin/frame_follow /tmp/rkav.frames --small -o small.nv12  # 存缩小变体（原始 NV12 拼接）
+ *   bin/frame_follow /tmp/rkav.frames --hold-ms 800          # 故意不按时还：演示租约收回
+ *
+ * 数据直接在共享映射上读（平均亮度就是在原 buffer 上算的），写文件时才拷贝。
+ */
+#include "plugins/frame_export/frame_export.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TAG "ffollow"
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s <socket> [options]\n\n"
+        "Options:\n"
+        "  --small                  Use the downscaled variant\n"
+        "  -o <file>                Append frames as raw NV12 ('-' = stdout)\n"
+        "  --frames <n>             Stop after n frames\n"
+        "  --hold-ms <n>            Keep each frame n ms before releasing (simulate a slow reader)\n"
+        "  -h, --help               Show this help\n",
+        prog);
+}
+
+int main(int argc, char **argv)
+{
+    enum { OPT_SMALL = 1000, OPT_FRAMES, OPT_HOLD_MS };
+    static const struct option long_opts[] = {
+        {"small",   no_argument,       0, OPT_SMALL},
+        {"frames",  required_argument, 0, OPT_FRAMES},
+        {"hold-ms", required_argument, 0, OPT_HOLD_MS},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int small = 0;
+    unsigned max_frames = 0, hold_ms = 0;
+    const char *out_path = NULL;
+    int c;
+    while ((c = getopt_long(argc, argv, "ho:", long_opts, NULL)) != -1) {
+        switch (c) {
+            case OPT_SMALL:   small = 1; break;
+            case OPT_FRAMES:  max_frames = (unsigned)atoi(optarg); break;
+            case OPT_HOLD_MS: hold_ms = (unsigned)atoi(optarg); break;
+            case 'o':         out_path = optarg; break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    FxReader r;
+    if (fx_reader_connect(&r, argv[optind]) != 0) return 1;
+    const FxHello *h = &r.hello;
+    if (small && !h->small_w) {
+        LOGE("[%s] producer has no downscaled variant (--frame-export-scale)", TAG);
+        fx_reader_close(&r);
+        return 1;
+    }
+    unsigned w = small ? h->small_w : h->width, ht = small ? h->small_h : h->height;
+    size_t off = small ? (size_t)h->small_off : 0, size = (size_t)w * ht * 3 / 2;
+    LOGI("[%s] attached: %u buffers, %ux%u%s, lease=%ums max_held=%u", TAG, h->n_bufs, w, ht,
+         small ? " (small)" : "", h->lease_ms, h->max_held);
+
+    FILE *out = NULL;
+    if (out_path) {
+        out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "wb");
+        if (!out) {
+            LOGE("[%s] open %s failed", TAG, out_path);
+            fx_reader_close(&r);
+            return 1;
+        }
+    }
+
+    uint64_t frames = 0, revoked = 0, last_id = 0, gaps = 0;
+    uint64_t t_tick = rkav_now_monotonic_us();
+    double luma_sum = 0.0;
+    for (;;) {
+        FxMsg m;
+        int rc = fx_reader_next(&r, &m, 200);
+        if (rc < 0) break;
+        if (rc > 0 && m.type == FX_MSG_REVOKE) {
+            revoked++;
+            continue;
+        }
+        if (rc > 0 && m.type == FX_MSG_FRAME) {
+            const uint8_t *y = r.maps[m.buf] + off;
+            uint64_t sum = 0;
+            for (size_t i = 0; i < (size_t)w * ht; i += 64) sum += y[i];
+            luma_sum += (double)sum / (double)(((size_t)w * ht + 63) / 64);
+            if (frames && m.frame_id > last_id + 1) gaps += m.frame_id - last_id - 1;
+            last_id = m.frame_id;
+            if (out && fwrite(y, 1, size, out) != size) {
+                LOGE("[%s] write failed", TAG);
+                break;
+            }
+            if (hold_ms) usleep(hold_ms * 1000u);
+            fx_reader_release(&r, &m);
+            frames++;
+            if (max_frames && frames >= max_frames) break;
+        }
+        uint64_t now = rkav_now_monotonic_us();
+        if (now - t_tick >= 1000000) {
+            LOGI("[%s] frames=%llu skipped_ids=%llu revoked=%llu mean_luma=%.1f", TAG,
+                 (unsigned long long)frames, (unsigned long long)gaps, (unsigned long long)revoked,
+                 frames ? luma_sum / (double)frames : 0.0);
+            t_tick = now;
+        }
+    }
+
+    LOGI("[%s] done: frames=%llu skipped_ids=%llu revoked=%llu mean_luma=%.1f", TAG,
+         (unsigned long long)frames, (unsigned long long)gaps, (unsigned long long)revoked,
+         frames ? luma_sum / (double)frames : 0.0);
+    if (out && out != stdout) fclose(out);
+    else if (out) fflush(out);
+    fx_reader_close(&r);
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * h264_trim：按 <file>.idx 包索引从裸 .h264 里切一段时间，不扫码流。
+ *
+ *   bin/h264_trim in.h264 --from 3:17:00 --to 3:17:30 -o clip.h264
+ *   bin/h264_trim in.h264 --list
+ *
+ * - 时间相对第一个包：秒（可带小数）/ MM:SS / HH:MM:SS
+ * - 起点退到 --from 之前最近的关键帧，终点是第一个 pts >= --to 的包（不含）
+ * - 起点关键帧不带 SPS/PPS 时（MPP 默认只在第一帧出头），从之前最近的带参数集的包里取出来补在前面
+ * - 数据用 copy_file_range 搬（同文件系统上可能直接共享块），不行退 sendfile，再不行退 pread/write
+ * - 输出旁边同样写一份 .idx（偏移重新从 0 算），切出来的片段还能再切
+ *
+ * 索引按写入顺序存，假定 pts 单调（本项目的编码器不出 B 帧）。
+ */
+#include "pkt_index.h"
+#include "lib/media/mux/h264_nal.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAG "trim"
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s <in.h264> [options]\n\n"
+        "Options:\n"
+        "  --from <t>               Start time, seconds | MM:SS | HH:MM:SS (default: 0)\n"
+        "  --to <t>                 End time, exclusive (default: end of file)\n"
+        "  -o <file>                Output file ('-' = stdout)\n"
+        "  --index <file>           Index path (default: <in.h264>.idx)\n"
+        "  --no-out-index           Don't write <out>.idx\n"
+        "  --list                   Print index summary and exit\n"
+        "  -h, --help               Show this help\n",
+        prog);
+}
+
+/* "12.5" / "1:30" / "3:17:00.250" -> us；失败返回 -1 */
+static int parse_time(const char *s, uint64_t *out_us)
+{
+    double parts[3] = { 0 };
+    int n = 0;
+    const char *p = s;
+    for (;;) {
+        char *end = NULL;
+        double v = strtod(p, &end);
+        if (end == p || v < 0 || n == 3) return -1;
+        parts[n++] = v;
+        if (*end == '\0') break;
+        if (*end != ':') return -1;
+        p = end + 1;
+    }
+    double sec = 0;
+    for (int i = 0; i < n; i++) sec = sec * 60.0 + parts[i];
+    *out_us = (uint64_t)(sec * 1e6 + 0.5);
+    return 0;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* 从一个带参数集的访问单元里取出 SPS/PPS（带 4 字节起始码），返回字节数 */
+static size_t extract_params(const uint8_t *au, size_t size, uint8_t *out, size_t cap)
+{
+    static const uint8_t sc[4] = { 0, 0, 0, 1 };
+    size_t off = 0, n = 0;
+    const uint8_t *nal;
+    size_t len;
+    while (h264_next_nal(au, size, &off, &nal, &len)) {
+        int t = h264_nal_type(nal);
+        if (t == H264_NAL_SLICE || t == H264_NAL_IDR) break;
+        if ((t != H264_NAL_SPS && t != H264_NAL_PPS) || n + 4 + len > cap) continue;
+        memcpy(out + n, sc, 4);
+        memcpy(out + n + 4, nal, len);
+        n += 4 + len;
+    }
+    return n;
+}
+
+/* [off, off + len) 从 in 搬到 out 的当前位置 */
+static int copy_range(int in, int out, uint64_t off, uint64_t len, const char **method)
+{
+    uint64_t left = len;
+
+    *method = "copy_file_range";
+    loff_t io = (loff_t)off;
+    while (left > 0) {
+        ssize_t n = copy_file_range(in, &io, out, NULL, left, 0);
+        if (n > 0) {
+            left -= (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) return -1;                          // 源文件比索引短
+        // 跨文件系统 / 老内核 / 输出是管道：换条路，已经搬过的部分不重来
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return -1;
+        break;
+    }
+    if (left == 0) return 0;
+
+    *method = "sendfile";
+    off_t so = (off_t)io;
+    while (left > 0) {
+        ssize_t n = sendfile(out, in, &so, left > (1u << 30) ? (1u << 30) : left);
+        if (n > 0) {
+            left -= (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) return -1;
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+        break;
+    }
+    if (left == 0) return 0;
+
+    *method = "read/write";
+    static uint8_t buf[1 << 20];
+    while (left > 0) {
+        size_t want = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+        ssize_t n = pread(in, buf, want, so);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || write_all(out, buf, (size_t)n) != 0) return -1;
+        so += n;
+        left -= (uint64_t)n;
+    }
+    return 0;
+}
+
+static void print_list(const char *path, const PktIndexView *v, uint64_t data_size)
+{
+    size_t keys = 0, params = 0;
+    for (size_t i = 0; i < v->n; i++) {
+        if (v->rec[i].flags & PKT_IDX_KEY) keys++;
+        if (v->rec[i].flags & PKT_IDX_PARAMS) params++;
+    }
+    double dur = v->n ? (double)(v->rec[v->n - 1].pts_us - v->rec[0].pts_us) / 1e6 : 0.0;
+    LOGI("[%s] %s: packets=%zu keyframes=%zu with_params=%zu duration=%.3fs fps=%u bytes=%llu gop=%.1f",
+         TAG, path, v->n, keys, params, dur, v->fps, (unsigned long long)data_size,
+         keys ? (double)v->n / (double)keys : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    enum { OPT_FROM = 1000, OPT_TO, OPT_INDEX, OPT_NO_OUT_INDEX, OPT_LIST };
+    static const struct option long_opts[] = {
+        {"from",         required_argument, 0, OPT_FROM},
+        {"to",           required_argument, 0, OPT_TO},
+        {"index",        required_argument, 0, OPT_INDEX},
+        {"no-out-index", no_argument,       0, OPT_NO_OUT_INDEX},
+        {"list",         no_argument,       0, OPT_LIST},
+        {"help",         no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    uint64_t from_us = 0, to_us = UINT64_MAX;
+    const char *out_path = NULL, *idx_path = NULL;
+    int out_index = 1, list = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "ho:", long_opts, NULL)) != -1) {
+        switch (c) {
+            case OPT_FROM:
+            case OPT_TO:
+                if (parse_time(optarg, c == OPT_FROM ? &from_us : &to_us) != 0) {
+                    LOGE("[%s] invalid time: %s", TAG, optarg);
+                    return 2;
+                }
+                break;
+            case 'o':              out_path = optarg; break;
+            case OPT_INDEX:        idx_path = optarg; break;
+            case OPT_NO_OUT_INDEX: out_index = 0; break;
+            case OPT_LIST:         list = 1; break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 1 != argc || (!list && !out_path)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (to_us <= from_us) {
+        LOGE("[%s] --to must be after --from", TAG);
+        return 2;
+    }
+
+    const char *in_path = argv[optind];
+    char idx_buf[512];
+    if (!idx_path) {
+        snprintf(idx_buf, sizeof(idx_buf), "%s.idx", in_path);
+        idx_path = idx_buf;
+    }
+
+    int in = open(in_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (in < 0 || fstat(in, &st) != 0) {
+        LOGE("[%s] open %s failed: %s", TAG, in_path, strerror(errno));
+        return 1;
+    }
+    PktIndexView v;
+    if (pkt_index_load(idx_path, (uint64_t)st.st_size, &v) != 0) {
+        close(in);
+        return 1;
+    }
+    if (list) {
+        print_list(in_path, &v, (uint64_t)st.st_size);
+        pkt_index_unload(&v);
+        close(in);
+        return 0;
+    }
+    if (v.n == 0) {
+        LOGE("[%s] %s: index is empty", TAG, idx_path);
+        pkt_index_unload(&v);
+        close(in);
+        return 1;
+    }
+
+    uint64_t t0 = v.rec[0].pts_us;
+    uint64_t from_abs = t0 + from_us;
+    uint64_t to_abs = to_us == UINT64_MAX ? UINT64_MAX : t0 + to_us;
+
+    // 起点：from 处（含）往回找关键帧；文件开头没关键帧时往后找第一个
+    size_t s = pkt_index_lower_bound(&v, from_abs + 1);
+    s = s ? s - 1 : 0;
+    while (s > 0 && !(v.rec[s].flags & PKT_IDX_KEY)) s--;
+    while (s < v.n && !(v.rec[s].flags & PKT_IDX_KEY)) s++;
+    size_t e = to_abs == UINT64_MAX ? v.n : pkt_index_lower_bound(&v, to_abs);
+    if (s >= e) {
+        LOGE("[%s] no keyframe in range", TAG);
+        pkt_index_unload(&v);
+        close(in);
+        return 1;
+    }
+
+    // 参数集：起点关键帧自己带就直接用，否则回头找最近一个带的，只读那一个包
+    uint8_t params[1024];
+    size_t params_len = 0;
+    if (!(v.rec[s].flags & PKT_IDX_PARAMS)) {
+        size_t p = s;
+        while (p > 0 && !(v.rec[p].flags & PKT_IDX_PARAMS)) p--;
+        if (v.rec[p].flags & PKT_IDX_PARAMS) {
+            uint8_t *au = (uint8_t *)malloc(v.rec[p].size);
+            if (au && pread(in, au, v.rec[p].size, (off_t)v.rec[p].offset) == (ssize_t)v.rec[p].size) {
+                params_len = extract_params(au, v.rec[p].size, params, sizeof(params));
+            }
+            free(au);
+        }
+        if (!params_len) LOGW("[%s] no SPS/PPS found before the start keyframe", TAG);
+    }
+
+    int to_stdout = strcmp(out_path, "-") == 0;
+    int out = to_stdout ? STDOUT_FILENO : open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        LOGE("[%s] open %s failed: %s", TAG, out_path, strerror(errno));
+        pkt_index_unload(&v);
+        close(in);
+        return 1;
+    }
+
+    uint64_t begin = v.rec[s].offset;
+    uint64_t end = e < v.n ? v.rec[e].offset : v.rec[v.n - 1].offset + v.rec[v.n - 1].size;
+    const char *method = "none";
+    uint64_t t_start = rkav_now_monotonic_us();
+    int ret = 0;
+    if ((params_len && write_all(out, params, params_len) != 0) ||
+        copy_range(in, out, begin, end - begin, &method) != 0) {
+        LOGE("[%s] copy failed (%s): %s", TAG, method, strerror(errno));
+        ret = 1;
+    }
+    uint64_t dt = rkav_now_monotonic_us() - t_start;
+    if (!to_stdout && close(out) != 0) ret = 1;
+
+    if (ret == 0 && out_index && !to_stdout) {
+        char out_idx[512];
+        snprintf(out_idx, sizeof(out_idx), "%s.idx", out_path);
+        PktIndex ox;
+        if (pkt_index_open(&ox, out_idx, v.fps) == 0) {
+            for (size_t i = s; i < e; i++) {
+                PktIndexRec r = v.rec[i];
+                if (i == s) {
+                    r.offset = 0;
+                    r.size += (uint32_t)params_len;
+                    if (params_len) r.flags |= PKT_IDX_PARAMS;
+                } else {
+                    r.offset = r.offset - begin + params_len;
+                }
+                pkt_index_add(&ox, r.offset, r.size, r.pts_us, r.flags);
+            }
+            if (pkt_index_close(&ox) != 0) ret = 1;
+        } else {
+            ret = 1;
+        }
+    }
+
+    if (ret == 0) {
+        LOGI("[%s] %s [%.3fs, %.3fs) -> %s: start keyframe at %.3fs, packets=%zu bytes=%llu "
+             "params=%s copy=%s %.1fms",
+             TAG, in_path, (double)from_us / 1e6,
+             (double)((e < v.n ? v.rec[e].pts_us : v.rec[v.n - 1].pts_us) - t0) / 1e6,
+             out_path, (double)(v.rec[s].pts_us - t0) / 1e6, e - s,
+             (unsigned long long)(end - begin + params_len),
+             params_len ? "injected" : "inline", method, (double)dt / 1e3);
+    }
+    pkt_index_unload(&v);
+    close(in);
+    return ret;
+}
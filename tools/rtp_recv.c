@@ -0,0 +1,371 @@
+/*
+ * rtp_recv：--out-rtp 的本机接收端。收视频（port）和 L16 音频（port + 2），顺带吃掉两路 RTCP。
+ *
+ *   bin/rtp_recv 5004                                 # 统计：包率 / recvmmsg 次数 / 丢包 / 乱序 / 1 ms 内最大突发
+ *   bin/rtp_recv 5004 -o rx.h264 --pcm rx.pcm        # FU-A 重组回 Annex-B，L16 转回 S16LE
+ *   bin/rtp_recv 5004 --sec 10
+ *
+ * 发送端没有限速时一个 IDR 会在 1 ms 内涌进来几十包，--rtp-pace-kbps 之后 burst_1ms 应该降到桶深附近。
+ */
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TAG "rtp_recv"
+
+#define BATCH     64
+#define PKT_MAX   9216
+#define FU_MAX    (4u << 20)
+
+typedef struct {
+    const char *name;
+    int       fd, rtcp_fd;
+    uint64_t  packets, bytes, calls, lost, reordered, sr;
+    uint64_t  last_packets, last_calls;
+    int       have_seq;
+    uint16_t  next_seq;
+    uint32_t  ssrc;
+    // 1 ms 窗口里的包数峰值
+    uint64_t  bucket_ms;
+    unsigned  bucket_n, burst_max, tick_burst_max;
+} RxStream;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static int bind_udp(const char *ip, unsigned port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1, rcvbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, ip, &sa.sin_addr) != 1 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        LOGE("[%s] bind %s:%u failed: %s", TAG, ip, port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* 序号检查；返回 1 = 按序或前跳（前跳计丢包），0 = 重复 / 迟到 */
+static int track_seq(RxStream *st, uint16_t seq, uint32_t ssrc)
+{
+    if (!st->have_seq || ssrc != st->ssrc) {
+        st->have_seq = 1;
+        st->ssrc = ssrc;
+        st->next_seq = (uint16_t)(seq + 1);
+        return 1;
+    }
+    int16_t d = (int16_t)(seq - st->next_seq);
+    if (d < 0) {
+        st->reordered++;
+        return 0;
+    }
+    st->lost += (uint64_t)d;
+    st->next_seq = (uint16_t)(seq + 1);
+    return 1;
+}
+
+static void track_burst(RxStream *st, uint64_t now_us)
+{
+    uint64_t ms = now_us / 1000;
+    if (ms != st->bucket_ms) {
+        st->bucket_ms = ms;
+        st->bucket_n = 0;
+    }
+    st->bucket_n++;
+    if (st->bucket_n > st->burst_max) st->burst_max = st->bucket_n;
+    if (st->bucket_n > st->tick_burst_max) st->tick_burst_max = st->bucket_n;
+}
+
+/* ---------- H.264 解包 ---------- */
+
+typedef struct {
+    FILE     *out;
+    uint8_t  *fu;
+    size_t    fu_len;
+    int       fu_active;
+    uint64_t  nals, fu_nals, fu_broken, aus, stap;
+} Depack;
+
+static void put_nal(Depack *d, const uint8_t *nal, size_t len)
+{
+    static const uint8_t sc[4] = { 0, 0, 0, 1 };
+    d->nals++;
+    if (!d->out) return;
+    fwrite(sc, 1, 4, d->out);
+    fwrite(nal, 1, len, d->out);
+}
+
+static void depack_h264(Depack *d, const uint8_t *p, size_t n, int seq_ok)
+{
+    if (!n) return;
+    int type = p[0] & 0x1f;
+    if (type >= 1 && type <= 23) {
+        put_nal(d, p, n);
+    } else if (type == 24) {                             // STAP-A（本项目不发，别的发送端可能发）
+        size_t off = 1;
+        while (off + 2 <= n) {
+            size_t l = ((size_t)p[off] << 8) | p[off + 1];
+            off += 2;
+            if (off + l > n) break;
+            put_nal(d, p + off, l);
+            off += l;
+        }
+        d->stap++;
+    } else if (type == 28 && n >= 2) {
+        int s = p[1] & 0x80, e = p[1] & 0x40;
+        if (s) {
+            if (d->fu_active) d->fu_broken++;
+            d->fu[0] = (uint8_t)((p[0] & 0xe0) | (p[1] & 0x1f));
+            d->fu_len = 1;
+            d->fu_active = 1;
+        } else if (!d->fu_active || !seq_ok) {
+            // 中间丢了片：整个 NAL 扔掉，等下一个起始片
+            if (d->fu_active) d->fu_broken++;
+            d->fu_active = 0;
+            return;
+        }
+        if (d->fu_len + n - 2 > FU_MAX) {
+            d->fu_broken++;
+            d->fu_active = 0;
+            return;
+        }
+        memcpy(d->fu + d->fu_len, p + 2, n - 2);
+        d->fu_len += n - 2;
+        if (e) {
+            put_nal(d, d->fu, d->fu_len);
+            d->fu_nals++;
+            d->fu_active = 0;
+        }
+    }
+}
+
+/* ---------- 收包 ---------- */
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s <port> [options]     video on <port>, L16 audio on <port>+2, RTCP on +1/+3\n\n"
+        "Options:\n"
+        "  --bind <ip>              Local address (default: 0.0.0.0)\n"
+        "  -o <file>                Reassemble video into Annex-B H.264\n"
+        "  --pcm <file>             Write audio as S16LE\n"
+        "  --sec <n>                Stop after n seconds\n"
+        "  --idle-ms <n>            Stop after n ms without packets once started (default: 2000)\n"
+        "  -h, --help               Show this help\n",
+        prog);
+}
+
+static int drain(RxStream *st, int is_video, Depack *d, FILE *pcm, struct mmsghdr *msgs, uint8_t (*bufs)[PKT_MAX])
+{
+    int r = recvmmsg(st->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (r <= 0) return 0;
+    st->calls++;
+    uint64_t now = rkav_now_monotonic_us();
+    for (int i = 0; i < r; i++) {
+        const uint8_t *p = bufs[i];
+        size_t n = msgs[i].msg_len;
+        if (n < 12 || (p[0] >> 6) != 2) continue;
+        size_t hl = 12 + 4u * (p[0] & 0x0f);
+        if (p[0] & 0x10) {                               // 扩展头
+            if (n < hl + 4) continue;
+            hl += 4 + 4u * (((size_t)p[hl + 2] << 8) | p[hl + 3]);
+        }
+        if (n < hl) continue;
+        size_t plen = n - hl;
+        if (p[0] & 0x20) plen -= p[n - 1] <= plen ? p[n - 1] : plen;   // padding
+        uint16_t seq = (uint16_t)((p[2] << 8) | p[3]);
+        uint32_t ssrc = ((uint32_t)p[8] << 24) | ((uint32_t)p[9] << 16) | ((uint32_t)p[10] << 8) | p[11];
+
+        uint64_t lost_before = st->lost;
+        int in_order = track_seq(st, seq, ssrc);
+        st->packets++;
+        st->bytes += n;
+        track_burst(st, now);
+        if (!in_order) continue;
+        if (is_video) {
+            depack_h264(d, p + hl, plen, st->lost == lost_before);
+            if (p[1] & 0x80) d->aus++;
+        } else if (pcm) {
+            uint8_t le[PKT_MAX];
+            for (size_t k = 0; k + 1 < plen; k += 2) {
+                le[k] = p[hl + k + 1];
+                le[k + 1] = p[hl + k];
+            }
+            fwrite(le, 1, plen & ~(size_t)1, pcm);
+        }
+    }
+    return r;
+}
+
+static void drain_rtcp(RxStream *st)
+{
+    uint8_t buf[1500];
+    for (;;) {
+        ssize_t n = recv(st->rtcp_fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n <= 0) break;
+        if (n >= 28 && buf[1] == 200) st->sr++;
+    }
+}
+
+static void tick_line(RxStream *st, double sec, char *out, size_t cap)
+{
+    snprintf(out, cap, "%s %.0f pkt/s %.0f recvmmsg/s lost=%llu reord=%llu burst_1ms=%u", st->name,
+             (double)(st->packets - st->last_packets) / sec, (double)(st->calls - st->last_calls) / sec,
+             (unsigned long long)st->lost, (unsigned long long)st->reordered, st->tick_burst_max);
+    st->last_packets = st->packets;
+    st->last_calls = st->calls;
+    st->tick_burst_max = 0;
+}
+
+int main(int argc, char **argv)
+{
+    enum { OPT_BIND = 1000, OPT_PCM, OPT_SEC, OPT_IDLE_MS };
+    static const struct option long_opts[] = {
+        {"bind",    required_argument, 0, OPT_BIND},
+        {"pcm",     required_argument, 0, OPT_PCM},
+        {"sec",     required_argument, 0, OPT_SEC},
+        {"idle-ms", required_argument, 0, OPT_IDLE_MS},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    const char *bind_ip = "0.0.0.0", *out_path = NULL, *pcm_path = NULL;
+    unsigned sec = 0, idle_ms = 2000;
+    int c;
+    while ((c = getopt_long(argc, argv, "ho:", long_opts, NULL)) != -1) {
+        switch (c) {
+            case OPT_BIND:    bind_ip = optarg; break;
+            case OPT_PCM:     pcm_path = optarg; break;
+            case OPT_SEC:     sec = (unsigned)atoi(optarg); break;
+            case OPT_IDLE_MS: idle_ms = (unsigned)atoi(optarg); break;
+            case 'o':         out_path = optarg; break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    unsigned port = (unsigned)atoi(argv[optind]);
+    if (port == 0 || port + 3 > 65535) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    RxStream v = { .name = "video" }, a = { .name = "audio" };
+    v.fd = bind_udp(bind_ip, port);
+    v.rtcp_fd = bind_udp(bind_ip, port + 1);
+    a.fd = bind_udp(bind_ip, port + 2);
+    a.rtcp_fd = bind_udp(bind_ip, port + 3);
+    if (v.fd < 0 || v.rtcp_fd < 0 || a.fd < 0 || a.rtcp_fd < 0) return 1;
+
+    Depack d;
+    memset(&d, 0, sizeof(d));
+    d.fu = (uint8_t *)malloc(FU_MAX);
+    FILE *pcm = NULL;
+    if (out_path && !(d.out = fopen(out_path, "wb"))) {
+        LOGE("[%s] open %s failed", TAG, out_path);
+        return 1;
+    }
+    if (pcm_path && !(pcm = fopen(pcm_path, "wb"))) {
+        LOGE("[%s] open %s failed", TAG, pcm_path);
+        return 1;
+    }
+
+    static uint8_t bufs[BATCH][PKT_MAX];
+    static struct mmsghdr msgs[BATCH];
+    static struct iovec iov[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = PKT_MAX;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    LOGI("[%s] listening on %s:%u (video) / %u (audio)", TAG, bind_ip, port, port + 2);
+
+    uint64_t t0 = rkav_now_monotonic_us(), t_tick = t0, t_last_pkt = 0, polls = 0;
+    while (!g_stop) {
+        struct pollfd pfd[4] = {
+            { .fd = v.fd, .events = POLLIN }, { .fd = a.fd, .events = POLLIN },
+            { .fd = v.rtcp_fd, .events = POLLIN }, { .fd = a.rtcp_fd, .events = POLLIN },
+        };
+        int pr = poll(pfd, 4, 100);
+        if (pr < 0 && errno != EINTR) break;
+        polls++;
+        uint64_t now = rkav_now_monotonic_us();
+        if (pr > 0) {
+            if (pfd[0].revents & POLLIN) {
+                while (drain(&v, 1, &d, NULL, msgs, bufs) == BATCH) {}
+                t_last_pkt = now;
+            }
+            if (pfd[1].revents & POLLIN) {
+                while (drain(&a, 0, NULL, pcm, msgs, bufs) == BATCH) {}
+                t_last_pkt = now;
+            }
+            if (pfd[2].revents & POLLIN) drain_rtcp(&v);
+            if (pfd[3].revents & POLLIN) drain_rtcp(&a);
+        }
+        if (now - t_tick >= 1000000) {
+            char vl[128], al[128];
+            double s = (double)(now - t_tick) / 1e6;
+            tick_line(&v, s, vl, sizeof(vl));
+            tick_line(&a, s, al, sizeof(al));
+            LOGI("[%s] %s | %s", TAG, vl, al);
+            t_tick = now;
+        }
+        if (sec && now - t0 >= (uint64_t)sec * 1000000ULL) break;
+        if (t_last_pkt && idle_ms && now - t_last_pkt >= (uint64_t)idle_ms * 1000ULL) break;
+    }
+
+    double wall = (double)(rkav_now_monotonic_us() - t0) / 1e6;
+    LOGI("[%s] video: packets=%llu bytes=%llu recvmmsg=%llu (%.1f pkt/call) lost=%llu reordered=%llu "
+         "burst_1ms_max=%u sr=%llu | nals=%llu fu_a=%llu fu_broken=%llu aus=%llu",
+         TAG, (unsigned long long)v.packets, (unsigned long long)v.bytes, (unsigned long long)v.calls,
+         v.calls ? (double)v.packets / (double)v.calls : 0.0, (unsigned long long)v.lost,
+         (unsigned long long)v.reordered, v.burst_max, (unsigned long long)v.sr,
+         (unsigned long long)d.nals, (unsigned long long)d.fu_nals, (unsigned long long)d.fu_broken,
+         (unsigned long long)d.aus);
+    LOGI("[%s] audio: packets=%llu bytes=%llu recvmmsg=%llu lost=%llu reordered=%llu sr=%llu | wall=%.1fs polls=%llu",
+         TAG, (unsigned long long)a.packets, (unsigned long long)a.bytes, (unsigned long long)a.calls,
+         (unsigned long long)a.lost, (unsigned long long)a.reordered, (unsigned long long)a.sr, wall,
+         (unsigned long long)polls);
+
+    if (d.out) fclose(d.out);
+    if (pcm) fclose(pcm);
+    free(d.fu);
+    close(v.fd);
+    close(v.rtcp_fd);
+    close(a.fd);
+    close(a.rtcp_fd);
+    return v.packets || a.packets ? 0 : 1;
+}
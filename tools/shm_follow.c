@@ -0,0 +1,149 @@
+/*
+ * shm_follow：--shm-bus 的参考读者。连上 socket 拿到只读 memfd，跟着最新消息读。
+ *
+ *   bin/shm_follow /tmp/rkav.bus                      # 只统计：每秒打印消息数 / lost / 发布->读到延迟
+ *   bin/shm_follow /tmp/rkav.bus --video -o live.h264 # 从下一个关键帧开始把视频接出来
+ *   bin/shm_follow /tmp/rkav.bus --slow-us 50000      # 故意慢：演示 overrun 不会拖住生产者
+ *
+ * - 数据直接从共享映射 fwrite 出去，写完再 shm_bus_msg_valid()；被覆盖的计 torn
+ * - 视频丢过消息就等下一个关键帧再接着写，输出始终可解码
+ * - 生产者退出（读完剩下的消息）或 --sec 到了就结束
+ */
+#include "plugins/shm_bus/shm_bus.h"
+#include "lat_hist.h"
+#include "lib/utils/log.h"
+#include "rkav/time.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TAG "follow"
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s <socket> [options]\n\n"
+        "Options:\n"
+        "  --video                  Write video packets to -o (starts at the next keyframe)\n"
+        "  --audio                  Write PCM chunks to -o\n"
+        "  -o <file>                Output file ('-' = stdout)\n"
+        "  --sec <n>                Stop after n seconds (default: until the producer exits)\n"
+        "  --slow-us <n>            Sleep n us per message (simulate a slow reader)\n"
+        "  -h, --help               Show this help\n",
+        prog);
+}
+
+int main(int argc, char **argv)
+{
+    enum { OPT_VIDEO = 1000, OPT_AUDIO, OPT_SEC, OPT_SLOW_US };
+    static const struct option long_opts[] = {
+        {"video",   no_argument,       0, OPT_VIDEO},
+        {"audio",   no_argument,       0, OPT_AUDIO},
+        {"sec",     required_argument, 0, OPT_SEC},
+        {"slow-us", required_argument, 0, OPT_SLOW_US},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    unsigned want = 0, sec = 0, slow_us = 0;
+    const char *out_path = NULL;
+    int c;
+    while ((c = getopt_long(argc, argv, "ho:", long_opts, NULL)) != -1) {
+        switch (c) {
+            case OPT_VIDEO:   want = SHM_BUS_VIDEO; break;
+            case OPT_AUDIO:   want = SHM_BUS_AUDIO; break;
+            case OPT_SEC:     sec = (unsigned)atoi(optarg); break;
+            case OPT_SLOW_US: slow_us = (unsigned)atoi(optarg); break;
+            case 'o':         out_path = optarg; break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 1 != argc || (out_path && !want)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    FILE *out = NULL;
+    if (out_path) {
+        out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "wb");
+        if (!out) {
+            LOGE("[%s] open %s failed", TAG, out_path);
+            return 1;
+        }
+    }
+
+    ShmBusReader r;
+    if (shm_bus_connect(&r, argv[optind]) != 0) return 1;
+    LOGI("[%s] attached: pid=%u %ux%u@%u %uHz/%uch, %u slots, %.1f MiB ring", TAG,
+         r.hdr->producer_pid, r.hdr->width, r.hdr->height, r.hdr->fps,
+         r.hdr->sample_rate, r.hdr->channels, r.hdr->slot_count,
+         (double)r.hdr->data_size / (1024.0 * 1024.0));
+
+    LatHist lat;
+    lat_hist_init(&lat);
+    LatHistSnap total;
+    memset(&total, 0, sizeof(total));
+    uint64_t n[3] = { 0 }, torn = 0, written = 0;
+    uint64_t t_start = rkav_now_monotonic_us(), t_tick = t_start;
+    int need_key = 1;
+
+    for (;;) {
+        uint64_t now = rkav_now_monotonic_us();
+        if (sec && now - t_start >= (uint64_t)sec * 1000000ull) break;
+        if (now - t_tick >= 1000000) {
+            LatHistSnap s;
+            lat_hist_take(&lat, &s);
+            LOGI("[%s] video=%llu audio=%llu lost=%llu torn=%llu lat p50=%.0fus p99=%.0fus", TAG,
+                 (unsigned long long)n[SHM_BUS_VIDEO], (unsigned long long)n[SHM_BUS_AUDIO],
+                 (unsigned long long)r.lost, (unsigned long long)torn,
+                 lat_hist_percentile_us(&s, 0.50), lat_hist_percentile_us(&s, 0.99));
+            lat_hist_snap_merge(&total, &s);
+            t_tick = now;
+        }
+
+        ShmBusMsg m;
+        int rc = shm_bus_next(&r, &m, 200);
+        if (rc < 0) break;
+        if (rc == 0) continue;
+
+        lat_hist_record_span(&lat, m.t_pub_us, rkav_now_monotonic_us());
+        if (m.type <= SHM_BUS_AUDIO) n[m.type]++;
+        if (m.lost) need_key = 1;
+
+        if (out && m.type == want) {
+            if (want == SHM_BUS_VIDEO && need_key && !(m.flags & SHM_BUS_FLAG_KEY)) continue;
+            need_key = 0;
+            if (fwrite(m.data, 1, m.len, out) != m.len) {
+                LOGE("[%s] write failed", TAG);
+                break;
+            }
+            written += m.len;
+        }
+        if (!shm_bus_msg_valid(&r, &m)) {
+            // 写出去的这条在读的过程中被覆盖：视频从下一个关键帧重新接
+            torn++;
+            need_key = 1;
+        }
+        if (slow_us) usleep(slow_us);
+    }
+
+    LatHistSnap s;
+    lat_hist_take(&lat, &s);
+    lat_hist_snap_merge(&total, &s);
+    LOGI("[%s] done: video=%llu audio=%llu lost=%llu torn=%llu written=%llu lat p50=%.0fus p99=%.0fus", TAG,
+         (unsigned long long)n[SHM_BUS_VIDEO], (unsigned long long)n[SHM_BUS_AUDIO],
+         (unsigned long long)r.lost, (unsigned long long)torn, (unsigned long long)written,
+         lat_hist_percentile_us(&total, 0.50), lat_hist_percentile_us(&total, 0.99));
+
+    shm_bus_reader_close(&r);
+    if (out && out != stdout) fclose(out);
+    else if (out) fflush(out);
+    return 0;
+}
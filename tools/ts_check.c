@@ -0,0 +1,31 @@
+/*
+ * ts_check：回读 --out-ts 写出的 TS 文件做一致性检查（与运行结束时的自检同一份代码）。
+ *
+ *   bin/ts_check out.ts [more.ts ...]
+ *
+ * 全部通过返回 0，任一文件不通过返回 1。
+ */
+#include "lib/media/mux/ts_mux.h"
+#include "lib/utils/log.h"
+
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.ts> [...]\n", argv[0]);
+        return 2;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        TsCheckReport r;
+        if (ts_check_file(argv[i], &r) != 0) {
+            failed = 1;
+            continue;
+        }
+        ts_check_print(argv[i], &r);
+        if (!ts_check_ok(&r)) failed = 1;
+    }
+    return failed;
+}